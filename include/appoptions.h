@@ -50,6 +50,12 @@ public:
 	 * @return string representation of argument value
 	 */
 	string Value() {return m_value;}
+
+	/**
+	 * @brief Name allows to determine the full name of argument
+	 * @return full argument name
+	 */
+	string Name() {return m_name;}
 private:
 	ApplicationOptions* m_parent; /// pointer to instance of ApplicationOptions class
 	string m_name; /// full name of argument
@@ -92,9 +98,11 @@ public:
 	ApplicationOption Help {this, "help", "h", "Show help", false};
 	/**
 	  @brief 'method' argument - is used to determine the file processing mode (either 'JSON to TLV' conversion or 'TLV to JSON');
-			  possible values: json2tlv (default), tlv2json
+			  possible values: json2tlv (default), json2tlv-sax (the same conversion using SAX parser), json2tlv-columnar (the same conversion writing
+			  blocks of records in columnar layout), tlv2json, tlv2json-direct (the same conversion writing JSON text directly),
+			  tlv2index (building secondary index of the key given by 'index-key' argument)
 	  **/
-	ApplicationOption Method {this, "method", "m", "Input file convertion method. Default value is json2tlv. You can use also tlv2json to unpack binary data.", true, "json2tlv"};
+	ApplicationOption Method {this, "method", "m", "Input file convertion method. Default value is json2tlv. You can use also json2tlv-sax to pack data using faster SAX parser, json2tlv-columnar to pack data in columnar layout (format 2) and tlv2json to unpack binary data (tlv2json-direct unpacks it faster writing JSON text directly). tlv2index builds index of values of the key given by --index-key.", true, "json2tlv"};
 	/**
 	  @brief 'input' argument - the input file name; must be the valid name of file containing data in format depending on value of 'method' argument;
 			  if 'method' is json2tlv input file must comtain valid JSON-records separated by new line;
@@ -109,6 +117,112 @@ public:
 	  @brief 'force' argument - allows to work with already existing output file, passing this argument concludes in erasing all data in existing output file
 	  **/
 	ApplicationOption Force {this, "force", "f", "Owerwrite output file if exists", false};
+	/**
+	  @brief 'threads' argument - the number of threads used for coding (both encoding and decoding of all records); default value is 1 (single threaded mode)
+	  **/
+	ApplicationOption Threads {this, "threads", "t", "Number of threads used for coding. Default value is 1.", true, "1"};
+	/**
+	  @brief 'format' argument - the version of TLV format written by encoder; possible values: 1 (default, the original format), 2 (compact format);
+			  decoder detects the format of input data automatically
+	  **/
+	ApplicationOption Format {this, "format", "F", "TLV format version written by encoder: 1 (default) or 2 (compact). Decoder detects format automatically.", true, "1"};
+	/**
+	  @brief 'stream' argument - with this argument encoder writes streamable TLV data (format 2) defining every key before its first use,
+			  so decoder converts it in a single pass and can read it from pipe
+	  **/
+	ApplicationOption Stream {this, "stream", "S", "Write streamable TLV data (implies format 2): keys are defined inline, so it can be decoded in a single pass from pipe.", false};
+	/**
+	  @brief 'compression' argument - the codec compressing blocks of records written by encoder (implies format 2); possible values: lz (fast built-in codec),
+			  zlib and zstd (if they are found at build time), stored (blocks are framed without compression); decoder detects codecs automatically
+	  **/
+	ApplicationOption Compression {this, "compression", "c", "Compress blocks of TLV data (implies format 2) with codec: lz (fast built-in codec), zlib or zstd (if available in this build). Blocks are compressed and decompressed in parallel.", true, ""};
+	/**
+	  @brief 'int-codecs' argument - with this argument columnar encoder writes every integer column chunk by the codec giving the smallest size:
+			  delta, delta-of-delta, frame of reference (values packed by bits) or RLE
+	  **/
+	ApplicationOption IntegerCodecs {this, "int-codecs", "", "Encode integer columns by delta, delta-of-delta, frame-of-reference, RLE or bit-packing codec chosen per column chunk (requires json2tlv-columnar method).", false};
+	/**
+	  @brief 'xor-doubles' argument - with this argument columnar encoder writes every column chunk of doubles XORed with previous values
+			  (Gorilla codec), if it gives smaller size
+	  **/
+	ApplicationOption XorDoubles {this, "xor-doubles", "", "Encode double columns by XOR with previous values, bit-exact (requires json2tlv-columnar method).", false};
+	/**
+	  @brief 'shapes' argument - with this argument encoder writes every record as the index of its shape (the list of its keys kept in
+			  the second dictionary) followed by values of members (implies format 2)
+	  **/
+	ApplicationOption Shapes {this, "shapes", "", "Write records as shape indexes followed by values (implies format 2): the lists of keys of records are kept in dictionary of shapes.", false};
+	/**
+	  @brief 'string-dictionary' argument - the maximum count of string values of a key kept in dictionary (implies format 2);
+			  encoder replaces repeated string values by 2-byte codes until dictionary of the key is full
+	  **/
+	ApplicationOption StringDictionary {this, "string-dictionary", "", "Replace string values of low-cardinality keys by codes (implies format 2): up to this count of values of every key (65536 max) are kept in dictionary.", true, ""};
+	/**
+	  @brief 'checksums' argument - with this argument encoder writes CRC-32C checksum of every block into block index (implies format 2);
+			  decoder verifies checksums of the blocks it converts
+	  **/
+	ApplicationOption Checksums {this, "checksums", "", "Write CRC-32C checksum of every block of TLV data (implies format 2). Decoder verifies checksums of converted blocks.", false};
+	/**
+	  @brief 'verify-only' argument - with this argument decoder verifies checksums of all blocks of TLV data in parallel without converting records;
+			  output file is not required
+	  **/
+	ApplicationOption VerifyOnly {this, "verify-only", "", "Decoder verifies checksums of all blocks without converting records (output file is not required).", false};
+	/**
+	  @brief 'zone-maps' argument - with this argument encoder writes minimum, maximum and null count of values of every key
+			  for every block of records (implies format 2), so decoder skips the blocks which can not match the filter given by 'where' argument
+	  **/
+	ApplicationOption ZoneMaps {this, "zone-maps", "", "Write min/max/null-count statistics of every key for every block of records (implies format 2). Decoder skips blocks by them.", false};
+	/**
+	  @brief 'bloom-keys' argument - the comma separated list of keys whose string and numeric values encoder adds to Bloom filter
+			  of every block of records (implies format 2), so decoder skips the blocks which can not contain the values compared
+			  by '==' in the filter given by 'where' argument
+	  **/
+	ApplicationOption BloomKeys {this, "bloom-keys", "", "Write Bloom filters of values of these keys for every block of records (comma separated list, implies format 2). Decoder skips blocks by them in equality lookups.", true, ""};
+	/**
+	  @brief 'where' argument - the filter of records converted by decoder: comparisons of member values with numbers or strings
+			  joined by '&&' (e.g. "latency > 500 && status == 200 && user == \"u517\"")
+	  **/
+	ApplicationOption Where {this, "where", "", "Decoder converts only the records matching filter: comparisons of members with numbers (==, !=, <, <=, >, >=) or quoted strings (==, !=) joined by && and || (&& binds tighter) and grouped by parentheses.", true, ""};
+	/**
+	  @brief 'from' argument - the number of the first record converted by decoder (records are numbered from 0);
+			  the block containing the record is found by block index of TLV data, if it exists
+	  **/
+	ApplicationOption From {this, "from", "", "Decoder converts records starting from this number (counting from 0).", true, ""};
+	/**
+	  @brief 'count' argument - the maximum count of records converted by decoder
+	  **/
+	ApplicationOption Count {this, "count", "", "Decoder converts no more than this count of records.", true, ""};
+	/**
+	  @brief 'sample' argument - decoder converts this count of records chosen randomly from the range given by 'from' and 'count' arguments
+	  **/
+	ApplicationOption Sample {this, "sample", "", "Decoder converts this count of records chosen randomly (from the range given by --from and --count).", true, ""};
+	/**
+	  @brief 'seed' argument - the seed of random sampling; by default random seed is used
+	  **/
+	ApplicationOption Seed {this, "seed", "", "The seed of random sampling.", true, ""};
+	/**
+	  @brief 'keys' argument - the comma separated list of keys of members converted by decoder (other members are omitted);
+			  only the columns of these keys are read from TLV data in columnar layout
+	  **/
+	ApplicationOption Keys {this, "keys", "", "Decoder converts only the members of these keys (comma separated list); values of other keys are skipped, columnar TLV data is read only for these keys.", true, ""};
+	/**
+	  @brief 'index-key' argument - the key whose values are indexed by tlv2index method: the index file maps values to the offsets
+			  of records, it is written into output file
+	  **/
+	ApplicationOption IndexKey {this, "index-key", "", "tlv2index method writes sorted index of values of this key (row-oriented TLV data with dictionary) into output file.", true, ""};
+	/**
+	  @brief 'index-memory' argument - the size in megabytes of index entries sorted in memory by tlv2index method, larger indexes
+			  are merged from sorted runs kept in temporary files
+	  **/
+	ApplicationOption IndexMemory {this, "index-memory", "", "The size in megabytes of index entries sorted in memory by tlv2index method (default 256), larger indexes are merged from temporary files.", true, ""};
+	/**
+	  @brief 'lookup' argument - the index file built by tlv2index method; decoder finds the records whose indexed key is compared by '=='
+			  in the filter given by 'where' argument by binary search in the index and converts only them
+	  **/
+	ApplicationOption Lookup {this, "lookup", "", "Decoder finds the records by this index file (built by tlv2index) instead of scanning, the indexed key must be compared by == in --where filter.", true, ""};
+	/**
+	  @brief 'stats' argument - with this argument program prints statistics of coding process after it is finished
+	  **/
+	ApplicationOption Stats {this, "stats", "s", "Print statistics of coding process", false};
 private:
 	boost::program_options::options_description m_options_description;
 	static std::map<string, ApplicationOption*> m_options;///collection of command arguments (ApplicationOption class instances)
@@ -6,36 +6,64 @@
 #ifndef CODER_H
 #define CODER_H
 
+#include <algorithm>
+#include <cstring>
+#include <limits>
 #include <memory>
 #include <map>
+#include <set>
+#include <unordered_map>
 #include <vector>
 #include "rapidjson/document.h"
 #include "rapidjson/error/error.h"
 #include "rapidjson/error/en.h"
 #include "packerstream.h"
+#include "compression.h"
 #include "apperror.h"
 
 namespace jsonpacker_coder {
 
 using namespace jsonpacker_stream;
 
+class RecordFilter;
+
 /**
   @defgroup JSONPACKER_CODER_CLASSES JSON packer coder classes
   @{
   **/
 
 /**
- * @brief The JsonKeyDictionary class represents JSON key dictionary
+ * @brief The JsonKeyDictionary class represents JSON key dictionary;
+ * keys are stored in string arena and found by open addressing hash table, keys are retrieved by index in constant time
  */
 class JsonKeyDictionary {
 public:
 	using Ptr = std::shared_ptr<JsonKeyDictionary>;
+	/**
+	 * @brief The Key struct refers to the key stored in dictionary
+	 */
+	struct Key {
+		const char* data; ///the key name (is not null terminated)
+		size_t length; ///the length of key name
+		int index; ///the index of the key
+	};
+
+	JsonKeyDictionary() = default;
+	JsonKeyDictionary(const JsonKeyDictionary&) = delete;
+	JsonKeyDictionary& operator = (const JsonKeyDictionary&) = delete;
 	/**
 	 * @brief AddKey adds key to dictionary and gives it a unique index
 	 * @param key[in] the key name
 	 * @return the index of the key
 	 */
-	int AddKey(const std::string& key);
+	int AddKey(const std::string& key) {return AddKeyString(key.data(), key.length());}
+	/**
+	 * @brief AddKeyString adds key to dictionary and gives it a unique index
+	 * @param key[in] the key name
+	 * @param length[in] the length of key name
+	 * @return the index of the key
+	 */
+	int AddKeyString(const char* key, size_t length);
 	/**
 	 * @brief AddKey adds key with the specified index to dictionary
 	 * @param key[in] the key name
@@ -45,21 +73,293 @@ public:
 	/**
 	 * @brief operator [] retrieves key by its index
 	 * @param index[in] the index of the key
-	 * @return
+	 * @return the key name
 	 */
-	std::string operator [] (int index);
+	std::string operator [] (int index) const {
+		const Key& key = GetKey(index);
+		return std::string(key.data, key.length);
+	}
+	/**
+	 * @brief GetKey retrieves key by its index without copying key name
+	 * @param index[in] the index of the key
+	 * @return the reference to the key valid until the next key is added (key name is valid until dictionary is cleared)
+	 */
+	const Key& GetKey(int index) const {return m_entries[Position(index)];}
+	/**
+	 * @brief Position retrieves the position of key in Entries() by its index
+	 * @param index[in] the index of the key
+	 * @return the position of the key
+	 */
+	size_t Position(int index) const;
 	/**
 	 * @brief Clear removes all keys from dictionary
 	 */
 	void Clear();
 	/**
-	 * @brief Keys returns map with key-index pairs
+	 * @brief Entries returns keys in order of their addition
+	 * @return the vector of keys
+	 */
+	const std::vector<Key>& Entries() const {return m_entries;}
+	/**
+	 * @brief Keys returns map with key-index pairs; the map is built on demand, so it is intended for rare use
+	 * (e.g. writing the dictionary in TLV data)
 	 * @return map with key-index pairs
 	 */
-	std::map<std::string, int>& Keys() {return m_keys;}
+	const std::map<std::string, int>& Keys() const;
+private:
+	/**
+	 * @brief Find searches the hash table for the key
+	 * @param key[in] the key name
+	 * @param length[in] the length of key name
+	 * @param hash[in] the hash of key name
+	 * @return the slot holding the key or the empty slot where the key should be placed
+	 */
+	size_t Find(const char* key, size_t length, uint64_t hash);
+	/**
+	 * @brief Insert stores new key in arena and adds it to the hash table and the index
+	 * @param slot[in] the empty slot found by Find
+	 * @param key[in] the key name
+	 * @param length[in] the length of key name
+	 * @param hash[in] the hash of key name
+	 * @param index[in] the index of the key
+	 */
+	void Insert(size_t slot, const char* key, size_t length, uint64_t hash, int index);
+	/**
+	 * @brief Grow doubles the capacity of the hash table
+	 */
+	void Grow();
+	/**
+	 * @brief AddToIndex makes the key retrievable by its index
+	 * @param index[in] the index of the key
+	 * @param position[in] the position of the key in m_entries + 1
+	 */
+	void AddToIndex(int index, uint32_t position);
+
+	int m_current {0}; ///the last index given by AddKey
+	std::vector<Key> m_entries; ///keys in order of addition
+	std::vector<uint64_t> m_hashes; ///hashes of m_entries
+	std::vector<uint32_t> m_slots; ///hash table: position in m_entries + 1, 0 means empty slot
+	std::vector<uint32_t> m_index; ///dense index: position in m_entries + 1 for each key index
+	std::map<int, uint32_t> m_sparse_index; ///index for key indexes too far from dense range
+	std::vector<std::unique_ptr<char[]>> m_arena; ///blocks holding key names
+	char* m_arena_next {nullptr}; ///free space in the last arena block
+	size_t m_arena_free {0}; ///free bytes in the last arena block
+	mutable std::map<std::string, int> m_keys; ///cached result of Keys()
+	mutable bool m_keys_valid {false}; ///m_keys corresponds to the current content
+};
+
+/**
+ * @brief The JsonShapeDictionary class represents dictionary of record shapes; the shape is the list of key indexes of record members
+ * in order of members, shapes are numbered sequentially from 0 in order of their addition
+ */
+class JsonShapeDictionary {
+public:
+	using Ptr = std::shared_ptr<JsonShapeDictionary>;
+
+	JsonShapeDictionary() = default;
+	JsonShapeDictionary(const JsonShapeDictionary&) = delete;
+	JsonShapeDictionary& operator = (const JsonShapeDictionary&) = delete;
+	/**
+	 * @brief AddShape adds shape to dictionary unless it is there already
+	 * @param keys[in] key indexes of record members in order of members
+	 * @return the index of the shape
+	 */
+	int AddShape(const std::vector<int>& keys);
+	/**
+	 * @brief GetShape retrieves shape by its index
+	 * @param index[in] the index of the shape
+	 * @return key indexes of record members in order of members
+	 * @throw JsonPackerMissed if there is no shape with this index
+	 */
+	const std::vector<int>& GetShape(int index) const;
+	/**
+	 * @brief Size returns the count of shapes
+	 * @return the count of shapes
+	 */
+	size_t Size() const {return m_shapes.size();}
+	/**
+	 * @brief Clear removes all shapes from dictionary
+	 */
+	void Clear();
+private:
+	std::vector<std::vector<int>> m_shapes; ///shapes in order of addition
+	std::unordered_multimap<uint64_t, int> m_hashes; ///indexes of shapes by hashes of their keys
+};
+
+/**
+ * @brief The JsonValueDictionary class represents dictionaries of string values, one dictionary per key; values are numbered
+ * sequentially from 0 in order of their addition to the dictionary of their key (keys are referred by dense numbers: key indexes
+ * in encoder, positions of keys in JsonKeyDictionary in decoder)
+ */
+class JsonValueDictionary {
+public:
+	JsonValueDictionary() = default;
+	JsonValueDictionary(const JsonValueDictionary&) = delete;
+	JsonValueDictionary& operator = (const JsonValueDictionary&) = delete;
+	/**
+	 * @brief AddValue adds value to dictionary of the key
+	 * @param key[in] the number of the key
+	 * @param value[in] pointer to the value
+	 * @param length[in] the length of the value
+	 * @return the code of the value
+	 */
+	int AddValue(size_t key, const char* value, size_t length);
+	/**
+	 * @brief Encode finds the code of value in dictionary of the key adding the value to dictionary unless it is full (has max_size values);
+	 * the key whose dictionary is full and misses the value is treated as high-cardinality key, its values are not encoded any more
+	 * @param key[in] the number of the key
+	 * @param value[in] pointer to the value
+	 * @param length[in] the length of the value
+	 * @param max_size[in] the maximum count of values in dictionary of one key
+	 * @param added[out] receives true if the value is added to dictionary
+	 * @return the code of the value or -1 if the value is not encoded
+	 */
+	int Encode(size_t key, const char* value, size_t length, size_t max_size, bool& added);
+	/**
+	 * @brief GetValue retrieves the value by its code
+	 * @param key[in] the number of the key
+	 * @param code[in] the code of the value
+	 * @return the value
+	 * @throw JsonPackerMissed if there is no value with this code
+	 */
+	const std::string& GetValue(size_t key, int code) const {
+		if (key >= m_keys.size() || code < 0 || static_cast<size_t>(code) >= m_keys[key].values.size())
+			throw app_err::JsonPackerMissed("string value", std::to_string(code));
+		return m_keys[key].values[static_cast<size_t>(code)];
+	}
+	/**
+	 * @brief Size returns the count of values in dictionary of the key
+	 * @param key[in] the number of the key
+	 * @return the count of values
+	 */
+	size_t Size(size_t key) const {return key < m_keys.size() ? m_keys[key].values.size() : 0;}
+	/**
+	 * @brief KeyCount returns the number following the numbers of all keys having dictionaries
+	 * @return the count of dictionaries
+	 */
+	size_t KeyCount() const {return m_keys.size();}
+	/**
+	 * @brief Clear removes all values from dictionaries
+	 */
+	void Clear();
 private:
-	int m_current {0};
-	std::map<std::string, int> m_keys;
+	/**
+	 * @brief The KeyValues struct represents dictionary of values of one key
+	 */
+	struct KeyValues {
+		std::vector<std::string> values; ///values in order of codes
+		std::unordered_multimap<uint64_t, int> codes; ///codes of values by hashes of values
+		bool closed {false}; ///the key has too many values to be encoded
+	};
+	/**
+	 * @brief Find searches dictionary of the key for the value
+	 * @return the code of the value or -1 if the value is not found
+	 */
+	int Find(const KeyValues& values, const char* value, size_t length, uint64_t hash) const;
+
+	std::vector<KeyValues> m_keys; ///dictionaries indexed by numbers of keys
+};
+
+/**
+ * @brief The TlvFormat enum describes versions of TLV data format
+ */
+enum class TlvFormat : char {
+	v1 = 1, ///the original format: every TLV record has 1-byte type and 8-byte length
+	v2 = 2  ///the compact format: data begins with header, lengths are written as LEB128 varints, records of fixed-width types have no length
+};
+
+/**
+ * @brief The JsonPackerOptions struct contains options controlling the coding process
+ */
+struct JsonPackerOptions {
+	TlvFormat format {TlvFormat::v1}; ///the format of TLV data written by encoder (decoder detects format automatically)
+	unsigned int threads {1}; ///the number of threads used for coding (1 - single threaded mode)
+	size_t chunk_size {4 * 1024 * 1024}; ///the size in bytes of input data processed by one thread at once in multi-threaded mode
+	bool inline_keys {false}; ///encoder defines every key by rtKeyDefinition record before its first use instead of writing dictionary at the end (streamable TLV, requires v2 format)
+	size_t block_size {1024 * 1024}; ///encoder starts the next block of records (@see TlvBlock) when the current block reaches this size in bytes
+	uint64_t block_records {64 * 1024}; ///encoder starts the next block of records when the current block reaches this count of records
+	uint64_t from {0}; ///the number of the first record converted by decoder
+	uint64_t count {std::numeric_limits<uint64_t>::max()}; ///the maximum count of records converted by decoder
+	uint64_t sample {0}; ///the count of records chosen randomly from the range [from, from + count) and converted by decoder (0 - all records of the range); streamable data can't be sampled
+	uint64_t seed {0}; ///the seed of random sampling (0 - random seed)
+	std::string compression; ///the name of codec compressing blocks of records written by encoder (empty - blocks are not compressed, requires v2 format)
+	size_t string_dictionary {0}; ///the maximum count of string values of one key encoded by dictionary (0 - strings are written as is), requires v2 format
+	bool integer_codecs {false}; ///encoder writes integer columns by the codec giving the smallest size (@see ColumnCodecId), requires columnar layout
+	bool double_codecs {false}; ///encoder writes double columns XORed with previous values (@see EncodeDoubles), requires columnar layout
+	bool shapes {false}; ///encoder writes every record as the index of its shape followed by values of members (@see JsonShapeDictionary), requires v2 format
+	std::vector<std::string> keys; ///the keys of members converted by decoder (empty - all members); values of other members are skipped without being copied, only the columns of these keys (and of keys compared by filter) are read from columnar TLV data
+	bool checksums {false}; ///encoder writes CRC-32C of every block into block index (@see TlvBlock::checksum), requires v2 format and block index; decoder always verifies checksums of converted blocks
+	bool verify_only {false}; ///decoder verifies checksums of all blocks without converting records (the count of records of verified blocks is counted in statistics)
+	bool zone_maps {false}; ///encoder writes statistics of values of every key for every block (@see ZoneStats), requires v2 format and block index
+	std::string where; ///the filter expression selecting records converted by decoder (@see RecordFilter), the blocks which can not match are skipped by zone maps and Bloom filters
+	std::vector<std::string> bloom_keys; ///encoder writes Bloom filter of string and numeric values of every of these keys for every block (@see BloomFilter), requires v2 format and block index
+	std::string index_key; ///the key whose values are indexed by TlvToIndex (@see TlvIndexWriter)
+	size_t index_memory {256 * 1024 * 1024}; ///the size in bytes of index entries sorted in memory by TlvToIndex, larger indexes are merged from sorted runs kept in temporary files
+	std::string index_file; ///the secondary index used by decoder to find the records whose indexed key is compared by == in filter (empty - records are scanned, @see TlvIndex)
+};
+
+/**
+ * @brief The JsonPackerStats struct contains statistics collected during the coding process
+ */
+struct JsonPackerStats {
+	uint64_t records {0}; ///the count of processed JSON records
+	uint64_t parser_heap_allocations {0}; ///the count of heap allocations made by JSON parser arenas only (stops growing after they are warmed up); other buffers of encoder are reused between records and grow only with the size of output
+};
+
+/**
+ * @brief The JsonParseArena class parses JSON records in situ using memory pool which is reused between records
+ *
+ * The record is copied into the mutable buffer and parsed with ParseInsitu, so strings are not copied by parser.
+ * All memory needed by the document is taken from the pool placed in the arena buffer; the pool is reset before
+ * the next record instead of being freed. If the pool overflows, the arena buffer is enlarged before parsing the next record,
+ * so after warm-up parsing makes no heap allocations.
+ */
+class JsonParseArena {
+public:
+	/**
+	 * @brief The CountingAllocator class is the base allocator of memory pool which counts heap allocations
+	 */
+	class CountingAllocator {
+	public:
+		static const bool kNeedFree = true;
+		void* Malloc(size_t size);
+		void* Realloc(void* original_ptr, size_t original_size, size_t new_size);
+		static void Free(void* ptr);
+		size_t m_allocations {0}; ///the count of heap allocations
+	};
+	using PoolAllocator = rapidjson::MemoryPoolAllocator<CountingAllocator>;
+	using Document = rapidjson::GenericDocument<rapidjson::UTF8<>, PoolAllocator, PoolAllocator>;
+
+	JsonParseArena();
+	JsonParseArena(const JsonParseArena&) = delete;
+	JsonParseArena& operator=(const JsonParseArena&) = delete;
+	/**
+	 * @brief Parse parses JSON record; the document is valid until the next call
+	 * @param data[in] pointer to JSON record
+	 * @param length[in] the length of JSON record
+	 * @return reference to parsed document
+	 */
+	Document& Parse(const char* data, size_t length);
+	/**
+	 * @brief MutableCopy copies JSON record into the mutable buffer of the arena to be parsed in situ; the copy is valid until the next call of Parse or MutableCopy
+	 * @param data[in] pointer to JSON record
+	 * @param length[in] the length of JSON record
+	 * @return pointer to zero terminated copy of JSON record
+	 */
+	char* MutableCopy(const char* data, size_t length);
+	/**
+	 * @brief HeapAllocations returns the count of heap allocations made by the arena
+	 * @return the count of heap allocations
+	 */
+	size_t HeapAllocations() const {return m_base_allocator.m_allocations;}
+private:
+	void Reset();
+
+	CountingAllocator m_base_allocator; ///the allocator used by pool when arena buffer is full
+	std::vector<char> m_arena; ///the buffer for memory pool
+	std::vector<char> m_record; ///the mutable copy of the record to parse in situ
+	std::unique_ptr<PoolAllocator> m_pool; ///the memory pool
+	std::unique_ptr<Document> m_document; ///the document reused between records
 };
 
 /**
@@ -89,12 +389,30 @@ public:
 	 * @return shared pointer to dictionary
 	 */
 	JsonKeyDictionary::Ptr GetDictionary();
+	/**
+	 * @brief GetShapes returns stored dictionary of record shapes
+	 * @return shared pointer to dictionary of shapes
+	 */
+	JsonShapeDictionary::Ptr GetShapes();
+	/**
+	 * @brief Options returns options of coding process
+	 * @return reference to coder options
+	 */
+	JsonPackerOptions& Options() {return m_options;}
+	/**
+	 * @brief Stats returns statistics collected during the last coding process
+	 * @return reference to coder statistics
+	 */
+	const JsonPackerStats& Stats() {return m_stats;}
 protected:
 	JsonKeyDictionary::Ptr m_dictionary {new JsonKeyDictionary()};/// the JSON keys dictionary
+	JsonShapeDictionary::Ptr m_shapes {new JsonShapeDictionary()};/// the dictionary of record shapes
+	JsonPackerOptions m_options;/// the coding options
+	JsonPackerStats m_stats;/// the coding statistics
 };
 
 /**
- * @brief GetPacker creates an instance of coder class by its name ('json2tlv' and 'tlv2json' are available at the moment)
+ * @brief GetPacker creates an instance of coder class by its name ('json2tlv', 'json2tlv-sax', 'tlv2json' and 'tlv2json-direct' are available at the moment)
  * @param name[in] the name of class to instantiate
  * @return
  */
@@ -138,13 +456,78 @@ public:
   **/
 
 
+/**
+ * @brief The TlvRecordData class stores data of TLV record; data of SmallSize bytes or less (scalar values, short strings)
+ * is stored inside the object, so it is not allocated on the heap
+ */
+class TlvRecordData {
+public:
+	static const size_t SmallSize = 16; ///the maximal size of data stored without heap allocation
+
+	TlvRecordData() {}
+	/**
+	 * @brief TlvRecordData constructor
+	 * @param begin[in] the begining of data
+	 * @param end[in] the end of data
+	 */
+	TlvRecordData(const char* begin, const char* end) {assign(begin, end);}
+	/**
+	 * @brief data returns pointer to data
+	 * @return pointer to data
+	 */
+	char* data() {return m_size <= SmallSize ? m_small : m_large.data();}
+	const char* data() const {return m_size <= SmallSize ? m_small : m_large.data();}
+	/**
+	 * @brief size returns the size of data
+	 * @return size in bytes
+	 */
+	size_t size() const {return m_size;}
+	/**
+	 * @brief empty checks whether there is no data
+	 * @return true if the size of data is 0
+	 */
+	bool empty() const {return !m_size;}
+	/**
+	 * @brief resize changes the size of data keeping its content
+	 * @param size[in] new size in bytes
+	 */
+	void resize(size_t size) {
+		if (size > SmallSize) {
+			if (m_size <= SmallSize) {
+				m_large.resize(size);
+				memcpy(m_large.data(), m_small, m_size);
+			} else
+				m_large.resize(size);
+		} else if (m_size > SmallSize)
+			memcpy(m_small, m_large.data(), size);
+		m_size = size;
+	}
+	/**
+	 * @brief assign replaces data
+	 * @param begin[in] the begining of data
+	 * @param end[in] the end of data
+	 */
+	void assign(const char* begin, const char* end) {
+		const size_t size = static_cast<size_t>(end - begin);
+		if (size > SmallSize)
+			m_large.assign(begin, end);
+		else if (size)
+			memcpy(m_small, begin, size);
+		m_size = size;
+	}
+private:
+	char m_small[SmallSize]; ///data of small size
+	std::vector<char> m_large; ///data of large size (keeps its capacity when data becomes small)
+	size_t m_size {0}; ///the size of data
+};
+
 /**
  * @brief The TlvRecord class is used to process data in TLV-format
  */
 template<typename SizeType>
 class TlvRecord {
 public:
-	typedef std::vector<char> DataVector;
+	typedef TlvRecordData DataVector;
 	/**
 	 * @brief The TlvRecordType enum describes TLV-record data types
 	 */
@@ -160,8 +543,41 @@ public:
 		rtDouble		= 7,	///TLV record contain double value
 		rtFloat			= 8,	///TLV record contain float value
 		rtString		= 9,	///TLV record contain string value
+		rtKeyDefinition	= 10,	///TLV record defines dictionary key: 4-byte key index followed by key name
+		rtShape			= 11,	///JSON record shape index (replaces member count and key indexes of members)
+		rtShapeDefinition	= 12,	///TLV record defines record shape: 4-byte shape index followed by 4-byte key indexes of members
+		rtStringRef		= 13,	///TLV record contain 2-byte code of string value in dictionary of the key of the member
+		rtValueDefinition	= 14,	///TLV record defines string value: 4-byte key index and 2-byte code followed by the value
 		rtDictionary	= 127	///TLV record represent the begining of dictionary
 	};
+	/**
+	 * @brief FixedDataSize returns the size of data of fixed-width types (in TLV v2 format such records are written without length)
+	 * @param type[in] type of the record (@see TlvRecordType)
+	 * @return the size of data in bytes or -1 for types with variable data size
+	 */
+	static SizeType FixedDataSize(TlvRecordType type) {
+		switch (type) {
+		case TlvRecordType::rtMemberCount:
+		case TlvRecordType::rtShape:
+		case TlvRecordType::rtInt:
+		case TlvRecordType::rtUInt:
+		case TlvRecordType::rtFloat:
+			return 4;
+		case TlvRecordType::rtInt64:
+		case TlvRecordType::rtUInt64:
+		case TlvRecordType::rtDouble:
+			return 8;
+		case TlvRecordType::rtBool:
+			return sizeof(bool);
+		case TlvRecordType::rtStringRef:
+			return 2;
+		case TlvRecordType::rtNull:
+		case TlvRecordType::rtDictionary:
+			return 0;
+		default:
+			return -1;
+		}
+	}
 	/**
 	 * @brief TlvRecord default constructor
 	 */
@@ -204,7 +620,8 @@ public:
 	 * @param value[in] reference to RapidJson value
 	 * @return reference to itself
 	 */
-	TlvRecord<SizeType>& Init(const rapidjson::Document::ValueType& value) {
+	template<typename Allocator>
+	TlvRecord<SizeType>& Init(const rapidjson::GenericValue<rapidjson::UTF8<>, Allocator>& value) {
 		if (value.IsBool()) {
 			bool v = value.GetBool();
 			return Init(TlvRecordType::rtBool, reinterpret_cast<const char*>(&v), sizeof(bool));
@@ -237,7 +654,7 @@ public:
 			return Init(TlvRecordType::rtNull, nullptr, 0);
 		}
 		else if (value.IsString()) {
-			return Init(value.GetString());
+			return Init(TlvRecordType::rtString, value.GetString(), static_cast<SizeType>(value.GetStringLength()));
 		}
 		return *this;
 	}
@@ -264,7 +681,8 @@ public:
 	 * @param value[in] reference to RapidJson value
 	 * @return reference to itself
 	 */
-	TlvRecord<SizeType>& operator() (const rapidjson::Document::ValueType& value) {
+	template<typename Allocator>
+	TlvRecord<SizeType>& operator() (const rapidjson::GenericValue<rapidjson::UTF8<>, Allocator>& value) {
 		return Init(value);
 	}
 
@@ -301,8 +719,7 @@ public:
 			v.SetFloat(*(reinterpret_cast<float*>(m_data.data())));
 			break;
 		case TlvRecordType::rtString:
-			m_data.push_back(0);
-			v.SetString(m_data.data(), m_data.size() - 1, allocator);
+			v.SetString(m_data.data(), static_cast<rapidjson::SizeType>(m_data.size()), allocator);
 			break;
 		default:
 			throw app_err::JsonPackerError("Unknown data type!");
@@ -346,8 +763,9 @@ public:
 	 * @return string representation of TLV-data
 	 */
 	std::string GetString() {
-		m_data.push_back(0);
-		return std::string(m_data.data());
+		//the string ends with the first zero character, if there is one
+		const char* data = m_data.data();
+		return std::string(data, std::find(data, data + m_data.size(), '\0'));
 	}
 	/**
 	 * @brief GetInt returns value of TLV-record as integer
@@ -406,7 +824,498 @@ std::ostream& operator << (std::ostream &os, TlvRecord<SizeType> &record) {
 	return os;
 }
 
+#define TLV_MAGIC "JPKT"
+#define TLV_HEADER_SIZE 8
+#define TLV_TRAILER_SIZE 20 ///the size of trailer without optional fields
+#define TLV_TRAILER_BLOCK_INDEX_SIZE 28 ///the size of trailer holding the offset of block index
+#define TLV_TRAILER_ZONE_MAP_SIZE 36 ///the size of trailer holding the offsets of block index and zone maps
+#define TLV_TRAILER_BLOOM_FILTER_SIZE 44 ///the size of trailer holding the offsets of block index, zone maps and Bloom filters
+#define TLV_BLOCK_INDEX_ENTRY_SIZE 20
+#define TLV_BLOCK_INDEX_COMPRESSED_ENTRY_SIZE 28 ///the size of block index entry holding the offset of block in uncompressed data
+#define TLV_BLOCK_INDEX_CHECKSUM_SIZE 4 ///the size of checksum following block index entry when TLV_EXT_FLAG_CHECKSUMS is set
+#define TLV_FRAME_HEADER_SIZE 9 ///the size of header of compressed block (1-byte codec identifier, 4-byte raw size and 4-byte stored size)
+#define TLV_MIN_COMPRESSED_BLOCK_SIZE 512 ///blocks smaller than this size in bytes are always stored without compression
+
+#define TLV_FLAG_TRAILER 0x01 ///TLV data ends with trailer (@see TlvTrailer)
+#define TLV_FLAG_INLINE_KEYS 0x02 ///keys are defined by rtKeyDefinition records preceding their first use, there is no dictionary at the end
+#define TLV_FLAG_BLOCK_INDEX 0x04 ///block index (@see TlvBlock) is written between dictionary and trailer
+#define TLV_FLAG_COMPRESSED 0x08 ///every block of records is written as compressed frame (@see TlvBlockSource), requires TLV_FLAG_BLOCK_INDEX
+#define TLV_FLAG_COLUMNAR 0x10 ///every block of records is written in columnar layout (@see EncodeColumnarBlock), requires TLV_FLAG_BLOCK_INDEX
+#define TLV_FLAG_SHAPES 0x20 ///records are written as rtShape record followed by values, shapes are defined by rtShapeDefinition records (in dictionary or inline)
+#define TLV_FLAG_STRING_DICTIONARY 0x40 ///string values of low-cardinality keys are written as rtStringRef records, the values are defined by rtValueDefinition records (in dictionary or inline)
+#define TLV_FLAG_COLUMN_CODECS 0x80 ///values of column chunks are preceded by codec identifier, integer and double columns may be encoded by delta, frame-of-reference, RLE or XOR codecs (@see ColumnCodecId), requires TLV_FLAG_COLUMNAR
+
+#define TLV_EXT_FLAG_CHECKSUMS 0x01 ///every entry of block index is followed by CRC-32C checksum of the block as it is stored (@see TlvBlock), requires TLV_FLAG_BLOCK_INDEX
+
+#define TLV_MAX_STRING_DICTIONARY_SIZE 65536 ///the maximum count of string values of one key encoded by dictionary (codes are 2-byte)
+#define TLV_MIN_DICTIONARY_STRING_SIZE 2 ///shorter strings are always written as is, rtStringRef record would not be smaller
+
+/**
+ * @brief The TlvHeader struct describes the header written at the begining of TLV data (starting from v2 format):
+ * 4-byte magic (@see TLV_MAGIC), 1-byte format version, 1-byte flags (combination of TLV_FLAG_* values),
+ * 1-byte extended flags (combination of TLV_EXT_FLAG_* values) and 1 reserved byte
+ */
+struct TlvHeader {
+	TlvFormat format {TlvFormat::v1}; ///the format of TLV data
+	unsigned char flags {0}; ///format flags
+	unsigned char ext_flags {0}; ///extended format flags
+};
+
+/**
+ * @brief The TlvTrailer struct describes the trailer written at the end of TLV data when TLV_FLAG_TRAILER is set in header:
+ * 8-byte offset of dictionary, 1-byte format version, 3 reserved bytes, optional fields, 4-byte trailer size and 4-byte magic (@see TLV_MAGIC);
+ * the optional fields are 8-byte offset of block index written when TLV_FLAG_BLOCK_INDEX is set, 8-byte offset of zone maps
+ * of blocks (@see ZoneStats) and 8-byte offset of Bloom filters of blocks (@see BloomFilter), the sections follow block index
+ * in this order; all offsets are counted from the begining of TLV data
+ */
+struct TlvTrailer {
+	uint64_t dictionary_offset {0}; ///the offset of rtDictionary record
+	uint64_t block_index_offset {0}; ///the offset of block index (0 if there is no block index)
+	uint64_t zone_map_offset {0}; ///the offset of zone maps, block index ends there (0 if there are no zone maps)
+	uint64_t bloom_filter_offset {0}; ///the offset of Bloom filters, block index or zone maps end there (0 if there are no Bloom filters)
+	uint64_t trailer_offset {0}; ///the offset of trailer itself (is not written, calculated on read)
+};
+
+/**
+ * @brief The TlvBlock struct describes the block of consecutive JSON records in TLV data; block index is the array of
+ * 20-byte entries (8-byte number of the first record, 8-byte offset of the block and 4-byte count of records) ordered by offset;
+ * if blocks are compressed (TLV_FLAG_COMPRESSED is set) every entry is followed by 8-byte offset of the block in uncompressed data;
+ * if checksums are written (TLV_EXT_FLAG_CHECKSUMS is set) every entry ends with 4-byte CRC-32C of the block as it is stored
+ * (compressed frame or block in columnar layout), the block ends at the offset of the next block or at the dictionary
+ */
+struct TlvBlock {
+	uint64_t first_record {0}; ///the number of the first record of the block
+	uint64_t offset {0}; ///the offset of the block
+	uint64_t record_count {0}; ///the count of records in the block
+	uint64_t raw_offset {0}; ///the offset of the block in uncompressed data, as if all preceding blocks were not compressed (equal to offset if blocks are not compressed)
+	uint32_t checksum {0}; ///CRC-32C of the block as it is stored (0 if checksums are not written)
+};
+
+/**
+ * @brief The ZoneStats struct holds statistics of values of one key in the block of records (@see WriteTlvZoneMaps)
+ */
+struct ZoneStats {
+	int key {0}; ///the key index
+	uint64_t null_count {0}; ///the count of records of the block which have no member of the key or have null value
+	uint64_t number_count {0}; ///the count of numeric values
+	double min {0}; ///the minimum of numeric values (integers are converted to double)
+	double max {0}; ///the maximum of numeric values
+};
+
+using ZoneMap = std::vector<ZoneStats>; ///the statistics of keys present in the block ordered by key index
+
+/**
+ * @brief The BloomFilter struct holds split-block Bloom filter of values of one key in the block of records (@see WriteTlvBloomFilters)
+ */
+struct BloomFilter {
+	int key {0}; ///the key index
+	std::string bits; ///64-byte blocks of the filter (@see simd::BloomInsert), empty if the block has no string or numeric values of the key
+};
+
+using BlockBloomFilters = std::vector<BloomFilter>; ///the Bloom filters of the block ordered by key index
+
+/**
+ * @brief WriteTlvHeader writes header of TLV data into output; nothing is written for v1 format, which has no header
+ * @param sink[in] reference to output
+ * @param header[in] the header to write
+ */
+void WriteTlvHeader(ByteSink& sink, const TlvHeader& header);
+
+/**
+ * @brief ReadTlvHeader reads header of TLV data from input; if there is no header the data is treated as v1 format
+ * and nothing is consumed from input
+ * @param source[in] reference to input
+ * @return the header of TLV data
+ * @throw TlvInvalidFormatError if the header has unsupported format version
+ */
+TlvHeader ReadTlvHeader(ByteSource& source);
+
+/**
+ * @brief WriteTlvTrailer writes trailer of TLV data into output
+ * @param sink[in] reference to output
+ * @param trailer[in] the trailer to write
+ */
+void WriteTlvTrailer(ByteSink& sink, const TlvTrailer& trailer);
+
+/**
+ * @brief ReadTlvTrailer reads trailer from the end of input; the position of input is undefined after the call
+ * @param source[in] reference to input
+ * @param tlv_begin[in] the position of the begining of TLV data in input
+ * @param trailer[out] receives the trailer
+ * @return true if valid trailer is found, false otherwise
+ */
+bool ReadTlvTrailer(ByteSource& source, uint64_t tlv_begin, TlvTrailer& trailer);
+
+/**
+ * @brief WriteTlvBlockIndex writes block index into output
+ * @param sink[in] reference to output
+ * @param blocks[in] the blocks of TLV data
+ * @param compressed[in] the blocks are compressed (entries hold offsets in uncompressed data)
+ * @param checksums[in] entries hold checksums of blocks
+ */
+void WriteTlvBlockIndex(ByteSink& sink, const std::vector<TlvBlock>& blocks, bool compressed = false, bool checksums = false);
+
+/**
+ * @brief ReadTlvBlockIndex reads block index located by trailer; the position of input is undefined after the call
+ * @param source[in] reference to input
+ * @param tlv_begin[in] the position of the begining of TLV data in input
+ * @param trailer[in] the trailer of TLV data
+ * @param blocks[out] receives the blocks
+ * @param compressed[in] the blocks are compressed (entries hold offsets in uncompressed data)
+ * @param checksums[in] entries hold checksums of blocks
+ * @throw TlvInvalidFormatError if block index is invalid
+ */
+void ReadTlvBlockIndex(ByteSource& source, uint64_t tlv_begin, const TlvTrailer& trailer, std::vector<TlvBlock>& blocks, bool compressed = false, bool checksums = false);
+
+/**
+ * @brief VerifyTlvBlock compares CRC-32C of the block as it is stored with its checksum from block index
+ * @param data[in] pointer to the block as it is stored
+ * @param size[in] the size of the block as it is stored
+ * @param block[in] the block
+ * @param number[in] the number of the block in block index (used in error message)
+ * @throw app_err::JsonPackerError if checksum does not match
+ */
+void VerifyTlvBlock(const char* data, size_t size, const TlvBlock& block, size_t number);
+
+/**
+ * @brief EncodeVarint encodes unsigned value as LEB128 varint
+ * @param value[in] the value to encode
+ * @param buffer[out] the buffer receiving encoded value, must have space for at least 10 bytes
+ * @return the count of bytes written into buffer
+ */
+size_t EncodeVarint(uint64_t value, char* buffer);
+
+/**
+ * @brief ReadVarint reads LEB128 varint from input stream
+ * @param is[in] reference to input stream
+ * @return the decoded value
+ * @throw TlvInvalidFormatError if stream ends or the varint is longer than 10 bytes
+ */
+uint64_t ReadVarint(std::istream& is);
+
+/**
+ * @brief DecodeVarint decodes LEB128 varint from memory
+ * @param data[in] pointer to data
+ * @param size[in] size of data in bytes
+ * @param value[out] receives the decoded value
+ * @return the count of bytes taken by varint or 0 if data ends before the end of varint
+ * @throw TlvInvalidFormatError if the varint is longer than 10 bytes
+ */
+size_t DecodeVarint(const char* data, size_t size, uint64_t& value);
+
+#define TLV_MAX_RECORD_HEADER_SIZE 11 ///the maximal size of type and length of TLV record (1-byte type and 10-byte varint)
+
+/**
+ * @brief WriteTlv writes TlvRecord to output stream in the specified format
+ * @param os[in] reference to output stream
+ * @param record[in] TLV record
+ * @param format[in] the format of TLV data
+ * @return reference to output stream
+ */
+template<typename SizeType>
+std::ostream& WriteTlv(std::ostream& os, TlvRecord<SizeType>& record, TlvFormat format) {
+	if (format == TlvFormat::v1)
+		return os << record;
+	os.write(&record.CharType(), 1);
+	if (TlvRecord<SizeType>::FixedDataSize(record.Type()) < 0) {
+		char length[10];
+		os.write(length, static_cast<std::streamsize>(EncodeVarint(static_cast<uint64_t>(record.DataSize()), length)));
+	}
+	if (record.DataSize())
+		os.write(reinterpret_cast<const char*>(record.Data().data()), record.DataSize());
+	return os;
+}
+
+/**
+ * @brief ReadTlv reads TlvRecord from input stream in the specified format
+ * @param is[in] reference to input stream
+ * @param record[in] TLV record
+ * @param format[in] the format of TLV data
+ * @return reference to input stream
+ */
+template<typename SizeType>
+std::istream& ReadTlv(std::istream& is, TlvRecord<SizeType>& record, TlvFormat format) {
+	if (format == TlvFormat::v1)
+		return is >> record;
+	is.read(&record.CharType(), 1);
+	if (!is.eof()) {
+		bool failed_read = false;
+		try {
+			record.DataSize() = TlvRecord<SizeType>::FixedDataSize(record.Type());
+			if (record.DataSize() < 0)
+				record.DataSize() = static_cast<SizeType>(ReadVarint(is));
+			if (!record.IgnoreDataOnRead()) {
+				record.Data().resize(static_cast<unsigned long>(record.DataSize()));
+				is.read(record.Data().data(), record.DataSize());
+			} else
+				is.seekg(record.DataSize(), std::ios::cur);
+		} catch (...) {
+			failed_read = true;
+		}
+		if (is.fail() || is.eof() || failed_read)
+			throw TlvInvalidFormatError();
+	}
+	return is;
+}
+
+
+/**
+ * @brief WriteTlv writes TlvRecord straight into the buffer of output in the specified format
+ * @param sink[in] reference to output
+ * @param record[in] TLV record
+ * @param format[in] the format of TLV data
+ */
+template<typename SizeType>
+void WriteTlv(ByteSink& sink, TlvRecord<SizeType>& record, TlvFormat format) {
+	static_assert(sizeof(SizeType) < TLV_MAX_RECORD_HEADER_SIZE, "the length of record does not fit the record header");
+	const size_t size = static_cast<size_t>(record.DataSize());
+	char* const data = sink.Reserve(TLV_MAX_RECORD_HEADER_SIZE + size);
+	char* next = data;
+	*next++ = record.CharType();
+	if (format == TlvFormat::v1) {
+		memcpy(next, &record.DataSize(), sizeof(SizeType));
+		next += sizeof(SizeType);
+	} else if (TlvRecord<SizeType>::FixedDataSize(record.Type()) < 0)
+		next += EncodeVarint(static_cast<uint64_t>(size), next);
+	if (size) {
+		memcpy(next, record.Data().data(), size);
+		next += size;
+	}
+	sink.Commit(static_cast<size_t>(next - data));
+}
+
+/**
+ * @brief ReadTlv reads TlvRecord from input in the specified format
+ * @param source[in] reference to input
+ * @param record[in] TLV record
+ * @param format[in] the format of TLV data
+ * @return true if the record is read, false if input is finished
+ * @throw TlvInvalidFormatError if input ends inside of the record
+ */
+template<typename SizeType>
+bool ReadTlv(ByteSource& source, TlvRecord<SizeType>& record, TlvFormat format) {
+	const char* data;
+	const size_t available = source.Peek(data, TLV_MAX_RECORD_HEADER_SIZE);
+	if (!available)
+		return false;
+	record.CharType() = data[0];
+	size_t header_size = 1;
+	if (format == TlvFormat::v1) {
+		if (available < header_size + sizeof(SizeType))
+			throw TlvInvalidFormatError();
+		memcpy(&record.DataSize(), data + header_size, sizeof(SizeType));
+		header_size += sizeof(SizeType);
+	} else {
+		record.DataSize() = TlvRecord<SizeType>::FixedDataSize(record.Type());
+		if (record.DataSize() < 0) {
+			uint64_t size;
+			const size_t length = DecodeVarint(data + header_size, available - header_size, size);
+			if (!length)
+				throw TlvInvalidFormatError();
+			record.DataSize() = static_cast<SizeType>(size);
+			header_size += length;
+		}
+	}
+	if (record.DataSize() < 0)
+		throw TlvInvalidFormatError();
+	source.Consume(header_size);
+
+	const uint64_t size = static_cast<uint64_t>(record.DataSize());
+	if (record.IgnoreDataOnRead()) {
+		if (source.Skip(size) != size)
+			throw TlvInvalidFormatError();
+	} else {
+		if (source.Peek(data, static_cast<size_t>(size)) < size)
+			throw TlvInvalidFormatError();
+		record.Data().assign(data, data + size);
+		source.Consume(static_cast<size_t>(size));
+	}
+	return true;
+}
+
+/**
+ * @brief The TlvRecordView class refers to TLV record placed in memory without owning or copying its data
+ */
+class TlvRecordView {
+public:
+	using TlvRecordType = TlvRecord<std::streamsize>::TlvRecordType;
+
+	TlvRecordView() {}
+	/**
+	 * @brief TlvRecordView constructor
+	 * @param type[in] type of the record (@see TlvRecordType)
+	 * @param data[in] pointer to data
+	 * @param data_size[in] data size in bytes
+	 * @param record_size[in] the size of the whole record (type, length and data) in bytes
+	 */
+	TlvRecordView(TlvRecordType type, const char* data, size_t data_size, size_t record_size)
+		: m_type(type)
+		, m_data(data)
+		, m_data_size(data_size)
+		, m_record_size(record_size)
+	{
+	}
+	/**
+	 * @brief Type returns the type (@see TlvRecordType) of the record
+	 * @return the record type
+	 */
+	TlvRecordType Type() const {return m_type;}
+	/**
+	 * @brief Data returns pointer to data of the record
+	 * @return pointer to data
+	 */
+	const char* Data() const {return m_data;}
+	/**
+	 * @brief DataSize returns the size of data of the record
+	 * @return size in bytes
+	 */
+	size_t DataSize() const {return m_data_size;}
+	/**
+	 * @brief RecordSize returns the size of the whole record (type, length and data)
+	 * @return size in bytes
+	 */
+	size_t RecordSize() const {return m_record_size;}
+	/**
+	 * @brief GetInt returns value of the record as integer
+	 * @return integer representation of data
+	 * @throw TlvInvalidFormatError if data is shorter than integer
+	 */
+	int GetInt() const {
+		int value;
+		if (m_data_size < sizeof(value))
+			throw TlvInvalidFormatError();
+		memcpy(&value, m_data, sizeof(value));
+		return value;
+	}
+	/**
+	 * @brief GetString returns value of the record as string (the string ends with the first zero character, if there is one)
+	 * @return string representation of data
+	 */
+	std::string GetString() const {
+		return std::string(m_data, std::find(m_data, m_data + m_data_size, '\0'));
+	}
+private:
+	TlvRecordType m_type {TlvRecordType::rtUnknown}; ///the type of the record
+	const char* m_data {nullptr}; ///data of the record
+	size_t m_data_size {0}; ///the size of data
+	size_t m_record_size {0}; ///the size of the whole record
+};
+
+/**
+ * @brief ParseTlv parses TLV record placed in memory
+ * @param data[in] pointer to data
+ * @param size[in] the size of available data
+ * @param format[in] the format of TLV data
+ * @param record[out] receives the view of the record
+ * @return the size of the record or 0 if data ends inside of the record
+ * @throw TlvInvalidFormatError if the length of record is invalid
+ */
+size_t ParseTlv(const char* data, size_t size, TlvFormat format, TlvRecordView& record);
+
+/**
+ * @brief The TlvReader class walks TLV records of input and yields their views; if input data is in memory
+ * (e.g. mapped file, @see MemoryByteSource) the records are neither copied nor allocated
+ */
+class TlvReader {
+public:
+	/**
+	 * @brief TlvReader constructor
+	 * @param source[in] the input positioned at the first record
+	 * @param format[in] the format of TLV data
+	 */
+	TlvReader(ByteSource& source, TlvFormat format)
+		: m_source(source)
+		, m_format(format)
+	{
+	}
+	/**
+	 * @brief Next consumes the previous record and reads the next one
+	 * @param record[out] receives the view of the record valid until the next call of Next
+	 * @return true if the record is read, false if input is finished
+	 * @throw TlvInvalidFormatError if input ends inside of the record
+	 */
+	bool Next(TlvRecordView& record) {
+		m_source.Consume(m_pending);
+		m_pending = 0;
+		const char* data;
+		size_t available = m_source.Peek(data, TLV_MAX_RECORD_HEADER_SIZE);
+		if (!available)
+			return false;
+		size_t size = ParseTlv(data, available, m_format, record);
+		if (!size) {
+			//the data of record is not buffered yet
+			size = record.RecordSize();
+			if (!size || m_source.Peek(data, size) < size || !ParseTlv(data, size, m_format, record))
+				throw TlvInvalidFormatError();
+		}
+		m_pending = size;
+		return true;
+	}
+	/**
+	 * @brief Consume consumes the last read record, so input is positioned after it
+	 */
+	void Consume() {
+		m_source.Consume(m_pending);
+		m_pending = 0;
+	}
+	/**
+	 * @brief Position returns the position of input after the last read record
+	 * @return position in bytes
+	 */
+	uint64_t Position() const {return m_source.Position() + m_pending;}
+private:
+	ByteSource& m_source; ///the input
+	TlvFormat m_format; ///the format of TLV data
+	size_t m_pending {0}; ///the size of the last read record which is not consumed yet
+};
+
+/**
+ * @brief The TlvBlockSource class reads compressed blocks of TLV data (TLV_FLAG_COMPRESSED is set) as uncompressed data:
+ * positions are offsets in uncompressed data (@see TlvBlock::raw_offset) added to the position of TLV data in input,
+ * so data begins at the position following the header as uncompressed TLV data does
+ *
+ * Every block is written as frame: 1-byte codec identifier (@see jsonpacker_compression::BlockCodecId), 4-byte size of
+ * uncompressed data, 4-byte size of stored data and stored data. Blocks are decompressed when they are read, several blocks
+ * (at least one block per thread) are decompressed in parallel.
+ */
+class TlvBlockSource : public ByteSource {
+public:
+	/**
+	 * @brief TlvBlockSource constructor
+	 * @param source[in] the input containing compressed blocks
+	 * @param tlv_begin[in] the position of the begining of TLV data in input
+	 * @param blocks[in] the blocks read from block index (offsets are counted from the begining of TLV data)
+	 * @param data_end[in] the position of the end of the last block in input
+	 * @param threads[in] the number of threads decompressing blocks
+	 * @param checksums[in] the checksums of frames are verified before they are decompressed (@see TlvBlock::checksum)
+	 * @throw TlvInvalidFormatError if the header of the last block is invalid
+	 */
+	TlvBlockSource(ByteSource& source, uint64_t tlv_begin, const std::vector<TlvBlock>& blocks, uint64_t data_end, unsigned int threads, bool checksums = false);
+	uint64_t Size() override;
+protected:
+	void Fill(size_t size) override;
+	uint64_t SkipBlocks(uint64_t size) override;
+	void SeekBlocks(uint64_t position) override;
+private:
+	/**
+	 * @brief RawSize returns the size of uncompressed data of the block
+	 * @param index[in] the index of the block
+	 * @return size in bytes
+	 */
+	uint64_t RawSize(size_t index) const {
+		return (index + 1 < m_blocks.size() ? m_blocks[index + 1].raw_offset : m_raw_end) - m_blocks[index].raw_offset;
+	}
 
+	ByteSource& m_source; ///the input containing compressed blocks
+	std::vector<TlvBlock> m_blocks; ///the blocks (offsets are positions in input and in uncompressed data)
+	uint64_t m_data_end; ///the position of the end of the last block in input
+	uint64_t m_raw_end; ///the position of the end of uncompressed data
+	size_t m_threads; ///the number of threads decompressing blocks
+	bool m_checksums; ///the checksums of frames are verified
+	size_t m_next_block {0}; ///the index of the block following buffered data
+	std::vector<char> m_buffer; ///the buffer holding uncompressed data
+	std::vector<jsonpacker_compression::BlockCodec::Ptr> m_codecs; ///codecs indexed by identifiers (created on first use)
+};
 
 /**
  * @brief The JsonToTlv class is a class to convert input data containing JSON records separated by line into TLV format
@@ -428,6 +1337,122 @@ public:
 	 * @return combination of flags to open file
 	 */
 	std::ios_base::openmode OutputOpenModeFlags() override;
+protected:
+	struct EncodedChunk;
+	/**
+	 * @brief EncodeLine parses JSON record with RapidJson DOM and writes it in TLV format into output stream of the chunk
+	 * @param line[in] pointer to JSON record
+	 * @param length[in] the length of JSON record
+	 * @param chunk[in] the chunk containing the record
+	 * @return the result of parsing JSON record
+	 */
+	virtual rapidjson::ParseResult EncodeLine(const char* line, size_t length, EncodedChunk& chunk);
+	/**
+	 * @brief ColumnarLayout tells if blocks of records are written in columnar layout (@see EncodeColumnarBlock); may be overridden in derived classes
+	 * @return true for columnar layout, false for row-oriented layout
+	 */
+	virtual bool ColumnarLayout() const;
+	/**
+	 * @brief WriteShape writes rtShape record of the record with keys collected in EncodedChunk::record_keys into output of the chunk;
+	 * the shape is added to dictionary of shapes of the chunk and defined before its first use if keys are defined inline
+	 * @param chunk[in] the chunk containing the record
+	 */
+	void WriteShape(EncodedChunk& chunk);
+private:
+	/**
+	 * @brief EncodeChunk converts all lines of the chunk; stops at the first line containing parse error
+	 * @param chunk[in] the chunk to convert
+	 */
+	void EncodeChunk(EncodedChunk& chunk);
+	/**
+	 * @brief EncodeBatch converts input data consisting of complete lines; in multi-threaded mode the data is split into
+	 * newline-aligned chunks converted in parallel, the output is identical to output of single-threaded mode
+	 * @param data[in] pointer to input data
+	 * @param size[in] size of input data
+	 * @param line_number[in,out] the count of lines processed before the batch, receives the count of lines processed after the batch
+	 * @param output[in] the output to write TLV data to
+	 */
+	void EncodeBatch(const char* data, size_t size, int& line_number, ByteSink& output);
+	/**
+	 * @brief WriteChunk writes the chunk converted in multi-threaded mode into output replacing local key and shape indexes
+	 * with global ones, encoding string values by dictionaries and inserting definitions of new keys, shapes and values
+	 * (if they are defined inline), so the output is identical to output of single-threaded mode
+	 * @param chunk[in] the chunk converted with local dictionaries
+	 * @param output[in] the output to write TLV data to
+	 */
+	void WriteChunk(EncodedChunk& chunk, ByteSink& output);
+
+	/**
+	 * @brief IndexRecord adds the record to block index
+	 * @param offset[in] the offset of the record
+	 */
+	void IndexRecord(uint64_t offset);
+	/**
+	 * @brief WriteBlocks converts the blocks of row-oriented data (compresses them or writes them in columnar layout) in parallel,
+	 * collects their checksums, zone maps and Bloom filters and writes them into output; the last block is left in row output unless all blocks are written, because it may get more records
+	 * @param row_output[in] the output holding row-oriented TLV data which is not written yet
+	 * @param output[in] the output receiving converted blocks
+	 * @param tlv_begin[in] the position of the begining of TLV data in output
+	 * @param all[in] write all blocks (at the end of data)
+	 */
+	void WriteBlocks(StringByteSink& row_output, ByteSink& output, uint64_t tlv_begin, bool all);
+	/**
+	 * @brief BloomKeyIndexes returns the indexes of keys filtered by Bloom filters (@see JsonPackerOptions::bloom_keys) which are in dictionary
+	 * @return key indexes in ascending order
+	 */
+	std::vector<int> BloomKeyIndexes() const;
+
+	std::vector<std::unique_ptr<JsonParseArena>> m_arenas; ///parse arenas, one per thread
+	bool m_index_blocks {false}; ///block index is built
+	uint64_t m_tlv_begin {0}; ///the position of the begining of TLV data in output (in row output if blocks are converted)
+	std::vector<TlvBlock> m_blocks; ///the blocks of written records
+	jsonpacker_compression::BlockCodec::Ptr m_codec; ///the codec compressing blocks (nullptr if blocks are not compressed)
+	size_t m_written_blocks {0}; ///the count of converted blocks written into output
+	uint64_t m_rows_discarded {0}; ///the size of data removed from row output after conversion
+	uint64_t m_raw_position {0}; ///the offset of the next block in uncompressed data
+	std::vector<std::string> m_frames; ///converted blocks (reused between calls)
+	std::vector<std::string> m_columnar_blocks; ///blocks in columnar layout (reused between calls)
+	std::vector<ZoneMap> m_zone_maps; ///the zone maps of blocks (empty if zone maps are not written)
+	std::vector<BlockBloomFilters> m_bloom_filters; ///the Bloom filters of blocks (empty if Bloom filters are not written)
+	JsonValueDictionary m_values; ///dictionaries of string values (indexed by key indexes)
+};
+
+/**
+ * @brief The JsonToTlvSax class is a class to convert input data containing JSON records separated by line into TLV format
+ * using RapidJson SAX parser; TLV data is written directly from parser callbacks without building DOM, the output is identical
+ * to the output of JsonToTlv
+ *
+ * Nested objects and arrays can not be represented in TLV format, so records containing them are reported as parse errors.
+ */
+class JsonToTlvSax : public JsonToTlv {
+protected:
+	/**
+	 * @brief EncodeLine parses JSON record with RapidJson SAX parser and writes it in TLV format into output stream of the chunk
+	 * @param line[in] pointer to JSON record
+	 * @param length[in] the length of JSON record
+	 * @param chunk[in] the chunk containing the record
+	 * @return the result of parsing JSON record
+	 */
+	rapidjson::ParseResult EncodeLine(const char* line, size_t length, EncodedChunk& chunk) override;
+};
+
+/**
+ * @brief The JsonToTlvColumnar class is a class to convert input data containing JSON records separated by line into TLV format
+ * (v2 by default, v1 is not supported) with columnar layout of blocks (row groups): records of every block are parsed by SAX parser,
+ * buffered and written as column chunks, one per key (@see EncodeColumnarBlock)
+ */
+class JsonToTlvColumnar : public JsonToTlvSax {
+public:
+	/**
+	 * @brief JsonToTlvColumnar constructor
+	 */
+	JsonToTlvColumnar();
+protected:
+	/**
+	 * @brief ColumnarLayout tells that blocks of records are written in columnar layout
+	 * @return true
+	 */
+	bool ColumnarLayout() const override;
 };
 
 /**
@@ -450,6 +1475,240 @@ public:
 	 * @return combination of flags to open file
 	 */
 	std::ios_base::openmode OutputOpenModeFlags() override;
+private:
+	/**
+	 * @brief LoadDictionary reads dictionary entries (key name and key index pairs, then rtShapeDefinition records) following rtDictionary record
+	 * @param source[in] the input positioned after rtDictionary record
+	 * @param format[in] the format of TLV data
+	 * @param end[in] the position where dictionary ends (by default dictionary lasts until the end of input)
+	 */
+	void LoadDictionary(ByteSource& source, TlvFormat format, uint64_t end = std::numeric_limits<uint64_t>::max());
+	/**
+	 * @brief DecodeRange converts the records selected by options (@see JsonPackerOptions::from, count and sample);
+	 * input is positioned at the block containing the first selected record if block index is given; checksums of the blocks
+	 * are verified when the blocks are entered
+	 * @param input[in] the input positioned at the first record
+	 * @param format[in] the format of TLV data
+	 * @param blocks[in] the blocks of TLV data (offsets are positions in input) or empty vector if there is no block index
+	 * @param data_end[in] the position of dictionary
+	 * @param output[in] the output receiving JSON records
+	 */
+	void DecodeRange(ByteSource& input, TlvFormat format, const std::vector<TlvBlock>& blocks, uint64_t data_end, ByteSink& output);
+	/**
+	 * @brief DecodeParallel converts all records using the specified number of threads (@see JsonPackerOptions::threads);
+	 * the data is read by batches split into units of complete records (by block index or by scanning types and lengths
+	 * of TLV records), units are converted in parallel into separate buffers written into output in order of input;
+	 * checksums of the blocks are verified by the units holding them
+	 * @param input[in] the input positioned at the first record
+	 * @param format[in] the format of TLV data
+	 * @param blocks[in] the blocks of TLV data (offsets are positions in input) or empty vector if there is no block index
+	 * @param data_end[in] the position of dictionary (or the end of the last block)
+	 * @param output[in] the output receiving JSON records
+	 * @param first_block[in] the number of the first block in block index
+	 */
+	void DecodeParallel(ByteSource& input, TlvFormat format, const std::vector<TlvBlock>& blocks, uint64_t data_end, ByteSink& output, size_t first_block = 0);
+	/**
+	 * @brief DecodeSelectedBlocks converts all records of selected blocks; every run of consecutive selected blocks is converted
+	 * by DecodeParallel, the other blocks are not read
+	 * @param input[in] the input
+	 * @param format[in] the format of TLV data
+	 * @param blocks[in] the blocks of TLV data (offsets are positions in input)
+	 * @param selected[in] the flags of selected blocks
+	 * @param data_end[in] the position of dictionary
+	 * @param output[in] the output receiving JSON records
+	 */
+	void DecodeSelectedBlocks(ByteSource& input, TlvFormat format, const std::vector<TlvBlock>& blocks, const std::vector<bool>& selected, uint64_t data_end, ByteSink& output);
+	/**
+	 * @brief LookupRecords converts the records found by secondary index (@see JsonPackerOptions::index_file) and matching filter
+	 * @param input[in] the input
+	 * @param format[in] the format of TLV data
+	 * @param data_size[in] the size of TLV data (the index must be built for data of the same size)
+	 * @param blocks[in] the blocks of TLV data (offsets are positions in input); checksums of the blocks holding found records are verified
+	 * @param data_end[in] the position of dictionary
+	 * @param output[in] the output receiving JSON records
+	 * @throw app_err::JsonPackerError if the index is invalid or filter does not compare the indexed key by ==
+	 */
+	void LookupRecords(ByteSource& input, TlvFormat format, uint64_t data_size, const std::vector<TlvBlock>& blocks, uint64_t data_end, ByteSink& output);
+	/**
+	 * @brief SkipRecords skips records without converting them; stops at the dictionary or the end of input
+	 * @param input[in] the input positioned at the record
+	 * @param format[in] the format of TLV data
+	 * @param count[in] the count of records to skip
+	 * @return the count of skipped records
+	 */
+	uint64_t SkipRecords(ByteSource& input, TlvFormat format, uint64_t count);
+	/**
+	 * @brief FilterRecords converts the records matching filter until the dictionary or the end of input; records are read by batches
+	 * (@see FILTER_BATCH_SIZE) straight from buffered TLV data: the values of filtered keys are collected without building JSON records,
+	 * the filter is evaluated for the whole batch and only the matching records are passed to ConvertRecords
+	 * @param input[in] the input positioned at the first record
+	 * @param format[in] the format of TLV data
+	 * @param output[in] the output receiving JSON records
+	 * @param count[in] the maximum count of records to read
+	 * @return the count of converted records
+	 * @throw TlvInvalidFormatError if TLV records are invalid
+	 */
+	uint64_t FilterRecords(ByteSource& input, TlvFormat format, ByteSink& output, uint64_t count);
+	/**
+	 * @brief SelectKey adds the key to the selected keys if it is given by JsonPackerOptions::keys
+	 * @param name[in] the key name
+	 * @param key_index[in] the key index
+	 */
+	void SelectKey(const std::string& name, int key_index);
+	/**
+	 * @brief DecodeColumnar converts the records selected by options (@see JsonPackerOptions::from, count, sample and keys) from
+	 * blocks in columnar layout; only the chunks of selected keys are read, records of the blocks are rebuilt and converted
+	 * in parallel (@see JsonPackerOptions::threads); checksums of the blocks are verified before they are read
+	 * @param input[in] the input
+	 * @param blocks[in] the blocks of TLV data (offsets are positions in input)
+	 * @param selected[in] the flags of selected blocks (empty vector if all blocks are selected), ignored if records are sampled
+	 * @param data_end[in] the position of dictionary
+	 * @param column_codecs[in] values of column chunks are preceded by codec identifier (TLV_FLAG_COLUMN_CODECS is set)
+	 * @param output[in] the output receiving JSON records
+	 */
+	void DecodeColumnar(ByteSource& input, const std::vector<TlvBlock>& blocks, const std::vector<bool>& selected, uint64_t data_end, bool column_codecs, ByteSink& output);
+	/**
+	 * @brief VerifyBlocks verifies checksums of all blocks without converting records (@see JsonPackerOptions::verify_only);
+	 * the blocks are read by batches and checksummed in parallel (@see JsonPackerOptions::threads)
+	 * @param input[in] the input
+	 * @param tlv_begin[in] the position of the begining of TLV data in input
+	 * @param blocks[in] the blocks of TLV data as they are stored (offsets are counted from the begining of TLV data)
+	 * @param data_end[in] the position of the end of the last block in input
+	 * @throw TlvInvalidFormatError if the blocks can not be read
+	 * @throw app_err::JsonPackerError if checksum of some block does not match
+	 */
+	void VerifyBlocks(ByteSource& input, uint64_t tlv_begin, const std::vector<TlvBlock>& blocks, uint64_t data_end);
+	/**
+	 * @brief SampleRecords chooses records randomly without replacement (@see JsonPackerOptions::sample and seed)
+	 * @param range[in] the count of records to choose from
+	 * @return the numbers of chosen records in the range [0, range)
+	 */
+	std::set<uint64_t> SampleRecords(uint64_t range);
+protected:
+	/**
+	 * @brief DefineKey adds the key defined by rtKeyDefinition record to the dictionary
+	 * @param data[in] data of the record
+	 * @param size[in] size of data
+	 * @throw TlvInvalidFormatError if data is too short
+	 */
+	void DefineKey(const char* data, size_t size);
+	/**
+	 * @brief DefineShape adds the shape defined by rtShapeDefinition record to the dictionary of shapes
+	 * @param data[in] data of the record
+	 * @param size[in] size of data
+	 * @throw TlvInvalidFormatError if data is invalid or shapes are not defined in order of their indexes
+	 * @throw JsonPackerMissed if the key of shape is not defined
+	 */
+	void DefineShape(const char* data, size_t size);
+	/**
+	 * @brief DefineValue adds the string value defined by rtValueDefinition record to the dictionary of its key
+	 * @param data[in] data of the record
+	 * @param size[in] size of data
+	 * @throw TlvInvalidFormatError if data is invalid or values are not defined in order of their codes
+	 * @throw JsonPackerMissed if the key is not defined
+	 */
+	void DefineValue(const char* data, size_t size);
+	/**
+	 * @brief DictionaryLoaded is called after the dictionary is loaded (or before decoding of data with inline keys), before
+	 * any record is converted; may be overridden in derived classes
+	 */
+	virtual void DictionaryLoaded();
+	/**
+	 * @brief DecodeRecords converts TLV records into JSON records until the dictionary or the end of input; if filter is set
+	 * (@see JsonPackerOptions::where) the records are selected by FilterRecords, otherwise all of them are converted by ConvertRecords
+	 * @param input[in] the input positioned at the first record
+	 * @param format[in] the format of TLV data
+	 * @param output[in] the output receiving JSON records
+	 * @param count[in] the maximum count of records to read
+	 * @return the count of converted records
+	 */
+	virtual uint64_t DecodeRecords(ByteSource& input, TlvFormat format, ByteSink& output, uint64_t count);
+	/**
+	 * @brief ConvertRecords converts TLV records into JSON records until the dictionary or the end of input; each record is built
+	 * as RapidJson document and serialized by RapidJson writer; the keys and shapes defined inline are added to the dictionaries as they appear
+	 * @param input[in] the input positioned at the first record
+	 * @param format[in] the format of TLV data
+	 * @param output[in] the output receiving JSON records
+	 * @param count[in] the maximum count of records to convert
+	 * @param defined[in] the definitions met in input are already applied (by FilterRecords), so they are skipped
+	 * @return the count of converted records
+	 */
+	virtual uint64_t ConvertRecords(ByteSource& input, TlvFormat format, ByteSink& output, uint64_t count, bool defined);
+	/**
+	 * @brief KeySelected checks if the members of the key are converted (@see JsonPackerOptions::keys)
+	 * @param key_index[in] the key index
+	 * @return true if the key is selected or all keys are converted
+	 */
+	bool KeySelected(int key_index) const {
+		return m_selected_keys.empty() || (key_index >= 0 && static_cast<size_t>(key_index) < m_selected_keys.size() && m_selected_keys[static_cast<size_t>(key_index)]);
+	}
+
+	JsonValueDictionary m_values; ///dictionaries of string values (indexed by positions of keys in dictionary)
+	std::shared_ptr<RecordFilter> m_filter; ///the filter of records (nullptr if all records are converted)
+	std::vector<bool> m_selected_keys; ///the flags of selected keys indexed by key index (empty if all keys are converted)
+	bool m_verify_blocks {false}; ///checksums of uncompressed blocks are verified as the blocks are read
+};
+
+/**
+ * @brief The TlvToJsonDirect class is a class to convert input data in TLV format into JSON records separated by line
+ * writing JSON text straight from TLV data into output buffer; the output is identical to the output of TlvToJson
+ *
+ * Every dictionary key is rendered as quoted and escaped "key": text once (before decoding or when it is defined inline),
+ * values are formatted in place. The keys of every record shape are rendered as the list of member prefixes ("key": and ,"key":),
+ * so members of records written with shapes are output without looking up the dictionary. String values encoded by dictionaries
+ * are kept quoted and escaped.
+ */
+class TlvToJsonDirect : public TlvToJson {
+protected:
+	/**
+	 * @brief DictionaryLoaded renders keys, shapes and string values of the dictionary
+	 */
+	void DictionaryLoaded() override;
+	/**
+	 * @brief ConvertRecords converts TLV records into JSON text until the dictionary or the end of input
+	 * @param input[in] the input positioned at the first record
+	 * @param format[in] the format of TLV data
+	 * @param output[in] the output receiving JSON records
+	 * @param count[in] the maximum count of records to convert
+	 * @param defined[in] the definitions met in input are already applied, they are only rendered
+	 * @return the count of converted records
+	 */
+	uint64_t ConvertRecords(ByteSource& input, TlvFormat format, ByteSink& output, uint64_t count, bool defined) override;
+private:
+	/**
+	 * @brief RenderKeys renders the dictionary entries which are not rendered yet (keys defined inline are rendered as they appear)
+	 */
+	void RenderKeys();
+	/**
+	 * @brief RenderShapes renders member prefixes of the shapes which are not rendered yet
+	 */
+	void RenderShapes();
+	/**
+	 * @brief RenderValues renders string values of dictionaries which are not rendered yet
+	 */
+	void RenderValues();
+	/**
+	 * @brief WriteValue reads the value of member (with value definitions preceding it) and writes it as JSON text
+	 * @param reader[in] the reader of TLV records
+	 * @param key_index[in] the key index of member
+	 * @param output[in] the output receiving JSON text
+	 * @param defined[in] the value definitions are already applied
+	 */
+	void WriteValue(TlvReader& reader, int key_index, ByteSink& output, bool defined);
+	/**
+	 * @brief SkipValue reads the value of member which is not selected (with value definitions preceding it) without writing it
+	 * @param reader[in] the reader of TLV records
+	 * @param defined[in] the value definitions are already applied
+	 */
+	void SkipValue(TlvReader& reader, bool defined);
+
+	std::string m_keys_text; ///rendered keys of the dictionary
+	std::vector<size_t> m_keys_offsets; ///offsets of rendered keys in m_keys_text (in order of dictionary entries)
+	std::string m_prefixes_text; ///rendered member prefixes of shapes
+	std::vector<size_t> m_prefixes_offsets; ///offsets of rendered member prefixes in m_prefixes_text
+	std::vector<size_t> m_shape_prefixes; ///the number of the first member prefix of every shape (in order of shape indexes)
+	std::vector<std::string> m_values_text; ///rendered string values of dictionaries (indexed by positions of keys)
+	std::vector<std::vector<size_t>> m_values_offsets; ///offsets of rendered values in m_values_text (in order of codes)
 };
 
 /**
@@ -0,0 +1,147 @@
+/**
+  @file
+  @brief Header file with description of functions and classes converting blocks of TLV records into columnar layout and back
+  **/
+
+#ifndef COLUMNAR_H
+#define COLUMNAR_H
+
+#include <string>
+#include <vector>
+#include "coder.h"
+
+namespace jsonpacker_coder {
+
+/**
+  @addtogroup JSONPACKER_CODER_CLASSES
+  @{
+  **/
+
+/**
+ * @brief The ColumnCodecId enum contains identifiers of codecs of columns written before values of column chunk
+ * (@see EncodeColumnarBlock); the integer codecs keep values as 64-bit numbers (values of 4-byte types are sign-extended
+ * or zero-extended), frame of reference is written as zigzag-encoded varint base, 1-byte width and values minus base packed by bits
+ */
+enum class ColumnCodecId : unsigned char {
+	packed = 0, ///values are packed densely as they are in TLV records
+	frame = 1, ///frame of reference of values
+	delta = 2, ///the first value (zigzag-encoded varint) and frame of reference of differences between consecutive values
+	delta_of_delta = 3, ///the first value and the first difference (zigzag-encoded varints) and frame of reference of differences between consecutive differences
+	rle = 4, ///count of runs of equal values followed by value (zigzag-encoded varint) and length of every run
+	xor_float = 5 ///doubles XORed with previous values (@see EncodeDoubles)
+};
+
+/**
+ * @brief EncodeIntegers encodes values of integer column by the codec giving the smallest size
+ * @param values[in] the values extended to 64 bits
+ * @param max_size[in] values are encoded only if the size of encoded values is less than this size (the size of packed values)
+ * @param data[out] receives encoded values (is not changed if values are left packed)
+ * @return the identifier of chosen codec (ColumnCodecId::packed if values are not encoded)
+ */
+ColumnCodecId EncodeIntegers(const std::vector<uint64_t>& values, size_t max_size, std::string& data);
+
+/**
+ * @brief DecodeIntegers decodes values of integer column
+ * @param codec[in] the identifier of codec (except ColumnCodecId::packed)
+ * @param data[in] encoded values
+ * @param size[in] size of encoded values
+ * @param count[in] the count of values
+ * @param values[out] receives values extended to 64 bits
+ * @throw TlvInvalidFormatError if encoded values are invalid or their size differs from size
+ */
+void DecodeIntegers(ColumnCodecId codec, const char* data, size_t size, size_t count, std::vector<uint64_t>& values);
+
+/**
+ * @brief EncodeDoubles encodes values of double column by XOR with previous values (Gorilla codec) if it gives smaller size;
+ * the bit stream (in little-endian bit order) begins with 64 bits of the first value, every next value is XORed with
+ * the previous one and written as bit 0 if the result is 0, bits 1 and 0 followed by the meaningful bits of the result
+ * if they fit in the window of the previous meaningful bits, or bits 1 and 1 followed by 5-bit count of leading zeros,
+ * 6-bit count of meaningful bits minus 1 and meaningful bits
+ * @param values[in] bits of the values
+ * @param max_size[in] values are encoded only if the size of encoded values is less than this size (the size of packed values)
+ * @param data[out] receives encoded values (is not changed if values are left packed)
+ * @return the identifier of chosen codec (ColumnCodecId::xor_float or ColumnCodecId::packed if values are not encoded)
+ */
+ColumnCodecId EncodeDoubles(const std::vector<uint64_t>& values, size_t max_size, std::string& data);
+
+/**
+ * @brief DecodeDoubles decodes values of double column encoded by XOR with previous values
+ * @param data[in] encoded values
+ * @param size[in] size of encoded values
+ * @param count[in] the count of values
+ * @param values[out] receives bits of the values
+ * @throw TlvInvalidFormatError if encoded values are invalid or their size differs from size
+ */
+void DecodeDoubles(const char* data, size_t size, size_t count, std::vector<uint64_t>& values);
+
+/**
+ * @brief EncodeColumnarBlock converts TLV records of the block (v2 format) into columnar layout (TLV_FLAG_COLUMNAR is set in header);
+ * the block consists of 4-byte size of block head, block head and column chunks (all numbers except sizes are written as varints):
+ * - head: count of records, count of shapes, shapes (count of members and key indexes in order of members of the record),
+ *   shape number of every record, count of columns and column directory (key index and size of chunk of every column);
+ * - column chunk (one per key): presence bitmap (bit per record, set if the record has the key), count of values,
+ *   type tags of values (1 byte per value) and values packed densely (data of fixed-width types as is, data of other
+ *   types preceded by its length); if column codecs are used (TLV_FLAG_COLUMN_CODECS is set in header) values are preceded
+ *   by 1-byte codec identifier (@see ColumnCodecId), the columns of integer or double values may be encoded by codecs other than packed
+ * @param data[in] TLV records of the block
+ * @param size[in] size of TLV records
+ * @param integer_codecs[in] encode integer columns by the codec giving the smallest size
+ * @param double_codecs[in] encode double columns by XOR with previous values
+ * @param block[out] receives the block in columnar layout
+ * @throw TlvInvalidFormatError if TLV records are invalid
+ */
+void EncodeColumnarBlock(const char* data, size_t size, bool integer_codecs, bool double_codecs, std::string& block);
+
+/**
+ * @brief The ColumnarBlockReader class reads the block in columnar layout (@see EncodeColumnarBlock) and rebuilds its records;
+ * only the chunks of selected columns are read from input
+ */
+class ColumnarBlockReader {
+public:
+	/**
+	 * @brief Read reads head of the block and chunks of selected columns
+	 * @param source[in] the input
+	 * @param offset[in] the position of the block in input
+	 * @param selected_keys[in] flags of selected keys indexed by key index (empty vector - all keys are selected)
+	 * @param column_codecs[in] values of column chunks are preceded by codec identifier
+	 * @throw TlvInvalidFormatError if the block is invalid
+	 */
+	void Read(ByteSource& source, uint64_t offset, const std::vector<bool>& selected_keys, bool column_codecs);
+	/**
+	 * @brief RecordCount returns the count of records of the block
+	 * @return the count of records
+	 */
+	uint64_t RecordCount() const {return m_row_shapes.size();}
+	/**
+	 * @brief RebuildRecords writes records of the block in TLV format (v2) into output; records have only the members of
+	 * selected keys in order of members of original records
+	 * @param output[in] the output receiving TLV records
+	 * @throw TlvInvalidFormatError if the block is invalid
+	 */
+	void RebuildRecords(ByteSink& output) const;
+private:
+	/**
+	 * @brief The Column struct refers to the chunk of selected column
+	 */
+	struct Column {
+		std::string data; ///the chunk of column (empty if the column is not selected)
+		size_t types {0}; ///the offset of type tags in data
+		size_t values {0}; ///the offset of packed values in data
+		size_t value_count {0}; ///the count of values
+		ColumnCodecId codec {ColumnCodecId::packed}; ///the codec of values
+	};
+
+	std::vector<std::vector<int>> m_shapes; ///the shapes of records (column numbers of members, -1 for members of keys which are not selected)
+	std::vector<size_t> m_selected_members; ///the count of members of selected keys in every shape
+	std::vector<uint32_t> m_row_shapes; ///the shape number of every record
+	std::vector<Column> m_columns; ///the columns
+	std::vector<int> m_column_keys; ///the key indexes of columns
+};
+
+/**
+  @}
+  **/
+
+} //end of namespace jsonpacker_coder
+
+#endif // COLUMNAR_H
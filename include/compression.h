@@ -0,0 +1,98 @@
+/**
+  @file
+  @brief Header file with description of codecs compressing blocks of TLV data
+  **/
+
+#ifndef COMPRESSION_H
+#define COMPRESSION_H
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace jsonpacker_compression {
+
+/**
+  @defgroup JSONPACKER_COMPRESSION JSON packer block codecs
+  @{
+  **/
+
+/**
+ * @brief The BlockCodecId enum contains identifiers of codecs written into headers of compressed blocks
+ */
+enum class BlockCodecId : unsigned char {
+	stored = 0, ///the block is not compressed
+	lz = 1, ///the built-in LZ codec (byte-oriented LZ77 with 64 KB window)
+	zlib = 2, ///zlib (deflate) codec, available if zlib is found at build time
+	zstd = 3 ///zstd codec, available if zstd is found at build time
+};
+
+/**
+ * @brief The BlockCodec class is the base class for codecs compressing independent blocks of data; codecs have no state,
+ * so one instance may be used by several threads at once
+ */
+class BlockCodec {
+public:
+	using Ptr = std::shared_ptr<BlockCodec>;
+	virtual ~BlockCodec();
+	/**
+	 * @brief Id returns the identifier of codec written into headers of compressed blocks
+	 * @return the identifier of codec
+	 */
+	virtual BlockCodecId Id() const = 0;
+	/**
+	 * @brief MaxCompressedSize returns the size of buffer which is enough to compress the data of given size
+	 * @param size[in] the size of data in bytes
+	 * @return the size of buffer in bytes
+	 */
+	virtual size_t MaxCompressedSize(size_t size) const = 0;
+	/**
+	 * @brief Compress compresses the block of data
+	 * @param data[in] pointer to data
+	 * @param size[in] size of data in bytes
+	 * @param buffer[out] the buffer receiving compressed data
+	 * @param capacity[in] the size of buffer (at least MaxCompressedSize(size) bytes)
+	 * @return the size of compressed data
+	 */
+	virtual size_t Compress(const char* data, size_t size, char* buffer, size_t capacity) const = 0;
+	/**
+	 * @brief Decompress restores the block of data
+	 * @param data[in] pointer to compressed data
+	 * @param size[in] size of compressed data in bytes
+	 * @param buffer[out] the buffer receiving restored data
+	 * @param raw_size[in] the size of restored data in bytes
+	 * @return true if compressed data is valid and gives exactly raw_size bytes, false otherwise
+	 */
+	virtual bool Decompress(const char* data, size_t size, char* buffer, size_t raw_size) const = 0;
+};
+
+/**
+ * @brief GetCodec creates codec by its name ('stored', 'lz', and 'zlib' or 'zstd' if they are found at build time)
+ * @param name[in] the name of codec
+ * @return pointer to codec
+ * @throw JsonPackerMissed if codec is not available
+ */
+BlockCodec::Ptr GetCodec(const std::string& name);
+
+/**
+ * @brief GetCodec creates codec by its identifier read from header of compressed block
+ * @param id[in] the identifier of codec
+ * @return pointer to codec
+ * @throw JsonPackerMissed if codec is not available
+ */
+BlockCodec::Ptr GetCodec(BlockCodecId id);
+
+/**
+ * @brief CodecNames returns the names of available codecs
+ * @return the names of codecs in order of their identifiers
+ */
+std::vector<std::string> CodecNames();
+
+/**
+  @}
+  **/
+
+} // end of namespace jsonpacker_compression
+
+#endif // COMPRESSION_H
@@ -0,0 +1,305 @@
+/**
+  @file
+  @brief Header file with description of zone maps of TLV blocks and filter of JSON records used by decoder
+  **/
+
+#ifndef FILTER_H
+#define FILTER_H
+
+#include <string>
+#include <vector>
+#include "coder.h"
+
+namespace jsonpacker_coder {
+
+/**
+  @addtogroup JSONPACKER_CODER_CLASSES
+  @{
+  **/
+
+/**
+ * @brief CollectZoneMap collects statistics of values of every key in TLV records of the block (v2 format)
+ * @param data[in] TLV records of the block
+ * @param size[in] size of TLV records
+ * @param shapes[in] the shapes of records written with rtShape record
+ * @param zone_map[out] receives the statistics
+ * @throw TlvInvalidFormatError if TLV records are invalid
+ */
+void CollectZoneMap(const char* data, size_t size, const JsonShapeDictionary& shapes, ZoneMap& zone_map);
+
+/**
+ * @brief WriteTlvZoneMaps writes zone maps of blocks into output (@see TlvTrailer::zone_map_offset); the zone map of
+ * every block (in the order of block index entries, so it is paired with the offset of the block) is written as varint
+ * count of keys followed by key index, null count and count of numeric values (varints) of every key, the count of numeric
+ * values is followed by 8-byte minimum and 8-byte maximum (doubles) unless it is 0
+ * @param sink[in] reference to output
+ * @param zone_maps[in] the zone maps of blocks
+ */
+void WriteTlvZoneMaps(ByteSink& sink, const std::vector<ZoneMap>& zone_maps);
+
+/**
+ * @brief ReadTlvZoneMaps reads zone maps located by trailer; the position of input is undefined after the call
+ * @param source[in] reference to input
+ * @param tlv_begin[in] the position of the begining of TLV data in input
+ * @param trailer[in] the trailer of TLV data
+ * @param block_count[in] the count of blocks in block index
+ * @param zone_maps[out] receives the zone maps of blocks
+ * @throw TlvInvalidFormatError if zone maps are invalid
+ */
+void ReadTlvZoneMaps(ByteSource& source, uint64_t tlv_begin, const TlvTrailer& trailer, size_t block_count, std::vector<ZoneMap>& zone_maps);
+
+/**
+ * @brief CollectBloomFilters builds Bloom filters of string and numeric values of keys in TLV records of the block (v2 format);
+ * the filter of every key has one 64-byte block per 32 distinct values (16 bits per value), numbers are added as doubles
+ * @param data[in] TLV records of the block
+ * @param size[in] size of TLV records
+ * @param shapes[in] the shapes of records written with rtShape record
+ * @param values[in] the dictionaries of string values referred by rtStringRef records (indexed by key indexes)
+ * @param keys[in] the key indexes of filtered keys in ascending order
+ * @param filters[out] receives the filters of keys
+ * @throw TlvInvalidFormatError if TLV records are invalid
+ */
+void CollectBloomFilters(const char* data, size_t size, const JsonShapeDictionary& shapes, const JsonValueDictionary& values,
+						 const std::vector<int>& keys, BlockBloomFilters& filters);
+
+/**
+ * @brief WriteTlvBloomFilters writes Bloom filters of blocks into output (@see TlvTrailer::bloom_filter_offset); the filters of
+ * every block (in the order of block index entries) are written as varint count of keys followed by key index and count of
+ * 64-byte blocks of the filter (varints) and the blocks of every key; every filtered key is written for every block, so the block
+ * without values of the key has empty filter
+ * @param sink[in] reference to output
+ * @param filters[in] the filters of blocks
+ * @param keys[in] the key indexes of filtered keys in ascending order
+ */
+void WriteTlvBloomFilters(ByteSink& sink, const std::vector<BlockBloomFilters>& filters, const std::vector<int>& keys);
+
+/**
+ * @brief ReadTlvBloomFilters reads Bloom filters located by trailer; the position of input is undefined after the call
+ * @param source[in] reference to input
+ * @param tlv_begin[in] the position of the begining of TLV data in input
+ * @param trailer[in] the trailer of TLV data
+ * @param block_count[in] the count of blocks in block index
+ * @param filters[out] receives the filters of blocks
+ * @throw TlvInvalidFormatError if Bloom filters are invalid
+ */
+void ReadTlvBloomFilters(ByteSource& source, uint64_t tlv_begin, const TlvTrailer& trailer, size_t block_count, std::vector<BlockBloomFilters>& filters);
+
+/**
+ * @brief HashValue calculates the hash of string or numeric value looked up in Bloom filters and secondary index (@see TlvIndex);
+ * numbers of all types are hashed as doubles, so equal numbers have equal hashes
+ * @param type[in] the type of TLV record (string values of rtStringRef records are passed as rtString)
+ * @param data[in] the data of TLV record
+ * @param size[in] the size of data
+ * @param hash[out] receives the hash
+ * @return false if the value is neither string nor number
+ */
+bool HashValue(TlvRecordView::TlvRecordType type, const char* data, size_t size, uint64_t& hash);
+
+#define FILTER_BATCH_SIZE 1024 ///the maximum count of records evaluated by filter at once
+
+/**
+ * @brief The RecordFilter class selects JSON records by filter expression: comparisons of member value with number or string
+ * joined by '&&' and '||' and grouped by parentheses (e.g. 'status == "error" && latency > 250 || retries >= 3', '&&' takes
+ * precedence over '||'); the comparison operators are ==, !=, <, <=, > and >= (strings are compared only by == and !=, they are
+ * written in double quotes with '\"' and '\\' escapes), the keys containing other characters than letters, digits, '_', '-', '.'
+ * and '$' are written in double quotes; the comparison is satisfied if the member has numeric (string) value satisfying it
+ *
+ * The expression is compiled into postfix program of comparisons and logical operations. The values of members of a batch
+ * of records are collected into columns (one per key of expression, @see Batch) and the program is evaluated for the whole
+ * batch: every comparison produces the bitmap of records satisfying it and the bitmaps are combined by logical operations.
+ * The filter is not changed by evaluation, so it is shared by threads decoding records.
+ */
+class RecordFilter {
+public:
+	using TlvRecordType = TlvRecord<std::streamsize>::TlvRecordType;
+
+	/**
+	 * @brief The Batch class holds the values of members of up to FILTER_BATCH_SIZE records compared by filter (one column per slot)
+	 * and the result of evaluation
+	 */
+	class Batch {
+	public:
+		/**
+		 * @brief Reset removes all records
+		 * @param slot_count[in] the count of slots (@see RecordFilter::SlotCount)
+		 */
+		void Reset(size_t slot_count);
+		/**
+		 * @brief Add adds the record having no values
+		 * @return false if the batch is full
+		 */
+		bool Add();
+		/**
+		 * @brief Pop removes the last added record (e.g. the record which is not completely read)
+		 */
+		void Pop();
+		/**
+		 * @brief SetValue stores the value of TLV record in the slot of the last added record
+		 * @param slot[in] the slot
+		 * @param type[in] the type of TLV record (string values of rtStringRef records are passed as rtString)
+		 * @param data[in] the data of TLV record
+		 * @param size[in] the size of data
+		 */
+		void SetValue(size_t slot, TlvRecordType type, const char* data, size_t size);
+		/**
+		 * @brief Size returns the count of records
+		 * @return the count of records
+		 */
+		size_t Size() const {return m_size;}
+		/**
+		 * @brief Matches returns the result of evaluation (@see RecordFilter::Evaluate)
+		 * @param record[in] the number of the record in the batch
+		 * @return true if the record matches the expression
+		 */
+		bool Matches(size_t record) const {return (m_matches[record / 64] >> (record % 64)) & 1;}
+	private:
+		friend class RecordFilter;
+
+		/**
+		 * @brief The Column struct holds the values of one slot
+		 */
+		struct Column {
+			std::vector<double> numbers; ///the numeric values
+			std::vector<uint64_t> number_mask; ///the bitmap of records having numeric value
+			std::vector<uint64_t> string_mask; ///the bitmap of records having string value
+			std::vector<size_t> string_begins; ///the offsets of string values in strings
+			std::vector<size_t> string_sizes; ///the sizes of string values
+			std::string strings; ///the string values (keeps its capacity when the batch is reset)
+		};
+
+		std::vector<Column> m_columns; ///the columns of slots
+		size_t m_size {0}; ///the count of records
+		std::vector<std::vector<uint64_t>> m_stack; ///the stack of bitmaps used by evaluation
+		std::vector<uint64_t> m_matches; ///the bitmap of matching records
+	};
+
+	/**
+	 * @brief RecordFilter constructor compiles the expression
+	 * @param expression[in] the filter expression
+	 * @throw app_err::JsonPackerError if the expression is invalid
+	 */
+	explicit RecordFilter(const std::string& expression);
+	/**
+	 * @brief Bind resolves the keys of expression by dictionary; the keys missing in dictionary have no values
+	 * @param dictionary[in] the dictionary of keys
+	 */
+	void Bind(const JsonKeyDictionary& dictionary);
+	/**
+	 * @brief Keys returns the keys of expression
+	 * @return the keys in order of slots
+	 */
+	const std::vector<std::string>& Keys() const {return m_keys;}
+	/**
+	 * @brief SlotCount returns the count of slots of values
+	 * @return the count of distinct keys of expression
+	 */
+	size_t SlotCount() const {return m_keys.size();}
+	/**
+	 * @brief Slot returns the slot of values of the key
+	 * @param key_index[in] the key index
+	 * @return the slot number or -1 if the key is not used by expression
+	 */
+	int Slot(int key_index) const {
+		return key_index >= 0 && static_cast<size_t>(key_index) < m_key_slots.size() ? m_key_slots[static_cast<size_t>(key_index)] : -1;
+	}
+	/**
+	 * @brief Evaluate evaluates the expression for every record of the batch (@see Batch::Matches)
+	 * @param batch[in] the batch of records
+	 */
+	void Evaluate(Batch& batch) const;
+	/**
+	 * @brief MayMatch checks if some record of the block may match the expression; equality comparisons are checked by Bloom filters
+	 * @param zone_map[in] the zone map of the block (nullptr - there is no zone map)
+	 * @param filters[in] the Bloom filters of the block (nullptr - there are no Bloom filters)
+	 * @return false if no record of the block matches the expression
+	 */
+	bool MayMatch(const ZoneMap* zone_map, const BlockBloomFilters* filters) const;
+	/**
+	 * @brief EqualityHash finds the comparison of member with number or string by == which every matching record satisfies
+	 * @param key[in] the key of member
+	 * @param hash[out] receives the hash of compared number or string (@see HashValue)
+	 * @return false if there is no such comparison
+	 */
+	bool EqualityHash(const std::string& key, uint64_t& hash) const;
+private:
+	/**
+	 * @brief The Operator enum contains comparison operators
+	 */
+	enum class Operator {
+		equal,
+		not_equal,
+		less,
+		less_equal,
+		greater,
+		greater_equal
+	};
+
+	/**
+	 * @brief The Condition struct describes the comparison of member value with number or string
+	 */
+	struct Condition {
+		size_t slot {0}; ///the slot of compared value
+		Operator op {Operator::equal}; ///the operator
+		double number {0}; ///the number compared with value
+		bool string {false}; ///the value is compared with string
+		std::string text; ///the string compared with value
+		uint64_t hash {0}; ///the hash of compared number or string looked up in Bloom filters
+	};
+
+	/**
+	 * @brief The Opcode enum contains instructions of compiled expression
+	 */
+	enum class Opcode {
+		compare, ///pushes the result of the condition
+		logical_and, ///replaces two topmost results by their conjunction
+		logical_or ///replaces two topmost results by their disjunction
+	};
+
+	/**
+	 * @brief The Instruction struct describes the instruction of compiled expression
+	 */
+	struct Instruction {
+		Opcode opcode {Opcode::compare}; ///the instruction
+		size_t condition {0}; ///the condition of compare instruction
+	};
+
+	/**
+	 * @brief ParseDisjunction compiles conjunctions joined by '||'
+	 * @param expression[in] the filter expression
+	 * @param position[in,out] the position in expression
+	 * @param required[out] receives the conditions satisfied by every record matching the disjunction
+	 */
+	void ParseDisjunction(const std::string& expression, size_t& position, std::vector<size_t>& required);
+	/**
+	 * @brief ParseConjunction compiles comparisons and parenthesized disjunctions joined by '&&'
+	 */
+	void ParseConjunction(const std::string& expression, size_t& position, std::vector<size_t>& required);
+	/**
+	 * @brief ParseComparison compiles the comparison or parenthesized disjunction
+	 */
+	void ParseComparison(const std::string& expression, size_t& position, std::vector<size_t>& required);
+	/**
+	 * @brief Compare compares the value with the number of condition
+	 */
+	static bool Compare(double value, const Condition& condition);
+	/**
+	 * @brief ConditionMayMatch checks if some record of the block may satisfy the condition
+	 */
+	bool ConditionMayMatch(const Condition& condition, const ZoneMap* zone_map, const BlockBloomFilters* filters) const;
+
+	std::vector<Condition> m_conditions; ///the conditions
+	std::vector<Instruction> m_program; ///the compiled expression
+	size_t m_stack_depth {0}; ///the maximum count of results kept while the program is evaluated
+	std::vector<size_t> m_required; ///the conditions satisfied by every matching record
+	std::vector<std::string> m_keys; ///the keys of slots
+	std::vector<int> m_slot_keys; ///the key indexes of slots (-1 if the key is missing in dictionary)
+	std::vector<int> m_key_slots; ///the slots of keys indexed by key index
+};
+
+/**
+  @}
+  **/
+
+} //end of namespace jsonpacker_coder
+
+#endif // FILTER_H
@@ -0,0 +1,179 @@
+/**
+  @file
+  @brief Header file with description of secondary index of TLV data (sidecar file mapping values of one key to record offsets)
+  **/
+
+#ifndef INDEX_H
+#define INDEX_H
+
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+#include "coder.h"
+
+namespace jsonpacker_coder {
+
+/**
+  @addtogroup JSONPACKER_CODER_CLASSES
+  @{
+  **/
+
+#define TLV_INDEX_MAGIC "JPKI"
+#define TLV_INDEX_VERSION 1
+#define TLV_INDEX_HEADER_SIZE 24 ///the size of index header without key name
+#define TLV_INDEX_ENTRY_SIZE 16
+
+/**
+ * @brief The TlvIndexEntry struct describes the entry of secondary index: the hash of value of the indexed key (strings and numbers
+ * are hashed in the same way as by Bloom filters, @see RecordFilter) and the offset of the record having this value
+ */
+struct TlvIndexEntry {
+	uint64_t hash {0}; ///the hash of value
+	uint64_t offset {0}; ///the offset of the record counted from the begining of TLV data (in uncompressed data if blocks are compressed)
+
+	bool operator < (const TlvIndexEntry& other) const {
+		return hash < other.hash || (hash == other.hash && offset < other.offset);
+	}
+};
+
+/**
+ * @brief The TlvIndexWriter class sorts index entries and writes the index; the entries exceeding memory limit are sorted
+ * by runs written into temporary files, the runs are merged when the index is written
+ *
+ * The index begins with 4-byte magic (@see TLV_INDEX_MAGIC), 1-byte version, 3 reserved bytes, 8-byte size of indexed TLV data,
+ * 4-byte length of the name of indexed key, 4 reserved bytes and the key name padded by zeros to 8-byte boundary; it is followed
+ * by entries ordered by hash and offset (8-byte hash and 8-byte offset), so entries of the value are found by binary search.
+ */
+class TlvIndexWriter {
+public:
+	/**
+	 * @brief TlvIndexWriter constructor
+	 * @param memory[in] the size in bytes of entries sorted in memory
+	 */
+	explicit TlvIndexWriter(size_t memory);
+	/**
+	 * @brief Add adds the entry
+	 * @param entry[in] the entry
+	 * @throw app_err::JsonPackerError if temporary file can not be written
+	 */
+	void Add(const TlvIndexEntry& entry);
+	/**
+	 * @brief Write writes the index
+	 * @param sink[in] reference to output
+	 * @param key[in] the name of indexed key
+	 * @param data_size[in] the size of indexed TLV data
+	 * @return the count of entries
+	 * @throw app_err::JsonPackerError if temporary files can not be read
+	 */
+	uint64_t Write(ByteSink& sink, const std::string& key, uint64_t data_size);
+	/**
+	 * @brief RunCount returns the count of runs written into temporary files
+	 * @return the count of runs
+	 */
+	size_t RunCount() const {return m_runs.size();}
+private:
+	/**
+	 * @brief WriteRun sorts the entries kept in memory and writes them into temporary file
+	 */
+	void WriteRun();
+
+	/**
+	 * @brief The FileCloser struct closes temporary file (the file is removed when it is closed)
+	 */
+	struct FileCloser {
+		void operator () (FILE* file) const {fclose(file);}
+	};
+
+	size_t m_run_entries; ///the maximum count of entries sorted in memory
+	std::vector<TlvIndexEntry> m_entries; ///the entries kept in memory
+	std::vector<std::unique_ptr<FILE, FileCloser>> m_runs; ///the temporary files holding sorted runs
+	std::vector<uint64_t> m_run_sizes; ///the counts of entries of runs
+};
+
+/**
+ * @brief The TlvIndex class reads the index (@see TlvIndexWriter) mapped into memory
+ */
+class TlvIndex {
+public:
+	/**
+	 * @brief TlvIndex constructor maps the index file into memory
+	 * @param filename[in] the name of index file
+	 * @throw app_err::JsonPackerError if the file can not be mapped or is not valid index
+	 */
+	explicit TlvIndex(const std::string& filename);
+	/**
+	 * @brief Key returns the name of indexed key
+	 * @return the key name
+	 */
+	const std::string& Key() const {return m_key;}
+	/**
+	 * @brief DataSize returns the size of indexed TLV data
+	 * @return the size in bytes
+	 */
+	uint64_t DataSize() const {return m_data_size;}
+	/**
+	 * @brief Size returns the count of entries
+	 * @return the count of entries
+	 */
+	uint64_t Size() const {return m_size;}
+	/**
+	 * @brief Find finds the records having the value by binary search
+	 * @param hash[in] the hash of value
+	 * @param offsets[out] receives the offsets of records in ascending order
+	 */
+	void Find(uint64_t hash, std::vector<uint64_t>& offsets) const;
+private:
+	/**
+	 * @brief Entry reads the entry
+	 * @param index[in] the number of the entry
+	 * @return the entry
+	 */
+	TlvIndexEntry Entry(uint64_t index) const;
+
+	jsonpacker_stream::MappedFile m_file; ///the mapped index file
+	std::string m_key; ///the name of indexed key
+	uint64_t m_data_size {0}; ///the size of indexed TLV data
+	const char* m_entries {nullptr}; ///the first entry
+	uint64_t m_size {0}; ///the count of entries
+};
+
+/**
+ * @brief The TlvToIndex class builds secondary index (@see TlvIndexWriter) of the key given by JsonPackerOptions::index_key
+ * for row-oriented TLV data with dictionary; records are read sequentially, the hash of string or numeric value of the key
+ * is added to the index with the position of record in input (the records having no such value are not indexed)
+ */
+class TlvToIndex : public TlvToJson {
+public:
+	/**
+	 * @brief Run reads TLV data and writes the index into output
+	 * @param stream the stream (@see JsonPackerStream) to process
+	 * @throw app_err::JsonPackerError if the key is not given or TLV data is columnar or streamable
+	 */
+	void Run(JsonPackerStream& stream) override;
+protected:
+	/**
+	 * @brief DictionaryLoaded finds the index of indexed key in dictionary
+	 */
+	void DictionaryLoaded() override;
+	/**
+	 * @brief DecodeRecords adds the values of indexed key of records to the index; nothing is written into output
+	 * @param input[in] the input positioned at the first record
+	 * @param format[in] the format of TLV data
+	 * @param output[in] the output (is not used)
+	 * @param count[in] the maximum count of records to read
+	 * @return the count of read records
+	 */
+	uint64_t DecodeRecords(ByteSource& input, TlvFormat format, ByteSink& output, uint64_t count) override;
+private:
+	std::unique_ptr<TlvIndexWriter> m_writer; ///the writer of index
+	int m_key_index {-1}; ///the index of indexed key (-1 if the key is not in dictionary)
+};
+
+/**
+  @}
+  **/
+
+} //end of namespace jsonpacker_coder
+
+#endif // INDEX_H
@@ -1,11 +1,265 @@
 #ifndef PACKERSTREAM_H
 #define PACKERSTREAM_H
 
+#include <cstring>
 #include <fstream>
+#include <memory>
 #include <sstream>
+#include <string>
+#include <vector>
 
 namespace jsonpacker_stream {
 
+#define DEFAULT_IO_BLOCK_SIZE (1024 * 1024) ///the default size of buffers used by ByteSink and ByteSource
+
+/**
+ * @brief The ByteSink class is a base class for buffered output; data is written straight into the contiguous buffer
+ * (Reserve/Commit) and passed to the backend by large blocks
+ */
+class ByteSink {
+public:
+	/**
+	 * @brief ByteSink constructor
+	 * @param block_size[in] the size of buffer; data is passed to the backend when the buffer is full
+	 */
+	explicit ByteSink(size_t block_size = DEFAULT_IO_BLOCK_SIZE);
+	virtual ~ByteSink();
+	ByteSink(const ByteSink&) = delete;
+	ByteSink& operator=(const ByteSink&) = delete;
+	/**
+	 * @brief Reserve provides contiguous space for writing; the data is written only after Commit
+	 * @param size[in] the required size in bytes
+	 * @return pointer to the space of at least size bytes valid until the next call of Reserve, Write or Flush
+	 */
+	char* Reserve(size_t size) {
+		if (static_cast<size_t>(m_end - m_next) < size)
+			Drain(size);
+		return m_next;
+	}
+	/**
+	 * @brief Commit appends data written into reserved space
+	 * @param size[in] the size of written data in bytes (not greater than reserved size)
+	 */
+	void Commit(size_t size) {m_next += size;}
+	/**
+	 * @brief Write appends data
+	 * @param data[in] pointer to data
+	 * @param size[in] size of data in bytes
+	 */
+	void Write(const char* data, size_t size) {
+		if (size) {
+			memcpy(Reserve(size), data, size);
+			Commit(size);
+		}
+	}
+	/**
+	 * @brief Put appends one byte
+	 * @param value[in] the byte to append
+	 */
+	void Put(char value) {
+		*Reserve(1) = value;
+		Commit(1);
+	}
+	/**
+	 * @brief Position returns the count of bytes written into the sink
+	 * @return position in bytes
+	 */
+	uint64_t Position() const {return m_drained + static_cast<uint64_t>(m_next - m_buffer.data());}
+	/**
+	 * @brief Flush passes all buffered data to the backend and flushes the backend
+	 */
+	void Flush();
+protected:
+	/**
+	 * @brief WriteBlock writes data to the backend; must be overridden in derived classes
+	 * @param data[in] pointer to data
+	 * @param size[in] size of data in bytes
+	 */
+	virtual void WriteBlock(const char* data, size_t size) = 0;
+	/**
+	 * @brief FlushBlocks flushes the backend after all data is written; may be overridden in derived classes
+	 */
+	virtual void FlushBlocks();
+private:
+	/**
+	 * @brief Drain passes buffered data to the backend and ensures that buffer has space for size bytes
+	 * @param size[in] the required space in bytes
+	 */
+	void Drain(size_t size);
+
+	std::vector<char> m_buffer; ///the buffer
+	char* m_next {nullptr}; ///the first free byte of buffer
+	char* m_end {nullptr}; ///the end of buffer
+	uint64_t m_drained {0}; ///the count of bytes passed to the backend
+};
+
+/**
+ * @brief The StreamByteSink class writes data into std::ostream (adapter for file and string streams)
+ */
+class StreamByteSink : public ByteSink {
+public:
+	/**
+	 * @brief StreamByteSink constructor
+	 * @param os[in] reference to output stream
+	 * @param block_size[in] the size of buffer
+	 */
+	StreamByteSink(std::ostream& os, size_t block_size = DEFAULT_IO_BLOCK_SIZE);
+	~StreamByteSink() override;
+protected:
+	void WriteBlock(const char* data, size_t size) override;
+	void FlushBlocks() override;
+private:
+	std::ostream& m_stream; ///output stream
+};
+
+/**
+ * @brief The StringByteSink class appends data to std::string
+ */
+class StringByteSink : public ByteSink {
+public:
+	/**
+	 * @brief StringByteSink constructor
+	 * @param block_size[in] the size of buffer
+	 */
+	explicit StringByteSink(size_t block_size = DEFAULT_IO_BLOCK_SIZE);
+	/**
+	 * @brief Data returns all data written into the sink
+	 * @return reference to string holding data
+	 */
+	std::string& Data();
+protected:
+	void WriteBlock(const char* data, size_t size) override;
+private:
+	std::string m_data; ///written data
+};
+
+/**
+ * @brief The ByteSource class is a base class for buffered input; data is read directly from the contiguous buffer (Peek/Consume)
+ */
+class ByteSource {
+public:
+	virtual ~ByteSource();
+	/**
+	 * @brief Peek provides contiguous input data without consuming it
+	 * @param data[out] receives pointer to data valid until the next call of Peek, Skip or Seek
+	 * @param size[in] the required size in bytes
+	 * @return the size of available data: at least size bytes unless input ends earlier (0 at the end of input)
+	 */
+	size_t Peek(const char*& data, size_t size = 1) {
+		if (static_cast<size_t>(m_end - m_next) < size)
+			Fill(size);
+		data = m_next;
+		return static_cast<size_t>(m_end - m_next);
+	}
+	/**
+	 * @brief Consume consumes peeked data
+	 * @param size[in] the size in bytes (not greater than peeked size)
+	 */
+	void Consume(size_t size) {m_next += size;}
+	/**
+	 * @brief Skip consumes data which may be not peeked
+	 * @param size[in] the size in bytes
+	 * @return the count of skipped bytes (less than size if input ends earlier)
+	 */
+	uint64_t Skip(uint64_t size);
+	/**
+	 * @brief Position returns the position of the next byte of input
+	 * @return position in bytes
+	 */
+	uint64_t Position() const {return m_position + static_cast<uint64_t>(m_next - m_data);}
+	/**
+	 * @brief Seek sets the position of the next byte of input
+	 * @param position[in] the position in bytes
+	 * @throw JsonPackerError if input is not seekable
+	 */
+	void Seek(uint64_t position);
+	/**
+	 * @brief Size returns the total size of input
+	 * @return size in bytes
+	 * @throw JsonPackerError if the size of input is unknown
+	 */
+	virtual uint64_t Size() = 0;
+	/**
+	 * @brief FlushOnWait sets the output flushed every time input waits for data, so the data converted from already received input
+	 * is passed on without delay (e.g. when input is a pipe)
+	 * @param output[in] pointer to output or nullptr
+	 */
+	void FlushOnWait(ByteSink* output) {m_wait_output = output;}
+protected:
+	/**
+	 * @brief Fill makes at least size bytes available unless input ends (waiting for no more data than required); must be overridden in derived classes
+	 * @param size[in] the required size in bytes
+	 */
+	virtual void Fill(size_t size) = 0;
+	/**
+	 * @brief SkipBlocks skips data following the buffered data; must be overridden in derived classes
+	 * @param size[in] the size in bytes
+	 * @return the count of skipped bytes
+	 */
+	virtual uint64_t SkipBlocks(uint64_t size) = 0;
+	/**
+	 * @brief SeekBlocks sets the position of input out of buffered data; must be overridden in derived classes
+	 * @param position[in] the position in bytes
+	 */
+	virtual void SeekBlocks(uint64_t position) = 0;
+	/**
+	 * @brief SetData sets the buffered data
+	 * @param data[in] pointer to data
+	 * @param size[in] size of data
+	 * @param position[in] the position of data in input
+	 */
+	void SetData(const char* data, size_t size, uint64_t position) {
+		m_data = m_next = data;
+		m_end = data + size;
+		m_position = position;
+	}
+	const char* m_data {nullptr}; ///the begining of buffered data
+	const char* m_next {nullptr}; ///the next byte of input
+	const char* m_end {nullptr}; ///the end of buffered data
+	uint64_t m_position {0}; ///the position of m_data in input
+	ByteSink* m_wait_output {nullptr}; ///the output flushed before waiting for input data
+};
+
+/**
+ * @brief The MemoryByteSource class reads data directly from memory (e.g. mapped file) without copying
+ */
+class MemoryByteSource : public ByteSource {
+public:
+	/**
+	 * @brief MemoryByteSource constructor
+	 * @param data[in] pointer to data
+	 * @param size[in] size of data in bytes
+	 */
+	MemoryByteSource(const char* data, size_t size);
+	uint64_t Size() override;
+protected:
+	void Fill(size_t size) override;
+	uint64_t SkipBlocks(uint64_t size) override;
+	void SeekBlocks(uint64_t position) override;
+};
+
+/**
+ * @brief The StreamByteSource class reads data from std::istream by large blocks (adapter for file and string streams)
+ */
+class StreamByteSource : public ByteSource {
+public:
+	/**
+	 * @brief StreamByteSource constructor; the data is read from the current position of stream
+	 * @param is[in] reference to input stream
+	 * @param block_size[in] the size of blocks read from stream
+	 */
+	StreamByteSource(std::istream& is, size_t block_size = DEFAULT_IO_BLOCK_SIZE);
+	uint64_t Size() override;
+protected:
+	void Fill(size_t size) override;
+	uint64_t SkipBlocks(uint64_t size) override;
+	void SeekBlocks(uint64_t position) override;
+private:
+	std::istream& m_stream; ///input stream
+	std::vector<char> m_buffer; ///the buffer
+	size_t m_block_size; ///the size of blocks read from stream
+};
+
 /**
  * @brief The JsonPackerStream class is a base class for streams used in packer classes
  */
@@ -22,6 +276,73 @@ public:
 	 * @return
 	 */
 	virtual std::ostream& OutputStream() = 0;
+	/**
+	 * @brief CreateInput creates buffered source reading input data; by default it reads InputStream(), may be overridden in derived classes
+	 * @return pointer to byte source; InputStream() must not be used while it exists
+	 */
+	virtual std::unique_ptr<ByteSource> CreateInput();
+	/**
+	 * @brief CreateOutput creates buffered sink writing output data; by default it writes OutputStream(), may be overridden in derived classes
+	 * @return pointer to byte sink; the data is written on Flush or destruction of the sink
+	 */
+	virtual std::unique_ptr<ByteSink> CreateOutput();
+	/**
+	 * @brief SetBlockSize sets the size of buffers used by input and output created after the call
+	 * @param block_size[in] the size in bytes
+	 */
+	void SetBlockSize(size_t block_size) {m_block_size = block_size;}
+	/**
+	 * @brief BlockSize returns the size of buffers used by input and output
+	 * @return the size in bytes
+	 */
+	size_t BlockSize() const {return m_block_size;}
+private:
+	size_t m_block_size {DEFAULT_IO_BLOCK_SIZE}; ///the size of buffers used by input and output
+};
+
+/**
+ * @brief The MappedFile class maps file into memory in read-only mode
+ */
+class MappedFile {
+public:
+	/**
+	 * @brief MappedFile constructor
+	 * @param filename[in] the name of file to map
+	 * @param sequential[in] if true - advise the kernel that the file would be read sequentially (the pages are read ahead aggressively)
+	 */
+	MappedFile(const std::string& filename, bool sequential = true);
+	~MappedFile();
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	/**
+	 * @brief Data returns pointer to the mapped file data
+	 * @return pointer to data (nullptr for empty file)
+	 */
+	const char* Data() const {return m_data;}
+	/**
+	 * @brief Size returns the size of the mapped file
+	 * @return size in bytes
+	 */
+	size_t Size() const {return m_size;}
+private:
+	char* m_data {nullptr}; ///mapped data
+	size_t m_size {0}; ///size of mapped data
+};
+
+/**
+ * @brief The MemoryInputBuffer class is a stream buffer reading data directly from memory (without copying)
+ */
+class MemoryInputBuffer : public std::streambuf {
+public:
+	/**
+	 * @brief MemoryInputBuffer constructor
+	 * @param data[in] pointer to data
+	 * @param size[in] size of data in bytes
+	 */
+	MemoryInputBuffer(const char* data, size_t size);
+protected:
+	pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) override;
+	pos_type seekpos(pos_type pos, std::ios_base::openmode which) override;
 };
 
 
@@ -79,5 +400,39 @@ private:
 	std::stringstream& m_output_stream;/// output string stream
 };
 
+/**
+ * @brief The JsonPackerMappedFileStream class allows packer classes to work with input file mapped into memory and output file
+ */
+class JsonPackerMappedFileStream : public JsonPackerStream {
+public:
+	/**
+	 * @brief JsonPackerMappedFileStream constructor
+	 * @param input_filename[in] the name of input file to map into memory
+	 * @param output_stream[in] reference to opened output file stream
+	 */
+	JsonPackerMappedFileStream(const std::string& input_filename, std::ofstream& output_stream);
+
+	/**
+	 * @brief InputStream provides an access to mapped input file as a stream
+	 * @return reference to std::istream reading mapped input file
+	 */
+	std::istream &InputStream() override;
+	/**
+	 * @brief OutputStream provides an access to output file stream
+	 * @return reference to std::ostream for output file stream
+	 */
+	std::ostream &OutputStream() override;
+	/**
+	 * @brief CreateInput creates source reading mapped input file without copying
+	 * @return pointer to byte source
+	 */
+	std::unique_ptr<ByteSource> CreateInput() override;
+private:
+	MappedFile m_input_file; ///mapped input file
+	MemoryInputBuffer m_input_buffer; ///stream buffer over mapped input file
+	std::istream m_input_stream; ///input stream over mapped input file
+	std::ofstream& m_output_stream; ///output file stream
+};
+
 } // end of namespace jsonpacker_stream
 #endif // PACKERSTREAM_H
@@ -0,0 +1,96 @@
+/**
+  @file
+  @brief Header file with description of vectorized functions used to scan data
+  **/
+
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace simd {
+
+/**
+  @defgroup JSONPACKER_SIMD JSON packer vectorized functions
+  @{
+  **/
+
+/**
+ * @brief FindByte searches for the first occurrence of byte value in memory range; uses AVX2 or SSE2 instructions when the processor supports them
+ * @param begin[in] the begining of memory range
+ * @param end[in] the end of memory range
+ * @param value[in] the byte value to search for
+ * @return pointer to the found byte or end if value is not found
+ */
+const char* FindByte(const char* begin, const char* end, char value);
+
+/**
+ * @brief UnpackBits unpacks values packed densely by width bits (bit stream in little-endian order) and adds base to them;
+ * uses AVX2 instructions when the processor supports them
+ * @param data[in] packed values
+ * @param size[in] size of packed values in bytes, at least (count * width + 7) / 8
+ * @param count[in] the count of values
+ * @param width[in] the width of values in bits (0 - 64)
+ * @param base[in] the value added to every unpacked value (modulo 2^64)
+ * @param values[out] receives count values
+ */
+void UnpackBits(const char* data, size_t size, size_t count, unsigned int width, uint64_t base, uint64_t* values);
+
+/**
+ * @brief Crc32c calculates CRC-32C (Castagnoli) checksum of memory range; uses SSE4.2 crc32 instructions on 3 interleaved
+ * stripes combined by PCLMULQDQ carry-less multiplication when the processor supports them
+ * @param data[in] the begining of memory range
+ * @param size[in] size of memory range in bytes
+ * @param crc[in] the checksum of preceding data (0 - there is no preceding data)
+ * @return the checksum of preceding data and memory range
+ */
+uint32_t Crc32c(const char* data, size_t size, uint32_t crc = 0);
+
+/**
+ * @brief BloomInsert adds hash to split-block Bloom filter: the 64-byte block (cache line) of the filter is selected by upper
+ * 32 bits of hash, lower 32 bits multiplied by 16 odd constants set one bit in every 32-bit word of the block
+ * @param filter[in,out] the filter of block_count 64-byte blocks
+ * @param block_count[in] the count of blocks of the filter (greater than 0)
+ * @param hash[in] the hash of value
+ */
+void BloomInsert(char* filter, size_t block_count, uint64_t hash);
+
+/**
+ * @brief BloomContains checks if hash may be added to split-block Bloom filter (@see BloomInsert); the bits of the block are
+ * checked at once by AVX2 instructions when the processor supports them
+ * @param filter[in] the filter of block_count 64-byte blocks
+ * @param block_count[in] the count of blocks of the filter (0 - the filter is empty)
+ * @param hash[in] the hash of value
+ * @return false if hash was not added to the filter
+ */
+bool BloomContains(const char* filter, size_t block_count, uint64_t hash);
+
+/**
+ * @brief The kernel namespace gives direct access to the implementations selected by the functions above at run time,
+ * so that each of them can be checked; the caller must check that the processor supports the instructions of the kernel
+ */
+namespace kernel {
+
+const char* FindByteScalar(const char* begin, const char* end, char value);
+void UnpackBitsScalar(const char* data, size_t size, size_t count, unsigned int width, uint64_t base, uint64_t* values);
+uint32_t Crc32cScalar(const char* data, size_t size, uint32_t crc = 0);
+bool BloomContainsScalar(const char* filter, size_t block_count, uint64_t hash);
+
+#if defined(__x86_64__) || defined(__i386__)
+const char* FindByteSse2(const char* begin, const char* end, char value); ///requires sse2
+const char* FindByteAvx2(const char* begin, const char* end, char value); ///requires avx2
+void UnpackBitsAvx2(const char* data, size_t size, size_t count, unsigned int width, uint64_t base, uint64_t* values); ///requires avx2
+uint32_t Crc32cSse42(const char* data, size_t size, uint32_t crc = 0); ///requires sse4.2 and pclmul
+bool BloomContainsAvx2(const char* filter, size_t block_count, uint64_t hash); ///requires avx2
+#endif
+
+} // end of namespace kernel
+
+/**
+  @}
+  **/
+
+} // end of namespace simd
+
+#endif // SIMD_H
@@ -8,6 +8,7 @@
 
 #include <memory>
 #include <map>
+#include <functional>
 #include "apperror.h"
 
 namespace util {
@@ -62,6 +63,14 @@ public:
 			throw app_err::JsonPackerMissed("creator", name);
 		return m_creators[name]->Create();
 	}
+	/**
+	 * @brief Registered checks if class is registerred in factory
+	 * @param name[in] the name of class
+	 * @return true if class is registerred, false otherwise
+	 */
+	bool Registered(const std::string& name) const {
+		return m_creators.find(name) != m_creators.end();
+	}
 	/**
 	 * @brief Clear removes all information about registerred classes
 	 */
@@ -116,6 +125,15 @@ private:
 	std::map<std::string, typename Creator::Ptr> m_creators;///collection with creator objects of registered classes
 };
 
+/**
+ * @brief ParallelFor calls function for every index in range [0, count) using the specified number of threads;
+ * the first exception thrown by the function is rethrown in the calling thread after all threads are finished
+ * @param count[in] the count of indexes to process
+ * @param threads[in] the maximum number of threads to use (if less than 2 all indexes are processed in the calling thread)
+ * @param function[in] the function to call
+ */
+void ParallelFor(size_t count, size_t threads, const std::function<void(size_t)>& function);
+
 /**
   @}
   **/
@@ -54,12 +54,12 @@ void ApplicationOptions::PrintHelp() {
 	if (!IsValid()) {
 		std::cout << "Invalid command line" << std::endl << std::endl;
 	}
-	std::cout << "Usage: json_packer [-f] [-m <convertion method>] -i <input file name> -o <output file name>" << std::endl;
+	std::cout << "Usage: json_packer [-f] [-m <convertion method>] [-t <threads>] [-F <format version>] [-S] [-c <codec>] [--shapes] [--int-codecs] [--xor-doubles] [--string-dictionary <size>] [--checksums] [--verify-only] [--zone-maps] [--bloom-keys <keys>] [--where <filter>] [--from <record>] [--count <records>] [--sample <records>] [--keys <keys>] [--index-key <key>] [--index-memory <MB>] [--lookup <index file>] [-s] -i <input file name> -o <output file name>" << std::endl;
 	std::cout << m_options_description << std::endl;
 }
 
 bool ApplicationOptions::IsValid() {
-	return Method.Exists() && InputFile.Exists() && OutputFile.Exists();
+	return Method.Exists() && InputFile.Exists() && (OutputFile.Exists() || VerifyOnly.Exists());
 }
 
 } // end of namespace app_opt
@@ -1,12 +1,24 @@
 #include <type_traits>
 #include "coder.h"
+#include "columnar.h"
+#include "filter.h"
+#include "index.h"
 #include "utils.h"
+#include "simd.h"
 
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <limits>
+#include <random>
+#include <set>
+#include <sstream>
 #include <vector>
 
 #include <rapidjson/stringbuffer.h>
 #include <rapidjson/writer.h>
+#include <rapidjson/reader.h>
 
 
 namespace jsonpacker_coder {
@@ -19,6 +31,10 @@ JsonKeyDictionary::Ptr JsonPackerBase::GetDictionary() {
 	return m_dictionary;
 }
 
+JsonShapeDictionary::Ptr JsonPackerBase::GetShapes() {
+	return m_shapes;
+}
+
 
 JsonPackerBase::Ptr GetPacker(const std::string &name) {
 	return util::Factory<JsonPackerBase>::Instance()->Get(name);
@@ -26,35 +42,225 @@ JsonPackerBase::Ptr GetPacker(const std::string &name) {
 
 RegisterInFactory("json2tlv", JsonToTlv, JsonPackerBase);
 RegisterInFactory("tlv2json", TlvToJson, JsonPackerBase);
+RegisterInFactory("json2tlv-sax", JsonToTlvSax, JsonPackerBase);
+RegisterInFactory("tlv2json-direct", TlvToJsonDirect, JsonPackerBase);
+RegisterInFactory("json2tlv-columnar", JsonToTlvColumnar, JsonPackerBase);
+
+
+namespace {
 
+const size_t ArenaBlockSize = 64 * 1024;
+const size_t InitialSlotCount = 64;
 
-int JsonKeyDictionary::AddKey(const std::string &key) {
-	auto it = m_keys.insert(std::make_pair(key, 0));
-	if (it.second) {
-		it.first->second = ++m_current;
+/**
+ * @brief HashKey calculates FNV-1a hash of key name
+ */
+inline uint64_t HashKey(const char* key, size_t length) {
+	uint64_t hash = 14695981039346656037ULL;
+	for (size_t i = 0; i < length; ++i) {
+		hash ^= static_cast<unsigned char>(key[i]);
+		hash *= 1099511628211ULL;
 	}
-	return it.first->second;
+	return hash;
+}
+
+} // end of anonymous namespace
+
+int JsonKeyDictionary::AddKeyString(const char *key, size_t length) {
+	const uint64_t hash = HashKey(key, length);
+	const size_t slot = Find(key, length, hash);
+	if (m_slots[slot])
+		return m_entries[m_slots[slot] - 1].index;
+	Insert(slot, key, length, hash, ++m_current);
+	return m_current;
 }
 
 void JsonKeyDictionary::AddKey(const std::string &key, int index) {
-	auto it = m_keys.find(key);
-	if (it == m_keys.end()) {
-		m_keys[key] = index;
-	} else
+	const uint64_t hash = HashKey(key.data(), key.length());
+	const size_t slot = Find(key.data(), key.length(), hash);
+	if (m_slots[slot])
 		throw app_err::JsonPackerExists("dictionary key", key);
+	Insert(slot, key.data(), key.length(), hash, index);
 }
 
-std::string JsonKeyDictionary::operator [](int index) {
-	for (auto& key_pair : m_keys) {
-		if (key_pair.second == index)
-			return key_pair.first;
+size_t JsonKeyDictionary::Position(int index) const {
+	uint32_t position = 0;
+	if (index >= 0 && static_cast<size_t>(index) < m_index.size())
+		position = m_index[static_cast<size_t>(index)];
+	else {
+		auto it = m_sparse_index.find(index);
+		if (it != m_sparse_index.end())
+			position = it->second;
 	}
-	throw app_err::JsonPackerMissed("dictionary key", std::to_string(index));
+	if (!position)
+		throw app_err::JsonPackerMissed("dictionary key", std::to_string(index));
+	return position - 1;
 }
 
 void JsonKeyDictionary::Clear() {
-	m_keys.clear();
 	m_current = 0;
+	m_entries.clear();
+	m_hashes.clear();
+	m_slots.clear();
+	m_index.clear();
+	m_sparse_index.clear();
+	m_arena.clear();
+	m_arena_next = nullptr;
+	m_arena_free = 0;
+	m_keys.clear();
+	m_keys_valid = false;
+}
+
+const std::map<std::string, int> &JsonKeyDictionary::Keys() const {
+	if (!m_keys_valid) {
+		m_keys.clear();
+		for (auto& key : m_entries)
+			m_keys.emplace_hint(m_keys.end(), std::string(key.data, key.length), key.index);
+		m_keys_valid = true;
+	}
+	return m_keys;
+}
+
+size_t JsonKeyDictionary::Find(const char *key, size_t length, uint64_t hash) {
+	if (m_slots.empty())
+		m_slots.resize(InitialSlotCount);
+	const size_t mask = m_slots.size() - 1;
+	for (size_t slot = static_cast<size_t>(hash) & mask; ; slot = (slot + 1) & mask) {
+		const uint32_t position = m_slots[slot];
+		if (!position)
+			return slot;
+		const Key& entry = m_entries[position - 1];
+		if (m_hashes[position - 1] == hash && entry.length == length && memcmp(entry.data, key, length) == 0)
+			return slot;
+	}
+}
+
+void JsonKeyDictionary::Insert(size_t slot, const char *key, size_t length, uint64_t hash, int index) {
+	//copy key name into arena
+	if (length > m_arena_free) {
+		const size_t block_size = std::max(ArenaBlockSize, length);
+		m_arena.emplace_back(new char[block_size]);
+		m_arena_next = m_arena.back().get();
+		m_arena_free = block_size;
+	}
+	char* data = m_arena_next;
+	memcpy(data, key, length);
+	m_arena_next += length;
+	m_arena_free -= length;
+
+	m_entries.push_back(Key {data, length, index});
+	m_hashes.push_back(hash);
+	const uint32_t position = static_cast<uint32_t>(m_entries.size());
+	m_slots[slot] = position;
+
+	AddToIndex(index, position);
+	m_keys_valid = false;
+
+	//keep load factor not higher than 1/2
+	if (m_entries.size() * 2 > m_slots.size())
+		Grow();
+}
+
+void JsonKeyDictionary::Grow() {
+	std::vector<uint32_t> slots(m_slots.size() * 2);
+	const size_t mask = slots.size() - 1;
+	for (uint32_t position = 1; position <= m_entries.size(); ++position) {
+		size_t slot = static_cast<size_t>(m_hashes[position - 1]) & mask;
+		while (slots[slot])
+			slot = (slot + 1) & mask;
+		slots[slot] = position;
+	}
+	m_slots.swap(slots);
+
+	//the dense index range grows with the table, so keys loaded in arbitrary order of indexes end up in the dense index
+	for (auto it = m_sparse_index.begin(); it != m_sparse_index.end();) {
+		if (it->first >= 0 && static_cast<size_t>(it->first) < 2 * m_slots.size()) {
+			AddToIndex(it->first, it->second);
+			it = m_sparse_index.erase(it);
+		} else
+			++it;
+	}
+}
+
+void JsonKeyDictionary::AddToIndex(int index, uint32_t position) {
+	//keys are numbered sequentially, so the dense index is used unless index is far away from the others
+	if (index >= 0 && static_cast<size_t>(index) < 2 * m_slots.size()) {
+		if (static_cast<size_t>(index) >= m_index.size())
+			m_index.resize(static_cast<size_t>(index) + 1);
+		m_index[static_cast<size_t>(index)] = position;
+	} else
+		m_sparse_index[index] = position;
+}
+
+int JsonShapeDictionary::AddShape(const std::vector<int> &keys) {
+	const uint64_t hash = HashKey(reinterpret_cast<const char*>(keys.data()), keys.size() * sizeof(int));
+	auto range = m_hashes.equal_range(hash);
+	for (auto it = range.first; it != range.second; ++it) {
+		if (m_shapes[static_cast<size_t>(it->second)] == keys)
+			return it->second;
+	}
+	const int index = static_cast<int>(m_shapes.size());
+	m_shapes.push_back(keys);
+	m_hashes.emplace(hash, index);
+	return index;
+}
+
+const std::vector<int> &JsonShapeDictionary::GetShape(int index) const {
+	if (index < 0 || static_cast<size_t>(index) >= m_shapes.size())
+		throw app_err::JsonPackerMissed("record shape", std::to_string(index));
+	return m_shapes[static_cast<size_t>(index)];
+}
+
+void JsonShapeDictionary::Clear() {
+	m_shapes.clear();
+	m_hashes.clear();
+}
+
+int JsonValueDictionary::AddValue(size_t key, const char *value, size_t length) {
+	if (m_keys.size() <= key)
+		m_keys.resize(key + 1);
+	KeyValues& values = m_keys[key];
+	const int code = static_cast<int>(values.values.size());
+	values.values.emplace_back(value, length);
+	values.codes.emplace(HashKey(value, length), code);
+	return code;
+}
+
+int JsonValueDictionary::Encode(size_t key, const char *value, size_t length, size_t max_size, bool &added) {
+	added = false;
+	if (length < TLV_MIN_DICTIONARY_STRING_SIZE)
+		return -1;
+	if (m_keys.size() <= key)
+		m_keys.resize(key + 1);
+	KeyValues& values = m_keys[key];
+	if (values.closed)
+		return -1;
+	const uint64_t hash = HashKey(value, length);
+	const int code = Find(values, value, length, hash);
+	if (code >= 0)
+		return code;
+	if (values.values.size() >= max_size) {
+		values.closed = true;
+		return -1;
+	}
+	added = true;
+	values.values.emplace_back(value, length);
+	values.codes.emplace(hash, static_cast<int>(values.values.size() - 1));
+	return static_cast<int>(values.values.size() - 1);
+}
+
+void JsonValueDictionary::Clear() {
+	m_keys.clear();
+}
+
+int JsonValueDictionary::Find(const KeyValues &values, const char *value, size_t length, uint64_t hash) const {
+	auto range = values.codes.equal_range(hash);
+	for (auto it = range.first; it != range.second; ++it) {
+		const std::string& candidate = values.values[static_cast<size_t>(it->second)];
+		if (candidate.size() == length && memcmp(candidate.data(), value, length) == 0)
+			return it->second;
+	}
+	return -1;
 }
 
 
@@ -73,38 +279,1242 @@ TlvInvalidFormatError::TlvInvalidFormatError()
 {
 }
 
+void WriteTlvHeader(ByteSink &sink, const TlvHeader &header) {
+	if (header.format == TlvFormat::v1)
+		return;
+	char* data = sink.Reserve(TLV_HEADER_SIZE);
+	memset(data, 0, TLV_HEADER_SIZE);
+	memcpy(data, TLV_MAGIC, 4);
+	data[4] = static_cast<char>(header.format);
+	data[5] = static_cast<char>(header.flags);
+	data[6] = static_cast<char>(header.ext_flags);
+	sink.Commit(TLV_HEADER_SIZE);
+}
+
+TlvHeader ReadTlvHeader(ByteSource &source) {
+	TlvHeader header;
+	const char* data;
+	if (source.Peek(data, TLV_HEADER_SIZE) >= TLV_HEADER_SIZE && memcmp(data, TLV_MAGIC, 4) == 0) {
+		if (data[4] != static_cast<char>(TlvFormat::v2))
+			throw TlvInvalidFormatError();
+		header.format = static_cast<TlvFormat>(data[4]);
+		header.flags = static_cast<unsigned char>(data[5]);
+		header.ext_flags = static_cast<unsigned char>(data[6]);
+		source.Consume(TLV_HEADER_SIZE);
+	}
+	//v1 format has no header
+	return header;
+}
+
+void WriteTlvTrailer(ByteSink &sink, const TlvTrailer &trailer) {
+	const uint32_t size = trailer.bloom_filter_offset ? TLV_TRAILER_BLOOM_FILTER_SIZE : (trailer.zone_map_offset ? TLV_TRAILER_ZONE_MAP_SIZE
+		: (trailer.block_index_offset ? TLV_TRAILER_BLOCK_INDEX_SIZE : TLV_TRAILER_SIZE));
+	char* data = sink.Reserve(size);
+	memset(data, 0, size);
+	memcpy(data, &trailer.dictionary_offset, sizeof(trailer.dictionary_offset));
+	data[8] = static_cast<char>(TlvFormat::v2);
+	if (trailer.block_index_offset)
+		memcpy(data + 12, &trailer.block_index_offset, sizeof(trailer.block_index_offset));
+	if (trailer.zone_map_offset)
+		memcpy(data + 20, &trailer.zone_map_offset, sizeof(trailer.zone_map_offset));
+	if (trailer.bloom_filter_offset)
+		memcpy(data + 28, &trailer.bloom_filter_offset, sizeof(trailer.bloom_filter_offset));
+	memcpy(data + size - 8, &size, sizeof(size));
+	memcpy(data + size - 4, TLV_MAGIC, 4);
+	sink.Commit(size);
+}
+
+bool ReadTlvTrailer(ByteSource &source, uint64_t tlv_begin, TlvTrailer &trailer) {
+	const uint64_t tlv_end = source.Size();
+	if (tlv_end < tlv_begin + TLV_HEADER_SIZE + TLV_TRAILER_SIZE)
+		return false;
+	const char* data;
+	source.Seek(tlv_end - 8);
+	if (source.Peek(data, 8) < 8)
+		return false;
+	uint32_t size;
+	memcpy(&size, data, sizeof(size));
+	if (memcmp(data + 4, TLV_MAGIC, 4) != 0 || size < TLV_TRAILER_SIZE || size > tlv_end - tlv_begin - TLV_HEADER_SIZE)
+		return false;
+	//the trailer may be extended with new fields, they are placed before the size field
+	source.Seek(tlv_end - size);
+	if (source.Peek(data, size) < size)
+		return false;
+	trailer.trailer_offset = tlv_end - size - tlv_begin;
+	memcpy(&trailer.dictionary_offset, data, sizeof(trailer.dictionary_offset));
+	trailer.block_index_offset = 0;
+	trailer.zone_map_offset = 0;
+	trailer.bloom_filter_offset = 0;
+	if (size >= TLV_TRAILER_BLOCK_INDEX_SIZE) {
+		memcpy(&trailer.block_index_offset, data + 12, sizeof(trailer.block_index_offset));
+		if (trailer.block_index_offset && (trailer.block_index_offset <= trailer.dictionary_offset || trailer.block_index_offset > trailer.trailer_offset))
+			return false;
+	}
+	if (size >= TLV_TRAILER_ZONE_MAP_SIZE) {
+		//zone maps follow block index
+		memcpy(&trailer.zone_map_offset, data + 20, sizeof(trailer.zone_map_offset));
+		if (trailer.zone_map_offset && (trailer.zone_map_offset < trailer.block_index_offset || !trailer.block_index_offset || trailer.zone_map_offset > trailer.trailer_offset))
+			return false;
+	}
+	if (size >= TLV_TRAILER_BLOOM_FILTER_SIZE) {
+		//Bloom filters follow block index and zone maps
+		memcpy(&trailer.bloom_filter_offset, data + 28, sizeof(trailer.bloom_filter_offset));
+		if (trailer.bloom_filter_offset && (trailer.bloom_filter_offset < std::max(trailer.block_index_offset, trailer.zone_map_offset) || !trailer.block_index_offset
+											|| trailer.bloom_filter_offset > trailer.trailer_offset))
+			return false;
+	}
+	return trailer.dictionary_offset >= TLV_HEADER_SIZE && trailer.dictionary_offset < trailer.trailer_offset;
+}
+
+void WriteTlvBlockIndex(ByteSink &sink, const std::vector<TlvBlock> &blocks, bool compressed, bool checksums) {
+	const size_t entry_size = (compressed ? TLV_BLOCK_INDEX_COMPRESSED_ENTRY_SIZE : TLV_BLOCK_INDEX_ENTRY_SIZE) + (checksums ? TLV_BLOCK_INDEX_CHECKSUM_SIZE : 0);
+	for (auto& block : blocks) {
+		char* data = sink.Reserve(entry_size);
+		const uint32_t record_count = static_cast<uint32_t>(block.record_count);
+		memcpy(data, &block.first_record, sizeof(block.first_record));
+		memcpy(data + 8, &block.offset, sizeof(block.offset));
+		memcpy(data + 16, &record_count, sizeof(record_count));
+		if (compressed)
+			memcpy(data + 20, &block.raw_offset, sizeof(block.raw_offset));
+		if (checksums)
+			memcpy(data + entry_size - TLV_BLOCK_INDEX_CHECKSUM_SIZE, &block.checksum, sizeof(block.checksum));
+		sink.Commit(entry_size);
+	}
+}
+
+void ReadTlvBlockIndex(ByteSource &source, uint64_t tlv_begin, const TlvTrailer &trailer, std::vector<TlvBlock> &blocks, bool compressed, bool checksums) {
+	blocks.clear();
+	const size_t entry_size = (compressed ? TLV_BLOCK_INDEX_COMPRESSED_ENTRY_SIZE : TLV_BLOCK_INDEX_ENTRY_SIZE) + (checksums ? TLV_BLOCK_INDEX_CHECKSUM_SIZE : 0);
+	const uint64_t end = trailer.zone_map_offset ? trailer.zone_map_offset : (trailer.bloom_filter_offset ? trailer.bloom_filter_offset : trailer.trailer_offset);
+	const uint64_t size = end - trailer.block_index_offset;
+	if (!trailer.block_index_offset || size % entry_size)
+		throw TlvInvalidFormatError();
+	source.Seek(tlv_begin + trailer.block_index_offset);
+	for (uint64_t i = 0; i < size / entry_size; ++i) {
+		const char* data;
+		if (source.Peek(data, entry_size) < entry_size)
+			throw TlvInvalidFormatError();
+		TlvBlock block;
+		uint32_t record_count;
+		memcpy(&block.first_record, data, sizeof(block.first_record));
+		memcpy(&block.offset, data + 8, sizeof(block.offset));
+		memcpy(&record_count, data + 16, sizeof(record_count));
+		block.record_count = record_count;
+		block.raw_offset = block.offset;
+		if (compressed)
+			memcpy(&block.raw_offset, data + 20, sizeof(block.raw_offset));
+		if (checksums)
+			memcpy(&block.checksum, data + entry_size - TLV_BLOCK_INDEX_CHECKSUM_SIZE, sizeof(block.checksum));
+		source.Consume(entry_size);
+		//blocks follow each other without gaps in numbers of records; compressed blocks follow each other without gaps in
+		//uncompressed data too, so the first of them begins after the header
+		const uint64_t first_record = blocks.empty() ? 0 : blocks.back().first_record + blocks.back().record_count;
+		const uint64_t min_offset = blocks.empty() ? TLV_HEADER_SIZE : blocks.back().offset + 1;
+		const uint64_t min_raw_offset = blocks.empty() ? TLV_HEADER_SIZE : blocks.back().raw_offset + 1;
+		if (block.first_record != first_record || block.offset < min_offset || block.offset >= trailer.dictionary_offset
+				|| block.raw_offset < min_raw_offset || (compressed && blocks.empty() && block.raw_offset != TLV_HEADER_SIZE))
+			throw TlvInvalidFormatError();
+		blocks.push_back(block);
+	}
+}
+
+void VerifyTlvBlock(const char* data, size_t size, const TlvBlock &block, size_t number) {
+	if (simd::Crc32c(data, size) != block.checksum)
+		throw app_err::JsonPackerError("Checksum mismatch in block " + std::to_string(number) + " of TLV data");
+}
+
+namespace {
+
+/**
+ * @brief VerifyStoredBlock reads the whole block and verifies its checksum; input is positioned at the begining of the block
+ * @param input[in] the input
+ * @param blocks[in] the blocks of TLV data (offsets are positions in input)
+ * @param index[in] the index of the block
+ * @param data_end[in] the position of the end of the last block in input
+ * @throw TlvInvalidFormatError if the block can not be read
+ * @throw app_err::JsonPackerError if checksum does not match
+ */
+void VerifyStoredBlock(ByteSource& input, const std::vector<TlvBlock>& blocks, size_t index, uint64_t data_end) {
+	const uint64_t begin = blocks[index].offset;
+	const uint64_t end = index + 1 < blocks.size() ? blocks[index + 1].offset : data_end;
+	const char* data;
+	input.Seek(begin);
+	if (end < begin || input.Peek(data, static_cast<size_t>(end - begin)) < end - begin)
+		throw TlvInvalidFormatError();
+	VerifyTlvBlock(data, static_cast<size_t>(end - begin), blocks[index], index);
+}
+
+} // end of anonymous namespace
+
+TlvBlockSource::TlvBlockSource(ByteSource &source, uint64_t tlv_begin, const std::vector<TlvBlock> &blocks, uint64_t data_end, unsigned int threads, bool checksums)
+	: m_source(source)
+	, m_blocks(blocks)
+	, m_data_end(data_end)
+	, m_raw_end(tlv_begin + TLV_HEADER_SIZE)
+	, m_threads(std::max(threads, 1u))
+	, m_checksums(checksums)
+{
+	for (auto& block : m_blocks) {
+		block.offset += tlv_begin;
+		block.raw_offset += tlv_begin;
+	}
+	//the size of uncompressed data of the last block is known only from its header
+	if (!m_blocks.empty()) {
+		const char* data;
+		uint32_t raw_size;
+		m_source.Seek(m_blocks.back().offset);
+		if (m_blocks.back().offset >= m_data_end || m_source.Peek(data, TLV_FRAME_HEADER_SIZE) < TLV_FRAME_HEADER_SIZE)
+			throw TlvInvalidFormatError();
+		memcpy(&raw_size, data + 1, sizeof(raw_size));
+		m_raw_end = m_blocks.back().raw_offset + raw_size;
+	}
+	SetData(nullptr, 0, tlv_begin + TLV_HEADER_SIZE);
+}
+
+uint64_t TlvBlockSource::Size() {
+	return m_raw_end;
+}
+
+void TlvBlockSource::Fill(size_t size) {
+	using jsonpacker_compression::BlockCodec;
+	using jsonpacker_compression::BlockCodecId;
+	//unconsumed data is moved to the begining of buffer and the following blocks are decompressed after it;
+	//buffered data always ends at the begining of the next block
+	const size_t unconsumed = static_cast<size_t>(m_end - m_next);
+	const uint64_t position = Position();
+	if (unconsumed && m_next != m_buffer.data())
+		memmove(m_buffer.data(), m_next, unconsumed);
+	const size_t first = m_next_block;
+	size_t filled = unconsumed;
+	while (m_next_block < m_blocks.size() && (filled < size || m_next_block - first < m_threads))
+		filled += static_cast<size_t>(RawSize(m_next_block++));
+	if (m_buffer.size() < filled)
+		m_buffer.resize(filled);
+	if (m_next_block == first) {
+		SetData(m_buffer.data(), filled, position);
+		return;
+	}
+
+	//compressed blocks follow each other, so all of them are read at once
+	const uint64_t begin = m_blocks[first].offset;
+	const uint64_t end = m_next_block < m_blocks.size() ? m_blocks[m_next_block].offset : m_data_end;
+	const char* data;
+	m_source.Seek(begin);
+	if (end < begin || m_source.Peek(data, static_cast<size_t>(end - begin)) < end - begin)
+		throw TlvInvalidFormatError();
+	std::vector<const BlockCodec*> codecs(m_next_block - first);
+	for (size_t i = first; i < m_next_block; ++i) {
+		const char* frame = data + (m_blocks[i].offset - begin);
+		const uint64_t frame_end = i + 1 < m_blocks.size() ? m_blocks[i + 1].offset : m_data_end;
+		uint32_t raw_size, stored_size;
+		memcpy(&raw_size, frame + 1, sizeof(raw_size));
+		memcpy(&stored_size, frame + 5, sizeof(stored_size));
+		if (frame_end - m_blocks[i].offset < TLV_FRAME_HEADER_SIZE || frame_end - m_blocks[i].offset - TLV_FRAME_HEADER_SIZE != stored_size || raw_size != RawSize(i))
+			throw TlvInvalidFormatError();
+		const size_t codec_id = static_cast<unsigned char>(frame[0]);
+		if (m_codecs.size() <= codec_id)
+			m_codecs.resize(codec_id + 1);
+		if (!m_codecs[codec_id])
+			m_codecs[codec_id] = jsonpacker_compression::GetCodec(static_cast<BlockCodecId>(codec_id));
+		codecs[i - first] = m_codecs[codec_id].get();
+	}
+	char* const raw_data = m_buffer.data() + unconsumed;
+	util::ParallelFor(m_next_block - first, m_threads, [&](size_t index) {
+		const TlvBlock& block = m_blocks[first + index];
+		const char* frame = data + (block.offset - begin);
+		uint32_t stored_size;
+		memcpy(&stored_size, frame + 5, sizeof(stored_size));
+		//the frame is verified as it is stored
+		if (m_checksums)
+			VerifyTlvBlock(frame, TLV_FRAME_HEADER_SIZE + stored_size, block, first + index);
+		if (!codecs[index]->Decompress(frame + TLV_FRAME_HEADER_SIZE, stored_size, raw_data + (block.raw_offset - m_blocks[first].raw_offset), static_cast<size_t>(RawSize(first + index))))
+			throw TlvInvalidFormatError();
+	});
+	m_source.Consume(static_cast<size_t>(end - begin));
+	SetData(m_buffer.data(), filled, position);
+}
+
+uint64_t TlvBlockSource::SkipBlocks(uint64_t size) {
+	//the data before the position is consumed already
+	const uint64_t begin = m_position;
+	const uint64_t position = begin + std::min(size, m_raw_end > begin ? m_raw_end - begin : 0);
+	SeekBlocks(position);
+	return position - begin;
+}
+
+void TlvBlockSource::SeekBlocks(uint64_t position) {
+	if (m_blocks.empty() || position >= m_raw_end) {
+		m_next_block = m_blocks.size();
+		SetData(nullptr, 0, position);
+		return;
+	}
+	auto block = std::upper_bound(m_blocks.begin(), m_blocks.end(), position, [](uint64_t raw_offset, const TlvBlock& block) {
+		return raw_offset < block.raw_offset;
+	});
+	if (block == m_blocks.begin())
+		throw app_err::JsonPackerError("Unable to seek before the begining of compressed data");
+	--block;
+	//the block containing the position is decompressed and the data preceding the position is consumed
+	m_next_block = static_cast<size_t>(block - m_blocks.begin());
+	SetData(m_buffer.data(), 0, block->raw_offset);
+	const size_t offset = static_cast<size_t>(position - block->raw_offset);
+	if (offset) {
+		const char* data;
+		Peek(data, offset);
+		Consume(offset);
+	}
+}
+
+size_t EncodeVarint(uint64_t value, char *buffer) {
+	size_t size = 0;
+	while (value >= 0x80) {
+		buffer[size++] = static_cast<char>((value & 0x7f) | 0x80);
+		value >>= 7;
+	}
+	buffer[size++] = static_cast<char>(value);
+	return size;
+}
+
+uint64_t ReadVarint(std::istream &is) {
+	uint64_t value = 0;
+	for (int shift = 0; shift < 64; shift += 7) {
+		const int byte = is.get();
+		if (byte == std::char_traits<char>::eof())
+			throw TlvInvalidFormatError();
+		value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+		if (!(byte & 0x80))
+			return value;
+	}
+	throw TlvInvalidFormatError();
+}
+
+size_t ParseTlv(const char *data, size_t size, TlvFormat format, TlvRecordView &record) {
+	using RecType = TlvRecord<std::streamsize>;
+	if (!size)
+		return 0;
+	const auto type = static_cast<RecType::TlvRecordType>(data[0]);
+	size_t header_size = 1;
+	std::streamsize data_size;
+	if (format == TlvFormat::v1) {
+		if (size < header_size + sizeof(data_size)) {
+			record = TlvRecordView(type, nullptr, 0, 0);
+			return 0;
+		}
+		memcpy(&data_size, data + header_size, sizeof(data_size));
+		header_size += sizeof(data_size);
+	} else {
+		data_size = RecType::FixedDataSize(type);
+		if (data_size < 0) {
+			uint64_t length;
+			const size_t length_size = DecodeVarint(data + header_size, size - header_size, length);
+			if (!length_size) {
+				record = TlvRecordView(type, nullptr, 0, 0);
+				return 0;
+			}
+			data_size = static_cast<std::streamsize>(length);
+			header_size += length_size;
+		}
+	}
+	if (data_size < 0 || static_cast<uint64_t>(data_size) > std::numeric_limits<size_t>::max() - header_size)
+		throw TlvInvalidFormatError();
+	const size_t record_size = header_size + static_cast<size_t>(data_size);
+	record = TlvRecordView(type, data + header_size, static_cast<size_t>(data_size), record_size);
+	return size < record_size ? 0 : record_size;
+}
+
+size_t DecodeVarint(const char *data, size_t size, uint64_t &value) {
+	value = 0;
+	for (size_t i = 0; i < size; ++i) {
+		if (i == 10)
+			throw TlvInvalidFormatError();
+		const unsigned char byte = static_cast<unsigned char>(data[i]);
+		value |= static_cast<uint64_t>(byte & 0x7f) << (7 * i);
+		if (!(byte & 0x80))
+			return i + 1;
+	}
+	return 0;
+}
+
+void *JsonParseArena::CountingAllocator::Malloc(size_t size) {
+	if (!size)
+		return nullptr;
+	++m_allocations;
+	return std::malloc(size);
+}
+
+void *JsonParseArena::CountingAllocator::Realloc(void *original_ptr, size_t original_size, size_t new_size) {
+	(void)original_size;
+	if (!new_size) {
+		std::free(original_ptr);
+		return nullptr;
+	}
+	++m_allocations;
+	return std::realloc(original_ptr, new_size);
+}
+
+void JsonParseArena::CountingAllocator::Free(void *ptr) {
+	std::free(ptr);
+}
+
+JsonParseArena::JsonParseArena() {
+	Reset();
+}
+
+void JsonParseArena::Reset() {
+	if (m_pool && m_pool->Capacity() <= m_arena.size()) {
+		m_pool->Clear();
+		return;
+	}
+	//the pool has overflowed (or is not created yet): enlarge the arena to hold all memory used by the last record
+	const size_t arena_size = m_pool ? std::max(m_arena.size() * 2, m_pool->Capacity() * 2) : 64 * 1024;
+	m_document.reset();
+	m_pool.reset();
+	m_arena.clear();
+	m_arena.shrink_to_fit();
+	++m_base_allocator.m_allocations;
+	m_arena.resize(arena_size);
+	m_pool.reset(new PoolAllocator(m_arena.data(), m_arena.size(), 64 * 1024, &m_base_allocator));
+	m_document.reset(new Document(m_pool.get(), 1024, m_pool.get()));
+}
+
+JsonParseArena::Document &JsonParseArena::Parse(const char *data, size_t length) {
+	Reset();
+	m_document->ParseInsitu(MutableCopy(data, length));
+	return *m_document;
+}
+
+char *JsonParseArena::MutableCopy(const char *data, size_t length) {
+	if (m_record.capacity() < length + 1)
+		++m_base_allocator.m_allocations;
+	m_record.assign(data, data + length);
+	m_record.push_back(0);
+	return m_record.data();
+}
+
+namespace {
+
+/**
+ * @brief WriteKeyDefinition writes rtKeyDefinition record
+ */
+void WriteKeyDefinition(ByteSink& os, int key_index, const char* key, size_t length, TlvFormat format) {
+	const auto size = static_cast<std::streamsize>(sizeof(key_index) + length);
+	char* const begin = os.Reserve(TLV_MAX_RECORD_HEADER_SIZE + static_cast<size_t>(size));
+	char* next = begin;
+	*next++ = static_cast<char>(TlvRecord<std::streamsize>::TlvRecordType::rtKeyDefinition);
+	if (format == TlvFormat::v1) {
+		memcpy(next, &size, sizeof(size));
+		next += sizeof(size);
+	} else
+		next += EncodeVarint(static_cast<uint64_t>(size), next);
+	memcpy(next, &key_index, sizeof(key_index));
+	memcpy(next + sizeof(key_index), key, length);
+	os.Commit(static_cast<size_t>(next - begin) + static_cast<size_t>(size));
+}
+
+/**
+ * @brief WriteShapeDefinition writes rtShapeDefinition record
+ */
+void WriteShapeDefinition(ByteSink& os, int shape_index, const std::vector<int>& keys, TlvFormat format) {
+	const auto size = static_cast<std::streamsize>(sizeof(shape_index) + keys.size() * sizeof(int));
+	char* const begin = os.Reserve(TLV_MAX_RECORD_HEADER_SIZE + static_cast<size_t>(size));
+	char* next = begin;
+	*next++ = static_cast<char>(TlvRecord<std::streamsize>::TlvRecordType::rtShapeDefinition);
+	if (format == TlvFormat::v1) {
+		memcpy(next, &size, sizeof(size));
+		next += sizeof(size);
+	} else
+		next += EncodeVarint(static_cast<uint64_t>(size), next);
+	memcpy(next, &shape_index, sizeof(shape_index));
+	if (!keys.empty())
+		memcpy(next + sizeof(shape_index), keys.data(), keys.size() * sizeof(int));
+	os.Commit(static_cast<size_t>(next - begin) + static_cast<size_t>(size));
+}
+
+/**
+ * @brief WriteValueDefinition writes rtValueDefinition record
+ */
+void WriteValueDefinition(ByteSink& os, int key_index, int code, const char* value, size_t length, TlvFormat format) {
+	const uint16_t value_code = static_cast<uint16_t>(code);
+	const auto size = static_cast<std::streamsize>(sizeof(key_index) + sizeof(value_code) + length);
+	char* const begin = os.Reserve(TLV_MAX_RECORD_HEADER_SIZE + static_cast<size_t>(size));
+	char* next = begin;
+	*next++ = static_cast<char>(TlvRecord<std::streamsize>::TlvRecordType::rtValueDefinition);
+	if (format == TlvFormat::v1) {
+		memcpy(next, &size, sizeof(size));
+		next += sizeof(size);
+	} else
+		next += EncodeVarint(static_cast<uint64_t>(size), next);
+	memcpy(next, &key_index, sizeof(key_index));
+	memcpy(next + sizeof(key_index), &value_code, sizeof(value_code));
+	memcpy(next + sizeof(key_index) + sizeof(value_code), value, length);
+	os.Commit(static_cast<size_t>(next - begin) + static_cast<size_t>(size));
+}
+
+/**
+ * @brief WriteStringRef writes rtStringRef record preceded by rtValueDefinition record if the value is defined
+ */
+void WriteStringRef(ByteSink& os, int key_index, int code, const char* value, size_t length, bool define, TlvFormat format) {
+	if (define)
+		WriteValueDefinition(os, key_index, code, value, length, format);
+	const uint16_t value_code = static_cast<uint16_t>(code);
+	TlvRecord<std::streamsize> record(TlvRecord<std::streamsize>::TlvRecordType::rtStringRef, reinterpret_cast<const char*>(&value_code), sizeof(value_code));
+	WriteTlv(os, record, format);
+}
+
+/**
+ * @brief KeyRecordHeaderSize returns the size of type and length of the record holding key index or shape index
+ */
+size_t KeyRecordHeaderSize(TlvFormat format) {
+	return format == TlvFormat::v1 ? 1 + sizeof(std::streamsize) : 1;
+}
+
+} // end of anonymous namespace
+
+/**
+ * @brief The EncodedChunk struct holds the result of converting one newline-aligned chunk of input data
+ */
+struct JsonToTlv::EncodedChunk {
+	const char* begin {nullptr};/// the begining of chunk data
+	const char* end {nullptr};/// the end of chunk data
+	StringByteSink buffer;/// TLV data with key indexes local to the chunk
+	ByteSink* output {&buffer};/// the output receiving TLV data
+	JsonKeyDictionary local_dictionary;/// the dictionary local to the chunk
+	JsonKeyDictionary* dictionary {&local_dictionary};/// the dictionary used to obtain key indexes
+	bool define_keys {false};/// write rtKeyDefinition (rtShapeDefinition) record before the first use of every key (shape) added to dictionary
+	std::vector<uint64_t> key_offsets;/// positions of key indexes in buffer
+	JsonShapeDictionary local_shapes;/// the dictionary of shapes local to the chunk (shapes consist of local key indexes)
+	JsonShapeDictionary* shapes {&local_shapes};/// the dictionary used to obtain shape indexes
+	std::vector<uint64_t> shape_offsets;/// positions of shape indexes in buffer
+	std::vector<int> record_keys;/// the key indexes of members of the record (reused between records)
+	JsonValueDictionary* values {nullptr};/// dictionaries encoding string values (nullptr if strings are encoded when the chunk is written)
+	std::vector<std::pair<uint64_t, int>> string_offsets;/// positions of string values in buffer and local indexes of their keys
+	std::string definitions;/// the buffer reused to build key definitions of one record
+	std::vector<uint64_t> record_offsets;/// positions of records in output (collected when block index is built)
+	int line_count {0};/// count of lines processed in the chunk
+	rapidjson::ParseResult parse_result;/// the result of parsing the last processed line
+	std::string error_line;/// the line containing parse error
+	JsonParseArena* arena {nullptr};/// the arena used to parse records
+	TlvRecord<std::streamsize> record;/// the record reused to write TLV data
+	std::string record_buffer;/// the buffer reused to build TLV data of one record
+};
+
+rapidjson::ParseResult JsonToTlv::EncodeLine(const char *line, size_t length, EncodedChunk &chunk) {
+	using TlvType = TlvRecord<std::streamsize>::TlvRecordType;
+	auto& record = chunk.record;
+	ByteSink& os = *chunk.output;
+
+	auto& json_doc = chunk.arena->Parse(line, length);
+	if (json_doc.HasParseError())
+		return json_doc;
+
+	const TlvFormat format = m_options.format;
+	//string values are encoded by dictionaries here or when the chunk is written (@see WriteChunk)
+	auto write_value = [&](int key_index, const JsonParseArena::Document::ValueType& value) {
+		if (m_options.string_dictionary && value.IsString()) {
+			if (chunk.values) {
+				bool added;
+				const int code = chunk.values->Encode(static_cast<size_t>(key_index), value.GetString(), value.GetStringLength(), m_options.string_dictionary, added);
+				if (code >= 0) {
+					WriteStringRef(os, key_index, code, value.GetString(), value.GetStringLength(), added && chunk.define_keys, format);
+					return;
+				}
+			} else
+				chunk.string_offsets.emplace_back(os.Position(), key_index);
+		}
+		WriteTlv(os, record(value), format);
+	};
+	if (m_options.shapes) {
+		//keys are defined before the shape, the shape - before its first use
+		chunk.record_keys.clear();
+		for (auto it = json_doc.MemberBegin(); it != json_doc.MemberEnd(); ++it) {
+			const size_t key_count = chunk.dictionary->Entries().size();
+			chunk.record_keys.push_back(chunk.dictionary->AddKeyString(it->name.GetString(), it->name.GetStringLength()));
+			if (chunk.define_keys && chunk.dictionary->Entries().size() != key_count)
+				WriteKeyDefinition(os, chunk.record_keys.back(), it->name.GetString(), it->name.GetStringLength(), format);
+		}
+		WriteShape(chunk);
+		size_t member = 0;
+		for (auto it = json_doc.MemberBegin(); it != json_doc.MemberEnd(); ++it)
+			write_value(chunk.record_keys[member++], it->value);
+		return json_doc;
+	}
+	auto count = json_doc.MemberCount();
+	WriteTlv(os, record(TlvType::rtMemberCount, reinterpret_cast<const char*>(&count), sizeof(count)), format);
+	for (auto it = json_doc.MemberBegin(); it != json_doc.MemberEnd(); ++it) {
+		const size_t key_count = chunk.dictionary->Entries().size();
+		const int key_index = chunk.dictionary->AddKeyString(it->name.GetString(), it->name.GetStringLength());
+		if (chunk.define_keys && chunk.dictionary->Entries().size() != key_count)
+			WriteKeyDefinition(os, key_index, it->name.GetString(), it->name.GetStringLength(), format);
+		WriteTlv(os, record(TlvType::rtInt, reinterpret_cast<const char*>(&key_index), sizeof(key_index)), format);
+		if (chunk.dictionary == &chunk.local_dictionary)
+			chunk.key_offsets.push_back(os.Position() - sizeof(key_index));
+		write_value(key_index, it->value);
+	}
+	return json_doc;
+}
+
+void JsonToTlv::WriteShape(EncodedChunk &chunk) {
+	using TlvType = TlvRecord<std::streamsize>::TlvRecordType;
+	ByteSink& os = *chunk.output;
+	const size_t shape_count = chunk.shapes->Size();
+	const int shape_index = chunk.shapes->AddShape(chunk.record_keys);
+	if (chunk.define_keys && chunk.shapes->Size() != shape_count)
+		WriteShapeDefinition(os, shape_index, chunk.record_keys, m_options.format);
+	WriteTlv(os, chunk.record(TlvType::rtShape, reinterpret_cast<const char*>(&shape_index), sizeof(shape_index)), m_options.format);
+	if (chunk.shapes == &chunk.local_shapes)
+		chunk.shape_offsets.push_back(os.Position() - sizeof(shape_index));
+}
+
+void JsonToTlv::EncodeChunk(EncodedChunk &chunk) {
+	const char* line = chunk.begin;
+	while (line < chunk.end) {
+		const char* line_end = simd::FindByte(line, chunk.end, '\n');
+		++chunk.line_count;
+		const size_t length = static_cast<size_t>(line_end - line);
+		if (m_index_blocks)
+			chunk.record_offsets.push_back(chunk.output->Position());
+		chunk.parse_result = EncodeLine(line, length, chunk);
+		if (!chunk.parse_result) {
+			chunk.error_line.assign(line, length);
+			return;
+		}
+		line = line_end + 1;
+	}
+}
+
+void JsonToTlv::EncodeBatch(const char *data, size_t size, int &line_number, ByteSink &output) {
+	const size_t threads = std::max(m_options.threads, 1u);
+	const char* const data_end = data + size;
+
+	//split batch into newline-aligned chunks
+	std::vector<EncodedChunk> chunks(threads);
+	const char* chunk_begin = data;
+	for (size_t i = 0; i < threads; ++i) {
+		const char* chunk_end = data_end;
+		if (i + 1 < threads) {
+			chunk_end = std::max(chunk_begin, data + size * (i + 1) / threads);
+			if (chunk_end != chunk_begin) {
+				chunk_end = simd::FindByte(chunk_end - 1, data_end, '\n');
+				if (chunk_end != data_end)
+					++chunk_end;
+			}
+		}
+		chunks[i].begin = chunk_begin;
+		chunks[i].end = chunk_end;
+		chunk_begin = chunk_end;
+	}
+
+	//in single-threaded mode data is written directly into output stream
+	if (threads == 1) {
+		chunks.front().output = &output;
+		chunks.front().dictionary = m_dictionary.get();
+		chunks.front().shapes = m_shapes.get();
+		chunks.front().values = &m_values;
+		chunks.front().define_keys = m_options.inline_keys;
+	}
+	while (m_arenas.size() < threads)
+		m_arenas.emplace_back(new JsonParseArena());
+	for (size_t i = 0; i < threads; ++i)
+		chunks[i].arena = m_arenas[i].get();
+
+	util::ParallelFor(chunks.size(), threads, [this, &chunks](size_t index) {
+		EncodeChunk(chunks[index]);
+	});
+
+	//write chunks in input order (@see WriteChunk)
+	for (auto& chunk : chunks) {
+		if (chunk.dictionary == &chunk.local_dictionary)
+			WriteChunk(chunk, output);
+		else {
+			for (auto offset : chunk.record_offsets)
+				IndexRecord(offset - m_tlv_begin);
+		}
+
+		if (!chunk.parse_result) {
+			rapidjson::ParseErrorCode code = chunk.parse_result.Code();
+			throw JsonParseError(code, line_number + chunk.line_count, chunk.parse_result.Offset(), chunk.error_line, rapidjson::GetParseError_En(code));
+		}
+		line_number += chunk.line_count;
+		m_stats.records += static_cast<uint64_t>(chunk.line_count);
+	}
+	m_stats.parser_heap_allocations = 0;
+	for (auto& arena : m_arenas)
+		m_stats.parser_heap_allocations += arena->HeapAllocations();
+}
+
+void JsonToTlv::WriteChunk(EncodedChunk &chunk, ByteSink &output) {
+	const TlvFormat format = m_options.format;
+	//local indexes are given in order of first appearance of keys (shapes), so adding local keys (shapes)
+	//to the global dictionary in order of their indexes gives the same result as sequential processing
+	const auto& local_keys = chunk.local_dictionary.Entries();
+	std::vector<int> index_map(local_keys.size() + 1);
+	std::vector<bool> undefined(local_keys.size() + 1);
+	for (auto& key : local_keys) {
+		const size_t key_count = m_dictionary->Entries().size();
+		index_map[static_cast<size_t>(key.index)] = m_dictionary->AddKeyString(key.data, key.length);
+		undefined[static_cast<size_t>(key.index)] = m_options.inline_keys && m_dictionary->Entries().size() != key_count;
+	}
+	std::vector<int> shape_map(chunk.local_shapes.Size());
+	std::vector<bool> undefined_shapes(chunk.local_shapes.Size());
+	std::vector<int> keys;
+	for (size_t i = 0; i < shape_map.size(); ++i) {
+		keys.clear();
+		for (auto key : chunk.local_shapes.GetShape(static_cast<int>(i)))
+			keys.push_back(index_map[static_cast<size_t>(key)]);
+		const size_t shape_count = m_shapes->Size();
+		shape_map[i] = m_shapes->AddShape(keys);
+		undefined_shapes[i] = m_options.inline_keys && m_shapes->Size() != shape_count;
+	}
+
+	//data is written up to the position of the next change, the records beginning in written data are added to block index
+	std::string& tlv_data = chunk.buffer.Data();
+	size_t written = 0;
+	size_t next_record = 0;
+	auto write_to = [&](size_t position) {
+		for (; next_record < chunk.record_offsets.size() && chunk.record_offsets[next_record] <= position; ++next_record)
+			IndexRecord(output.Position() + (chunk.record_offsets[next_record] - written) - m_tlv_begin);
+		output.Write(tlv_data.data() + written, position - written);
+		written = position;
+	};
+	auto define_key = [&](size_t local_index) {
+		if (undefined[local_index]) {
+			const int key_index = index_map[local_index];
+			const auto& key = m_dictionary->GetKey(key_index);
+			WriteKeyDefinition(output, key_index, key.data, key.length, format);
+			undefined[local_index] = false;
+		}
+	};
+	//the definitions of new keys and shapes are inserted before the records of their first use
+	auto replace_index = [&](uint64_t offset) {
+		int index;
+		memcpy(&index, &tlv_data[static_cast<size_t>(offset)], sizeof(index));
+		const size_t local_index = static_cast<size_t>(index);
+		index = m_options.shapes ? shape_map[local_index] : index_map[local_index];
+		memcpy(&tlv_data[static_cast<size_t>(offset)], &index, sizeof(index));
+		if (m_options.shapes ? undefined_shapes[local_index] : undefined[local_index]) {
+			write_to(static_cast<size_t>(offset) - KeyRecordHeaderSize(format));
+			if (m_options.shapes) {
+				for (auto local_key : chunk.local_shapes.GetShape(static_cast<int>(local_index)))
+					define_key(static_cast<size_t>(local_key));
+				WriteShapeDefinition(output, index, m_shapes->GetShape(index), format);
+				undefined_shapes[local_index] = false;
+			} else
+				define_key(local_index);
+		}
+	};
+	//string values found in dictionaries replace the strings
+	auto encode_string = [&](const std::pair<uint64_t, int>& string) {
+		const size_t offset = static_cast<size_t>(string.first);
+		const int key_index = index_map[static_cast<size_t>(string.second)];
+		TlvRecordView value;
+		if (!ParseTlv(tlv_data.data() + offset, tlv_data.size() - offset, format, value))
+			throw TlvInvalidFormatError();
+		bool added;
+		const int code = m_values.Encode(static_cast<size_t>(key_index), value.Data(), value.DataSize(), m_options.string_dictionary, added);
+		if (code < 0)
+			return;
+		write_to(offset);
+		WriteStringRef(output, key_index, code, value.Data(), value.DataSize(), added && m_options.inline_keys, format);
+		written = offset + value.RecordSize();
+	};
+
+	const auto& index_offsets = m_options.shapes ? chunk.shape_offsets : chunk.key_offsets;
+	auto string = chunk.string_offsets.begin();
+	for (auto offset : index_offsets) {
+		for (; string != chunk.string_offsets.end() && string->first < offset; ++string)
+			encode_string(*string);
+		replace_index(offset);
+	}
+	for (; string != chunk.string_offsets.end(); ++string)
+		encode_string(*string);
+	write_to(tlv_data.size());
+}
+
+void JsonToTlv::IndexRecord(uint64_t offset) {
+	if (m_blocks.empty() || m_blocks.back().record_count >= m_options.block_records || offset - m_blocks.back().offset >= m_options.block_size) {
+		TlvBlock block;
+		if (!m_blocks.empty())
+			block.first_record = m_blocks.back().first_record + m_blocks.back().record_count;
+		block.offset = block.raw_offset = offset;
+		m_blocks.push_back(block);
+	}
+	++m_blocks.back().record_count;
+}
+
+namespace {
+
+/**
+ * @brief EncodeFrame compresses the block into frame (@see TlvBlockSource); the block is stored without compression
+ * if it is small or compression does not reduce its size
+ * @param codec[in] the codec compressing blocks
+ * @param data[in] pointer to uncompressed data of the block
+ * @param size[in] size of uncompressed data
+ * @param frame[out] receives the frame
+ */
+void EncodeFrame(const jsonpacker_compression::BlockCodec& codec, const char* data, size_t size, std::string& frame) {
+	using jsonpacker_compression::BlockCodecId;
+	if (size > std::numeric_limits<uint32_t>::max())
+		throw app_err::JsonPackerError("The block of TLV data is too large to be compressed");
+	BlockCodecId codec_id = BlockCodecId::stored;
+	size_t stored_size = size;
+	if (size >= TLV_MIN_COMPRESSED_BLOCK_SIZE && codec.Id() != BlockCodecId::stored) {
+		const size_t capacity = codec.MaxCompressedSize(size);
+		frame.resize(TLV_FRAME_HEADER_SIZE + capacity);
+		stored_size = codec.Compress(data, size, &frame[TLV_FRAME_HEADER_SIZE], capacity);
+		codec_id = codec.Id();
+	}
+	if (codec_id == BlockCodecId::stored || stored_size >= size) {
+		codec_id = BlockCodecId::stored;
+		stored_size = size;
+		frame.resize(TLV_FRAME_HEADER_SIZE + size);
+		memcpy(&frame[TLV_FRAME_HEADER_SIZE], data, size);
+	}
+	frame.resize(TLV_FRAME_HEADER_SIZE + stored_size);
+	const uint32_t raw_size32 = static_cast<uint32_t>(size);
+	const uint32_t stored_size32 = static_cast<uint32_t>(stored_size);
+	frame[0] = static_cast<char>(codec_id);
+	memcpy(&frame[1], &raw_size32, sizeof(raw_size32));
+	memcpy(&frame[5], &stored_size32, sizeof(stored_size32));
+}
+
+} // end of anonymous namespace
+
+void JsonToTlv::WriteBlocks(StringByteSink &row_output, ByteSink &output, uint64_t tlv_begin, bool all) {
+	const size_t count = all ? m_blocks.size() : (m_blocks.empty() ? 0 : m_blocks.size() - 1);
+	if (m_written_blocks >= count)
+		return;
+	//row output holds data starting from the first block which is not written yet
+	std::string& row_data = row_output.Data();
+	const uint64_t row_end = row_output.Position();
+	const size_t first = m_written_blocks;
+	const bool columnar = ColumnarLayout();
+	auto block_end = [this, row_end](size_t index) {
+		return index + 1 < m_blocks.size() ? m_blocks[index + 1].offset : row_end;
+	};
+	m_frames.resize(count - first);
+	m_columnar_blocks.resize(count - first);
+	if (m_options.zone_maps)
+		m_zone_maps.resize(count);
+	const std::vector<int> bloom_keys = BloomKeyIndexes();
+	if (!m_options.bloom_keys.empty())
+		m_bloom_filters.resize(count);
+	std::vector<size_t> raw_sizes(count - first);
+	util::ParallelFor(count - first, m_options.threads, [&](size_t index) {
+		const TlvBlock& block = m_blocks[first + index];
+		const char* data = row_data.data() + (block.offset - m_rows_discarded);
+		size_t size = static_cast<size_t>(block_end(first + index) - block.offset);
+		if (m_options.zone_maps)
+			CollectZoneMap(data, size, *m_shapes, m_zone_maps[first + index]);
+		if (!bloom_keys.empty())
+			CollectBloomFilters(data, size, *m_shapes, m_values, bloom_keys, m_bloom_filters[first + index]);
+		if (columnar) {
+			EncodeColumnarBlock(data, size, m_options.integer_codecs, m_options.double_codecs, m_columnar_blocks[index]);
+			data = m_columnar_blocks[index].data();
+			size = m_columnar_blocks[index].size();
+		}
+		raw_sizes[index] = size;
+		if (m_codec) {
+			EncodeFrame(*m_codec, data, size, m_frames[index]);
+			data = m_frames[index].data();
+			size = m_frames[index].size();
+		}
+		if (m_options.checksums)
+			m_blocks[first + index].checksum = simd::Crc32c(data, size);
+		if (!m_codec)
+			m_frames[index].swap(m_columnar_blocks[index]);
+	});
+	const uint64_t written_end = block_end(count - 1);
+	for (size_t i = first; i < count; ++i) {
+		//the blocks which are only checksummed are written from row output as they are
+		const char* data = row_data.data() + (m_blocks[i].offset - m_rows_discarded);
+		if (m_codec || columnar)
+			data = m_frames[i - first].data();
+		m_blocks[i].raw_offset = m_raw_position;
+		m_blocks[i].offset = output.Position() - tlv_begin;
+		m_raw_position += raw_sizes[i - first];
+		output.Write(data, m_codec || columnar ? m_frames[i - first].size() : raw_sizes[i - first]);
+	}
+	row_data.erase(0, static_cast<size_t>(written_end - m_rows_discarded));
+	m_rows_discarded = written_end;
+	m_written_blocks = count;
+}
+
+std::vector<int> JsonToTlv::BloomKeyIndexes() const {
+	std::vector<int> indexes;
+	if (m_options.bloom_keys.empty())
+		return indexes;
+	const auto& keys = m_dictionary->Keys();
+	for (auto& key : m_options.bloom_keys) {
+		auto it = keys.find(key);
+		if (it != keys.end())
+			indexes.push_back(it->second);
+	}
+	std::sort(indexes.begin(), indexes.end());
+	indexes.erase(std::unique(indexes.begin(), indexes.end()), indexes.end());
+	return indexes;
+}
+
+bool JsonToTlv::ColumnarLayout() const {
+	return false;
+}
+
 void JsonToTlv::Run(JsonPackerStream &stream) {
 	using RecType = TlvRecord<std::streamsize>;
 	using TlvType = RecType::TlvRecordType;
 	RecType record;
 
 	m_dictionary->Clear();
-	std::string line;
-	int line_number = 0;
-	while (getline(stream.InputStream(), line)) {
-		++line_number;
-		rapidjson::Document json_doc;
-		rapidjson::ParseResult ok = json_doc.Parse(line.c_str());
-		if (json_doc.HasParseError())
-			throw JsonParseError(json_doc.GetParseError(), line_number, json_doc.GetErrorOffset(), line, rapidjson::GetParseError_En(ok.Code()));
+	m_shapes->Clear();
+	m_stats = JsonPackerStats();
+	std::unique_ptr<ByteSource> input = stream.CreateInput();
+	std::unique_ptr<ByteSink> output = stream.CreateOutput();
+	const uint64_t tlv_begin = output->Position();
+	TlvHeader header;
+	header.format = m_options.format;
+	if (m_options.inline_keys) {
+		//the flags of inline keys are kept in header, so v1 format can not be streamable
+		if (header.format == TlvFormat::v1)
+			throw app_err::JsonPackerError("Streamable TLV data requires format version 2");
+		header.flags |= TLV_FLAG_INLINE_KEYS;
+	} else if (header.format != TlvFormat::v1)
+		header.flags |= TLV_FLAG_TRAILER | TLV_FLAG_BLOCK_INDEX;
+	m_codec.reset();
+	if (!m_options.compression.empty()) {
+		//compressed blocks are located by block index
+		if (!(header.flags & TLV_FLAG_BLOCK_INDEX))
+			throw app_err::JsonPackerError("Compressed TLV data requires format version 2 and can not be streamable");
+		m_codec = jsonpacker_compression::GetCodec(m_options.compression);
+		header.flags |= TLV_FLAG_COMPRESSED;
+	}
+	if (ColumnarLayout()) {
+		//columns are stored by blocks located by block index
+		if (!(header.flags & TLV_FLAG_BLOCK_INDEX))
+			throw app_err::JsonPackerError("Columnar TLV data requires format version 2 and can not be streamable");
+		header.flags |= TLV_FLAG_COLUMNAR;
+	}
+	if (m_options.integer_codecs || m_options.double_codecs) {
+		if (!ColumnarLayout())
+			throw app_err::JsonPackerError("Column codecs require columnar layout");
+		header.flags |= TLV_FLAG_COLUMN_CODECS;
+	}
+	m_values.Clear();
+	if (m_options.string_dictionary) {
+		if (header.format == TlvFormat::v1)
+			throw app_err::JsonPackerError("String dictionaries require format version 2");
+		if (m_options.string_dictionary > TLV_MAX_STRING_DICTIONARY_SIZE)
+			throw app_err::JsonPackerError("The size of string dictionary can not exceed " + std::to_string(TLV_MAX_STRING_DICTIONARY_SIZE));
+		header.flags |= TLV_FLAG_STRING_DICTIONARY;
+	}
+	if (m_options.shapes) {
+		//blocks in columnar layout keep shapes of their own
+		if (header.format == TlvFormat::v1 || ColumnarLayout())
+			throw app_err::JsonPackerError("Shape dictionary requires format version 2 and row-oriented layout");
+		header.flags |= TLV_FLAG_SHAPES;
+	}
+	if (m_options.checksums) {
+		//checksums are kept in block index
+		if (!(header.flags & TLV_FLAG_BLOCK_INDEX))
+			throw app_err::JsonPackerError("Block checksums require format version 2 and can not be streamable");
+		header.ext_flags |= TLV_EXT_FLAG_CHECKSUMS;
+	}
+	//zone maps are paired with entries of block index
+	if (m_options.zone_maps && !(header.flags & TLV_FLAG_BLOCK_INDEX))
+		throw app_err::JsonPackerError("Zone maps require format version 2 and can not be streamable");
+	if (!m_options.bloom_keys.empty() && !(header.flags & TLV_FLAG_BLOCK_INDEX))
+		throw app_err::JsonPackerError("Bloom filters require format version 2 and can not be streamable");
+	m_zone_maps.clear();
+	m_bloom_filters.clear();
+	WriteTlvHeader(*output, header);
+	m_tlv_begin = tlv_begin;
+	m_index_blocks = (header.flags & TLV_FLAG_BLOCK_INDEX) != 0;
+	m_blocks.clear();
 
+	//if blocks are converted (compressed or written in columnar layout), checksummed or summarized by zone maps or Bloom filters, records are written into row output (beginning with
+	//the copy of header, so block offsets are the same as in row-oriented data), and complete blocks are moved from it into output
+	//by every batch
+	std::unique_ptr<StringByteSink> row_output;
+	ByteSink* tlv_output = output.get();
+	if ((header.flags & (TLV_FLAG_COMPRESSED | TLV_FLAG_COLUMNAR)) || (header.ext_flags & TLV_EXT_FLAG_CHECKSUMS) || m_options.zone_maps || !m_options.bloom_keys.empty()) {
+		row_output.reset(new StringByteSink());
+		WriteTlvHeader(*row_output, header);
+		tlv_output = row_output.get();
+		m_tlv_begin = 0;
+		m_written_blocks = 0;
+		m_rows_discarded = 0;
+		m_raw_position = TLV_HEADER_SIZE;
+	}
+	const size_t batch_size = std::max(m_options.threads, 1u) * std::max<size_t>(m_options.chunk_size, 1);
+	int line_number = 0;
 
-		auto count = json_doc.MemberCount();
-		stream.OutputStream() << record(TlvType::rtMemberCount, reinterpret_cast<const char*>(&count), sizeof(count));
-		for (auto it = json_doc.MemberBegin(); it != json_doc.MemberEnd(); ++it) {
-			const int key_index = m_dictionary->AddKey(it->name.GetString());
-			stream.OutputStream() << record(TlvType::rtInt, reinterpret_cast<const char*>(&key_index), sizeof(key_index));
-			stream.OutputStream() << record(it->value);
+	//the batch is at least batch_size bytes long and ends with complete line; if input data is in memory
+	//(mapped file), records are passed to parser without copying
+	for (;;) {
+		const char* data;
+		size_t required = batch_size;
+		size_t size;
+		for (;;) {
+			const size_t available = input->Peek(data, required);
+			if (available < required) {
+				size = available;
+				break;
+			}
+			const char* line_end = simd::FindByte(data + batch_size - 1, data + available, '\n');
+			if (line_end != data + available) {
+				size = static_cast<size_t>(line_end - data) + 1;
+				break;
+			}
+			required = available + batch_size;
 		}
+		if (!size)
+			break;
+		EncodeBatch(data, size, line_number, *tlv_output);
+		input->Consume(size);
+		if (row_output)
+			WriteBlocks(*row_output, *output, tlv_begin, false);
 	}
+	if (row_output)
+		WriteBlocks(*row_output, *output, tlv_begin, true);
 
-	stream.OutputStream() << record(TlvType::rtDictionary, nullptr, 0);
+	//all keys are defined already
+	if (header.flags & TLV_FLAG_INLINE_KEYS) {
+		output->Flush();
+		return;
+	}
+
+	TlvTrailer trailer;
+	trailer.dictionary_offset = output->Position() - tlv_begin;
+	WriteTlv(*output, record(TlvType::rtDictionary, nullptr, 0), m_options.format);
 	for(auto& key : m_dictionary->Keys()) {
 		const std::string key_name = key.first;
 		const int key_index = key.second;
-		stream.OutputStream() << record(key_name);
-		stream.OutputStream() << record(TlvType::rtInt, reinterpret_cast<const char*>(&key_index), sizeof(key_index));
+		WriteTlv(*output, record(key_name), m_options.format);
+		WriteTlv(*output, record(TlvType::rtInt, reinterpret_cast<const char*>(&key_index), sizeof(key_index)), m_options.format);
+	}
+	for (size_t i = 0; i < m_shapes->Size(); ++i)
+		WriteShapeDefinition(*output, static_cast<int>(i), m_shapes->GetShape(static_cast<int>(i)), m_options.format);
+	for (size_t key = 0; key < m_values.KeyCount(); ++key) {
+		for (size_t code = 0; code < m_values.Size(key); ++code) {
+			const std::string& value = m_values.GetValue(key, static_cast<int>(code));
+			WriteValueDefinition(*output, static_cast<int>(key), static_cast<int>(code), value.data(), value.size(), m_options.format);
+		}
 	}
+	if (header.flags & TLV_FLAG_BLOCK_INDEX) {
+		trailer.block_index_offset = output->Position() - tlv_begin;
+		WriteTlvBlockIndex(*output, m_blocks, m_codec != nullptr, (header.ext_flags & TLV_EXT_FLAG_CHECKSUMS) != 0);
+		if (m_options.zone_maps) {
+			trailer.zone_map_offset = output->Position() - tlv_begin;
+			WriteTlvZoneMaps(*output, m_zone_maps);
+		}
+		if (!m_options.bloom_keys.empty()) {
+			trailer.bloom_filter_offset = output->Position() - tlv_begin;
+			WriteTlvBloomFilters(*output, m_bloom_filters, BloomKeyIndexes());
+		}
+	}
+	if (header.flags & TLV_FLAG_TRAILER)
+		WriteTlvTrailer(*output, trailer);
+	output->Flush();
+}
+
+namespace {
+
+/**
+ * @brief The TlvSaxHandler class is RapidJson SAX handler writing TLV data of JSON record into buffer;
+ * the types of values are chosen in the same way as in TlvRecord::Init for RapidJson DOM values;
+ * if key indexes are collected for the shape of record, only values are written after rtShape placeholder
+ * and key definitions are written into the separate buffer; string values are encoded by dictionaries if they are set
+ */
+class TlvSaxHandler : public rapidjson::BaseReaderHandler<rapidjson::UTF8<>, TlvSaxHandler> {
+public:
+	using TlvType = TlvRecord<std::streamsize>::TlvRecordType;
+
+	TlvSaxHandler(std::string& buffer, TlvFormat format, JsonKeyDictionary& dictionary, std::vector<size_t>* key_positions, bool define_keys,
+				  std::vector<int>* shape_keys = nullptr, std::string* definitions = nullptr)
+		: m_buffer(buffer)
+		, m_format(format)
+		, m_dictionary(dictionary)
+		, m_key_positions(key_positions)
+		, m_define_keys(define_keys)
+		, m_shape_keys(shape_keys)
+		, m_definitions(definitions ? *definitions : buffer)
+	{
+	}
+
+	bool StartObject() {
+		if (m_nested)
+			return false;
+		m_nested = true;
+		const rapidjson::SizeType count = 0;
+		Write(m_shape_keys ? TlvType::rtShape : TlvType::rtMemberCount, &count, sizeof(count));
+		m_count_position = m_buffer.size() - sizeof(count);
+		return true;
+	}
+	bool EndObject(rapidjson::SizeType count) {
+		//member count is known only now, so it is written over the placeholder
+		if (!m_shape_keys)
+			memcpy(&m_buffer[m_count_position], &count, sizeof(count));
+		return true;
+	}
+	bool Key(const char* str, rapidjson::SizeType length, bool) {
+		const size_t key_count = m_dictionary.Entries().size();
+		const int key_index = m_dictionary.AddKeyString(str, length);
+		m_key_index = key_index;
+		if (m_define_keys && m_dictionary.Entries().size() != key_count) {
+			m_definition.assign(reinterpret_cast<const char*>(&key_index), sizeof(key_index));
+			m_definition.append(str, length);
+			Write(m_definitions, TlvType::rtKeyDefinition, m_definition.data(), static_cast<std::streamsize>(m_definition.size()));
+		}
+		if (m_shape_keys) {
+			m_shape_keys->push_back(key_index);
+			return true;
+		}
+		Write(TlvType::rtInt, &key_index, sizeof(key_index));
+		if (m_key_positions)
+			m_key_positions->push_back(m_buffer.size() - sizeof(key_index));
+		return true;
+	}
+	bool Null() {
+		return m_nested && Write(TlvType::rtNull, nullptr, 0);
+	}
+	bool Bool(bool value) {
+		return m_nested && Write(TlvType::rtBool, &value, sizeof(value));
+	}
+	bool Int(int value) {
+		return m_nested && Write(TlvType::rtInt, &value, sizeof(value));
+	}
+	bool Uint(unsigned int value) {
+		if (value <= static_cast<unsigned int>(std::numeric_limits<int>::max()))
+			return Int(static_cast<int>(value));
+		return m_nested && Write(TlvType::rtUInt, &value, sizeof(value));
+	}
+	bool Int64(int64_t value) {
+		return m_nested && Write(TlvType::rtInt64, &value, sizeof(value));
+	}
+	bool Uint64(uint64_t value) {
+		if (value <= static_cast<uint64_t>(std::numeric_limits<int64_t>::max()))
+			return Int64(static_cast<int64_t>(value));
+		return m_nested && Write(TlvType::rtUInt64, &value, sizeof(value));
+	}
+	bool Double(double value) {
+		return m_nested && Write(TlvType::rtDouble, &value, sizeof(value));
+	}
+	bool String(const char* str, rapidjson::SizeType length, bool) {
+		if (!m_nested)
+			return false;
+		if (m_values) {
+			bool added;
+			const int code = m_values->Encode(static_cast<size_t>(m_key_index), str, length, m_max_values, added);
+			if (code >= 0) {
+				const uint16_t value_code = static_cast<uint16_t>(code);
+				if (added && m_define_keys) {
+					m_definition.assign(reinterpret_cast<const char*>(&m_key_index), sizeof(m_key_index));
+					m_definition.append(reinterpret_cast<const char*>(&value_code), sizeof(value_code));
+					m_definition.append(str, length);
+					Write(TlvType::rtValueDefinition, m_definition.data(), static_cast<std::streamsize>(m_definition.size()));
+				}
+				return Write(TlvType::rtStringRef, &value_code, sizeof(value_code));
+			}
+		} else if (m_string_positions)
+			m_string_positions->emplace_back(m_buffer.size(), m_key_index);
+		return Write(TlvType::rtString, str, length);
+	}
+	bool StartArray() {
+		return false;
+	}
+	/**
+	 * @brief CountPosition returns the position of member count (shape index) in buffer
+	 */
+	size_t CountPosition() const {return m_count_position;}
+	/**
+	 * @brief SetStringDictionary sets the dictionaries encoding string values
+	 * @param values[in] the dictionaries encoding string values (nullptr - strings are written as they are)
+	 * @param max_values[in] the maximum count of values of a key
+	 * @param string_positions[in] receives positions of strings in buffer and key indexes if values are not encoded (may be nullptr)
+	 */
+	void SetStringDictionary(JsonValueDictionary* values, size_t max_values, std::vector<std::pair<size_t, int>>* string_positions) {
+		m_values = values;
+		m_max_values = max_values;
+		m_string_positions = string_positions;
+	}
+private:
+	bool Write(TlvType type, const void* data, std::streamsize size) {
+		return Write(m_buffer, type, data, size);
+	}
+	bool Write(std::string& buffer, TlvType type, const void* data, std::streamsize size) {
+		buffer.push_back(static_cast<char>(type));
+		if (m_format == TlvFormat::v1)
+			buffer.append(reinterpret_cast<const char*>(&size), sizeof(size));
+		else if (TlvRecord<std::streamsize>::FixedDataSize(type) < 0) {
+			char length[10];
+			buffer.append(length, EncodeVarint(static_cast<uint64_t>(size), length));
+		}
+		buffer.append(static_cast<const char*>(data), static_cast<size_t>(size));
+		return true;
+	}
+
+	std::string& m_buffer;
+	TlvFormat m_format;
+	JsonKeyDictionary& m_dictionary;
+	std::vector<size_t>* m_key_positions;
+	bool m_define_keys;
+	std::vector<int>* m_shape_keys;
+	std::string& m_definitions;
+	std::string m_definition;
+	bool m_nested {false};
+	size_t m_count_position {0};
+	int m_key_index {0};
+	JsonValueDictionary* m_values {nullptr};
+	size_t m_max_values {0};
+	std::vector<std::pair<size_t, int>>* m_string_positions {nullptr};
+};
+
+} // end of anonymous namespace
+
+rapidjson::ParseResult JsonToTlvSax::EncodeLine(const char *line, size_t length, EncodedChunk &chunk) {
+	std::vector<size_t> key_positions;
+	const bool local_dictionary = chunk.dictionary == &chunk.local_dictionary;
+	chunk.record_buffer.clear();
+	chunk.record_keys.clear();
+	chunk.definitions.clear();
+	TlvSaxHandler handler(chunk.record_buffer, m_options.format, *chunk.dictionary, local_dictionary ? &key_positions : nullptr, chunk.define_keys,
+						  m_options.shapes ? &chunk.record_keys : nullptr, m_options.shapes ? &chunk.definitions : nullptr);
+	std::vector<std::pair<size_t, int>> string_positions;
+	if (m_options.string_dictionary)
+		handler.SetStringDictionary(chunk.values, m_options.string_dictionary, local_dictionary ? &string_positions : nullptr);
+
+	rapidjson::InsituStringStream input(chunk.arena->MutableCopy(line, length));
+	rapidjson::Reader reader;
+	rapidjson::ParseResult ok = reader.Parse<rapidjson::kParseInsituFlag>(input, handler);
+	if (!ok)
+		return ok;
+
+	if (m_options.shapes) {
+		//record buffer begins with rtShape placeholder, it is replaced by the record written by WriteShape
+		chunk.output->Write(chunk.definitions.data(), chunk.definitions.size());
+		WriteShape(chunk);
+		const size_t values = handler.CountPosition() + sizeof(int);
+		for (auto& string : string_positions)
+			chunk.string_offsets.emplace_back(chunk.output->Position() + (string.first - values), string.second);
+		chunk.output->Write(chunk.record_buffer.data() + values, chunk.record_buffer.size() - values);
+		return ok;
+	}
+
+	if (local_dictionary) {
+		const uint64_t record_offset = chunk.output->Position();
+		for (auto position : key_positions)
+			chunk.key_offsets.push_back(record_offset + position);
+		for (auto& string : string_positions)
+			chunk.string_offsets.emplace_back(record_offset + string.first, string.second);
+	}
+	chunk.output->Write(chunk.record_buffer.data(), chunk.record_buffer.size());
+	return ok;
+}
+
+JsonToTlvColumnar::JsonToTlvColumnar() {
+	m_options.format = TlvFormat::v2;
+}
+
+bool JsonToTlvColumnar::ColumnarLayout() const {
+	return true;
 }
 
 std::ios_base::openmode JsonToTlv::InputOpenModeFlags() {
@@ -121,86 +1531,1205 @@ void TlvToJson::Run(JsonPackerStream &stream) {
 	RecType record;
 
 	m_dictionary->Clear();
-	stream.InputStream().seekg(0, std::ios::beg);
-	bool dictionary_found = false;
+	m_shapes->Clear();
+	m_values.Clear();
+	m_stats = JsonPackerStats();
+	std::unique_ptr<ByteSource> input = stream.CreateInput();
+	std::unique_ptr<ByteSink> output = stream.CreateOutput();
+	input->Seek(0);
+	const uint64_t tlv_begin = input->Position();
+	const TlvHeader header = ReadTlvHeader(*input);
+	const TlvFormat format = header.format;
+	const uint64_t data_begin = input->Position();
+	//compressed blocks and blocks in columnar layout are located by block index
+	const bool compressed = (header.flags & TLV_FLAG_COMPRESSED) != 0;
+	const bool columnar = (header.flags & TLV_FLAG_COLUMNAR) != 0;
+	if ((compressed || columnar) && (header.flags & (TLV_FLAG_TRAILER | TLV_FLAG_BLOCK_INDEX | TLV_FLAG_INLINE_KEYS)) != (TLV_FLAG_TRAILER | TLV_FLAG_BLOCK_INDEX))
+		throw TlvInvalidFormatError();
+	if ((columnar && (header.flags & TLV_FLAG_SHAPES)) || (!columnar && (header.flags & TLV_FLAG_COLUMN_CODECS)))
+		throw TlvInvalidFormatError();
+	//records are located by their positions in row-oriented data, the keys of records must be known before they are read
+	if (!m_options.index_file.empty() && (columnar || (header.flags & TLV_FLAG_INLINE_KEYS)))
+		throw app_err::JsonPackerError("Index lookup requires row-oriented TLV data with dictionary");
+	//found records are not numbered, so the range of records and sampling can't be applied to them
+	if (!m_options.index_file.empty() && (m_options.from || m_options.count != std::numeric_limits<uint64_t>::max() || m_options.sample))
+		throw app_err::JsonPackerError("Index lookup can't be combined with from, count or sample options");
+	//checksums are kept in block index
+	const bool checksums = (header.ext_flags & TLV_EXT_FLAG_CHECKSUMS) != 0;
+	if (checksums && (header.flags & (TLV_FLAG_TRAILER | TLV_FLAG_BLOCK_INDEX | TLV_FLAG_INLINE_KEYS)) != (TLV_FLAG_TRAILER | TLV_FLAG_BLOCK_INDEX))
+		throw TlvInvalidFormatError();
+	if (m_options.verify_only && !checksums)
+		throw app_err::JsonPackerError("TLV data has no block checksums to verify");
+	m_filter.reset();
+	m_verify_blocks = false;
+	if (!m_options.where.empty())
+		m_filter = std::make_shared<RecordFilter>(m_options.where);
+	//the keys are selected as they are found in dictionary or defined inline
+	m_selected_keys.clear();
+	if (!m_options.keys.empty())
+		m_selected_keys.push_back(false);
 
-	//search for dictionary
-	record.SetIgnoreDataOnRead(true);
-	std::string dictionary_key;
-	int dictionary_index;
-	bool wait_for_string = true;
-	while (!stream.InputStream().eof()) {
-		stream.InputStream() >> record;
-		if (stream.InputStream().eof())
+	if (header.flags & TLV_FLAG_INLINE_KEYS) {
+		//keys are defined before their first use, so data is decoded in a single pass without seeking (input may be a pipe);
+		//converted records are passed on whenever input waits for data
+		if (m_options.sample)
+			throw app_err::JsonPackerError("Streamable TLV data has no block index, so its records can't be sampled");
+		input->FlushOnWait(output.get());
+		if (m_filter)
+			m_filter->Bind(*m_dictionary);
+		DictionaryLoaded();
+		DecodeRange(*input, format, std::vector<TlvBlock>(), 0, *output);
+		output->Flush();
+		return;
+	}
+
+	TlvTrailer trailer;
+	std::vector<TlvBlock> blocks;
+	std::vector<ZoneMap> zone_maps;
+	std::vector<BlockBloomFilters> bloom_filters;
+	uint64_t data_end = 0;
+	std::unique_ptr<ByteSource> block_input;
+	ByteSource* data_input = input.get();
+	if (header.flags & TLV_FLAG_TRAILER) {
+		//the dictionary is located by trailer, so records are read only once
+		if (!ReadTlvTrailer(*input, tlv_begin, trailer))
+			throw TlvInvalidFormatError();
+		if (header.flags & TLV_FLAG_BLOCK_INDEX)
+			ReadTlvBlockIndex(*input, tlv_begin, trailer, blocks, compressed, checksums);
+		data_end = tlv_begin + trailer.dictionary_offset;
+		if (m_options.verify_only) {
+			VerifyBlocks(*input, tlv_begin, blocks, data_end);
+			m_stats.records = blocks.empty() ? 0 : blocks.back().first_record + blocks.back().record_count;
+			output->Flush();
+			return;
+		}
+		//the blocks are verified as they are stored when they are read: compressed frames before they are decompressed,
+		//other blocks before their records are converted; the blocks which are not read are not verified
+		m_verify_blocks = checksums && !compressed;
+		//zone maps and Bloom filters are needed only to skip blocks which can not match filter
+		if (trailer.zone_map_offset && m_filter)
+			ReadTlvZoneMaps(*input, tlv_begin, trailer, blocks.size(), zone_maps);
+		if (trailer.bloom_filter_offset && m_filter)
+			ReadTlvBloomFilters(*input, tlv_begin, trailer, blocks.size(), bloom_filters);
+		input->Seek(data_end);
+		if (!ReadTlv(*input, record, format) || record.Type() != TlvType::rtDictionary)
+			throw TlvInvalidFormatError();
+		LoadDictionary(*input, format, tlv_begin + (trailer.block_index_offset ? trailer.block_index_offset : trailer.trailer_offset));
+		//compressed blocks are read as uncompressed data, so records are converted in the same way
+		if (compressed) {
+			block_input.reset(new TlvBlockSource(*input, tlv_begin, blocks, data_end, m_options.threads, checksums));
+			data_input = block_input.get();
+			data_end = block_input->Size();
+		}
+		for (auto& block : blocks)
+			block.offset = tlv_begin + block.raw_offset;
+	} else {
+		//search for dictionary
+		record.SetIgnoreDataOnRead(true);
+		for (data_end = input->Position(); ReadTlv(*input, record, format); data_end = input->Position()) {
+			if (record.Type() == TlvType::rtDictionary) {
+				LoadDictionary(*input, format);
+				break;
+			}
+		}
+	}
+	if (m_dictionary->Entries().empty())
+		throw app_err::JsonPackerMissed("dictionary", "");
+	if (!m_options.keys.empty()) {
+		const auto& keys = m_dictionary->Keys();
+		for (auto& name : m_options.keys) {
+			auto key = keys.find(name);
+			if (key != keys.end())
+				SelectKey(name, key->second);
+		}
+	}
+	std::vector<bool> selected_blocks;
+	if (m_filter) {
+		m_filter->Bind(*m_dictionary);
+		if (!zone_maps.empty() || !bloom_filters.empty()) {
+			for (size_t i = 0; i < blocks.size(); ++i)
+				selected_blocks.push_back(m_filter->MayMatch(zone_maps.empty() ? nullptr : &zone_maps[i], bloom_filters.empty() ? nullptr : &bloom_filters[i]));
+		}
+	}
+	DictionaryLoaded();
+
+	//read and convert data; the blocks which can not match filter are skipped unless records are sampled
+	const bool all_records = !m_options.from && m_options.count == std::numeric_limits<uint64_t>::max() && !m_options.sample;
+	data_input->Seek(data_begin);
+	if (!m_options.index_file.empty())
+		LookupRecords(*data_input, format, input->Size(), blocks, data_end, *output);
+	else if (columnar)
+		DecodeColumnar(*data_input, blocks, selected_blocks, data_end, (header.flags & TLV_FLAG_COLUMN_CODECS) != 0, *output);
+	else if (all_records && !selected_blocks.empty())
+		DecodeSelectedBlocks(*data_input, format, blocks, selected_blocks, data_end, *output);
+	else if (m_options.threads > 1 && all_records)
+		DecodeParallel(*data_input, format, blocks, data_end, *output);
+	else
+		DecodeRange(*data_input, format, blocks, data_end, *output);
+	output->Flush();
+}
+
+void TlvToJson::LookupRecords(ByteSource &input, TlvFormat format, uint64_t data_size, const std::vector<TlvBlock> &blocks, uint64_t data_end, ByteSink &output) {
+	const TlvIndex index(m_options.index_file);
+	uint64_t hash;
+	if (!m_filter || !m_filter->EqualityHash(index.Key(), hash))
+		throw app_err::JsonPackerError("Index lookup requires filter comparing key '" + index.Key() + "' by ==");
+	if (index.DataSize() != data_size)
+		throw app_err::JsonPackerError("Index file does not match TLV data");
+	//the records of other values having the same hash are rejected by filter
+	std::vector<uint64_t> offsets;
+	index.Find(hash, offsets);
+	//the block holding the record is verified once, when its first found record is read
+	std::vector<bool> verified(m_verify_blocks ? blocks.size() : 0);
+	for (auto offset : offsets) {
+		if (m_verify_blocks) {
+			auto block = std::upper_bound(blocks.begin(), blocks.end(), offset, [](uint64_t position, const TlvBlock& block) {
+				return position < block.offset;
+			});
+			if (block == blocks.begin())
+				throw TlvInvalidFormatError();
+			const size_t index = static_cast<size_t>(block - blocks.begin()) - 1;
+			if (!verified[index]) {
+				VerifyStoredBlock(input, blocks, index, data_end);
+				verified[index] = true;
+			}
+		}
+		input.Seek(offset);
+		m_stats.records += DecodeRecords(input, format, output, 1);
+	}
+}
+
+void TlvToJson::DecodeRange(ByteSource &input, TlvFormat format, const std::vector<TlvBlock> &blocks, uint64_t data_end, ByteSink &output) {
+	const uint64_t from = m_options.from;
+	const uint64_t count = m_options.count;
+	auto block_of = [&blocks](uint64_t record_number) {
+		auto it = std::upper_bound(blocks.begin(), blocks.end(), record_number, [](uint64_t number, const TlvBlock& block) {
+			return number < block.first_record;
+		});
+		return it == blocks.begin() ? blocks.end() : it - 1;
+	};
+	//the number of the record at the current position of input and the last verified block
+	uint64_t current = 0;
+	auto verified = blocks.end();
+	auto seek_to = [&](uint64_t record_number) {
+		//the block containing the record is used if it is ahead of the current position or if it has to be verified
+		auto block = block_of(record_number);
+		if (block != blocks.end() && (block->first_record > current || (m_verify_blocks && block != verified))) {
+			input.Seek(block->offset);
+			current = block->first_record;
+			if (m_verify_blocks) {
+				VerifyStoredBlock(input, blocks, static_cast<size_t>(block - blocks.begin()), data_end);
+				verified = block;
+			}
+		}
+		current += SkipRecords(input, format, record_number - current);
+		return current == record_number;
+	};
+
+	if (!m_options.sample) {
+		if (!seek_to(from))
+			return;
+		if (!m_verify_blocks || blocks.empty()) {
+			m_stats.records += DecodeRecords(input, format, output, count);
+			return;
+		}
+		//the records are converted block by block, every block is verified when it is entered
+		for (uint64_t remaining = count; remaining;) {
+			const auto next = verified + 1;
+			const uint64_t block_count = next != blocks.end() ? std::min(remaining, next->first_record - current) : remaining;
+			m_stats.records += DecodeRecords(input, format, output, block_count);
+			remaining -= block_count;
+			current += block_count;
+			if (next == blocks.end() || !remaining || !seek_to(current))
+				break;
+		}
+		return;
+	}
+
+	//the records are sampled from the range without replacement and converted in the order of input
+	uint64_t total = 0;
+	if (!blocks.empty())
+		total = blocks.back().first_record + blocks.back().record_count;
+	else {
+		const uint64_t position = input.Position();
+		total = SkipRecords(input, format, std::numeric_limits<uint64_t>::max());
+		input.Seek(position);
+	}
+	if (from >= total)
+		return;
+	for (auto record_number : SampleRecords(std::min(total - from, count))) {
+		if (!seek_to(from + record_number))
+			throw TlvInvalidFormatError();
+		m_stats.records += DecodeRecords(input, format, output, 1);
+		++current;
+	}
+}
+
+std::set<uint64_t> TlvToJson::SampleRecords(uint64_t range) {
+	//Floyd's algorithm
+	const uint64_t sample = std::min(m_options.sample, range);
+	std::mt19937_64 random(m_options.seed ? m_options.seed : std::random_device()());
+	std::set<uint64_t> chosen;
+	for (uint64_t j = range - sample; j < range; ++j) {
+		const uint64_t value = std::uniform_int_distribution<uint64_t>(0, j)(random);
+		chosen.insert(chosen.count(value) ? j : value);
+	}
+	return chosen;
+}
+
+void TlvToJson::DecodeColumnar(ByteSource &input, const std::vector<TlvBlock> &blocks, const std::vector<bool> &selected, uint64_t data_end, bool column_codecs, ByteSink &output) {
+	//the chunks of keys compared by filter are read too, their members are dropped when records are converted
+	std::vector<bool> selected_keys = m_selected_keys;
+	if (m_filter && !selected_keys.empty()) {
+		const auto& keys = m_dictionary->Keys();
+		for (auto& name : m_filter->Keys()) {
+			auto key = keys.find(name);
+			if (key == keys.end() || key->second < 0)
+				continue;
+			if (selected_keys.size() <= static_cast<size_t>(key->second))
+				selected_keys.resize(static_cast<size_t>(key->second) + 1);
+			selected_keys[static_cast<size_t>(key->second)] = true;
+		}
+	}
+
+	//the range of selected records and the blocks containing them
+	const uint64_t total = blocks.empty() ? 0 : blocks.back().first_record + blocks.back().record_count;
+	const uint64_t from = std::min(m_options.from, total);
+	const uint64_t end = from + std::min(m_options.count, total - from);
+	std::set<uint64_t> chosen;
+	if (m_options.sample) {
+		for (auto record_number : SampleRecords(end - from))
+			chosen.insert(from + record_number);
+	}
+	auto first_block = std::upper_bound(blocks.begin(), blocks.end(), from, [](uint64_t number, const TlvBlock& block) {
+		return number < block.first_record;
+	});
+	if (first_block != blocks.begin())
+		--first_block;
+
+	const size_t threads = std::max(m_options.threads, 1u);
+	std::vector<ColumnarBlockReader> readers(threads);
+	std::vector<std::vector<TlvBlock>::const_iterator> batch_blocks;
+	std::vector<uint64_t> unit_records(threads);
+	std::vector<std::unique_ptr<StringByteSink>> unit_outputs;
+	std::vector<std::unique_ptr<StringByteSink>> unit_rows;
+	while (unit_outputs.size() < threads) {
+		unit_outputs.emplace_back(new StringByteSink());
+		unit_rows.emplace_back(new StringByteSink());
+	}
+	for (auto block = first_block; block != blocks.end() && block->first_record < end;) {
+		//the blocks are read one by one and converted in parallel; the blocks which can not match filter are skipped unless records are sampled
+		batch_blocks.clear();
+		for (; batch_blocks.size() < threads && block != blocks.end() && block->first_record < end; ++block) {
+			const size_t block_index = static_cast<size_t>(block - blocks.begin());
+			if (!selected.empty() && !m_options.sample && !selected[block_index])
+				continue;
+			if (m_verify_blocks)
+				VerifyStoredBlock(input, blocks, block_index, data_end);
+			ColumnarBlockReader& reader = readers[batch_blocks.size()];
+			reader.Read(input, block->offset, selected_keys, column_codecs);
+			if (reader.RecordCount() != block->record_count)
+				throw TlvInvalidFormatError();
+			batch_blocks.push_back(block);
+		}
+		const size_t batch_size = batch_blocks.size();
+		util::ParallelFor(batch_size, threads, [&](size_t index) {
+			const TlvBlock& unit_block = *batch_blocks[index];
+			unit_rows[index]->Data().clear();
+			readers[index].RebuildRecords(*unit_rows[index]);
+			const std::string& rows = unit_rows[index]->Data();
+			MemoryByteSource unit(rows.data(), rows.size());
+			const uint64_t unit_begin = std::max(from, unit_block.first_record);
+			const uint64_t unit_end = std::min(end, unit_block.first_record + unit_block.record_count);
+			uint64_t current = unit_block.first_record;
+			unit_records[index] = 0;
+			if (chosen.empty()) {
+				current += SkipRecords(unit, TlvFormat::v2, unit_begin - current);
+				unit_records[index] = DecodeRecords(unit, TlvFormat::v2, *unit_outputs[index], unit_end - unit_begin);
+				return;
+			}
+			for (auto record = chosen.lower_bound(unit_begin); record != chosen.end() && *record < unit_end; ++record) {
+				current += SkipRecords(unit, TlvFormat::v2, *record - current);
+				unit_records[index] += DecodeRecords(unit, TlvFormat::v2, *unit_outputs[index], 1);
+				++current;
+			}
+		});
+		for (size_t i = 0; i < batch_size; ++i) {
+			std::string& unit_output = unit_outputs[i]->Data();
+			output.Write(unit_output.data(), unit_output.size());
+			unit_output.clear();
+			m_stats.records += unit_records[i];
+		}
+	}
+}
+
+void TlvToJson::DecodeSelectedBlocks(ByteSource &input, TlvFormat format, const std::vector<TlvBlock> &blocks, const std::vector<bool> &selected, uint64_t data_end, ByteSink &output) {
+	std::vector<TlvBlock> run;
+	for (size_t i = 0; i < blocks.size();) {
+		if (!selected[i]) {
+			++i;
+			continue;
+		}
+		run.clear();
+		for (; i < blocks.size() && selected[i]; ++i)
+			run.push_back(blocks[i]);
+		input.Seek(run.front().offset);
+		DecodeParallel(input, format, run, i < blocks.size() ? blocks[i].offset : data_end, output, i - run.size());
+	}
+}
+
+void TlvToJson::VerifyBlocks(ByteSource &input, uint64_t tlv_begin, const std::vector<TlvBlock> &blocks, uint64_t data_end) {
+	auto block = blocks.begin();
+	auto block_end = [&](std::vector<TlvBlock>::const_iterator it) {
+		return it + 1 != blocks.end() ? tlv_begin + (it + 1)->offset : data_end;
+	};
+
+	const size_t threads = std::max(m_options.threads, 1u);
+	const uint64_t batch_size = threads * std::max<size_t>(m_options.chunk_size, 1);
+	while (block != blocks.end()) {
+		//the batch consists of consecutive blocks, it is at least batch_size bytes long unless data ends earlier
+		const auto batch_begin = block;
+		const uint64_t begin = tlv_begin + block->offset;
+		uint64_t batch_end = begin;
+		for (; block != blocks.end() && batch_end - begin < batch_size; ++block)
+			batch_end = block_end(block);
+		const char* data;
+		input.Seek(begin);
+		if (batch_end < begin || input.Peek(data, static_cast<size_t>(batch_end - begin)) < batch_end - begin)
+			throw TlvInvalidFormatError();
+		util::ParallelFor(static_cast<size_t>(block - batch_begin), threads, [&](size_t index) {
+			const auto unit_block = batch_begin + static_cast<std::ptrdiff_t>(index);
+			const uint64_t unit_begin = tlv_begin + unit_block->offset;
+			VerifyTlvBlock(data + (unit_begin - begin), static_cast<size_t>(block_end(unit_block) - unit_begin), *unit_block, static_cast<size_t>(unit_block - blocks.begin()));
+		});
+		input.Consume(static_cast<size_t>(batch_end - begin));
+	}
+}
+
+namespace {
+
+/**
+ * @brief ScanRecords finds the ends of complete JSON records in TLV data reading only types and lengths of TLV records
+ * @param data[in] pointer to data beginning with JSON record
+ * @param size[in] size of data
+ * @param format[in] the format of TLV data
+ * @param unit_size[in] the minimum size of unit
+ * @param unit_ends[out] receives the ends of units (the distance between them is at least unit_size unless data ends)
+ * @return the size of complete JSON records
+ */
+size_t ScanRecords(const char* data, size_t size, TlvFormat format, size_t unit_size, std::vector<size_t>& unit_ends) {
+	using TlvType = TlvRecordView::TlvRecordType;
+	TlvRecordView record;
+	size_t end = 0;
+	for (size_t next = 0;;) {
+		size_t record_size = ParseTlv(data + next, size - next, format, record);
+		if (!record_size)
+			break;
+		if (record.Type() != TlvType::rtMemberCount)
+			throw TlvInvalidFormatError();
+		const int member_count = record.GetInt();
+		next += record_size;
+		for (int i = 0; i < 2 * member_count && record_size; ++i) {
+			record_size = ParseTlv(data + next, size - next, format, record);
+			next += record_size;
+		}
+		if (!record_size)
 			break;
+		end = next;
+		if (end - (unit_ends.empty() ? 0 : unit_ends.back()) >= unit_size)
+			unit_ends.push_back(end);
+	}
+	if (end && (unit_ends.empty() || unit_ends.back() != end))
+		unit_ends.push_back(end);
+	return end;
+}
 
-		if (record.Type() == TlvType::rtDictionary) {
-			dictionary_found = true;
-			record.SetIgnoreDataOnRead(false);
+} // end of anonymous namespace
+
+void TlvToJson::DecodeParallel(ByteSource &input, TlvFormat format, const std::vector<TlvBlock> &blocks, uint64_t data_end, ByteSink &output, size_t first_block) {
+	const size_t threads = m_options.threads;
+	const size_t batch_size = threads * std::max<size_t>(m_options.chunk_size, 1);
+	const size_t unit_size = std::max<size_t>(m_options.block_size, 1);
+	std::vector<size_t> unit_ends;
+	std::vector<uint64_t> unit_records;
+	std::vector<std::unique_ptr<StringByteSink>> unit_outputs;
+	auto batch_block = blocks.begin();
+
+	while (input.Position() < data_end) {
+		//the batch is at least batch_size bytes long (unless data ends earlier) and consists of complete records
+		const uint64_t position = input.Position();
+		const char* data;
+		size_t required = static_cast<size_t>(std::min<uint64_t>(batch_size, data_end - position));
+		size_t size = 0;
+		for (;;) {
+			if (input.Peek(data, required) < required)
+				throw TlvInvalidFormatError();
+			unit_ends.clear();
+			if (!blocks.empty()) {
+				//blocks begin with complete records, so no scanning is needed
+				auto block = batch_block;
+				for (; block != blocks.end() && block->offset < position + required; ++block) {
+					if (block->offset > position && block->offset - position - (unit_ends.empty() ? 0 : unit_ends.back()) >= unit_size)
+						unit_ends.push_back(static_cast<size_t>(block->offset - position));
+				}
+				if (position + required == data_end && (unit_ends.empty() || unit_ends.back() != required))
+					unit_ends.push_back(required);
+				size = unit_ends.empty() ? 0 : unit_ends.back();
+			} else
+				size = ScanRecords(data, required, format, unit_size, unit_ends);
+			if (size)
+				break;
+			if (position + required == data_end)
+				throw TlvInvalidFormatError();
+			required = static_cast<size_t>(std::min<uint64_t>(required + batch_size, data_end - position));
+		}
+		//the next batch begins with the block following the batch
+		while (batch_block != blocks.end() && batch_block->offset <= position + size)
+			++batch_block;
+
+		while (unit_outputs.size() < unit_ends.size())
+			unit_outputs.emplace_back(new StringByteSink());
+		unit_records.assign(unit_ends.size(), 0);
+		util::ParallelFor(unit_ends.size(), threads, [&](size_t index) {
+			const size_t unit_begin = index ? unit_ends[index - 1] : 0;
+			if (m_verify_blocks) {
+				//units end on block boundaries, so the unit verifies the blocks beginning in it
+				auto block = std::lower_bound(blocks.begin(), blocks.end(), position + unit_begin, [](const TlvBlock& block, uint64_t offset) {
+					return block.offset < offset;
+				});
+				for (; block != blocks.end() && block->offset < position + unit_ends[index]; ++block) {
+					const uint64_t block_end = block + 1 != blocks.end() ? (block + 1)->offset : data_end;
+					if (block_end > position + unit_ends[index])
+						throw TlvInvalidFormatError();
+					VerifyTlvBlock(data + (block->offset - position), static_cast<size_t>(block_end - block->offset), *block, first_block + static_cast<size_t>(block - blocks.begin()));
+				}
+			}
+			MemoryByteSource unit(data + unit_begin, unit_ends[index] - unit_begin);
+			unit_records[index] = DecodeRecords(unit, format, *unit_outputs[index], std::numeric_limits<uint64_t>::max());
+			if (unit.Position() != unit_ends[index] - unit_begin)
+				throw TlvInvalidFormatError();
+		});
+		for (size_t i = 0; i < unit_ends.size(); ++i) {
+			std::string& unit_output = unit_outputs[i]->Data();
+			output.Write(unit_output.data(), unit_output.size());
+			unit_output.clear();
+			m_stats.records += unit_records[i];
+		}
+		input.Consume(size);
+	}
+}
+
+uint64_t TlvToJson::SkipRecords(ByteSource &input, TlvFormat format, uint64_t count) {
+	using TlvType = TlvRecordView::TlvRecordType;
+	TlvReader reader(input, format);
+	TlvRecordView record;
+	uint64_t skipped = 0;
+	while (skipped < count && reader.Next(record)) {
+		//the dictionary is left in input
+		if (record.Type() == TlvType::rtDictionary)
+			return skipped;
+		if (record.Type() == TlvType::rtKeyDefinition) {
+			DefineKey(record.Data(), record.DataSize());
+			continue;
+		}
+		if (record.Type() == TlvType::rtShapeDefinition) {
+			DefineShape(record.Data(), record.DataSize());
+			continue;
+		}
+		if (record.Type() == TlvType::rtValueDefinition) {
+			DefineValue(record.Data(), record.DataSize());
+			continue;
+		}
+		if (record.Type() == TlvType::rtShape) {
+			//the record has only values
+			const size_t member_count = m_shapes->GetShape(record.GetInt()).size();
+			for (size_t i = 0; i < member_count; ++i) {
+				if (!reader.Next(record))
+					throw TlvInvalidFormatError();
+				if (record.Type() == TlvType::rtValueDefinition) {
+					DefineValue(record.Data(), record.DataSize());
+					--i;
+				}
+			}
+			++skipped;
 			continue;
 		}
-		if (dictionary_found) {
-			//check format
-			if ((wait_for_string && record.Type() != TlvType::rtString) ||
-				(!wait_for_string && record.Type() != TlvType::rtInt))
-			{
+		if (record.Type() != TlvType::rtMemberCount)
+			throw TlvInvalidFormatError();
+		const int member_count = record.GetInt();
+		for (int i = 0; i < 2 * member_count; ++i) {
+			if (!reader.Next(record))
 				throw TlvInvalidFormatError();
+			if (record.Type() == TlvType::rtKeyDefinition) {
+				DefineKey(record.Data(), record.DataSize());
+				--i;
+			} else if (record.Type() == TlvType::rtValueDefinition) {
+				DefineValue(record.Data(), record.DataSize());
+				--i;
+			}
+		}
+		++skipped;
+	}
+	reader.Consume();
+	return skipped;
+}
+
+uint64_t TlvToJson::DecodeRecords(ByteSource &input, TlvFormat format, ByteSink &output, uint64_t count) {
+	if (m_filter)
+		return FilterRecords(input, format, output, count);
+	return ConvertRecords(input, format, output, count, false);
+}
+
+uint64_t TlvToJson::FilterRecords(ByteSource &input, TlvFormat format, ByteSink &output, uint64_t count) {
+	using TlvType = TlvRecordView::TlvRecordType;
+	//the batch is local, so records are filtered by several threads at once
+	RecordFilter::Batch batch;
+	std::vector<size_t> begins;
+	std::vector<size_t> ends;
+	TlvRecordView record;
+	//the data which is already buffered is scanned, more data is waited for only if no record is complete
+	//(input may be a pipe receiving records slowly)
+	size_t required = 1;
+	//the definitions of the record which is not completely buffered are applied once, when they are read for the first time
+	uint64_t defined_end = 0;
+	auto define = [&](uint64_t position, size_t size) {
+		if (position < defined_end)
+			return;
+		if (record.Type() == TlvType::rtKeyDefinition)
+			DefineKey(record.Data(), record.DataSize());
+		else if (record.Type() == TlvType::rtShapeDefinition)
+			DefineShape(record.Data(), record.DataSize());
+		else
+			DefineValue(record.Data(), record.DataSize());
+		defined_end = position + size;
+	};
+	uint64_t read = 0;
+	uint64_t decoded = 0;
+	bool dictionary = false;
+	while (read < count && !dictionary) {
+		//the batch consists of complete records, the values of filtered keys are collected while records are scanned
+		const char* data;
+		const size_t available = input.Peek(data, required);
+		const uint64_t position = input.Position();
+		size_t scanned = 0;
+		size_t next = 0;
+		auto next_member_record = [&]() {
+			for (;;) {
+				const size_t size = ParseTlv(data + next, available - next, format, record);
+				if (!size)
+					return false;
+				next += size;
+				if (record.Type() != TlvType::rtKeyDefinition && record.Type() != TlvType::rtValueDefinition)
+					return true;
+				define(position + next - size, size);
 			}
-			if (record.Type() == TlvType::rtString) {
-				dictionary_key = record.GetString();
-				wait_for_string = false;
+		};
+		begins.clear();
+		ends.clear();
+		batch.Reset(m_filter->SlotCount());
+		while (read + begins.size() < count && begins.size() < FILTER_BATCH_SIZE) {
+			const size_t begin = next;
+			const size_t size = ParseTlv(data + next, available - next, format, record);
+			if (!size)
+				break;
+			//the dictionary is left in input
+			if (record.Type() == TlvType::rtDictionary) {
+				dictionary = true;
+				break;
+			}
+			next += size;
+			if (record.Type() == TlvType::rtKeyDefinition || record.Type() == TlvType::rtShapeDefinition || record.Type() == TlvType::rtValueDefinition) {
+				define(position + begin, size);
+				scanned = next;
+				continue;
+			}
+			if (record.Type() != TlvType::rtShape && record.Type() != TlvType::rtMemberCount)
+				throw TlvInvalidFormatError();
+			const std::vector<int>* shape = record.Type() == TlvType::rtShape ? &m_shapes->GetShape(record.GetInt()) : nullptr;
+			const int member_count = shape ? static_cast<int>(shape->size()) : record.GetInt();
+			batch.Add();
+			bool complete = true;
+			for (int member = 0; member < member_count && complete; ++member) {
+				int key_index = 0;
+				if (shape)
+					key_index = (*shape)[static_cast<size_t>(member)];
+				else if ((complete = next_member_record()))
+					key_index = record.GetInt();
+				if (!complete || !(complete = next_member_record()))
+					break;
+				const int slot = m_filter->Slot(key_index);
+				if (slot < 0)
+					continue;
+				if (record.Type() == TlvType::rtStringRef) {
+					uint16_t code;
+					if (record.DataSize() != sizeof(code))
+						throw TlvInvalidFormatError();
+					memcpy(&code, record.Data(), sizeof(code));
+					const std::string& value = m_values.GetValue(m_dictionary->Position(key_index), code);
+					batch.SetValue(static_cast<size_t>(slot), TlvType::rtString, value.data(), value.size());
+				} else
+					batch.SetValue(static_cast<size_t>(slot), record.Type(), record.Data(), record.DataSize());
+			}
+			if (!complete) {
+				batch.Pop();
+				break;
+			}
+			begins.push_back(begin);
+			ends.push_back(next);
+			scanned = next;
+		}
+		if (!scanned && !dictionary) {
+			if (available < required) {
+				if (available)
+					throw TlvInvalidFormatError();
+				break;
 			}
-			else if (record.Type() == TlvType::rtInt) {
-				dictionary_index = record.GetInt();
-				m_dictionary->AddKey(dictionary_key, dictionary_index);
-				wait_for_string = true;
+			//only the data completing the first TLV record which is not completely buffered is waited for
+			size_t end = 0;
+			while (const size_t size = ParseTlv(data + end, available - end, format, record))
+				end += size;
+			required = end < available && record.RecordSize() ? end + record.RecordSize() : available + 1;
+			continue;
+		}
+		required = 1;
+		m_filter->Evaluate(batch);
+
+		//every run of consecutive matching records is converted at once, the definitions inside of it are already applied
+		for (size_t i = 0; i < begins.size();) {
+			if (!batch.Matches(i)) {
+				++i;
+				continue;
 			}
+			size_t last = i;
+			while (last + 1 < begins.size() && batch.Matches(last + 1))
+				++last;
+			MemoryByteSource run(data + begins[i], ends[last] - begins[i]);
+			decoded += ConvertRecords(run, format, output, last - i + 1, true);
+			i = last + 1;
 		}
+		read += begins.size();
+		input.Consume(scanned);
 	}
-	if (!dictionary_found || m_dictionary->Keys().empty())
-		throw app_err::JsonPackerMissed("dictionary", "");
+	return decoded;
+}
 
-	//read and convert data
-	stream.InputStream().clear();
-	stream.InputStream().seekg(0, std::ios::beg);
-	record.SetIgnoreDataOnRead(false);
-	while (!stream.InputStream().eof()) {
-		stream.InputStream() >> record;
-		if (stream.InputStream().eof())
-			break;
+uint64_t TlvToJson::ConvertRecords(ByteSource &input, TlvFormat format, ByteSink &output, uint64_t count, bool defined) {
+	using RecType = TlvRecord<std::streamsize>;
+	using TlvType = RecType::TlvRecordType;
+	RecType record;
+
+	rapidjson::StringBuffer buffer;
+	uint64_t decoded = 0;
+	while (decoded < count && ReadTlv(input, record, format)) {
 		if (record.Type() == TlvType::rtDictionary)
 			break;
 
-		if (record.Type() == TlvType::rtMemberCount) {
+		if (record.Type() == TlvType::rtKeyDefinition) {
+			if (!defined)
+				DefineKey(record.Data().data(), static_cast<size_t>(record.DataSize()));
+		} else if (record.Type() == TlvType::rtShapeDefinition) {
+			if (!defined)
+				DefineShape(record.Data().data(), static_cast<size_t>(record.DataSize()));
+		} else if (record.Type() == TlvType::rtValueDefinition) {
+			if (!defined)
+				DefineValue(record.Data().data(), static_cast<size_t>(record.DataSize()));
+		} else if (record.Type() == TlvType::rtMemberCount || record.Type() == TlvType::rtShape) {
 			rapidjson::Document document;
 			document.SetObject();
-			int member_count = record.GetInt();
+			//the keys of the record written with shape are taken from the shape
+			const std::vector<int>* shape = record.Type() == TlvType::rtShape ? &m_shapes->GetShape(record.GetInt()) : nullptr;
+			int member_count = shape ? static_cast<int>(shape->size()) : record.GetInt();
 			for (int i = 0; i < member_count; ++i) {
 				//key
-				stream.InputStream() >> record;
-				if (stream.InputStream().eof())
-					throw TlvInvalidFormatError();
-				//TODO: check type - must be int (or change it to rtKeyIndex)
-				std::string key = (*m_dictionary)[record.GetInt()];
+				int key_index;
+				if (shape)
+					key_index = (*shape)[static_cast<size_t>(i)];
+				else {
+					if (!ReadTlv(input, record, format))
+						throw TlvInvalidFormatError();
+					while (record.Type() == TlvType::rtKeyDefinition) {
+						if (!defined)
+							DefineKey(record.Data().data(), static_cast<size_t>(record.DataSize()));
+						if (!ReadTlv(input, record, format))
+							throw TlvInvalidFormatError();
+					}
+					//TODO: check type - must be int (or change it to rtKeyIndex)
+					key_index = record.GetInt();
+				}
+				const size_t key_position = m_dictionary->Position(key_index);
+				if (!KeySelected(key_index)) {
+					//the data of value is skipped without copying, string values defined before it are added to the dictionary
+					for (;;) {
+						const char* type;
+						if (!input.Peek(type))
+							throw TlvInvalidFormatError();
+						const bool definition = static_cast<TlvType>(type[0]) == TlvType::rtValueDefinition;
+						record.SetIgnoreDataOnRead(!definition);
+						ReadTlv(input, record, format);
+						record.SetIgnoreDataOnRead(false);
+						if (!definition)
+							break;
+						if (!defined)
+							DefineValue(record.Data().data(), static_cast<size_t>(record.DataSize()));
+					}
+					continue;
+				}
+				const auto& key = m_dictionary->Entries()[key_position];
 				rapidjson::Value key_value;
-				key_value.SetString(key.c_str(), static_cast<rapidjson::SizeType>(key.length()), document.GetAllocator());
+				key_value.SetString(key.data, static_cast<rapidjson::SizeType>(key.length), document.GetAllocator());
 
-				//value
-				stream.InputStream() >> record;
-				if (stream.InputStream().eof())
+				//value (string values of dictionaries are defined before their first use)
+				if (!ReadTlv(input, record, format))
 					throw TlvInvalidFormatError();
-				rapidjson::Value v = record.GetJsonValue(document.GetAllocator());
+				while (record.Type() == TlvType::rtValueDefinition) {
+					if (!defined)
+						DefineValue(record.Data().data(), static_cast<size_t>(record.DataSize()));
+					if (!ReadTlv(input, record, format))
+						throw TlvInvalidFormatError();
+				}
+				rapidjson::Value v;
+				if (record.Type() == TlvType::rtStringRef) {
+					uint16_t code;
+					if (record.DataSize() != sizeof(code))
+						throw TlvInvalidFormatError();
+					memcpy(&code, record.Data().data(), sizeof(code));
+					const std::string& value = m_values.GetValue(key_position, code);
+					v.SetString(value.data(), static_cast<rapidjson::SizeType>(value.size()), document.GetAllocator());
+				} else
+					v = record.GetJsonValue(document.GetAllocator());
 
 				document.AddMember(key_value, v, document.GetAllocator());
 			}
-			rapidjson::StringBuffer buffer;
+			++decoded;
+			buffer.Clear();
 			rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
 			document.Accept(writer);
 
-			stream.OutputStream() << buffer.GetString() << std::endl;
+			output.Write(buffer.GetString(), buffer.GetSize());
+			output.Put('\n');
 		} else
 			throw TlvInvalidFormatError();
 	}
+	return decoded;
+}
+
+void TlvToJson::DictionaryLoaded() {
+}
+
+void TlvToJson::SelectKey(const std::string &name, int key_index) {
+	//the keys missing in dictionary are not selected
+	if (m_selected_keys.empty() || key_index < 0 || std::find(m_options.keys.begin(), m_options.keys.end(), name) == m_options.keys.end())
+		return;
+	if (m_selected_keys.size() <= static_cast<size_t>(key_index))
+		m_selected_keys.resize(static_cast<size_t>(key_index) + 1);
+	m_selected_keys[static_cast<size_t>(key_index)] = true;
+}
+
+void TlvToJson::DefineKey(const char *data, size_t size) {
+	int key_index;
+	if (size < sizeof(key_index))
+		throw TlvInvalidFormatError();
+	memcpy(&key_index, data, sizeof(key_index));
+	const std::string name(data + sizeof(key_index), size - sizeof(key_index));
+	m_dictionary->AddKey(name, key_index);
+	SelectKey(name, key_index);
+	if (m_filter)
+		m_filter->Bind(*m_dictionary);
+}
+
+void TlvToJson::DefineShape(const char *data, size_t size) {
+	int shape_index;
+	if (size < sizeof(shape_index) || (size - sizeof(shape_index)) % sizeof(int))
+		throw TlvInvalidFormatError();
+	memcpy(&shape_index, data, sizeof(shape_index));
+	std::vector<int> keys((size - sizeof(shape_index)) / sizeof(int));
+	if (!keys.empty())
+		memcpy(keys.data(), data + sizeof(shape_index), keys.size() * sizeof(int));
+	//the keys are defined before the shape
+	for (auto key : keys)
+		m_dictionary->Position(key);
+	if (static_cast<size_t>(shape_index) != m_shapes->Size() || m_shapes->AddShape(keys) != shape_index)
+		throw TlvInvalidFormatError();
+}
+
+void TlvToJson::DefineValue(const char *data, size_t size) {
+	int key_index;
+	uint16_t code;
+	if (size < sizeof(key_index) + sizeof(code))
+		throw TlvInvalidFormatError();
+	memcpy(&key_index, data, sizeof(key_index));
+	memcpy(&code, data + sizeof(key_index), sizeof(code));
+	//values of a key are defined in order of their codes
+	const size_t position = m_dictionary->Position(key_index);
+	if (code != m_values.Size(position))
+		throw TlvInvalidFormatError();
+	m_values.AddValue(position, data + sizeof(key_index) + sizeof(code), size - sizeof(key_index) - sizeof(code));
+}
+
+namespace {
+
+/**
+ * @brief WriteJsonString writes quoted string escaped in the same way as RapidJson writer does
+ */
+void WriteJsonString(const char* str, size_t length, ByteSink& output) {
+	static const char hex_digits[16] = {'0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'A', 'B', 'C', 'D', 'E', 'F'};
+	static const char escape[256] = {
+		'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'b', 't', 'n', 'u', 'f', 'r', 'u', 'u',
+		'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u',
+		0, 0, '"', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+		0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+		0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+		0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, '\\', 0, 0, 0
+	};
+	char* const begin = output.Reserve(2 + length * 6);
+	char* out = begin;
+	*out++ = '"';
+	const char* const end = str + length;
+	while (str < end) {
+		//copy the run of characters which need no escaping at once
+		const char* run = str;
+		while (run < end && !escape[static_cast<unsigned char>(*run)])
+			++run;
+		memcpy(out, str, static_cast<size_t>(run - str));
+		out += run - str;
+		if (run == end)
+			break;
+		const unsigned char c = static_cast<unsigned char>(*run);
+		*out++ = '\\';
+		*out++ = escape[c];
+		if (escape[c] == 'u') {
+			*out++ = '0';
+			*out++ = '0';
+			*out++ = hex_digits[c >> 4];
+			*out++ = hex_digits[c & 0xF];
+		}
+		str = run + 1;
+	}
+	*out++ = '"';
+	output.Commit(static_cast<size_t>(out - begin));
+}
+
+/**
+ * @brief WriteJsonValue formats the value of TLV record in place in the same way as RapidJson writer does
+ */
+void WriteJsonValue(const TlvRecordView& record, ByteSink& output) {
+	using TlvType = TlvRecordView::TlvRecordType;
+	//every fixed-width value is read from the prefix of data, as TlvRecord::GetJsonValue does
+	const size_t fixed_size = static_cast<size_t>(std::max<std::streamsize>(TlvRecord<std::streamsize>::FixedDataSize(record.Type()), 0));
+	if (record.DataSize() < fixed_size)
+		throw TlvInvalidFormatError();
+	const char* const data = record.Data();
+	char* const begin = output.Reserve(32);
+	char* end = begin;
+	switch (record.Type()) {
+	case TlvType::rtInt: {
+		int v;
+		memcpy(&v, data, sizeof(v));
+		end = rapidjson::internal::i32toa(v, begin);
+		break;
+	}
+	case TlvType::rtUInt: {
+		unsigned int v;
+		memcpy(&v, data, sizeof(v));
+		end = rapidjson::internal::u32toa(v, begin);
+		break;
+	}
+	case TlvType::rtNull:
+		memcpy(begin, "null", 4);
+		end = begin + 4;
+		break;
+	case TlvType::rtBool:
+		if (data[0]) {
+			memcpy(begin, "true", 4);
+			end = begin + 4;
+		} else {
+			memcpy(begin, "false", 5);
+			end = begin + 5;
+		}
+		break;
+	case TlvType::rtInt64: {
+		int64_t v;
+		memcpy(&v, data, sizeof(v));
+		end = rapidjson::internal::i64toa(v, begin);
+		break;
+	}
+	case TlvType::rtUInt64: {
+		uint64_t v;
+		memcpy(&v, data, sizeof(v));
+		end = rapidjson::internal::u64toa(v, begin);
+		break;
+	}
+	case TlvType::rtDouble:
+	case TlvType::rtFloat: {
+		double v;
+		if (record.Type() == TlvType::rtFloat) {
+			float f;
+			memcpy(&f, data, sizeof(f));
+			v = static_cast<double>(f);
+		} else
+			memcpy(&v, data, sizeof(v));
+		if (rapidjson::internal::Double(v).IsNanOrInf())
+			throw app_err::JsonPackerError("Non-finite number can not be written in JSON format");
+		end = rapidjson::internal::dtoa(v, begin);
+		break;
+	}
+	case TlvType::rtString:
+		WriteJsonString(data, record.DataSize(), output);
+		return;
+	default:
+		throw app_err::JsonPackerError("Unknown data type!");
+	}
+	output.Commit(static_cast<size_t>(end - begin));
+}
+
+} // end of anonymous namespace
+
+void TlvToJsonDirect::DictionaryLoaded() {
+	m_keys_text.clear();
+	m_keys_offsets.assign(1, 0);
+	RenderKeys();
+	m_prefixes_text.clear();
+	m_prefixes_offsets.assign(1, 0);
+	m_shape_prefixes.assign(1, 0);
+	RenderShapes();
+	m_values_text.clear();
+	m_values_offsets.clear();
+	RenderValues();
+}
+
+uint64_t TlvToJsonDirect::ConvertRecords(ByteSource &input, TlvFormat format, ByteSink &output, uint64_t count, bool defined) {
+	using TlvType = TlvRecord<std::streamsize>::TlvRecordType;
+
+	//the keys, shapes and string values defined while records were skipped are rendered
+	RenderKeys();
+	RenderShapes();
+	RenderValues();
+	TlvReader reader(input, format);
+	TlvRecordView record;
+	uint64_t decoded = 0;
+	while (decoded < count && reader.Next(record)) {
+		//the dictionary is left in input
+		if (record.Type() == TlvType::rtDictionary)
+			return decoded;
+		if (record.Type() == TlvType::rtKeyDefinition) {
+			if (!defined)
+				DefineKey(record.Data(), record.DataSize());
+			RenderKeys();
+			continue;
+		}
+		if (record.Type() == TlvType::rtShapeDefinition) {
+			if (!defined)
+				DefineShape(record.Data(), record.DataSize());
+			RenderShapes();
+			continue;
+		}
+		if (record.Type() == TlvType::rtValueDefinition) {
+			if (!defined)
+				DefineValue(record.Data(), record.DataSize());
+			RenderValues();
+			continue;
+		}
+		if (record.Type() == TlvType::rtShape) {
+			//member prefixes of the shape are written before values
+			const int shape_index = record.GetInt();
+			const std::vector<int>& keys = m_shapes->GetShape(shape_index);
+			output.Put('{');
+			if (m_selected_keys.empty()) {
+				const size_t prefixes_begin = m_shape_prefixes[static_cast<size_t>(shape_index)];
+				for (size_t member = 0; member < keys.size(); ++member) {
+					const size_t prefix = prefixes_begin + member;
+					output.Write(m_prefixes_text.data() + m_prefixes_offsets[prefix], m_prefixes_offsets[prefix + 1] - m_prefixes_offsets[prefix]);
+					WriteValue(reader, keys[member], output, defined);
+				}
+			} else {
+				//the prefixes of the shape are not used, since some members are not selected
+				bool first = true;
+				for (auto key_index : keys) {
+					if (!KeySelected(key_index)) {
+						SkipValue(reader, defined);
+						continue;
+					}
+					const size_t position = m_dictionary->Position(key_index);
+					if (!first)
+						output.Put(',');
+					first = false;
+					output.Write(m_keys_text.data() + m_keys_offsets[position], m_keys_offsets[position + 1] - m_keys_offsets[position]);
+					WriteValue(reader, key_index, output, defined);
+				}
+			}
+			char* end = output.Reserve(2);
+			end[0] = '}';
+			end[1] = '\n';
+			output.Commit(2);
+			++decoded;
+			continue;
+		}
+		if (record.Type() != TlvType::rtMemberCount)
+			throw TlvInvalidFormatError();
+		const int member_count = record.GetInt();
+
+		output.Put('{');
+		bool first = true;
+		for (int i = 0; i < member_count; ++i) {
+			//key
+			if (!reader.Next(record))
+				throw TlvInvalidFormatError();
+			while (record.Type() == TlvType::rtKeyDefinition) {
+				if (!defined)
+					DefineKey(record.Data(), record.DataSize());
+				RenderKeys();
+				if (!reader.Next(record))
+					throw TlvInvalidFormatError();
+			}
+			const int key_index = record.GetInt();
+			const size_t position = m_dictionary->Position(key_index);
+			if (!KeySelected(key_index)) {
+				SkipValue(reader, defined);
+				continue;
+			}
+			if (!first)
+				output.Put(',');
+			first = false;
+			output.Write(m_keys_text.data() + m_keys_offsets[position], m_keys_offsets[position + 1] - m_keys_offsets[position]);
+
+			//value
+			WriteValue(reader, key_index, output, defined);
+		}
+		char* end = output.Reserve(2);
+		end[0] = '}';
+		end[1] = '\n';
+		output.Commit(2);
+		++decoded;
+	}
+	reader.Consume();
+	return decoded;
+}
+
+void TlvToJsonDirect::RenderKeys() {
+	//m_keys_offsets holds the begining of every rendered key and the end of the last one
+	const auto& entries = m_dictionary->Entries();
+	for (size_t position = m_keys_offsets.size() - 1; position < entries.size(); ++position) {
+		StringByteSink key(2 + entries[position].length * 6 + 1);
+		WriteJsonString(entries[position].data, entries[position].length, key);
+		key.Put(':');
+		m_keys_text += key.Data();
+		m_keys_offsets.push_back(m_keys_text.size());
+	}
+}
+
+void TlvToJsonDirect::RenderShapes() {
+	//m_shape_prefixes holds the first member prefix of every rendered shape and the end of the last one
+	for (size_t index = m_shape_prefixes.size() - 1; index < m_shapes->Size(); ++index) {
+		bool first = true;
+		for (auto key : m_shapes->GetShape(static_cast<int>(index))) {
+			const size_t position = m_dictionary->Position(key);
+			if (!first)
+				m_prefixes_text += ',';
+			first = false;
+			m_prefixes_text.append(m_keys_text, m_keys_offsets[position], m_keys_offsets[position + 1] - m_keys_offsets[position]);
+			m_prefixes_offsets.push_back(m_prefixes_text.size());
+		}
+		m_shape_prefixes.push_back(m_prefixes_offsets.size() - 1);
+	}
+}
+
+void TlvToJsonDirect::RenderValues() {
+	//m_values_offsets holds the begining of every rendered value of a key and the end of the last one
+	if (m_values_text.size() < m_values.KeyCount()) {
+		m_values_text.resize(m_values.KeyCount());
+		m_values_offsets.resize(m_values.KeyCount(), std::vector<size_t>(1, 0));
+	}
+	for (size_t position = 0; position < m_values.KeyCount(); ++position) {
+		std::vector<size_t>& offsets = m_values_offsets[position];
+		for (size_t code = offsets.size() - 1; code < m_values.Size(position); ++code) {
+			const std::string& value = m_values.GetValue(position, static_cast<int>(code));
+			StringByteSink rendered(2 + value.size() * 6);
+			WriteJsonString(value.data(), value.size(), rendered);
+			m_values_text[position] += rendered.Data();
+			offsets.push_back(m_values_text[position].size());
+		}
+	}
+}
+
+void TlvToJsonDirect::WriteValue(TlvReader &reader, int key_index, ByteSink &output, bool defined) {
+	using TlvType = TlvRecordView::TlvRecordType;
+	TlvRecordView record;
+	if (!reader.Next(record))
+		throw TlvInvalidFormatError();
+	while (record.Type() == TlvType::rtValueDefinition) {
+		if (!defined)
+			DefineValue(record.Data(), record.DataSize());
+		RenderValues();
+		if (!reader.Next(record))
+			throw TlvInvalidFormatError();
+	}
+	if (record.Type() != TlvType::rtStringRef) {
+		WriteJsonValue(record, output);
+		return;
+	}
+	uint16_t code;
+	if (record.DataSize() != sizeof(code))
+		throw TlvInvalidFormatError();
+	memcpy(&code, record.Data(), sizeof(code));
+	const size_t position = m_dictionary->Position(key_index);
+	if (position >= m_values_offsets.size() || static_cast<size_t>(code) + 1 >= m_values_offsets[position].size())
+		throw app_err::JsonPackerMissed("string value", std::to_string(code));
+	const std::vector<size_t>& offsets = m_values_offsets[position];
+	output.Write(m_values_text[position].data() + offsets[code], offsets[code + 1u] - offsets[code]);
+}
+
+void TlvToJsonDirect::SkipValue(TlvReader &reader, bool defined) {
+	using TlvType = TlvRecordView::TlvRecordType;
+	TlvRecordView record;
+	do {
+		if (!reader.Next(record))
+			throw TlvInvalidFormatError();
+		if (record.Type() == TlvType::rtValueDefinition) {
+			if (!defined)
+				DefineValue(record.Data(), record.DataSize());
+			RenderValues();
+		}
+	} while (record.Type() == TlvType::rtValueDefinition);
+}
+
+void TlvToJson::LoadDictionary(ByteSource &source, TlvFormat format, uint64_t end) {
+	using RecType = TlvRecord<std::streamsize>;
+	using TlvType = RecType::TlvRecordType;
+	RecType record;
+
+	std::string dictionary_key;
+	int dictionary_index;
+	bool wait_for_string = true;
+	while (source.Position() < end) {
+		if (!ReadTlv(source, record, format))
+			break;
+		//shapes and string values are defined after keys
+		if (wait_for_string && record.Type() == TlvType::rtShapeDefinition) {
+			DefineShape(record.Data().data(), static_cast<size_t>(record.DataSize()));
+			continue;
+		}
+		if (wait_for_string && record.Type() == TlvType::rtValueDefinition) {
+			DefineValue(record.Data().data(), static_cast<size_t>(record.DataSize()));
+			continue;
+		}
+		//check format
+		if ((wait_for_string && record.Type() != TlvType::rtString) ||
+			(!wait_for_string && record.Type() != TlvType::rtInt))
+		{
+			throw TlvInvalidFormatError();
+		}
+		if (record.Type() == TlvType::rtString) {
+			dictionary_key = record.GetString();
+			wait_for_string = false;
+		}
+		else if (record.Type() == TlvType::rtInt) {
+			dictionary_index = record.GetInt();
+			m_dictionary->AddKey(dictionary_key, dictionary_index);
+			wait_for_string = true;
+		}
+	}
+	if (end != std::numeric_limits<uint64_t>::max() && source.Position() != end)
+		throw TlvInvalidFormatError();
 }
 
 std::ios_base::openmode TlvToJson::InputOpenModeFlags() {
@@ -0,0 +1,697 @@
+#include "columnar.h"
+#include "simd.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <unordered_map>
+
+namespace jsonpacker_coder {
+
+namespace {
+
+using TlvType = TlvRecordView::TlvRecordType;
+
+/**
+ * @brief The ColumnBuilder struct collects the chunk of one column
+ */
+struct ColumnBuilder {
+	int key {0}; ///the key index of the column
+	std::string bitmap; ///presence bitmap
+	std::string types; ///type tags of values
+	std::string values; ///packed values
+	std::vector<uint64_t> numbers; ///values extended to 64 bits if all values are integer, bits of values if all values are doubles
+	bool integer {true}; ///all values are integer
+	bool real {true}; ///all values are doubles
+	ColumnCodecId codec {ColumnCodecId::packed}; ///the codec of values
+};
+
+void AppendVarint(std::string& data, uint64_t value) {
+	char buffer[10];
+	data.append(buffer, EncodeVarint(value, buffer));
+}
+
+/**
+ * @brief ReadHeadVarint decodes varint of block head and moves pointer after it
+ * @param next[in,out] pointer to varint
+ * @param end[in] the end of data
+ * @param limit[in] the maximum valid value
+ * @return the decoded value
+ * @throw TlvInvalidFormatError if data ends before the end of varint or the value is greater than limit
+ */
+uint64_t ReadHeadVarint(const char*& next, const char* end, uint64_t limit) {
+	uint64_t value;
+	const size_t size = DecodeVarint(next, static_cast<size_t>(end - next), value);
+	if (!size || value > limit)
+		throw TlvInvalidFormatError();
+	next += size;
+	return value;
+}
+
+uint64_t ZigZag(uint64_t value) {
+	return (value << 1) ^ static_cast<uint64_t>(static_cast<int64_t>(value) >> 63);
+}
+
+uint64_t UnZigZag(uint64_t value) {
+	return (value >> 1) ^ (~(value & 1) + 1);
+}
+
+size_t VarintSize(uint64_t value) {
+	size_t size = 1;
+	for (; value >= 0x80; value >>= 7)
+		++size;
+	return size;
+}
+
+/**
+ * @brief IntegerSize returns the size of value of integer type
+ * @return the size of value in bytes or 0 if the type is not integer
+ */
+size_t IntegerSize(TlvType type) {
+	switch (type) {
+	case TlvType::rtInt:
+	case TlvType::rtUInt:
+		return 4;
+	case TlvType::rtInt64:
+	case TlvType::rtUInt64:
+		return 8;
+	default:
+		return 0;
+	}
+}
+
+/**
+ * @brief GetIntegerValue extends the value of integer type to 64 bits (4-byte signed values are sign-extended)
+ * @return false if the type of value is not integer
+ */
+bool GetIntegerValue(const TlvRecordView& record, uint64_t& value) {
+	if (record.Type() == TlvType::rtInt) {
+		int32_t number;
+		memcpy(&number, record.Data(), sizeof(number));
+		value = static_cast<uint64_t>(static_cast<int64_t>(number));
+		return true;
+	}
+	const size_t size = IntegerSize(record.Type());
+	value = 0;
+	memcpy(&value, record.Data(), size);
+	return size != 0;
+}
+
+/**
+ * @brief The Frame struct describes frame of reference of values
+ */
+struct Frame {
+	uint64_t base {0}; ///the minimal value
+	unsigned int width {0}; ///the width in bits of differences between values and the minimal value
+};
+
+Frame GetFrame(const uint64_t* values, size_t count) {
+	Frame frame;
+	if (!count)
+		return frame;
+	int64_t min = static_cast<int64_t>(values[0]);
+	int64_t max = min;
+	for (size_t i = 1; i < count; ++i) {
+		min = std::min(min, static_cast<int64_t>(values[i]));
+		max = std::max(max, static_cast<int64_t>(values[i]));
+	}
+	frame.base = static_cast<uint64_t>(min);
+	const uint64_t range = static_cast<uint64_t>(max) - static_cast<uint64_t>(min);
+	frame.width = range ? static_cast<unsigned int>(64 - __builtin_clzll(range)) : 0;
+	return frame;
+}
+
+size_t FrameSize(const Frame& frame, size_t count) {
+	return VarintSize(ZigZag(frame.base)) + 1 + (count * frame.width + 7) / 8;
+}
+
+void WriteFrame(const uint64_t* values, size_t count, const Frame& frame, std::string& data) {
+	AppendVarint(data, ZigZag(frame.base));
+	data.push_back(static_cast<char>(frame.width));
+	const size_t begin = data.size();
+	data.resize(begin + (count * frame.width + 7) / 8, '\0');
+	unsigned char* const packed = reinterpret_cast<unsigned char*>(&data[begin]);
+	uint64_t bit = 0;
+	for (size_t i = 0; i < count; ++i) {
+		const uint64_t value = values[i] - frame.base;
+		for (unsigned int done = 0; done < frame.width;) {
+			const unsigned int shift = static_cast<unsigned int>(bit % 8);
+			const unsigned int taken = std::min(8 - shift, frame.width - done);
+			packed[bit / 8] = static_cast<unsigned char>(packed[bit / 8] | (((value >> done) & ((1u << taken) - 1)) << shift));
+			done += taken;
+			bit += taken;
+		}
+	}
+}
+
+/**
+ * @brief ReadFrame decodes frame of reference of values and moves pointer after it
+ * @throw TlvInvalidFormatError if data ends before the end of frame
+ */
+void ReadFrame(const char*& next, const char* end, size_t count, uint64_t* values) {
+	const uint64_t base = UnZigZag(ReadHeadVarint(next, end, std::numeric_limits<uint64_t>::max()));
+	if (next == end || static_cast<unsigned char>(*next) > 64)
+		throw TlvInvalidFormatError();
+	const unsigned int width = static_cast<unsigned char>(*next++);
+	const size_t size = (count * width + 7) / 8;
+	if (static_cast<size_t>(end - next) < size)
+		throw TlvInvalidFormatError();
+	simd::UnpackBits(next, size, count, width, base, values);
+	next += size;
+}
+
+/**
+ * @brief The BitWriter class appends bit stream to data (bits of every byte are filled from the lowest one)
+ */
+class BitWriter {
+public:
+	explicit BitWriter(std::string& data) : m_data(data) {}
+	/**
+	 * @brief Write writes the lowest bits of value starting from the lowest one
+	 * @param value[in] the value
+	 * @param count[in] the count of bits (0 - 64)
+	 */
+	void Write(uint64_t value, unsigned int count) {
+		for (unsigned int done = 0; done < count;) {
+			if (!m_used)
+				m_data.push_back('\0');
+			const unsigned int taken = std::min(8 - m_used, count - done);
+			m_data.back() = static_cast<char>(static_cast<unsigned char>(m_data.back()) | (((value >> done) & ((1u << taken) - 1)) << m_used));
+			m_used = (m_used + taken) % 8;
+			done += taken;
+		}
+	}
+private:
+	std::string& m_data;
+	unsigned int m_used {0}; ///the count of used bits of the last byte
+};
+
+/**
+ * @brief The BitReader class reads bit stream written by BitWriter
+ */
+class BitReader {
+public:
+	BitReader(const char* data, size_t size) : m_data(data), m_size(size) {}
+	/**
+	 * @brief Peek returns the next bits without reading them
+	 * @return at least 57 next bits (the bits after the end of data are zeros)
+	 */
+	uint64_t Peek() const {
+		//the bits are taken from 8 bytes beginning with the byte of the next bit
+		const size_t byte = static_cast<size_t>(m_bit / 8);
+		uint64_t word = 0;
+		if (byte + sizeof(word) <= m_size)
+			memcpy(&word, m_data + byte, sizeof(word));
+		else if (byte < m_size)
+			memcpy(&word, m_data + byte, m_size - byte);
+		return word >> (m_bit % 8);
+	}
+	/**
+	 * @brief Skip skips bits (data may end before the last bit, @see Size)
+	 * @param count[in] the count of bits
+	 */
+	void Skip(unsigned int count) {
+		m_bit += count;
+	}
+	/**
+	 * @brief Read reads bits of value starting from the lowest one (data may end before the last bit, @see Size)
+	 * @param count[in] the count of bits (0 - 64)
+	 * @return the value
+	 */
+	uint64_t Read(unsigned int count) {
+		if (count > 56) {
+			const uint64_t low = Read(32);
+			return low | Read(count - 32) << 32;
+		}
+		const uint64_t value = Peek() & ((uint64_t(1) << count) - 1);
+		Skip(count);
+		return value;
+	}
+	/**
+	 * @brief Size returns the count of bytes holding the bits read (greater than the size of data if data ended before the last bit)
+	 */
+	size_t Size() const {return static_cast<size_t>((m_bit + 7) / 8);}
+private:
+	const char* m_data;
+	size_t m_size;
+	uint64_t m_bit {0}; ///the number of the next bit
+};
+
+} // end of anonymous namespace
+
+ColumnCodecId EncodeIntegers(const std::vector<uint64_t> &values, size_t max_size, std::string &data) {
+	const size_t count = values.size();
+	std::vector<uint64_t> deltas(count ? count - 1 : 0);
+	for (size_t i = 1; i < count; ++i)
+		deltas[i - 1] = values[i] - values[i - 1];
+	std::vector<uint64_t> deltas_of_deltas(deltas.empty() ? 0 : deltas.size() - 1);
+	for (size_t i = 1; i < deltas.size(); ++i)
+		deltas_of_deltas[i - 1] = deltas[i] - deltas[i - 1];
+	size_t runs = 0;
+	size_t runs_size = 0;
+	for (size_t i = 0, length = 1; i < count; ++i, ++length) {
+		if (i + 1 == count || values[i + 1] != values[i]) {
+			++runs;
+			runs_size += VarintSize(ZigZag(values[i])) + VarintSize(length);
+			length = 0;
+		}
+	}
+
+	//the sizes of encodings are calculated before encoding, values are left packed unless some codec gives smaller size
+	const Frame frame = GetFrame(values.data(), count);
+	const Frame deltas_frame = GetFrame(deltas.data(), deltas.size());
+	const Frame deltas_of_deltas_frame = GetFrame(deltas_of_deltas.data(), deltas_of_deltas.size());
+	const size_t none = std::numeric_limits<size_t>::max();
+	const size_t sizes[] = {
+		max_size,
+		FrameSize(frame, count),
+		count ? VarintSize(ZigZag(values[0])) + FrameSize(deltas_frame, deltas.size()) : none,
+		count > 1 ? VarintSize(ZigZag(values[0])) + VarintSize(ZigZag(deltas[0])) + FrameSize(deltas_of_deltas_frame, deltas_of_deltas.size()) : none,
+		VarintSize(runs) + runs_size
+	};
+	const ColumnCodecId codec = static_cast<ColumnCodecId>(std::min_element(std::begin(sizes), std::end(sizes)) - std::begin(sizes));
+	switch (codec) {
+	case ColumnCodecId::packed:
+		break;
+	case ColumnCodecId::frame:
+		WriteFrame(values.data(), count, frame, data);
+		break;
+	case ColumnCodecId::delta:
+		AppendVarint(data, ZigZag(values[0]));
+		WriteFrame(deltas.data(), deltas.size(), deltas_frame, data);
+		break;
+	case ColumnCodecId::delta_of_delta:
+		AppendVarint(data, ZigZag(values[0]));
+		AppendVarint(data, ZigZag(deltas[0]));
+		WriteFrame(deltas_of_deltas.data(), deltas_of_deltas.size(), deltas_of_deltas_frame, data);
+		break;
+	case ColumnCodecId::rle:
+		AppendVarint(data, runs);
+		for (size_t i = 0, length = 1; i < count; ++i, ++length) {
+			if (i + 1 == count || values[i + 1] != values[i]) {
+				AppendVarint(data, ZigZag(values[i]));
+				AppendVarint(data, length);
+				length = 0;
+			}
+		}
+		break;
+	case ColumnCodecId::xor_float:
+		//doubles are encoded by EncodeDoubles, the size of this codec is never estimated for integers
+		throw app_err::JsonPackerError("XOR codec can not encode integers");
+	}
+	return codec;
+}
+
+void DecodeIntegers(ColumnCodecId codec, const char *data, size_t size, size_t count, std::vector<uint64_t> &values) {
+	const uint64_t max_value = std::numeric_limits<uint64_t>::max();
+	const char* next = data;
+	const char* const end = data + size;
+	values.resize(count);
+	switch (codec) {
+	case ColumnCodecId::frame:
+		ReadFrame(next, end, count, values.data());
+		break;
+	case ColumnCodecId::delta:
+		if (!count)
+			throw TlvInvalidFormatError();
+		values[0] = UnZigZag(ReadHeadVarint(next, end, max_value));
+		ReadFrame(next, end, count - 1, values.data() + 1);
+		for (size_t i = 1; i < count; ++i)
+			values[i] += values[i - 1];
+		break;
+	case ColumnCodecId::delta_of_delta: {
+		if (count < 2)
+			throw TlvInvalidFormatError();
+		values[0] = UnZigZag(ReadHeadVarint(next, end, max_value));
+		uint64_t delta = UnZigZag(ReadHeadVarint(next, end, max_value));
+		values[1] = values[0] + delta;
+		ReadFrame(next, end, count - 2, values.data() + 2);
+		for (size_t i = 2; i < count; ++i) {
+			delta += values[i];
+			values[i] = values[i - 1] + delta;
+		}
+		break;
+	}
+	case ColumnCodecId::rle: {
+		const uint64_t runs = ReadHeadVarint(next, end, count);
+		size_t filled = 0;
+		for (uint64_t run = 0; run < runs; ++run) {
+			const uint64_t value = UnZigZag(ReadHeadVarint(next, end, max_value));
+			const size_t length = static_cast<size_t>(ReadHeadVarint(next, end, count - filled));
+			std::fill(values.begin() + static_cast<std::ptrdiff_t>(filled), values.begin() + static_cast<std::ptrdiff_t>(filled + length), value);
+			filled += length;
+		}
+		if (filled != count)
+			throw TlvInvalidFormatError();
+		break;
+	}
+	default:
+		throw TlvInvalidFormatError();
+	}
+	if (next != end)
+		throw TlvInvalidFormatError();
+}
+
+ColumnCodecId EncodeDoubles(const std::vector<uint64_t> &values, size_t max_size, std::string &data) {
+	if (values.empty())
+		return ColumnCodecId::packed;
+	std::string encoded;
+	BitWriter writer(encoded);
+	writer.Write(values[0], 64);
+	unsigned int window_leading = 64;
+	unsigned int window_trailing = 0;
+	for (size_t i = 1; i < values.size() && encoded.size() < max_size; ++i) {
+		const uint64_t difference = values[i] ^ values[i - 1];
+		if (!difference) {
+			writer.Write(0, 1);
+			continue;
+		}
+		const unsigned int leading = std::min(static_cast<unsigned int>(__builtin_clzll(difference)), 31u);
+		const unsigned int trailing = static_cast<unsigned int>(__builtin_ctzll(difference));
+		if (window_leading < 64 && leading >= window_leading && trailing >= window_trailing) {
+			//meaningful bits fit in the window of the previous value
+			writer.Write(1, 2);
+			writer.Write(difference >> window_trailing, 64 - window_leading - window_trailing);
+			continue;
+		}
+		const unsigned int length = 64 - leading - trailing;
+		writer.Write(3, 2);
+		writer.Write(leading, 5);
+		writer.Write(length - 1, 6);
+		writer.Write(difference >> trailing, length);
+		window_leading = leading;
+		window_trailing = trailing;
+	}
+	if (encoded.size() >= max_size)
+		return ColumnCodecId::packed;
+	data += encoded;
+	return ColumnCodecId::xor_float;
+}
+
+void DecodeDoubles(const char *data, size_t size, size_t count, std::vector<uint64_t> &values) {
+	values.resize(count);
+	if (!count)
+		throw TlvInvalidFormatError();
+	BitReader reader(data, size);
+	values[0] = reader.Read(64);
+	unsigned int window_leading = 64;
+	unsigned int window_trailing = 0;
+	for (size_t i = 1; i < count; ++i) {
+		//control bits, the new window and meaningful bits (if they fit) are taken at once
+		const uint64_t bits = reader.Peek();
+		if (!(bits & 1)) {
+			reader.Skip(1);
+			values[i] = values[i - 1];
+			continue;
+		}
+		unsigned int header = 2;
+		if (bits & 2) {
+			header = 13;
+			window_leading = static_cast<unsigned int>(bits >> 2 & 31);
+			window_trailing = 64 - window_leading - static_cast<unsigned int>((bits >> 7 & 63) + 1);
+			if (window_trailing > 64)
+				throw TlvInvalidFormatError();
+		} else if (window_leading == 64)
+			throw TlvInvalidFormatError();
+		const unsigned int length = 64 - window_leading - window_trailing;
+		uint64_t difference;
+		if (header + length <= 57) {
+			difference = bits >> header & ((uint64_t(1) << length) - 1);
+			reader.Skip(header + length);
+		} else {
+			reader.Skip(header);
+			difference = reader.Read(length);
+		}
+		values[i] = values[i - 1] ^ (difference << window_trailing);
+	}
+	if (reader.Size() != size)
+		throw TlvInvalidFormatError();
+}
+
+void EncodeColumnarBlock(const char *data, size_t size, bool integer_codecs, bool double_codecs, std::string &block) {
+	using RecType = TlvRecord<std::streamsize>;
+	std::vector<ColumnBuilder> columns;
+	std::vector<int> key_columns;
+	std::unordered_map<std::string, uint64_t> shape_numbers;
+	std::string shapes;
+	std::vector<uint64_t> row_shapes;
+	std::string shape;
+	TlvRecordView record;
+
+	//values are distributed into columns, the order of members is kept in shape of record
+	for (size_t next = 0; next < size;) {
+		size_t record_size = ParseTlv(data + next, size - next, TlvFormat::v2, record);
+		if (!record_size || record.Type() != TlvType::rtMemberCount || record.GetInt() < 0)
+			throw TlvInvalidFormatError();
+		next += record_size;
+		const int member_count = record.GetInt();
+		const size_t row = row_shapes.size();
+		shape.clear();
+		AppendVarint(shape, static_cast<uint64_t>(member_count));
+		for (int i = 0; i < member_count; ++i) {
+			record_size = ParseTlv(data + next, size - next, TlvFormat::v2, record);
+			if (!record_size || record.Type() != TlvType::rtInt || record.GetInt() < 0)
+				throw TlvInvalidFormatError();
+			next += record_size;
+			const int key = record.GetInt();
+			AppendVarint(shape, static_cast<uint64_t>(key));
+			record_size = ParseTlv(data + next, size - next, TlvFormat::v2, record);
+			if (!record_size)
+				throw TlvInvalidFormatError();
+			next += record_size;
+
+			if (key_columns.size() <= static_cast<size_t>(key))
+				key_columns.resize(static_cast<size_t>(key) + 1, -1);
+			if (key_columns[static_cast<size_t>(key)] < 0) {
+				key_columns[static_cast<size_t>(key)] = static_cast<int>(columns.size());
+				columns.emplace_back();
+				columns.back().key = key;
+			}
+			ColumnBuilder& column = columns[static_cast<size_t>(key_columns[static_cast<size_t>(key)])];
+			column.bitmap.resize(row / 8 + 1);
+			column.bitmap[row / 8] = static_cast<char>(column.bitmap[row / 8] | (1 << (row % 8)));
+			column.types.push_back(static_cast<char>(record.Type()));
+			if (RecType::FixedDataSize(record.Type()) < 0)
+				AppendVarint(column.values, record.DataSize());
+			column.values.append(record.Data(), record.DataSize());
+			if (column.integer || column.real) {
+				uint64_t value = 0;
+				column.integer = column.integer && integer_codecs && GetIntegerValue(record, value);
+				column.real = column.real && double_codecs && record.Type() == TlvType::rtDouble;
+				if (column.real)
+					memcpy(&value, record.Data(), sizeof(value));
+				if (column.integer || column.real)
+					column.numbers.push_back(value);
+				else
+					column.numbers.clear();
+			}
+		}
+		auto inserted = shape_numbers.emplace(shape, shape_numbers.size());
+		if (inserted.second)
+			shapes += shape;
+		row_shapes.push_back(inserted.first->second);
+	}
+
+	std::string head;
+	AppendVarint(head, row_shapes.size());
+	AppendVarint(head, shape_numbers.size());
+	head += shapes;
+	for (auto shape_number : row_shapes)
+		AppendVarint(head, shape_number);
+	AppendVarint(head, columns.size());
+	const size_t bitmap_size = (row_shapes.size() + 7) / 8;
+	std::string value_count;
+	std::string encoded;
+	for (auto& column : columns) {
+		//packed values are replaced by encoded ones if column codec gives smaller size
+		encoded.clear();
+		if (column.integer)
+			column.codec = EncodeIntegers(column.numbers, column.values.size(), encoded);
+		else if (column.real)
+			column.codec = EncodeDoubles(column.numbers, column.values.size(), encoded);
+		if (column.codec != ColumnCodecId::packed)
+			column.values.swap(encoded);
+		value_count.clear();
+		AppendVarint(value_count, column.types.size());
+		AppendVarint(head, static_cast<uint64_t>(column.key));
+		AppendVarint(head, bitmap_size + value_count.size() + column.types.size() + (integer_codecs || double_codecs ? 1 : 0) + column.values.size());
+	}
+
+	const uint32_t head_size = static_cast<uint32_t>(head.size());
+	block.assign(reinterpret_cast<const char*>(&head_size), sizeof(head_size));
+	block += head;
+	for (auto& column : columns) {
+		column.bitmap.resize(bitmap_size);
+		block += column.bitmap;
+		AppendVarint(block, column.types.size());
+		block += column.types;
+		if (integer_codecs || double_codecs)
+			block.push_back(static_cast<char>(column.codec));
+		block += column.values;
+	}
+}
+
+void ColumnarBlockReader::Read(ByteSource &source, uint64_t offset, const std::vector<bool> &selected_keys, bool column_codecs) {
+	const char* data;
+	uint32_t head_size;
+	source.Seek(offset);
+	if (source.Peek(data, sizeof(head_size)) < sizeof(head_size))
+		throw TlvInvalidFormatError();
+	memcpy(&head_size, data, sizeof(head_size));
+	const size_t block_head_size = sizeof(head_size) + head_size;
+	if (source.Peek(data, block_head_size) < block_head_size)
+		throw TlvInvalidFormatError();
+
+	//every number takes at least one byte of head, so counts are limited by the size of head
+	const char* next = data + sizeof(head_size);
+	const char* const end = data + block_head_size;
+	const uint64_t record_count = ReadHeadVarint(next, end, head_size);
+	const uint64_t shape_count = ReadHeadVarint(next, end, head_size);
+	std::vector<std::vector<int>> shape_keys(static_cast<size_t>(shape_count));
+	for (auto& keys : shape_keys) {
+		keys.resize(static_cast<size_t>(ReadHeadVarint(next, end, head_size)));
+		for (auto& key : keys)
+			key = static_cast<int>(ReadHeadVarint(next, end, static_cast<uint64_t>(std::numeric_limits<int>::max())));
+	}
+	if (record_count && !shape_count)
+		throw TlvInvalidFormatError();
+	m_row_shapes.resize(static_cast<size_t>(record_count));
+	std::vector<uint64_t> shape_rows(shape_keys.size());
+	for (auto& shape : m_row_shapes) {
+		shape = static_cast<uint32_t>(ReadHeadVarint(next, end, shape_count - 1));
+		++shape_rows[shape];
+	}
+
+	//the keys are mapped to columns, the chunks of selected columns are read after head
+	const size_t column_count = static_cast<size_t>(ReadHeadVarint(next, end, head_size));
+	std::unordered_map<int, int> key_columns;
+	std::vector<uint64_t> chunk_sizes(column_count);
+	m_columns.assign(column_count, Column());
+	std::vector<int> column_keys(column_count);
+	for (size_t i = 0; i < column_count; ++i) {
+		column_keys[i] = static_cast<int>(ReadHeadVarint(next, end, static_cast<uint64_t>(std::numeric_limits<int>::max())));
+		chunk_sizes[i] = ReadHeadVarint(next, end, std::numeric_limits<uint32_t>::max());
+		if (!key_columns.emplace(column_keys[i], static_cast<int>(i)).second)
+			throw TlvInvalidFormatError();
+	}
+	if (next != end)
+		throw TlvInvalidFormatError();
+	m_column_keys = column_keys;
+
+	//shapes refer to columns of selected keys
+	std::vector<uint64_t> column_values(column_count);
+	m_shapes.assign(shape_keys.size(), std::vector<int>());
+	m_selected_members.assign(shape_keys.size(), 0);
+	for (size_t i = 0; i < shape_keys.size(); ++i) {
+		for (auto key : shape_keys[i]) {
+			auto column = key_columns.find(key);
+			if (column == key_columns.end())
+				throw TlvInvalidFormatError();
+			column_values[static_cast<size_t>(column->second)] += shape_rows[i];
+			const bool selected = selected_keys.empty() || (static_cast<size_t>(key) < selected_keys.size() && selected_keys[static_cast<size_t>(key)]);
+			m_shapes[i].push_back(selected ? column->second : -1);
+			if (selected)
+				++m_selected_members[i];
+		}
+	}
+
+	const size_t bitmap_size = static_cast<size_t>((record_count + 7) / 8);
+	uint64_t chunk_offset = offset + block_head_size;
+	for (size_t i = 0; i < column_count; ++i) {
+		const int key = column_keys[i];
+		const uint64_t chunk_size = chunk_sizes[i];
+		const bool selected = selected_keys.empty() || (static_cast<size_t>(key) < selected_keys.size() && selected_keys[static_cast<size_t>(key)]);
+		if (selected) {
+			Column& column = m_columns[i];
+			source.Seek(chunk_offset);
+			if (source.Peek(data, static_cast<size_t>(chunk_size)) < chunk_size)
+				throw TlvInvalidFormatError();
+			column.data.assign(data, static_cast<size_t>(chunk_size));
+			//presence bitmap is not needed to rebuild records, shapes give the order of members
+			const char* chunk = column.data.data();
+			const char* types = chunk + std::min<size_t>(bitmap_size, column.data.size());
+			column.value_count = static_cast<size_t>(ReadHeadVarint(types, chunk + column.data.size(), column.data.size()));
+			column.types = static_cast<size_t>(types - chunk);
+			column.values = column.types + column.value_count;
+			if (column.value_count != column_values[i] || column.values + (column_codecs ? 1 : 0) > column.data.size())
+				throw TlvInvalidFormatError();
+			if (column_codecs) {
+				if (static_cast<unsigned char>(column.data[column.values]) > static_cast<unsigned char>(ColumnCodecId::xor_float))
+					throw TlvInvalidFormatError();
+				column.codec = static_cast<ColumnCodecId>(column.data[column.values++]);
+			}
+		}
+		chunk_offset += chunk_size;
+	}
+}
+
+void ColumnarBlockReader::RebuildRecords(ByteSink &output) const {
+	using RecType = TlvRecord<std::streamsize>;
+	std::vector<size_t> value_numbers(m_columns.size(), 0);
+	std::vector<size_t> value_offsets(m_columns.size(), 0);
+	std::vector<const char*> value_data(m_columns.size());
+	std::vector<size_t> value_sizes(m_columns.size());
+	std::vector<std::string> decoded(m_columns.size());
+	std::vector<uint64_t> numbers;
+	for (size_t i = 0; i < m_columns.size(); ++i) {
+		const Column& column = m_columns[i];
+		if (column.codec == ColumnCodecId::packed) {
+			value_data[i] = column.data.data() + column.values;
+			value_sizes[i] = column.data.size() - column.values;
+			continue;
+		}
+		//encoded values are packed as they are in TLV records
+		const bool real = column.codec == ColumnCodecId::xor_float;
+		if (real)
+			DecodeDoubles(column.data.data() + column.values, column.data.size() - column.values, column.value_count, numbers);
+		else
+			DecodeIntegers(column.codec, column.data.data() + column.values, column.data.size() - column.values, column.value_count, numbers);
+		decoded[i].resize(column.value_count * sizeof(uint64_t));
+		char* next = &decoded[i][0];
+		for (size_t j = 0; j < column.value_count; ++j) {
+			const TlvType type = static_cast<TlvType>(column.data[column.types + j]);
+			const size_t size = real ? (type == TlvType::rtDouble ? sizeof(double) : 0) : IntegerSize(type);
+			if (!size)
+				throw TlvInvalidFormatError();
+			memcpy(next, &numbers[j], sizeof(uint64_t));
+			next += size;
+		}
+		decoded[i].resize(static_cast<size_t>(next - decoded[i].data()));
+		value_data[i] = decoded[i].data();
+		value_sizes[i] = decoded[i].size();
+	}
+
+	for (auto shape_number : m_row_shapes) {
+		const uint32_t member_count = static_cast<uint32_t>(m_selected_members[shape_number]);
+		output.Put(static_cast<char>(TlvType::rtMemberCount));
+		output.Write(reinterpret_cast<const char*>(&member_count), sizeof(member_count));
+		for (auto column_number : m_shapes[shape_number]) {
+			if (column_number < 0)
+				continue;
+			const size_t index = static_cast<size_t>(column_number);
+			const Column& column = m_columns[index];
+			const int key = m_column_keys[index];
+			output.Put(static_cast<char>(TlvType::rtInt));
+			output.Write(reinterpret_cast<const char*>(&key), sizeof(key));
+
+			//values are taken in order, the count of values matches shapes
+			const char type = column.data[column.types + value_numbers[index]++];
+			if ((type < static_cast<char>(TlvType::rtInt) || type > static_cast<char>(TlvType::rtString)) && type != static_cast<char>(TlvType::rtStringRef))
+				throw TlvInvalidFormatError();
+			const char* value = value_data[index] + value_offsets[index];
+			const size_t available = value_sizes[index] - value_offsets[index];
+			const std::streamsize fixed_size = RecType::FixedDataSize(static_cast<TlvType>(type));
+			uint64_t size = static_cast<uint64_t>(fixed_size);
+			size_t length_size = 0;
+			if (fixed_size < 0 && !(length_size = DecodeVarint(value, available, size)))
+				throw TlvInvalidFormatError();
+			if (size > available - length_size)
+				throw TlvInvalidFormatError();
+			output.Put(type);
+			output.Write(value, length_size + static_cast<size_t>(size));
+			value_offsets[index] += length_size + static_cast<size_t>(size);
+		}
+	}
+}
+
+} //end of namespace jsonpacker_coder
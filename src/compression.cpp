@@ -0,0 +1,248 @@
+#include "compression.h"
+#include "apperror.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#ifdef JSONPACKER_WITH_ZLIB
+#include <zlib.h>
+#endif
+#ifdef JSONPACKER_WITH_ZSTD
+#include <zstd.h>
+#endif
+
+namespace jsonpacker_compression {
+
+namespace {
+
+const char* const CODEC_NAMES[] = {"stored", "lz", "zlib", "zstd"}; ///the names of codecs indexed by identifiers
+
+/**
+ * @brief The StoredCodec class copies data without compression
+ */
+class StoredCodec : public BlockCodec {
+public:
+	BlockCodecId Id() const override {return BlockCodecId::stored;}
+	size_t MaxCompressedSize(size_t size) const override {return size;}
+	size_t Compress(const char* data, size_t size, char* buffer, size_t) const override {
+		memcpy(buffer, data, size);
+		return size;
+	}
+	bool Decompress(const char* data, size_t size, char* buffer, size_t raw_size) const override {
+		if (size != raw_size)
+			return false;
+		memcpy(buffer, data, size);
+		return true;
+	}
+};
+
+#define LZ_MIN_MATCH 4 ///the minimal length of match
+#define LZ_MAX_OFFSET 0xffff ///the maximal distance of match
+#define LZ_HASH_BITS 14 ///the size of hash table of match finder (log2 of count of entries)
+
+/**
+ * @brief The LzCodec class is a fast byte-oriented LZ77 codec; compressed data is a sequence of tokens
+ * followed by literals and match: 1-byte token (4 bits of literal length and 4 bits of match length minus LZ_MIN_MATCH,
+ * the value 15 is extended by following bytes added until the byte less than 255), literals, 2-byte match offset
+ * and extension of match length; the last token has only literals and no match
+ */
+class LzCodec : public BlockCodec {
+public:
+	BlockCodecId Id() const override {return BlockCodecId::lz;}
+	size_t MaxCompressedSize(size_t size) const override {return size + size / 255 + 16;}
+	size_t Compress(const char* data, size_t size, char* buffer, size_t) const override {
+		std::vector<uint32_t> table(size_t(1) << LZ_HASH_BITS, 0);
+		const char* const end = data + size;
+		const char* literals = data;
+		const char* next = data;
+		char* out = buffer;
+		//the step of search grows while no match is found, so incompressible data is passed quickly
+		unsigned int misses = 0;
+		while (end - next >= LZ_MIN_MATCH) {
+			const uint32_t value = Load32(next);
+			uint32_t& entry = table[Hash(value)];
+			const char* match = data + entry;
+			entry = static_cast<uint32_t>(next - data);
+			if (match >= next || next - match > LZ_MAX_OFFSET || Load32(match) != value) {
+				next += 1 + (misses++ >> 6);
+				continue;
+			}
+			misses = 0;
+			const char* match_end = next + LZ_MIN_MATCH;
+			while (match_end < end && *match_end == match[match_end - next])
+				++match_end;
+			out = WriteSequence(out, literals, static_cast<size_t>(next - literals), static_cast<size_t>(match_end - next), static_cast<uint16_t>(next - match));
+			next = literals = match_end;
+		}
+		out = WriteSequence(out, literals, static_cast<size_t>(end - literals), 0, 0);
+		return static_cast<size_t>(out - buffer);
+	}
+	bool Decompress(const char* data, size_t size, char* buffer, size_t raw_size) const override {
+		const unsigned char* next = reinterpret_cast<const unsigned char*>(data);
+		const unsigned char* const end = next + size;
+		char* out = buffer;
+		char* const out_end = buffer + raw_size;
+		while (next < end) {
+			const unsigned int token = *next++;
+			size_t literal_length = token >> 4;
+			if (literal_length == 15 && !ReadLength(next, end, literal_length))
+				return false;
+			if (static_cast<size_t>(end - next) < literal_length || static_cast<size_t>(out_end - out) < literal_length)
+				return false;
+			memcpy(out, next, literal_length);
+			out += literal_length;
+			next += literal_length;
+			//the last token has no match
+			if (next == end)
+				break;
+			if (end - next < 2)
+				return false;
+			const size_t offset = static_cast<size_t>(next[0]) | static_cast<size_t>(next[1]) << 8;
+			next += 2;
+			size_t match_length = token & 15;
+			if (match_length == 15 && !ReadLength(next, end, match_length))
+				return false;
+			match_length += LZ_MIN_MATCH;
+			if (!offset || offset > static_cast<size_t>(out - buffer) || static_cast<size_t>(out_end - out) < match_length)
+				return false;
+			const char* match = out - offset;
+			if (offset >= match_length)
+				memcpy(out, match, match_length);
+			else {
+				//overlapping match repeats the last offset bytes
+				for (size_t i = 0; i < match_length; ++i)
+					out[i] = match[i];
+			}
+			out += match_length;
+		}
+		return out == out_end;
+	}
+private:
+	static uint32_t Load32(const char* data) {
+		uint32_t value;
+		memcpy(&value, data, sizeof(value));
+		return value;
+	}
+	static size_t Hash(uint32_t value) {
+		return (value * 2654435761u) >> (32 - LZ_HASH_BITS);
+	}
+	static char* WriteLength(char* out, size_t length) {
+		for (; length >= 255; length -= 255)
+			*out++ = static_cast<char>(255);
+		*out++ = static_cast<char>(length);
+		return out;
+	}
+	/**
+	 * @brief WriteSequence writes token, literals, and offset and extension of match length if there is match (match_length is not 0)
+	 */
+	static char* WriteSequence(char* out, const char* literals, size_t literal_length, size_t match_length, uint16_t offset) {
+		const size_t match_code = match_length ? match_length - LZ_MIN_MATCH : 0;
+		*out++ = static_cast<char>(std::min<size_t>(literal_length, 15) << 4 | std::min<size_t>(match_code, 15));
+		if (literal_length >= 15)
+			out = WriteLength(out, literal_length - 15);
+		memcpy(out, literals, literal_length);
+		out += literal_length;
+		if (match_length) {
+			//the offset is little-endian regardless of the host
+			*out++ = static_cast<char>(offset & 0xff);
+			*out++ = static_cast<char>(offset >> 8);
+			if (match_code >= 15)
+				out = WriteLength(out, match_code - 15);
+		}
+		return out;
+	}
+	static bool ReadLength(const unsigned char*& next, const unsigned char* end, size_t& length) {
+		unsigned int value;
+		do {
+			if (next == end)
+				return false;
+			value = *next++;
+			length += value;
+		} while (value == 255);
+		return true;
+	}
+};
+
+#ifdef JSONPACKER_WITH_ZLIB
+/**
+ * @brief The ZlibCodec class compresses data by zlib with the default compression level (the same as gzip)
+ */
+class ZlibCodec : public BlockCodec {
+public:
+	BlockCodecId Id() const override {return BlockCodecId::zlib;}
+	size_t MaxCompressedSize(size_t size) const override {return static_cast<size_t>(compressBound(static_cast<uLong>(size)));}
+	size_t Compress(const char* data, size_t size, char* buffer, size_t capacity) const override {
+		uLongf compressed_size = static_cast<uLongf>(capacity);
+		if (compress2(reinterpret_cast<Bytef*>(buffer), &compressed_size, reinterpret_cast<const Bytef*>(data), static_cast<uLong>(size), Z_DEFAULT_COMPRESSION) != Z_OK)
+			throw app_err::JsonPackerError("zlib compression failed");
+		return static_cast<size_t>(compressed_size);
+	}
+	bool Decompress(const char* data, size_t size, char* buffer, size_t raw_size) const override {
+		uLongf restored_size = static_cast<uLongf>(raw_size);
+		return uncompress(reinterpret_cast<Bytef*>(buffer), &restored_size, reinterpret_cast<const Bytef*>(data), static_cast<uLong>(size)) == Z_OK
+				&& restored_size == raw_size;
+	}
+};
+#endif
+
+#ifdef JSONPACKER_WITH_ZSTD
+/**
+ * @brief The ZstdCodec class compresses data by zstd with the default compression level
+ */
+class ZstdCodec : public BlockCodec {
+public:
+	BlockCodecId Id() const override {return BlockCodecId::zstd;}
+	size_t MaxCompressedSize(size_t size) const override {return ZSTD_compressBound(size);}
+	size_t Compress(const char* data, size_t size, char* buffer, size_t capacity) const override {
+		const size_t compressed_size = ZSTD_compress(buffer, capacity, data, size, 3);
+		if (ZSTD_isError(compressed_size))
+			throw app_err::JsonPackerError(std::string("zstd compression failed: ") + ZSTD_getErrorName(compressed_size));
+		return compressed_size;
+	}
+	bool Decompress(const char* data, size_t size, char* buffer, size_t raw_size) const override {
+		const size_t restored_size = ZSTD_decompress(buffer, raw_size, data, size);
+		return !ZSTD_isError(restored_size) && restored_size == raw_size;
+	}
+};
+#endif
+
+} // end of anonymous namespace
+
+RegisterInFactory("stored", StoredCodec, BlockCodec);
+RegisterInFactory("lz", LzCodec, BlockCodec);
+#ifdef JSONPACKER_WITH_ZLIB
+RegisterInFactory("zlib", ZlibCodec, BlockCodec);
+#endif
+#ifdef JSONPACKER_WITH_ZSTD
+RegisterInFactory("zstd", ZstdCodec, BlockCodec);
+#endif
+
+BlockCodec::~BlockCodec()
+{
+}
+
+BlockCodec::Ptr GetCodec(const std::string &name) {
+	if (!util::Factory<BlockCodec>::Instance()->Registered(name))
+		throw app_err::JsonPackerMissed("codec", name);
+	return util::Factory<BlockCodec>::Instance()->Get(name);
+}
+
+BlockCodec::Ptr GetCodec(BlockCodecId id) {
+	const size_t index = static_cast<size_t>(id);
+	if (index >= sizeof(CODEC_NAMES) / sizeof(CODEC_NAMES[0]))
+		throw app_err::JsonPackerMissed("codec", std::to_string(index));
+	return GetCodec(CODEC_NAMES[index]);
+}
+
+std::vector<std::string> CodecNames() {
+	std::vector<std::string> names;
+	for (auto name : CODEC_NAMES) {
+		if (util::Factory<BlockCodec>::Instance()->Registered(name))
+			names.push_back(name);
+	}
+	return names;
+}
+
+} // end of namespace jsonpacker_compression
@@ -0,0 +1,712 @@
+#include "filter.h"
+#include "simd.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <limits>
+
+namespace jsonpacker_coder {
+
+namespace {
+
+using TlvType = TlvRecordView::TlvRecordType;
+
+/**
+ * @brief GetNumber converts the value of numeric TLV record to double
+ * @return false if the record is not numeric
+ */
+bool GetNumber(TlvType type, const char* data, size_t size, double& value) {
+	const std::streamsize fixed_size = TlvRecord<std::streamsize>::FixedDataSize(type);
+	if (fixed_size < 0 || size < static_cast<size_t>(fixed_size))
+		return false;
+	switch (type) {
+	case TlvType::rtInt: {
+		int v;
+		memcpy(&v, data, sizeof(v));
+		value = v;
+		return true;
+	}
+	case TlvType::rtUInt: {
+		unsigned int v;
+		memcpy(&v, data, sizeof(v));
+		value = v;
+		return true;
+	}
+	case TlvType::rtInt64: {
+		int64_t v;
+		memcpy(&v, data, sizeof(v));
+		value = static_cast<double>(v);
+		return true;
+	}
+	case TlvType::rtUInt64: {
+		uint64_t v;
+		memcpy(&v, data, sizeof(v));
+		value = static_cast<double>(v);
+		return true;
+	}
+	case TlvType::rtFloat: {
+		float v;
+		memcpy(&v, data, sizeof(v));
+		value = static_cast<double>(v);
+		return true;
+	}
+	case TlvType::rtDouble:
+		memcpy(&value, data, sizeof(value));
+		return true;
+	default:
+		return false;
+	}
+}
+
+void AppendVarint(ByteSink& sink, uint64_t value) {
+	char* data = sink.Reserve(10);
+	sink.Commit(EncodeVarint(value, data));
+}
+
+uint64_t TakeVarint(const char*& data, const char* end) {
+	uint64_t value;
+	const size_t size = DecodeVarint(data, static_cast<size_t>(end - data), value);
+	if (!size)
+		throw TlvInvalidFormatError();
+	data += size;
+	return value;
+}
+
+/**
+ * @brief HashBytes calculates the hash of value added to Bloom filters: FNV-1a hash of the type tag and the data finalized by
+ * MurmurHash3 mixer, so both halves of the hash are uniform
+ */
+uint64_t HashBytes(char tag, const char* data, size_t size) {
+	uint64_t hash = (14695981039346656037ULL ^ static_cast<unsigned char>(tag)) * 1099511628211ULL;
+	for (size_t i = 0; i < size; ++i)
+		hash = (hash ^ static_cast<unsigned char>(data[i])) * 1099511628211ULL;
+	hash ^= hash >> 33;
+	hash *= 0xff51afd7ed558ccdULL;
+	hash ^= hash >> 33;
+	hash *= 0xc4ceb9fe1a85ec53ULL;
+	return hash ^ (hash >> 33);
+}
+
+uint64_t HashString(const char* data, size_t size) {
+	return HashBytes('s', data, size);
+}
+
+/**
+ * @brief HashNumber calculates the hash of number; numbers of all types are compared as doubles, so they are hashed as doubles
+ */
+uint64_t HashNumber(double value) {
+	if (value == 0)
+		value = 0;
+	return HashBytes('n', reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+/**
+ * @brief ForEachValue calls handler(key, record) for every member of TLV records of the block (v2 format)
+ * @return the count of records
+ */
+template <class Handler>
+uint64_t ForEachValue(const char* data, size_t size, const JsonShapeDictionary& shapes, Handler handler) {
+	uint64_t record_count = 0;
+	TlvRecordView record;
+	auto next_record = [&](size_t& next) {
+		const size_t record_size = ParseTlv(data + next, size - next, TlvFormat::v2, record);
+		if (!record_size)
+			throw TlvInvalidFormatError();
+		next += record_size;
+	};
+	auto value = [&](int key, size_t& next) {
+		next_record(next);
+		while (record.Type() == TlvType::rtValueDefinition)
+			next_record(next);
+		if (key < 0)
+			throw TlvInvalidFormatError();
+		handler(key, record);
+	};
+
+	for (size_t next = 0; next < size; ++record_count) {
+		next_record(next);
+		if (record.Type() == TlvType::rtShape) {
+			for (auto key : shapes.GetShape(record.GetInt()))
+				value(key, next);
+			continue;
+		}
+		if (record.Type() != TlvType::rtMemberCount)
+			throw TlvInvalidFormatError();
+		const int member_count = record.GetInt();
+		for (int i = 0; i < member_count; ++i) {
+			next_record(next);
+			if (record.Type() != TlvType::rtInt)
+				throw TlvInvalidFormatError();
+			value(record.GetInt(), next);
+		}
+	}
+	return record_count;
+}
+
+/**
+ * @brief IsKeyChar checks if the character may be used in the key written without quotes
+ */
+bool IsKeyChar(char c) {
+	return std::isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '-' || c == '.' || c == '$';
+}
+
+} // end of anonymous namespace
+
+bool HashValue(TlvType type, const char *data, size_t size, uint64_t &hash) {
+	double number;
+	if (type == TlvType::rtString)
+		hash = HashString(data, size);
+	else if (GetNumber(type, data, size, number))
+		hash = HashNumber(number);
+	else
+		return false;
+	return true;
+}
+
+void CollectZoneMap(const char *data, size_t size, const JsonShapeDictionary &shapes, ZoneMap &zone_map) {
+	//statistics are collected by key index, the count of non-null values is kept in null_count until all records are read
+	std::vector<ZoneStats> keys;
+	std::vector<bool> present;
+	const uint64_t record_count = ForEachValue(data, size, shapes, [&](int key, const TlvRecordView& record) {
+		if (keys.size() <= static_cast<size_t>(key)) {
+			keys.resize(static_cast<size_t>(key) + 1);
+			present.resize(static_cast<size_t>(key) + 1);
+		}
+		ZoneStats& stats = keys[static_cast<size_t>(key)];
+		present[static_cast<size_t>(key)] = true;
+		if (record.Type() == TlvType::rtNull)
+			return;
+		++stats.null_count;
+		double value;
+		if (!GetNumber(record.Type(), record.Data(), record.DataSize(), value))
+			return;
+		if (!stats.number_count++) {
+			stats.min = value;
+			stats.max = value;
+		} else {
+			stats.min = std::min(stats.min, value);
+			stats.max = std::max(stats.max, value);
+		}
+	});
+
+	zone_map.clear();
+	for (size_t key = 0; key < keys.size(); ++key) {
+		if (!present[key])
+			continue;
+		zone_map.push_back(keys[key]);
+		zone_map.back().key = static_cast<int>(key);
+		zone_map.back().null_count = record_count - keys[key].null_count;
+	}
+}
+
+void WriteTlvZoneMaps(ByteSink &sink, const std::vector<ZoneMap> &zone_maps) {
+	for (auto& zone_map : zone_maps) {
+		AppendVarint(sink, zone_map.size());
+		for (auto& stats : zone_map) {
+			AppendVarint(sink, static_cast<uint64_t>(stats.key));
+			AppendVarint(sink, stats.null_count);
+			AppendVarint(sink, stats.number_count);
+			if (stats.number_count) {
+				sink.Write(reinterpret_cast<const char*>(&stats.min), sizeof(stats.min));
+				sink.Write(reinterpret_cast<const char*>(&stats.max), sizeof(stats.max));
+			}
+		}
+	}
+}
+
+void ReadTlvZoneMaps(ByteSource &source, uint64_t tlv_begin, const TlvTrailer &trailer, size_t block_count, std::vector<ZoneMap> &zone_maps) {
+	zone_maps.clear();
+	//Bloom filters follow zone maps
+	const uint64_t zone_map_end = trailer.bloom_filter_offset ? trailer.bloom_filter_offset : trailer.trailer_offset;
+	if (!trailer.zone_map_offset || trailer.zone_map_offset > zone_map_end)
+		throw TlvInvalidFormatError();
+	const size_t size = static_cast<size_t>(zone_map_end - trailer.zone_map_offset);
+	const char* data;
+	source.Seek(tlv_begin + trailer.zone_map_offset);
+	if (source.Peek(data, size) < size)
+		throw TlvInvalidFormatError();
+	const char* const end = data + size;
+	zone_maps.resize(block_count);
+	for (auto& zone_map : zone_maps) {
+		const uint64_t key_count = TakeVarint(data, end);
+		if (key_count > size)
+			throw TlvInvalidFormatError();
+		zone_map.resize(static_cast<size_t>(key_count));
+		for (auto& stats : zone_map) {
+			const uint64_t key = TakeVarint(data, end);
+			if (key > static_cast<uint64_t>(std::numeric_limits<int>::max()) || (&stats != zone_map.data() && static_cast<int>(key) <= (&stats - 1)->key))
+				throw TlvInvalidFormatError();
+			stats.key = static_cast<int>(key);
+			stats.null_count = TakeVarint(data, end);
+			stats.number_count = TakeVarint(data, end);
+			if (stats.number_count) {
+				if (end - data < static_cast<std::ptrdiff_t>(sizeof(stats.min) + sizeof(stats.max)))
+					throw TlvInvalidFormatError();
+				memcpy(&stats.min, data, sizeof(stats.min));
+				memcpy(&stats.max, data + sizeof(stats.min), sizeof(stats.max));
+				data += sizeof(stats.min) + sizeof(stats.max);
+			}
+		}
+	}
+	if (data != end)
+		throw TlvInvalidFormatError();
+	source.Consume(size);
+}
+
+void CollectBloomFilters(const char *data, size_t size, const JsonShapeDictionary &shapes, const JsonValueDictionary &values,
+						 const std::vector<int> &keys, BlockBloomFilters &filters) {
+	//the hashes of values are collected by key first, so the size of every filter is known before it is built
+	std::vector<int> key_positions;
+	for (size_t i = 0; i < keys.size(); ++i) {
+		if (key_positions.size() <= static_cast<size_t>(keys[i]))
+			key_positions.resize(static_cast<size_t>(keys[i]) + 1, -1);
+		key_positions[static_cast<size_t>(keys[i])] = static_cast<int>(i);
+	}
+	std::vector<std::vector<uint64_t>> hashes(keys.size());
+	ForEachValue(data, size, shapes, [&](int key, const TlvRecordView& record) {
+		if (static_cast<size_t>(key) >= key_positions.size() || key_positions[static_cast<size_t>(key)] < 0)
+			return;
+		std::vector<uint64_t>& key_hashes = hashes[static_cast<size_t>(key_positions[static_cast<size_t>(key)])];
+		uint64_t hash;
+		if (record.Type() == TlvType::rtStringRef) {
+			uint16_t code;
+			if (record.DataSize() != sizeof(code))
+				throw TlvInvalidFormatError();
+			memcpy(&code, record.Data(), sizeof(code));
+			const std::string& value = values.GetValue(static_cast<size_t>(key), code);
+			key_hashes.push_back(HashString(value.data(), value.size()));
+		} else if (HashValue(record.Type(), record.Data(), record.DataSize(), hash))
+			key_hashes.push_back(hash);
+	});
+
+	filters.resize(keys.size());
+	for (size_t i = 0; i < keys.size(); ++i) {
+		std::vector<uint64_t>& key_hashes = hashes[i];
+		std::sort(key_hashes.begin(), key_hashes.end());
+		key_hashes.erase(std::unique(key_hashes.begin(), key_hashes.end()), key_hashes.end());
+		const size_t block_count = (key_hashes.size() + 31) / 32;
+		filters[i].key = keys[i];
+		filters[i].bits.assign(block_count * 64, '\0');
+		for (auto hash : key_hashes)
+			simd::BloomInsert(&filters[i].bits[0], block_count, hash);
+	}
+}
+
+void WriteTlvBloomFilters(ByteSink &sink, const std::vector<BlockBloomFilters> &filters, const std::vector<int> &keys) {
+	for (auto& block_filters : filters) {
+		AppendVarint(sink, keys.size());
+		auto filter = block_filters.begin();
+		for (auto key : keys) {
+			//the keys added to dictionary after the block was written have no values in it
+			while (filter != block_filters.end() && filter->key < key)
+				++filter;
+			const bool found = filter != block_filters.end() && filter->key == key;
+			AppendVarint(sink, static_cast<uint64_t>(key));
+			AppendVarint(sink, found ? filter->bits.size() / 64 : 0);
+			if (found)
+				sink.Write(filter->bits.data(), filter->bits.size());
+		}
+	}
+}
+
+void ReadTlvBloomFilters(ByteSource &source, uint64_t tlv_begin, const TlvTrailer &trailer, size_t block_count, std::vector<BlockBloomFilters> &filters) {
+	filters.clear();
+	if (!trailer.bloom_filter_offset || trailer.bloom_filter_offset > trailer.trailer_offset)
+		throw TlvInvalidFormatError();
+	const size_t size = static_cast<size_t>(trailer.trailer_offset - trailer.bloom_filter_offset);
+	const char* data;
+	source.Seek(tlv_begin + trailer.bloom_filter_offset);
+	if (source.Peek(data, size) < size)
+		throw TlvInvalidFormatError();
+	const char* const end = data + size;
+	filters.resize(block_count);
+	for (auto& block_filters : filters) {
+		const uint64_t key_count = TakeVarint(data, end);
+		if (key_count > size)
+			throw TlvInvalidFormatError();
+		block_filters.resize(static_cast<size_t>(key_count));
+		for (auto& filter : block_filters) {
+			const uint64_t key = TakeVarint(data, end);
+			if (key > static_cast<uint64_t>(std::numeric_limits<int>::max()) || (&filter != block_filters.data() && static_cast<int>(key) <= (&filter - 1)->key))
+				throw TlvInvalidFormatError();
+			filter.key = static_cast<int>(key);
+			const uint64_t filter_blocks = TakeVarint(data, end);
+			if (filter_blocks > static_cast<uint64_t>(end - data) / 64)
+				throw TlvInvalidFormatError();
+			filter.bits.assign(data, static_cast<size_t>(filter_blocks) * 64);
+			data += filter.bits.size();
+		}
+	}
+	if (data != end)
+		throw TlvInvalidFormatError();
+	source.Consume(size);
+}
+
+void RecordFilter::Batch::Reset(size_t slot_count) {
+	m_columns.resize(slot_count);
+	for (auto& column : m_columns) {
+		if (column.numbers.empty()) {
+			column.numbers.resize(FILTER_BATCH_SIZE);
+			column.string_begins.resize(FILTER_BATCH_SIZE);
+			column.string_sizes.resize(FILTER_BATCH_SIZE);
+		}
+		column.number_mask.assign(FILTER_BATCH_SIZE / 64, 0);
+		column.string_mask.assign(FILTER_BATCH_SIZE / 64, 0);
+		column.strings.clear();
+	}
+	m_size = 0;
+}
+
+bool RecordFilter::Batch::Add() {
+	if (m_size == FILTER_BATCH_SIZE)
+		return false;
+	++m_size;
+	return true;
+}
+
+void RecordFilter::Batch::Pop() {
+	--m_size;
+	const uint64_t bit = uint64_t(1) << (m_size % 64);
+	for (auto& column : m_columns) {
+		column.number_mask[m_size / 64] &= ~bit;
+		column.string_mask[m_size / 64] &= ~bit;
+	}
+}
+
+void RecordFilter::Batch::SetValue(size_t slot, TlvRecordType type, const char *data, size_t size) {
+	Column& column = m_columns[slot];
+	const size_t record = m_size - 1;
+	const uint64_t bit = uint64_t(1) << (record % 64);
+	//the last value of repeated key is compared
+	column.number_mask[record / 64] &= ~bit;
+	column.string_mask[record / 64] &= ~bit;
+	if (GetNumber(type, data, size, column.numbers[record]))
+		column.number_mask[record / 64] |= bit;
+	else if (type == TlvType::rtString) {
+		column.string_begins[record] = column.strings.size();
+		column.string_sizes[record] = size;
+		column.strings.append(data, size);
+		column.string_mask[record / 64] |= bit;
+	}
+}
+
+namespace {
+
+/**
+ * @brief FilterError creates the exception describing invalid filter expression
+ */
+app_err::JsonPackerError FilterError(const std::string& expression, const std::string& message) {
+	return app_err::JsonPackerError("Invalid filter expression '" + expression + "': " + message);
+}
+
+void SkipSpaces(const std::string& expression, size_t& position) {
+	while (position < expression.size() && std::isspace(static_cast<unsigned char>(expression[position])))
+		++position;
+}
+
+/**
+ * @brief CompareNumbers sets bits of records having numeric value satisfying the comparison (64 records per word)
+ */
+template <class Compare>
+void CompareNumbers(const double* values, const uint64_t* mask, size_t words, double number, uint64_t* bits, Compare compare) {
+	for (size_t word = 0; word < words; ++word) {
+		uint64_t result = 0;
+		for (size_t i = 0; i < 64; ++i)
+			result |= static_cast<uint64_t>(compare(values[word * 64 + i], number)) << i;
+		bits[word] = result & mask[word];
+	}
+}
+
+} // end of anonymous namespace
+
+RecordFilter::RecordFilter(const std::string &expression) {
+	size_t position = 0;
+	ParseDisjunction(expression, position, m_required);
+	SkipSpaces(expression, position);
+	if (position != expression.size())
+		throw FilterError(expression, "'&&' or '||' expected at position " + std::to_string(position));
+	size_t depth = 0;
+	for (auto& instruction : m_program) {
+		depth = instruction.opcode == Opcode::compare ? depth + 1 : depth - 1;
+		m_stack_depth = std::max(m_stack_depth, depth);
+	}
+	m_slot_keys.assign(m_keys.size(), -1);
+}
+
+void RecordFilter::ParseDisjunction(const std::string &expression, size_t &position, std::vector<size_t> &required) {
+	ParseConjunction(expression, position, required);
+	for (;;) {
+		SkipSpaces(expression, position);
+		if (expression.compare(position, 2, "||") != 0)
+			return;
+		position += 2;
+		//only the conditions required by both operands are required by disjunction
+		std::vector<size_t> alternative;
+		ParseConjunction(expression, position, alternative);
+		required.erase(std::remove_if(required.begin(), required.end(), [&alternative](size_t condition) {
+			return std::find(alternative.begin(), alternative.end(), condition) == alternative.end();
+		}), required.end());
+		Instruction instruction;
+		instruction.opcode = Opcode::logical_or;
+		m_program.push_back(instruction);
+	}
+}
+
+void RecordFilter::ParseConjunction(const std::string &expression, size_t &position, std::vector<size_t> &required) {
+	ParseComparison(expression, position, required);
+	for (;;) {
+		SkipSpaces(expression, position);
+		if (expression.compare(position, 2, "&&") != 0)
+			return;
+		position += 2;
+		ParseComparison(expression, position, required);
+		Instruction instruction;
+		instruction.opcode = Opcode::logical_and;
+		m_program.push_back(instruction);
+	}
+}
+
+void RecordFilter::ParseComparison(const std::string &expression, size_t &position, std::vector<size_t> &required) {
+	static const std::pair<const char*, Operator> operators[] = {
+		{"==", Operator::equal}, {"!=", Operator::not_equal}, {"<=", Operator::less_equal},
+		{">=", Operator::greater_equal}, {"<", Operator::less}, {">", Operator::greater}
+	};
+
+	SkipSpaces(expression, position);
+	if (position < expression.size() && expression[position] == '(') {
+		++position;
+		ParseDisjunction(expression, position, required);
+		SkipSpaces(expression, position);
+		if (position == expression.size() || expression[position] != ')')
+			throw FilterError(expression, "')' expected at position " + std::to_string(position));
+		++position;
+		return;
+	}
+
+	//key
+	std::string key;
+	if (position < expression.size() && expression[position] == '"') {
+		const size_t end = expression.find('"', position + 1);
+		if (end == std::string::npos)
+			throw FilterError(expression, "unterminated key");
+		key = expression.substr(position + 1, end - position - 1);
+		position = end + 1;
+	} else {
+		const size_t begin = position;
+		while (position < expression.size() && IsKeyChar(expression[position]))
+			++position;
+		key = expression.substr(begin, position - begin);
+	}
+	if (key.empty())
+		throw FilterError(expression, "key expected");
+
+	//operator
+	Condition condition;
+	SkipSpaces(expression, position);
+	auto op = std::find_if(std::begin(operators), std::end(operators), [&](const std::pair<const char*, Operator>& op) {
+		return expression.compare(position, strlen(op.first), op.first) == 0;
+	});
+	if (op == std::end(operators))
+		throw FilterError(expression, "comparison operator expected after '" + key + "'");
+	condition.op = op->second;
+	position += strlen(op->first);
+
+	//string or number
+	SkipSpaces(expression, position);
+	if (position < expression.size() && expression[position] == '"') {
+		if (condition.op != Operator::equal && condition.op != Operator::not_equal)
+			throw FilterError(expression, "strings can be compared only by == and !=");
+		for (++position; position < expression.size() && expression[position] != '"'; ++position) {
+			if (expression[position] == '\\' && position + 1 < expression.size())
+				++position;
+			condition.text += expression[position];
+		}
+		if (position == expression.size())
+			throw FilterError(expression, "unterminated string");
+		++position;
+		condition.string = true;
+		condition.hash = HashString(condition.text.data(), condition.text.size());
+	} else {
+		const char* begin = expression.c_str() + position;
+		char* end;
+		condition.number = std::strtod(begin, &end);
+		if (end == begin)
+			throw FilterError(expression, "number or string expected after '" + key + " " + op->first + "'");
+		position += static_cast<size_t>(end - begin);
+		condition.hash = HashNumber(condition.number);
+	}
+
+	auto slot = std::find(m_keys.begin(), m_keys.end(), key);
+	condition.slot = static_cast<size_t>(slot - m_keys.begin());
+	if (slot == m_keys.end())
+		m_keys.push_back(key);
+	Instruction instruction;
+	instruction.condition = m_conditions.size();
+	required.push_back(instruction.condition);
+	m_program.push_back(instruction);
+	m_conditions.push_back(condition);
+}
+
+void RecordFilter::Bind(const JsonKeyDictionary &dictionary) {
+	const auto& keys = dictionary.Keys();
+	m_key_slots.clear();
+	for (size_t slot = 0; slot < m_keys.size(); ++slot) {
+		auto key = keys.find(m_keys[slot]);
+		m_slot_keys[slot] = key == keys.end() ? -1 : key->second;
+		if (m_slot_keys[slot] < 0)
+			continue;
+		if (m_key_slots.size() <= static_cast<size_t>(key->second))
+			m_key_slots.resize(static_cast<size_t>(key->second) + 1, -1);
+		m_key_slots[static_cast<size_t>(key->second)] = static_cast<int>(slot);
+	}
+}
+
+bool RecordFilter::Compare(double value, const Condition &condition) {
+	switch (condition.op) {
+	case Operator::equal:
+		return value == condition.number;
+	case Operator::not_equal:
+		return value != condition.number;
+	case Operator::less:
+		return value < condition.number;
+	case Operator::less_equal:
+		return value <= condition.number;
+	case Operator::greater:
+		return value > condition.number;
+	case Operator::greater_equal:
+		return value >= condition.number;
+	}
+	return false;
+}
+
+void RecordFilter::Evaluate(Batch &batch) const {
+	const size_t words = (batch.m_size + 63) / 64;
+	if (batch.m_stack.size() < m_stack_depth)
+		batch.m_stack.resize(m_stack_depth, std::vector<uint64_t>(FILTER_BATCH_SIZE / 64));
+	size_t top = 0;
+	for (auto& instruction : m_program) {
+		if (instruction.opcode != Opcode::compare) {
+			//the topmost result is combined with the preceding one
+			--top;
+			uint64_t* bits = batch.m_stack[top - 1].data();
+			const uint64_t* other = batch.m_stack[top].data();
+			for (size_t word = 0; word < words; ++word)
+				bits[word] = instruction.opcode == Opcode::logical_and ? bits[word] & other[word] : bits[word] | other[word];
+			continue;
+		}
+		const Condition& condition = m_conditions[instruction.condition];
+		const Batch::Column& column = batch.m_columns[condition.slot];
+		uint64_t* bits = batch.m_stack[top++].data();
+		if (condition.string) {
+			//strings are compared one by one
+			const bool equal = condition.op == Operator::equal;
+			for (size_t word = 0; word < words; ++word) {
+				uint64_t result = 0;
+				for (uint64_t mask = column.string_mask[word]; mask; mask &= mask - 1) {
+					const size_t i = static_cast<size_t>(__builtin_ctzll(mask));
+					const size_t record = word * 64 + i;
+					const bool same = column.string_sizes[record] == condition.text.size()
+						&& memcmp(column.strings.data() + column.string_begins[record], condition.text.data(), condition.text.size()) == 0;
+					result |= static_cast<uint64_t>(same == equal) << i;
+				}
+				bits[word] = result;
+			}
+			continue;
+		}
+		const double number = condition.number;
+		const double* values = column.numbers.data();
+		const uint64_t* mask = column.number_mask.data();
+		switch (condition.op) {
+		case Operator::equal:
+			CompareNumbers(values, mask, words, number, bits, std::equal_to<double>());
+			break;
+		case Operator::not_equal:
+			CompareNumbers(values, mask, words, number, bits, std::not_equal_to<double>());
+			break;
+		case Operator::less:
+			CompareNumbers(values, mask, words, number, bits, std::less<double>());
+			break;
+		case Operator::less_equal:
+			CompareNumbers(values, mask, words, number, bits, std::less_equal<double>());
+			break;
+		case Operator::greater:
+			CompareNumbers(values, mask, words, number, bits, std::greater<double>());
+			break;
+		case Operator::greater_equal:
+			CompareNumbers(values, mask, words, number, bits, std::greater_equal<double>());
+			break;
+		}
+	}
+	batch.m_matches.assign(batch.m_stack[0].begin(), batch.m_stack[0].begin() + static_cast<std::ptrdiff_t>(words));
+}
+
+bool RecordFilter::EqualityHash(const std::string &key, uint64_t &hash) const {
+	for (auto index : m_required) {
+		const Condition& condition = m_conditions[index];
+		if (condition.op == Operator::equal && m_keys[condition.slot] == key) {
+			hash = condition.hash;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool RecordFilter::ConditionMayMatch(const Condition &condition, const ZoneMap *zone_map, const BlockBloomFilters *filters) const {
+	const int key = m_slot_keys[condition.slot];
+	if (key < 0)
+		return false;
+	//the value may be in the block if the filter of the key contains its hash (the keys without filters are not checked)
+	if (filters && condition.op == Operator::equal) {
+		auto filter = std::lower_bound(filters->begin(), filters->end(), key, [](const BloomFilter& filter, int key) {
+			return filter.key < key;
+		});
+		if (filter != filters->end() && filter->key == key && !simd::BloomContains(filter->bits.data(), filter->bits.size() / 64, condition.hash))
+			return false;
+	}
+	if (!zone_map)
+		return true;
+	auto stats = std::lower_bound(zone_map->begin(), zone_map->end(), key, [](const ZoneStats& stats, int key) {
+		return stats.key < key;
+	});
+	if (stats == zone_map->end() || stats->key != key)
+		return false;
+	//zone maps have no statistics of strings
+	if (condition.string)
+		return true;
+	if (!stats->number_count)
+		return false;
+	//some value of the range [min, max] satisfies the comparison
+	switch (condition.op) {
+	case Operator::equal:
+		return stats->min <= condition.number && condition.number <= stats->max;
+	case Operator::not_equal:
+		return stats->min != condition.number || stats->max != condition.number;
+	case Operator::less:
+	case Operator::less_equal:
+		return Compare(stats->min, condition);
+	case Operator::greater:
+	case Operator::greater_equal:
+		return Compare(stats->max, condition);
+	}
+	return true;
+}
+
+bool RecordFilter::MayMatch(const ZoneMap *zone_map, const BlockBloomFilters *filters) const {
+	//the program is evaluated for the block, logical operations keep the result conservative since there is no negation
+	std::vector<bool> stack;
+	for (auto& instruction : m_program) {
+		if (instruction.opcode == Opcode::compare) {
+			stack.push_back(ConditionMayMatch(m_conditions[instruction.condition], zone_map, filters));
+			continue;
+		}
+		const bool other = stack.back();
+		stack.pop_back();
+		stack.back() = instruction.opcode == Opcode::logical_and ? stack.back() && other : stack.back() || other;
+	}
+	return stack.back();
+}
+
+} //end of namespace jsonpacker_coder
@@ -0,0 +1,261 @@
+#include "index.h"
+#include "filter.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <queue>
+
+namespace jsonpacker_coder {
+
+RegisterInFactory("tlv2index", TlvToIndex, JsonPackerBase);
+
+namespace {
+
+/**
+ * @brief IndexEntriesOffset returns the offset of the first entry of index (the key name is padded to 8-byte boundary)
+ */
+uint64_t IndexEntriesOffset(uint32_t key_length) {
+	return (TLV_INDEX_HEADER_SIZE + static_cast<uint64_t>(key_length) + 7) / 8 * 8;
+}
+
+void WriteIndexEntry(ByteSink& sink, const TlvIndexEntry& entry) {
+	char* data = sink.Reserve(TLV_INDEX_ENTRY_SIZE);
+	memcpy(data, &entry.hash, sizeof(entry.hash));
+	memcpy(data + 8, &entry.offset, sizeof(entry.offset));
+	sink.Commit(TLV_INDEX_ENTRY_SIZE);
+}
+
+} // end of anonymous namespace
+
+TlvIndexWriter::TlvIndexWriter(size_t memory)
+	: m_run_entries(std::max<size_t>(memory / sizeof(TlvIndexEntry), 1))
+{
+}
+
+void TlvIndexWriter::Add(const TlvIndexEntry &entry) {
+	if (m_entries.size() >= m_run_entries)
+		WriteRun();
+	m_entries.push_back(entry);
+}
+
+void TlvIndexWriter::WriteRun() {
+	std::sort(m_entries.begin(), m_entries.end());
+	std::unique_ptr<FILE, FileCloser> file(std::tmpfile());
+	if (!file || fwrite(m_entries.data(), sizeof(TlvIndexEntry), m_entries.size(), file.get()) != m_entries.size())
+		throw app_err::JsonPackerError("Unable to write temporary file of index");
+	m_runs.push_back(std::move(file));
+	m_run_sizes.push_back(m_entries.size());
+	m_entries.clear();
+}
+
+uint64_t TlvIndexWriter::Write(ByteSink &sink, const std::string &key, uint64_t data_size) {
+	const uint32_t key_length = static_cast<uint32_t>(key.size());
+	const size_t header_size = static_cast<size_t>(IndexEntriesOffset(key_length));
+	char* header = sink.Reserve(header_size);
+	memset(header, 0, header_size);
+	memcpy(header, TLV_INDEX_MAGIC, 4);
+	header[4] = TLV_INDEX_VERSION;
+	memcpy(header + 8, &data_size, sizeof(data_size));
+	memcpy(header + 16, &key_length, sizeof(key_length));
+	memcpy(header + TLV_INDEX_HEADER_SIZE, key.data(), key.size());
+	sink.Commit(header_size);
+
+	if (m_runs.empty()) {
+		std::sort(m_entries.begin(), m_entries.end());
+		for (auto& entry : m_entries)
+			WriteIndexEntry(sink, entry);
+		const uint64_t count = m_entries.size();
+		m_entries.clear();
+		return count;
+	}
+
+	//all entries are in runs, every run is read by its own part of memory
+	if (!m_entries.empty())
+		WriteRun();
+	m_entries = std::vector<TlvIndexEntry>();
+	const size_t buffer_entries = std::max<size_t>(m_run_entries / m_runs.size(), 256);
+	std::vector<std::vector<TlvIndexEntry>> buffers(m_runs.size());
+	std::vector<size_t> positions(m_runs.size());
+	std::vector<uint64_t> remaining = m_run_sizes;
+	auto fill = [&](size_t run) {
+		std::vector<TlvIndexEntry>& buffer = buffers[run];
+		buffer.resize(static_cast<size_t>(std::min<uint64_t>(buffer_entries, remaining[run])));
+		if (fread(buffer.data(), sizeof(TlvIndexEntry), buffer.size(), m_runs[run].get()) != buffer.size())
+			throw app_err::JsonPackerError("Unable to read temporary file of index");
+		remaining[run] -= buffer.size();
+		positions[run] = 0;
+		return !buffer.empty();
+	};
+	using HeapItem = std::pair<TlvIndexEntry, size_t>;
+	auto greater = [](const HeapItem& left, const HeapItem& right) {
+		return right.first < left.first;
+	};
+	std::priority_queue<HeapItem, std::vector<HeapItem>, decltype(greater)> heap(greater);
+	for (size_t run = 0; run < m_runs.size(); ++run) {
+		rewind(m_runs[run].get());
+		if (fill(run))
+			heap.emplace(buffers[run][0], run);
+	}
+	uint64_t count = 0;
+	while (!heap.empty()) {
+		const size_t run = heap.top().second;
+		WriteIndexEntry(sink, heap.top().first);
+		heap.pop();
+		++count;
+		if (++positions[run] < buffers[run].size() || fill(run))
+			heap.emplace(buffers[run][positions[run]], run);
+	}
+	m_runs.clear();
+	m_run_sizes.clear();
+	return count;
+}
+
+TlvIndex::TlvIndex(const std::string &filename)
+	: m_file(filename, false)
+{
+	const char* data = m_file.Data();
+	const size_t size = m_file.Size();
+	uint32_t key_length = 0;
+	if (size >= TLV_INDEX_HEADER_SIZE && memcmp(data, TLV_INDEX_MAGIC, 4) == 0 && data[4] == TLV_INDEX_VERSION)
+		memcpy(&key_length, data + 16, sizeof(key_length));
+	const uint64_t entries_offset = IndexEntriesOffset(key_length);
+	if (!key_length || entries_offset > size || (size - entries_offset) % TLV_INDEX_ENTRY_SIZE)
+		throw app_err::JsonPackerError("Invalid index file \"" + filename + "\"");
+	memcpy(&m_data_size, data + 8, sizeof(m_data_size));
+	m_key.assign(data + TLV_INDEX_HEADER_SIZE, key_length);
+	m_entries = data + entries_offset;
+	m_size = (size - entries_offset) / TLV_INDEX_ENTRY_SIZE;
+}
+
+TlvIndexEntry TlvIndex::Entry(uint64_t index) const {
+	TlvIndexEntry entry;
+	memcpy(&entry.hash, m_entries + index * TLV_INDEX_ENTRY_SIZE, sizeof(entry.hash));
+	memcpy(&entry.offset, m_entries + index * TLV_INDEX_ENTRY_SIZE + 8, sizeof(entry.offset));
+	return entry;
+}
+
+void TlvIndex::Find(uint64_t hash, std::vector<uint64_t> &offsets) const {
+	offsets.clear();
+	uint64_t first = 0;
+	uint64_t count = m_size;
+	while (count) {
+		const uint64_t step = count / 2;
+		if (Entry(first + step).hash < hash) {
+			first += step + 1;
+			count -= step + 1;
+		} else
+			count = step;
+	}
+	for (; first < m_size; ++first) {
+		const TlvIndexEntry entry = Entry(first);
+		if (entry.hash != hash)
+			break;
+		offsets.push_back(entry.offset);
+	}
+}
+
+void TlvToIndex::Run(JsonPackerStream &stream) {
+	if (m_options.index_key.empty())
+		throw app_err::JsonPackerError("The key of index is not given");
+	if (!m_options.where.empty() || !m_options.keys.empty() || !m_options.index_file.empty())
+		throw app_err::JsonPackerError("Index is built from all records, filter, key projection and lookup can not be used");
+	uint64_t data_size;
+	{
+		std::unique_ptr<ByteSource> input = stream.CreateInput();
+		input->Seek(0);
+		const TlvHeader header = ReadTlvHeader(*input);
+		if (header.flags & (TLV_FLAG_COLUMNAR | TLV_FLAG_INLINE_KEYS))
+			throw app_err::JsonPackerError("Index requires row-oriented TLV data with dictionary");
+		data_size = input->Size();
+	}
+	m_writer.reset(new TlvIndexWriter(m_options.index_memory));
+	m_key_index = -1;
+	//records are indexed by their positions in input, so they are read sequentially
+	const unsigned int threads = m_options.threads;
+	m_options.threads = 1;
+	try {
+		TlvToJson::Run(stream);
+	} catch (...) {
+		m_options.threads = threads;
+		m_writer.reset();
+		throw;
+	}
+	m_options.threads = threads;
+	std::unique_ptr<ByteSink> output = stream.CreateOutput();
+	m_writer->Write(*output, m_options.index_key, data_size);
+	output->Flush();
+	m_writer.reset();
+}
+
+void TlvToIndex::DictionaryLoaded() {
+	const auto& keys = m_dictionary->Keys();
+	auto key = keys.find(m_options.index_key);
+	m_key_index = key == keys.end() ? -1 : key->second;
+}
+
+uint64_t TlvToIndex::DecodeRecords(ByteSource &input, TlvFormat format, ByteSink &, uint64_t count) {
+	using TlvType = TlvRecordView::TlvRecordType;
+	TlvReader reader(input, format);
+	TlvRecordView record;
+	uint64_t offset = 0;
+	auto add_value = [&](int key_index) {
+		if (!reader.Next(record))
+			throw TlvInvalidFormatError();
+		while (record.Type() == TlvType::rtValueDefinition) {
+			DefineValue(record.Data(), record.DataSize());
+			if (!reader.Next(record))
+				throw TlvInvalidFormatError();
+		}
+		if (key_index != m_key_index)
+			return;
+		TlvIndexEntry entry;
+		entry.offset = offset;
+		if (record.Type() == TlvType::rtStringRef) {
+			uint16_t code;
+			if (record.DataSize() != sizeof(code))
+				throw TlvInvalidFormatError();
+			memcpy(&code, record.Data(), sizeof(code));
+			const std::string& value = m_values.GetValue(m_dictionary->Position(key_index), code);
+			HashValue(TlvType::rtString, value.data(), value.size(), entry.hash);
+		} else if (!HashValue(record.Type(), record.Data(), record.DataSize(), entry.hash))
+			return;
+		m_writer->Add(entry);
+	};
+
+	uint64_t read = 0;
+	while (read < count) {
+		offset = reader.Position();
+		if (!reader.Next(record))
+			break;
+		//the dictionary is left in input
+		if (record.Type() == TlvType::rtDictionary)
+			return read;
+		if (record.Type() == TlvType::rtShapeDefinition) {
+			DefineShape(record.Data(), record.DataSize());
+			continue;
+		}
+		if (record.Type() == TlvType::rtValueDefinition) {
+			DefineValue(record.Data(), record.DataSize());
+			continue;
+		}
+		if (record.Type() == TlvType::rtShape) {
+			for (auto key : m_shapes->GetShape(record.GetInt()))
+				add_value(key);
+		} else if (record.Type() == TlvType::rtMemberCount) {
+			const int member_count = record.GetInt();
+			for (int i = 0; i < member_count; ++i) {
+				if (!reader.Next(record) || record.Type() != TlvType::rtInt)
+					throw TlvInvalidFormatError();
+				add_value(record.GetInt());
+			}
+		} else
+			throw TlvInvalidFormatError();
+		++read;
+	}
+	reader.Consume();
+	return read;
+}
+
+} //end of namespace jsonpacker_coder
@@ -9,8 +9,13 @@
 
   **/
 
+#include <algorithm>
+#include <chrono>
 #include <iostream>
+#include <limits>
+#include <stdexcept>
 #include <fstream>
+#include <boost/algorithm/string.hpp>
 #include <boost/filesystem/operations.hpp>
 #include <boost/format.hpp>
 
@@ -21,6 +26,33 @@
 
 using namespace std;
 
+namespace {
+
+/**
+ * @brief NumericValue converts the value of option into unsigned decimal number
+ * @param option[in] the option with numeric value
+ * @param max_value[in] the maximal allowed value
+ * @return the value of option
+ * @throw app_err::JsonPackerError if the value is not a decimal number or exceeds max_value
+ */
+uint64_t NumericValue(app_opt::ApplicationOption& option, uint64_t max_value = std::numeric_limits<uint64_t>::max()) {
+	const string value = option.Value();
+	//std::stoull accepts signs and spaces, so "-1" would become the maximal value
+	if (value.empty() || !std::all_of(value.begin(), value.end(), [](char c) {return c >= '0' && c <= '9';}))
+		throw app_err::JsonPackerError("Invalid value of option --" + option.Name() + ": " + value);
+	uint64_t number;
+	try {
+		number = std::stoull(value);
+	} catch (const std::out_of_range&) {
+		throw app_err::JsonPackerError("Value of option --" + option.Name() + " is too large: " + value);
+	}
+	if (number > max_value)
+		throw app_err::JsonPackerError("Value of option --" + option.Name() + " is too large: " + value);
+	return number;
+}
+
+} // end of anonymous namespace
+
 int main(int argc, char *argv[])
 {
 	int return_code = EXIT_SUCCESS;
@@ -42,14 +74,86 @@ int main(int argc, char *argv[])
 		}
 
 		if (app_options.Method.Exists()) {
+			const auto start_time = std::chrono::steady_clock::now();
 			auto packer = jsonpacker_coder::GetPacker(app_options.Method.Value());
+			packer->Options().threads = static_cast<unsigned int>(std::max<uint64_t>(1, NumericValue(app_options.Threads, std::numeric_limits<unsigned int>::max())));
+			if (app_options.Format.Value() == "2")
+				packer->Options().format = jsonpacker_coder::TlvFormat::v2;
+			else if (app_options.Format.Value() != "1")
+				throw app_err::JsonPackerError("Unsupported TLV format version " + app_options.Format.Value());
+			if (app_options.Stream.Exists()) {
+				packer->Options().format = jsonpacker_coder::TlvFormat::v2;
+				packer->Options().inline_keys = true;
+			}
+			if (app_options.Compression.Exists()) {
+				packer->Options().format = jsonpacker_coder::TlvFormat::v2;
+				packer->Options().compression = app_options.Compression.Value();
+			}
+			if (app_options.Shapes.Exists()) {
+				packer->Options().format = jsonpacker_coder::TlvFormat::v2;
+				packer->Options().shapes = true;
+			}
+			if (app_options.IntegerCodecs.Exists())
+				packer->Options().integer_codecs = true;
+			if (app_options.XorDoubles.Exists())
+				packer->Options().double_codecs = true;
+			if (app_options.StringDictionary.Exists()) {
+				packer->Options().format = jsonpacker_coder::TlvFormat::v2;
+				packer->Options().string_dictionary = NumericValue(app_options.StringDictionary);
+			}
+			if (app_options.Checksums.Exists()) {
+				packer->Options().format = jsonpacker_coder::TlvFormat::v2;
+				packer->Options().checksums = true;
+			}
+			if (app_options.VerifyOnly.Exists())
+				packer->Options().verify_only = true;
+			if (app_options.ZoneMaps.Exists()) {
+				packer->Options().format = jsonpacker_coder::TlvFormat::v2;
+				packer->Options().zone_maps = true;
+			}
+			if (app_options.BloomKeys.Exists()) {
+				packer->Options().format = jsonpacker_coder::TlvFormat::v2;
+				boost::split(packer->Options().bloom_keys, app_options.BloomKeys.Value(), boost::is_any_of(","));
+			}
+			if (app_options.Where.Exists())
+				packer->Options().where = app_options.Where.Value();
+			if (app_options.Keys.Exists())
+				boost::split(packer->Options().keys, app_options.Keys.Value(), boost::is_any_of(","));
+			if (app_options.IndexKey.Exists())
+				packer->Options().index_key = app_options.IndexKey.Value();
+			if (app_options.IndexMemory.Exists())
+				packer->Options().index_memory = static_cast<size_t>(NumericValue(app_options.IndexMemory, std::numeric_limits<size_t>::max() / (1024 * 1024))) * 1024 * 1024;
+			if (app_options.Lookup.Exists())
+				packer->Options().index_file = app_options.Lookup.Value();
+			if (app_options.From.Exists())
+				packer->Options().from = NumericValue(app_options.From);
+			if (app_options.Count.Exists())
+				packer->Options().count = NumericValue(app_options.Count);
+			if (app_options.Sample.Exists())
+				packer->Options().sample = NumericValue(app_options.Sample);
+			if (app_options.Seed.Exists())
+				packer->Options().seed = NumericValue(app_options.Seed);
 
-			ifstream input;
-			input.open(app_options.InputFile.Value(), packer->InputOpenModeFlags());
-			std::ofstream ofs(app_options.OutputFile.Value(), packer->OutputOpenModeFlags());
+			//nothing is written in verify-only mode, so output file may be omitted
+			std::ofstream ofs;
+			if (app_options.OutputFile.Exists())
+				ofs.open(app_options.OutputFile.Value(), packer->OutputOpenModeFlags());
+			if (boost::filesystem::is_regular_file(app_options.InputFile.Value())) {
+				jsonpacker_stream::JsonPackerMappedFileStream stream(app_options.InputFile.Value(), ofs);
+				packer->Run(stream);
+			} else {
+				ifstream input;
+				input.open(app_options.InputFile.Value(), packer->InputOpenModeFlags());
+				jsonpacker_stream::JsonPackerFileStream stream(input, ofs);
+				packer->Run(stream);
+			}
 
-			jsonpacker_stream::JsonPackerFileStream stream(input, ofs);
-			packer->Run(stream);
+			if (app_options.Stats.Exists()) {
+				auto& stats = packer->Stats();
+				cout << "Records: " << stats.records << endl;
+				cout << "Parser heap allocations: " << stats.parser_heap_allocations << endl;
+				cout << "Elapsed time: " << std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count() << " s" << endl;
+			}
 		}
 	} catch (const app_err::JsonPackerError& e) {
 		cout << e.what() << endl;
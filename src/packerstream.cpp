@@ -1,4 +1,13 @@
 #include "packerstream.h"
+#include "apperror.h"
+
+#include <algorithm>
+#include <limits>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 namespace jsonpacker_stream {
 
@@ -6,6 +15,232 @@ JsonPackerStream::~JsonPackerStream()
 {
 }
 
+std::unique_ptr<ByteSource> JsonPackerStream::CreateInput() {
+	return std::unique_ptr<ByteSource>(new StreamByteSource(InputStream(), m_block_size));
+}
+
+std::unique_ptr<ByteSink> JsonPackerStream::CreateOutput() {
+	return std::unique_ptr<ByteSink>(new StreamByteSink(OutputStream(), m_block_size));
+}
+
+ByteSink::ByteSink(size_t block_size)
+	: m_buffer(std::max<size_t>(block_size, 1))
+	, m_next(m_buffer.data())
+	, m_end(m_buffer.data() + m_buffer.size())
+{
+}
+
+ByteSink::~ByteSink()
+{
+}
+
+void ByteSink::Flush() {
+	Drain(0);
+	FlushBlocks();
+}
+
+void ByteSink::FlushBlocks() {
+}
+
+void ByteSink::Drain(size_t size) {
+	const size_t buffered = static_cast<size_t>(m_next - m_buffer.data());
+	if (buffered)
+		WriteBlock(m_buffer.data(), buffered);
+	m_drained += buffered;
+	if (size > m_buffer.size())
+		m_buffer.resize(size);
+	m_next = m_buffer.data();
+	m_end = m_buffer.data() + m_buffer.size();
+}
+
+StreamByteSink::StreamByteSink(std::ostream &os, size_t block_size)
+	: ByteSink(block_size)
+	, m_stream(os)
+{
+}
+
+StreamByteSink::~StreamByteSink() {
+	//the data must be flushed explicitly to get errors, here they are ignored
+	try {
+		Flush();
+	} catch (...) {
+	}
+}
+
+void StreamByteSink::WriteBlock(const char *data, size_t size) {
+	m_stream.write(data, static_cast<std::streamsize>(size));
+}
+
+void StreamByteSink::FlushBlocks() {
+	m_stream.flush();
+}
+
+StringByteSink::StringByteSink(size_t block_size)
+	: ByteSink(block_size)
+{
+}
+
+std::string &StringByteSink::Data() {
+	Flush();
+	return m_data;
+}
+
+void StringByteSink::WriteBlock(const char *data, size_t size) {
+	m_data.append(data, size);
+}
+
+ByteSource::~ByteSource()
+{
+}
+
+uint64_t ByteSource::Skip(uint64_t size) {
+	const uint64_t buffered = static_cast<uint64_t>(m_end - m_next);
+	if (size <= buffered) {
+		m_next += size;
+		return size;
+	}
+	const uint64_t position = Position() + buffered;
+	SetData(nullptr, 0, position);
+	return buffered + SkipBlocks(size - buffered);
+}
+
+void ByteSource::Seek(uint64_t position) {
+	if (position >= m_position && position <= m_position + static_cast<uint64_t>(m_end - m_data))
+		m_next = m_data + (position - m_position);
+	else
+		SeekBlocks(position);
+}
+
+MemoryByteSource::MemoryByteSource(const char *data, size_t size) {
+	SetData(data, size, 0);
+}
+
+uint64_t MemoryByteSource::Size() {
+	return static_cast<uint64_t>(m_end - m_data);
+}
+
+void MemoryByteSource::Fill(size_t) {
+}
+
+uint64_t MemoryByteSource::SkipBlocks(uint64_t) {
+	return 0;
+}
+
+void MemoryByteSource::SeekBlocks(uint64_t) {
+	throw app_err::JsonPackerError("Unable to seek beyond the end of input data");
+}
+
+StreamByteSource::StreamByteSource(std::istream &is, size_t block_size)
+	: m_stream(is)
+	, m_block_size(std::max<size_t>(block_size, 1))
+{
+	m_stream.clear();
+	const std::streamoff position = m_stream.tellg();
+	//position of non-seekable stream (pipe) is unknown, so it is counted from the current position
+	SetData(nullptr, 0, position > 0 ? static_cast<uint64_t>(position) : 0);
+}
+
+uint64_t StreamByteSource::Size() {
+	//buffered data stays valid, so the stream is positioned back after the end of buffered data
+	m_stream.clear();
+	const std::streamoff position = m_stream.tellg();
+	m_stream.seekg(0, std::ios::end);
+	const std::streamoff size = m_stream.tellg();
+	m_stream.seekg(position, std::ios::beg);
+	if (position < 0 || size < 0 || m_stream.fail())
+		throw app_err::JsonPackerError("Unable to get the size of input data");
+	return static_cast<uint64_t>(size);
+}
+
+void StreamByteSource::Fill(size_t size) {
+	//move unconsumed data to the begining of buffer and read the next blocks after it;
+	//the buffer grows gradually, so the wrong size does not cause allocation of memory for data which does not exist
+	const size_t unconsumed = static_cast<size_t>(m_end - m_next);
+	const uint64_t position = Position();
+	if (unconsumed && m_next != m_buffer.data())
+		memmove(m_buffer.data(), m_next, unconsumed);
+	size_t filled = unconsumed;
+	while (filled < size && m_stream) {
+		if (m_buffer.size() < filled + m_block_size)
+			m_buffer.resize(std::max(filled + m_block_size, std::min(size, 2 * m_buffer.size())));
+		//the data which is already available is taken first, and only the rest of required data is waited for
+		//(input may be a pipe receiving data slowly)
+		filled += static_cast<size_t>(m_stream.readsome(m_buffer.data() + filled, static_cast<std::streamsize>(m_buffer.size() - filled)));
+		if (filled < size && m_stream) {
+			if (m_wait_output)
+				m_wait_output->Flush();
+			m_stream.read(m_buffer.data() + filled, static_cast<std::streamsize>(std::min(size - filled, m_buffer.size() - filled)));
+			filled += static_cast<size_t>(m_stream.gcount());
+		}
+	}
+	SetData(m_buffer.data(), filled, position);
+}
+
+uint64_t StreamByteSource::SkipBlocks(uint64_t size) {
+	uint64_t skipped = 0;
+	while (skipped < size && m_stream) {
+		const uint64_t part = std::min<uint64_t>(size - skipped, static_cast<uint64_t>(std::numeric_limits<std::streamsize>::max()));
+		m_stream.ignore(static_cast<std::streamsize>(part));
+		skipped += static_cast<uint64_t>(m_stream.gcount());
+	}
+	SetData(nullptr, 0, m_position + skipped);
+	return skipped;
+}
+
+void StreamByteSource::SeekBlocks(uint64_t position) {
+	m_stream.clear();
+	m_stream.seekg(static_cast<std::streamoff>(position), std::ios::beg);
+	if (m_stream.fail())
+		throw app_err::JsonPackerError("Unable to seek input data");
+	SetData(nullptr, 0, position);
+}
+
+MappedFile::MappedFile(const std::string &filename, bool sequential) {
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0)
+		throw app_err::JsonPackerFileMissed(filename);
+	struct stat file_stat;
+	if (fstat(fd, &file_stat) == 0 && file_stat.st_size > 0) {
+		m_size = static_cast<size_t>(file_stat.st_size);
+		void* data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (data == MAP_FAILED) {
+			close(fd);
+			throw app_err::JsonPackerError("Unable to map file \"" + filename + "\" into memory");
+		}
+		m_data = static_cast<char*>(data);
+		madvise(m_data, m_size, sequential ? MADV_SEQUENTIAL : MADV_RANDOM);
+	}
+	close(fd);
+}
+
+MappedFile::~MappedFile() {
+	if (m_data)
+		munmap(m_data, m_size);
+}
+
+MemoryInputBuffer::MemoryInputBuffer(const char *data, size_t size) {
+	char* begin = const_cast<char*>(data);
+	setg(begin, begin, begin + size);
+}
+
+MemoryInputBuffer::pos_type MemoryInputBuffer::seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) {
+	if (!(which & std::ios_base::in))
+		return pos_type(off_type(-1));
+	off_type pos = off;
+	if (dir == std::ios_base::cur)
+		pos += gptr() - eback();
+	else if (dir == std::ios_base::end)
+		pos += egptr() - eback();
+	if (pos < 0 || pos > egptr() - eback())
+		return pos_type(off_type(-1));
+	setg(eback(), eback() + pos, egptr());
+	return pos_type(pos);
+}
+
+MemoryInputBuffer::pos_type MemoryInputBuffer::seekpos(pos_type pos, std::ios_base::openmode which) {
+	return seekoff(off_type(pos), std::ios_base::beg, which);
+}
+
 JsonPackerFileStream::JsonPackerFileStream(std::ifstream &input_stream, std::ofstream &output_stream)
 	: JsonPackerStream()
 	, m_input_stream(input_stream)
@@ -36,5 +271,25 @@ std::ostream &JsonPackerStringStream::OutputStream() {
 	return m_output_stream;
 }
 
+JsonPackerMappedFileStream::JsonPackerMappedFileStream(const std::string &input_filename, std::ofstream &output_stream)
+	: JsonPackerStream()
+	, m_input_file(input_filename)
+	, m_input_buffer(m_input_file.Data(), m_input_file.Size())
+	, m_input_stream(&m_input_buffer)
+	, m_output_stream(output_stream)
+{
+}
+
+std::istream &JsonPackerMappedFileStream::InputStream() {
+	return m_input_stream;
+}
+
+std::ostream &JsonPackerMappedFileStream::OutputStream() {
+	return m_output_stream;
+}
+
+std::unique_ptr<ByteSource> JsonPackerMappedFileStream::CreateInput() {
+	return std::unique_ptr<ByteSource>(new MemoryByteSource(m_input_file.Data(), m_input_file.Size()));
+}
 
 } // end of namespace jsonpacker_stream
@@ -0,0 +1,363 @@
+#include "simd.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SIMD_X86
+#endif
+
+namespace simd {
+
+namespace {
+
+using FindByteFunction = const char* (*)(const char*, const char*, char);
+using UnpackBitsFunction = void (*)(const char*, size_t, size_t, unsigned int, uint64_t, uint64_t*);
+using Crc32cFunction = uint32_t (*)(uint32_t, const char*, size_t);
+using BloomContainsFunction = bool (*)(const char*, size_t, uint64_t);
+
+const uint32_t CRC32C_POLYNOMIAL = 0x82f63b78; ///the Castagnoli polynomial in reflected bit order
+const size_t CRC32C_STRIPE_SIZE = 1024; ///the size of each of 3 stripes checksummed at once by hardware kernel
+const size_t BLOOM_BLOCK_SIZE = 64; ///the size of block of Bloom filter
+const size_t BLOOM_BLOCK_WORDS = 16; ///the count of 32-bit words in block of Bloom filter
+///the odd constants selecting bits in words of block of Bloom filter (the first 8 are the ones of Parquet split-block Bloom filter)
+alignas(64) const uint32_t BLOOM_SALTS[BLOOM_BLOCK_WORDS] = {
+	0x47b6137bu, 0x44974d91u, 0x8824ad5bu, 0xa2b7289du, 0x705495c7u, 0x2df1424bu, 0x9efc4947u, 0x5c6bfb31u,
+	0x9e3779b1u, 0x85ebca77u, 0xc2b2ae3du, 0x27d4eb2fu, 0x165667b1u, 0xd3a2646du, 0xfd7046c5u, 0xb55a4f09u
+};
+
+const char* FindByteScalar(const char* begin, const char* end, char value) {
+	for (; begin != end; ++begin) {
+		if (*begin == value)
+			return begin;
+	}
+	return end;
+}
+
+/**
+ * @brief UnpackBitsFrom unpacks values starting from the value with given number
+ */
+void UnpackBitsFrom(const char* data, size_t size, size_t first, size_t count, unsigned int width, uint64_t base, uint64_t* values) {
+	const uint64_t mask = width < 64 ? (uint64_t(1) << width) - 1 : ~uint64_t(0);
+	for (size_t i = first; i < count; ++i) {
+		//the value takes no more than 9 bytes beginning with the byte of its first bit
+		const uint64_t bit = static_cast<uint64_t>(i) * width;
+		const size_t byte = static_cast<size_t>(bit / 8);
+		const unsigned int shift = static_cast<unsigned int>(bit % 8);
+		uint64_t word = 0;
+		memcpy(&word, data + byte, std::min<size_t>(sizeof(word), size - byte));
+		uint64_t value = word >> shift;
+		if (shift + width > 64)
+			value |= static_cast<uint64_t>(static_cast<unsigned char>(data[byte + 8])) << (64 - shift);
+		values[i] = (value & mask) + base;
+	}
+}
+
+void UnpackBitsScalar(const char* data, size_t size, size_t count, unsigned int width, uint64_t base, uint64_t* values) {
+	UnpackBitsFrom(data, size, 0, count, width, base, values);
+}
+
+/**
+ * @brief MultiplyCrc32c multiplies polynomials modulo the CRC-32C polynomial (bit 31 is the coefficient of x^0)
+ */
+uint32_t MultiplyCrc32c(uint32_t a, uint32_t b) {
+	uint32_t product = 0;
+	for (uint32_t mask = uint32_t(1) << 31; mask; mask >>= 1) {
+		if (a & mask)
+			product ^= b;
+		b = b & 1 ? (b >> 1) ^ CRC32C_POLYNOMIAL : b >> 1;
+	}
+	return product;
+}
+
+/**
+ * @brief PowerCrc32c returns x^exponent modulo the CRC-32C polynomial
+ */
+uint32_t PowerCrc32c(uint64_t exponent) {
+	uint32_t power = uint32_t(1) << 31;
+	//square is x^(2^k)
+	for (uint32_t square = uint32_t(1) << 30; exponent; exponent >>= 1, square = MultiplyCrc32c(square, square)) {
+		if (exponent & 1)
+			power = MultiplyCrc32c(power, square);
+	}
+	return power;
+}
+
+/**
+ * @brief The Crc32cTables struct holds the tables of slicing-by-8 algorithm: table[k][byte] is the CRC of byte followed by k zero bytes
+ */
+struct Crc32cTables {
+	uint32_t table[8][256];
+
+	Crc32cTables() {
+		for (uint32_t byte = 0; byte < 256; ++byte) {
+			uint32_t crc = byte;
+			for (int bit = 0; bit < 8; ++bit)
+				crc = crc & 1 ? (crc >> 1) ^ CRC32C_POLYNOMIAL : crc >> 1;
+			table[0][byte] = crc;
+		}
+		for (uint32_t byte = 0; byte < 256; ++byte) {
+			for (int k = 1; k < 8; ++k)
+				table[k][byte] = (table[k - 1][byte] >> 8) ^ table[0][table[k - 1][byte] & 0xff];
+		}
+	}
+};
+
+uint32_t Crc32cScalar(uint32_t crc, const char* data, size_t size) {
+	static const Crc32cTables tables;
+	const auto& table = tables.table;
+	crc = ~crc;
+	for (; size >= 8; data += 8, size -= 8) {
+		uint32_t low, high;
+		memcpy(&low, data, sizeof(low));
+		memcpy(&high, data + 4, sizeof(high));
+		low ^= crc;
+		crc = table[7][low & 0xff] ^ table[6][(low >> 8) & 0xff] ^ table[5][(low >> 16) & 0xff] ^ table[4][low >> 24]
+			^ table[3][high & 0xff] ^ table[2][(high >> 8) & 0xff] ^ table[1][(high >> 16) & 0xff] ^ table[0][high >> 24];
+	}
+	for (; size; ++data, --size)
+		crc = (crc >> 8) ^ table[0][(crc ^ static_cast<unsigned char>(*data)) & 0xff];
+	return ~crc;
+}
+
+/**
+ * @brief BloomBlock returns the offset of the block of Bloom filter selected by hash
+ */
+inline size_t BloomBlock(size_t block_count, uint64_t hash) {
+	return static_cast<size_t>(((hash >> 32) * block_count) >> 32) * BLOOM_BLOCK_SIZE;
+}
+
+bool BloomContainsScalar(const char* filter, size_t block_count, uint64_t hash) {
+	if (!block_count)
+		return false;
+	const char* block = filter + BloomBlock(block_count, hash);
+	for (size_t i = 0; i < BLOOM_BLOCK_WORDS; ++i) {
+		uint32_t word;
+		memcpy(&word, block + i * sizeof(word), sizeof(word));
+		if (!(word & (1u << ((static_cast<uint32_t>(hash) * BLOOM_SALTS[i]) >> 27))))
+			return false;
+	}
+	return true;
+}
+
+#ifdef SIMD_X86
+
+__attribute__((target("sse2")))
+const char* FindByteSse2(const char* begin, const char* end, char value) {
+	const __m128i pattern = _mm_set1_epi8(value);
+	for (; end - begin >= 16; begin += 16) {
+		const __m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i*>(begin));
+		const int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(data, pattern));
+		if (mask)
+			return begin + __builtin_ctz(static_cast<unsigned int>(mask));
+	}
+	return FindByteScalar(begin, end, value);
+}
+
+__attribute__((target("avx2")))
+const char* FindByteAvx2(const char* begin, const char* end, char value) {
+	const __m256i pattern = _mm256_set1_epi8(value);
+	for (; end - begin >= 32; begin += 32) {
+		const __m256i data = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(begin));
+		const int mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(data, pattern));
+		if (mask)
+			return begin + __builtin_ctz(static_cast<unsigned int>(mask));
+	}
+	return FindByteSse2(begin, end, value);
+}
+
+__attribute__((target("avx2")))
+void UnpackBitsAvx2(const char* data, size_t size, size_t count, unsigned int width, uint64_t base, uint64_t* values) {
+	size_t i = 0;
+	if (width && width <= 56) {
+		//every value is taken from 8 bytes beginning with the byte of its first bit, 4 values are gathered at once
+		const __m256i mask = _mm256_set1_epi64x(static_cast<long long>((uint64_t(1) << width) - 1));
+		const __m256i bases = _mm256_set1_epi64x(static_cast<long long>(base));
+		const __m256i lanes = _mm256_setr_epi64x(0, width, 2 * width, 3 * width);
+		const __m256i bit_shifts = _mm256_set1_epi64x(7);
+		for (; i + 4 <= count && (i + 3) * width / 8 + 8 <= size; i += 4) {
+			const __m256i bits = _mm256_add_epi64(_mm256_set1_epi64x(static_cast<long long>(i * width)), lanes);
+			const __m256i words = _mm256_i64gather_epi64(reinterpret_cast<const long long*>(data), _mm256_srli_epi64(bits, 3), 1);
+			const __m256i unpacked = _mm256_and_si256(_mm256_srlv_epi64(words, _mm256_and_si256(bits, bit_shifts)), mask);
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(values + i), _mm256_add_epi64(unpacked, bases));
+		}
+	}
+	UnpackBitsFrom(data, size, i, count, width, base, values);
+}
+
+__attribute__((target("sse4.2,pclmul")))
+uint32_t Crc32cSse42(uint32_t crc, const char* data, size_t size) {
+	//crc32 instruction has latency of 3 cycles, so 3 stripes are checksummed at once and their checksums are combined:
+	//the checksum shifted by n bytes (multiplied by x^(8n)) is the crc32 of carry-less product with x^(8n - 33)
+	static const __m128i shifts = _mm_set_epi64x(PowerCrc32c(8 * CRC32C_STRIPE_SIZE - 33), PowerCrc32c(16 * CRC32C_STRIPE_SIZE - 33));
+	uint64_t state = ~crc;
+	for (; size >= 3 * CRC32C_STRIPE_SIZE; data += 3 * CRC32C_STRIPE_SIZE, size -= 3 * CRC32C_STRIPE_SIZE) {
+		uint64_t first = state, second = 0, third = 0;
+		for (size_t i = 0; i < CRC32C_STRIPE_SIZE; i += 8) {
+			uint64_t words[3];
+			memcpy(&words[0], data + i, sizeof(uint64_t));
+			memcpy(&words[1], data + CRC32C_STRIPE_SIZE + i, sizeof(uint64_t));
+			memcpy(&words[2], data + 2 * CRC32C_STRIPE_SIZE + i, sizeof(uint64_t));
+			first = _mm_crc32_u64(first, words[0]);
+			second = _mm_crc32_u64(second, words[1]);
+			third = _mm_crc32_u64(third, words[2]);
+		}
+		const __m128i first_shifted = _mm_clmulepi64_si128(_mm_cvtsi64_si128(static_cast<long long>(first)), shifts, 0x00);
+		const __m128i second_shifted = _mm_clmulepi64_si128(_mm_cvtsi64_si128(static_cast<long long>(second)), shifts, 0x10);
+		state = _mm_crc32_u64(0, static_cast<uint64_t>(_mm_cvtsi128_si64(first_shifted)))
+			^ _mm_crc32_u64(0, static_cast<uint64_t>(_mm_cvtsi128_si64(second_shifted))) ^ third;
+	}
+	for (; size >= 8; data += 8, size -= 8) {
+		uint64_t word;
+		memcpy(&word, data, sizeof(word));
+		state = _mm_crc32_u64(state, word);
+	}
+	uint32_t state32 = static_cast<uint32_t>(state);
+	for (; size; ++data, --size)
+		state32 = _mm_crc32_u8(state32, static_cast<unsigned char>(*data));
+	return ~state32;
+}
+
+__attribute__((target("avx2")))
+bool BloomContainsAvx2(const char* filter, size_t block_count, uint64_t hash) {
+	if (!block_count)
+		return false;
+	//the masks of both halves of the block are built at once: the bit number of every word is the top 5 bits of the product
+	const char* block = filter + BloomBlock(block_count, hash);
+	const __m256i key = _mm256_set1_epi32(static_cast<int>(static_cast<uint32_t>(hash)));
+	const __m256i one = _mm256_set1_epi32(1);
+	const __m256i low_mask = _mm256_sllv_epi32(one, _mm256_srli_epi32(_mm256_mullo_epi32(key, _mm256_load_si256(reinterpret_cast<const __m256i*>(BLOOM_SALTS))), 27));
+	const __m256i high_mask = _mm256_sllv_epi32(one, _mm256_srli_epi32(_mm256_mullo_epi32(key, _mm256_load_si256(reinterpret_cast<const __m256i*>(BLOOM_SALTS + 8))), 27));
+	const __m256i low = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block));
+	const __m256i high = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + 32));
+	return _mm256_testc_si256(low, low_mask) && _mm256_testc_si256(high, high_mask);
+}
+
+BloomContainsFunction SelectBloomContains() {
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		return BloomContainsAvx2;
+	return BloomContainsScalar;
+}
+
+Crc32cFunction SelectCrc32c() {
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("pclmul"))
+		return Crc32cSse42;
+	return Crc32cScalar;
+}
+
+UnpackBitsFunction SelectUnpackBits() {
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		return UnpackBitsAvx2;
+	return UnpackBitsScalar;
+}
+
+FindByteFunction SelectFindByte() {
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		return FindByteAvx2;
+	if (__builtin_cpu_supports("sse2"))
+		return FindByteSse2;
+	return FindByteScalar;
+}
+
+#else
+
+FindByteFunction SelectFindByte() {
+	return FindByteScalar;
+}
+
+UnpackBitsFunction SelectUnpackBits() {
+	return UnpackBitsScalar;
+}
+
+Crc32cFunction SelectCrc32c() {
+	return Crc32cScalar;
+}
+
+BloomContainsFunction SelectBloomContains() {
+	return BloomContainsScalar;
+}
+
+#endif
+
+} // end of anonymous namespace
+
+namespace kernel {
+
+const char* FindByteScalar(const char *begin, const char *end, char value) {
+	return simd::FindByteScalar(begin, end, value);
+}
+
+void UnpackBitsScalar(const char *data, size_t size, size_t count, unsigned int width, uint64_t base, uint64_t *values) {
+	simd::UnpackBitsScalar(data, size, count, width, base, values);
+}
+
+uint32_t Crc32cScalar(const char *data, size_t size, uint32_t crc) {
+	return simd::Crc32cScalar(crc, data, size);
+}
+
+bool BloomContainsScalar(const char *filter, size_t block_count, uint64_t hash) {
+	return simd::BloomContainsScalar(filter, block_count, hash);
+}
+
+#ifdef SIMD_X86
+
+const char* FindByteSse2(const char *begin, const char *end, char value) {
+	return simd::FindByteSse2(begin, end, value);
+}
+
+const char* FindByteAvx2(const char *begin, const char *end, char value) {
+	return simd::FindByteAvx2(begin, end, value);
+}
+
+void UnpackBitsAvx2(const char *data, size_t size, size_t count, unsigned int width, uint64_t base, uint64_t *values) {
+	simd::UnpackBitsAvx2(data, size, count, width, base, values);
+}
+
+uint32_t Crc32cSse42(const char *data, size_t size, uint32_t crc) {
+	return simd::Crc32cSse42(crc, data, size);
+}
+
+bool BloomContainsAvx2(const char *filter, size_t block_count, uint64_t hash) {
+	return simd::BloomContainsAvx2(filter, block_count, hash);
+}
+
+#endif
+
+} // end of namespace kernel
+
+const char* FindByte(const char *begin, const char *end, char value) {
+	static const FindByteFunction function = SelectFindByte();
+	return function(begin, end, value);
+}
+
+void UnpackBits(const char *data, size_t size, size_t count, unsigned int width, uint64_t base, uint64_t *values) {
+	static const UnpackBitsFunction function = SelectUnpackBits();
+	function(data, size, count, width, base, values);
+}
+
+uint32_t Crc32c(const char *data, size_t size, uint32_t crc) {
+	static const Crc32cFunction function = SelectCrc32c();
+	return function(crc, data, size);
+}
+
+void BloomInsert(char *filter, size_t block_count, uint64_t hash) {
+	char* block = filter + BloomBlock(block_count, hash);
+	for (size_t i = 0; i < BLOOM_BLOCK_WORDS; ++i) {
+		uint32_t word;
+		memcpy(&word, block + i * sizeof(word), sizeof(word));
+		word |= 1u << ((static_cast<uint32_t>(hash) * BLOOM_SALTS[i]) >> 27);
+		memcpy(block + i * sizeof(word), &word, sizeof(word));
+	}
+}
+
+bool BloomContains(const char *filter, size_t block_count, uint64_t hash) {
+	static const BloomContainsFunction function = SelectBloomContains();
+	return function(filter, block_count, hash);
+}
+
+} // end of namespace simd
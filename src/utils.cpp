@@ -1,7 +1,49 @@
 #include "utils.h"
 
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
 #include <boost/algorithm/string/replace.hpp>
 
+namespace util {
+
+void ParallelFor(size_t count, size_t threads, const std::function<void(size_t)> &function) {
+	if (threads < 2 || count < 2) {
+		for (size_t i = 0; i < count; ++i)
+			function(i);
+		return;
+	}
+
+	std::atomic<size_t> next_index {0};
+	std::exception_ptr error;
+	std::mutex error_mutex;
+	auto worker = [&]() {
+		for (size_t i = next_index++; i < count; i = next_index++) {
+			try {
+				function(i);
+			} catch (...) {
+				std::lock_guard<std::mutex> lock(error_mutex);
+				if (!error)
+					error = std::current_exception();
+			}
+		}
+	};
+
+	std::vector<std::thread> pool;
+	for (size_t i = 1; i < std::min(threads, count); ++i)
+		pool.emplace_back(worker);
+	worker();
+	for (auto& thread : pool)
+		thread.join();
+	if (error)
+		std::rethrow_exception(error);
+}
+
+} // end of namespace util
+
 namespace str {
 
 std::string Replace(const std::string &source, const std::string &from, const std::string &to) {
@@ -0,0 +1,67 @@
+#include <random>
+#include <string>
+#include <gtest/gtest.h>
+#include "apperror.h"
+#include "compression.h"
+
+using namespace jsonpacker_compression;
+
+namespace {
+
+std::string CompressionTestData() {
+	//JSON-like text with repeated keys and random values
+	std::mt19937 random(1);
+	std::string data;
+	while (data.size() < 200000)
+		data += "{\"id\":" + std::to_string(random() % 100000) + ",\"name\":\"user" + std::to_string(random() % 50) + "\",\"active\":true}\n";
+	return data;
+}
+
+}
+
+TEST(CompressionTest, RoundTrip) {
+	std::mt19937 random(2);
+	std::string incompressible(5000, ' ');
+	for (auto& c : incompressible)
+		c = static_cast<char>(random());
+	const std::string inputs[] = {"", "a", "abcd", std::string(100000, 'x'), std::string(300, 'a') + std::string(300, 'b'),
+			incompressible, CompressionTestData()};
+
+	ASSERT_GE(CodecNames().size(), 2u);
+	for (auto& name : CodecNames()) {
+		auto codec = GetCodec(name);
+		EXPECT_EQ(GetCodec(codec->Id())->Id(), codec->Id());
+		for (auto& input : inputs) {
+			std::string compressed(codec->MaxCompressedSize(input.size()), '\0');
+			compressed.resize(codec->Compress(input.data(), input.size(), &compressed[0], compressed.size()));
+			std::string restored(input.size(), '\0');
+			EXPECT_TRUE(codec->Decompress(compressed.data(), compressed.size(), &restored[0], restored.size())) << name << " " << input.size();
+			EXPECT_TRUE(restored == input) << name << " " << input.size();
+			if (codec->Id() != BlockCodecId::stored && input.size() == 100000) {
+				EXPECT_LT(compressed.size(), input.size() / 50) << name;
+			}
+		}
+	}
+	EXPECT_THROW(GetCodec("unknown"), app_err::JsonPackerMissed);
+	EXPECT_THROW(GetCodec(static_cast<BlockCodecId>(200)), app_err::JsonPackerMissed);
+}
+
+TEST(CompressionTest, CorruptedDataIsRejected) {
+	const std::string input = CompressionTestData();
+	for (auto& name : CodecNames()) {
+		auto codec = GetCodec(name);
+		std::string compressed(codec->MaxCompressedSize(input.size()), '\0');
+		compressed.resize(codec->Compress(input.data(), input.size(), &compressed[0], compressed.size()));
+		std::string restored(input.size(), '\0');
+		//wrong size of restored data
+		EXPECT_FALSE(codec->Decompress(compressed.data(), compressed.size(), &restored[0], restored.size() - 1)) << name;
+		//truncated data
+		EXPECT_FALSE(codec->Decompress(compressed.data(), compressed.size() / 2, &restored[0], restored.size())) << name;
+	}
+
+	//match refers to data before the begining of block
+	auto lz = GetCodec("lz");
+	const char invalid[] = {0x10, 'a', 0x05, 0x00};
+	char restored[5];
+	EXPECT_FALSE(lz->Decompress(invalid, sizeof(invalid), restored, sizeof(restored)));
+}
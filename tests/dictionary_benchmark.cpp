@@ -0,0 +1,105 @@
+/**
+  @file
+  @brief The benchmark comparing JsonKeyDictionary with the former dictionary based on std::map
+  **/
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+#include "coder.h"
+
+namespace {
+
+/**
+ * @brief The MapKeyDictionary class is the former implementation of JSON key dictionary kept for comparison
+ */
+class MapKeyDictionary {
+public:
+	int AddKey(const std::string& key) {
+		auto it = m_keys.insert(std::make_pair(key, 0));
+		if (it.second)
+			it.first->second = ++m_current;
+		return it.first->second;
+	}
+	void AddKey(const std::string& key, int index) {
+		if (!m_keys.insert(std::make_pair(key, index)).second)
+			throw app_err::JsonPackerExists("dictionary key", key);
+	}
+	std::string operator [] (int index) {
+		for (auto& key_pair : m_keys) {
+			if (key_pair.second == index)
+				return key_pair.first;
+		}
+		throw app_err::JsonPackerMissed("dictionary key", std::to_string(index));
+	}
+private:
+	int m_current {0};
+	std::map<std::string, int> m_keys;
+};
+
+/**
+ * @brief The BenchmarkResult struct holds times of benchmark stages in seconds
+ */
+struct BenchmarkResult {
+	double encode {0};///adding keys of records (as json2tlv does)
+	double load {0};///loading keys with indexes (as tlv2json loads dictionary)
+	double decode {0};///retrieving keys by index (as tlv2json decodes records)
+};
+
+double Elapsed(const std::chrono::steady_clock::time_point& start) {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * @brief Run measures dictionary operations; every key is looked up lookups_per_key times,
+ * the count of reverse lookups is limited for the former dictionary because they take linear time
+ */
+template<typename Dictionary>
+BenchmarkResult Run(const std::vector<std::string>& keys, size_t lookups, size_t reverse_lookups, size_t& checksum) {
+	BenchmarkResult result;
+	{
+		Dictionary dictionary;
+		auto start = std::chrono::steady_clock::now();
+		for (size_t i = 0; i < lookups; ++i)
+			checksum += static_cast<size_t>(dictionary.AddKey(keys[i % keys.size()]));
+		result.encode = Elapsed(start);
+	}
+	Dictionary dictionary;
+	auto start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < keys.size(); ++i)
+		dictionary.AddKey(keys[i], static_cast<int>(i + 1));
+	result.load = Elapsed(start);
+
+	start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < reverse_lookups; ++i)
+		checksum += dictionary[static_cast<int>((i * 7919) % keys.size() + 1)].size();
+	result.decode = Elapsed(start) / static_cast<double>(reverse_lookups);
+	return result;
+}
+
+} // end of anonymous namespace
+
+int main() {
+	std::cout << std::setw(10) << "keys" << std::setw(12) << "dictionary"
+			  << std::setw(14) << "encode, s" << std::setw(14) << "load, s" << std::setw(18) << "lookup, ns" << std::endl;
+	size_t checksum = 0;
+	for (size_t key_count : {10, 1000, 1000000}) {
+		std::vector<std::string> keys;
+		for (size_t i = 0; i < key_count; ++i)
+			keys.push_back("record_field_" + std::to_string(i * 2654435761u % 4294967291u));
+		const size_t lookups = std::max<size_t>(key_count * 4, 4000000);
+
+		auto print = [key_count](const char* name, const BenchmarkResult& result) {
+			std::cout << std::setw(10) << key_count << std::setw(12) << name << std::fixed << std::setprecision(4)
+					  << std::setw(14) << result.encode << std::setw(14) << result.load
+					  << std::setw(18) << std::setprecision(1) << result.decode * 1e9 << std::endl;
+		};
+		print("std::map", Run<MapKeyDictionary>(keys, lookups, std::min<size_t>(lookups, 2000000 / key_count + 1), checksum));
+		print("hash", Run<jsonpacker_coder::JsonKeyDictionary>(keys, lookups, lookups, checksum));
+	}
+	std::cout << "checksum: " << checksum << std::endl;
+	return 0;
+}
@@ -1,10 +1,40 @@
+#include <cstring>
+#include <limits>
 #include <vector>
 #include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <numeric>
 #include <boost/algorithm/string.hpp>
 #include "apperror.h"
+#include "columnar.h"
+#include "filter.h"
+#include "index.h"
 #include "utils.h"
 #include "jsoncoder_tests.h"
 
+namespace {
+
+std::atomic<uint64_t> global_allocations {0}; ///the count of calls of global operator new in tests (@see JsonToTlvTest.NoAllocationsPerRecord)
+
+}
+
+void* operator new(size_t size) {
+	++global_allocations;
+	if (void* ptr = std::malloc(size ? size : 1))
+		return ptr;
+	throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept {
+	std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+	std::free(ptr);
+}
+
 namespace jsoncoder_tests {
 
 JsonTlvTestBase::JsonTlvTestBase()
@@ -26,6 +56,31 @@ void JsonTlvTestBase::FillInputStream(const std::vector<unsigned char> &data) {
 	}
 }
 
+JsonTlvTestBase::StringVector JsonTlvTestBase::GenerateJsonRecords(size_t count) {
+	StringVector records;
+	for (size_t i = 0; i < count; ++i) {
+		std::stringstream record;
+		record << "{\"id\":" << i << ", \"key" << i % 37 << "\":\"value" << i << "\"";
+		if (i % 3 == 0)
+			record << ", \"flag\":" << (i % 2 ? "true" : "false");
+		if (i % 5 == 0)
+			record << ", \"big" << i % 11 << "\":" << 5000000000LL * static_cast<long long>(i) << ", \"real\":" << i * 0.25;
+		if (i % 7 == 0)
+			record << ", \"nothing\":null";
+		record << "}";
+		records.push_back(record.str());
+	}
+	return records;
+}
+
+std::string JsonTlvTestBase::RunCoder(JsonPackerBase &coder, const std::string &input) {
+	std::stringstream input_stream(input);
+	std::stringstream output_stream;
+	jsonpacker_stream::JsonPackerStringStream stream(input_stream, output_stream);
+	coder.Run(stream);
+	return output_stream.str();
+}
+
 JsonToTlvTest::JsonToTlvTest()
 	: JsonTlvTestBase()
 {
@@ -75,6 +130,33 @@ TEST_F(JsonKeyDictionaryTest, GetInvalidKeyIndex) {
 	EXPECT_THROW(m_dictionary[123], app_err::JsonPackerMissed);
 }
 
+TEST_F(JsonKeyDictionaryTest, ManyKeysWithIndexInArbitraryOrder) {
+	const int key_count = 100000;
+	std::vector<int> indexes(key_count);
+	for (int i = 0; i < key_count; ++i)
+		indexes[static_cast<size_t>(i)] = (i * 7919) % key_count + 1;
+	for (int index : indexes)
+		m_dictionary.AddKey("key" + std::to_string(index), index);
+	m_dictionary.AddKey("negative", -5);
+	m_dictionary.AddKey("far", 1 << 30);
+
+	for (int index = 1; index <= key_count; ++index) {
+		EXPECT_EQ(m_dictionary[index], "key" + std::to_string(index));
+		EXPECT_EQ(m_dictionary.AddKey("key" + std::to_string(index)), index);
+	}
+	EXPECT_EQ(m_dictionary[-5], "negative");
+	EXPECT_EQ(m_dictionary[1 << 30], "far");
+	EXPECT_THROW(m_dictionary[0], app_err::JsonPackerMissed);
+	EXPECT_THROW(m_dictionary[key_count + 1], app_err::JsonPackerMissed);
+	EXPECT_THROW(m_dictionary.AddKey("key1", key_count + 1), app_err::JsonPackerExists);
+	EXPECT_EQ(m_dictionary.Keys().size(), static_cast<size_t>(key_count + 2));
+
+	m_dictionary.Clear();
+	EXPECT_TRUE(m_dictionary.Keys().empty());
+	EXPECT_THROW(m_dictionary[1], app_err::JsonPackerMissed);
+	EXPECT_EQ(m_dictionary.AddKey("key5"), 1);
+}
+
 TEST_F(JsonKeyDictionaryTest, CheckKeyIndexes) {
 	const std::vector<std::string> key_sequence = {
 		"key1", "key2", "key3", "key1", "key4", "key5", "key2", "key1"
@@ -100,6 +182,155 @@ TEST_F(JsonKeyDictionaryTest, CheckKeyIndexes) {
 }
 
 
+TEST(ByteStreamTest, SmallBlocks) {
+	std::string data;
+	for (int i = 0; i < 1000; ++i)
+		data += std::to_string(i) + ",";
+
+	std::stringstream output_stream;
+	{
+		jsonpacker_stream::StreamByteSink sink(output_stream, 5);
+		sink.Write(data.data(), 3);
+		char* reserved = sink.Reserve(100);
+		memcpy(reserved, data.data() + 3, 100);
+		sink.Commit(100);
+		for (size_t i = 103; i < data.size(); ++i)
+			sink.Put(data[i]);
+		EXPECT_EQ(sink.Position(), data.size());
+	}
+	EXPECT_EQ(output_stream.str(), data);
+
+	std::stringstream input_stream(data);
+	jsonpacker_stream::StreamByteSource source(input_stream, 3);
+	const char* peeked;
+	ASSERT_GE(source.Peek(peeked, 10), 10u);
+	EXPECT_EQ(std::string(peeked, 10), data.substr(0, 10));
+	source.Consume(4);
+	EXPECT_EQ(source.Skip(100), 100u);
+	EXPECT_EQ(source.Position(), 104u);
+	ASSERT_GE(source.Peek(peeked, 1), 1u);
+	EXPECT_EQ(*peeked, data[104]);
+	source.Seek(2);
+	ASSERT_EQ(source.Peek(peeked, data.size()), data.size() - 2);
+	EXPECT_EQ(std::string(peeked, data.size() - 2), data.substr(2));
+	EXPECT_EQ(source.Size(), data.size());
+	source.Consume(data.size() - 2);
+	EXPECT_EQ(source.Peek(peeked), 0u);
+	EXPECT_EQ(source.Skip(10), 0u);
+}
+
+TEST(TlvRecordDataTest, SmallAndLargeData) {
+	TlvRecordData data;
+	EXPECT_TRUE(data.empty());
+	const std::string small = "small";
+	data.assign(small.data(), small.data() + small.size());
+	EXPECT_EQ(std::string(data.data(), data.size()), small);
+
+	const std::string large(100, 'x');
+	data.resize(large.size());
+	memcpy(data.data() + small.size(), large.data(), large.size() - small.size());
+	EXPECT_EQ(std::string(data.data(), data.size()), small + large.substr(small.size()));
+
+	data.resize(3);
+	EXPECT_EQ(std::string(data.data(), data.size()), "sma");
+	data.assign(large.data(), large.data() + large.size());
+	EXPECT_EQ(std::string(data.data(), data.size()), large);
+}
+
+TEST(TlvReaderTest, ViewsReferToMappedData) {
+	using TlvType = TlvRecordView::TlvRecordType;
+	const std::vector<unsigned char> tlv = TLV_DATA_V2_VALID;
+	const char* const begin = reinterpret_cast<const char*>(tlv.data());
+	jsonpacker_stream::MemoryByteSource source(begin, tlv.size());
+	source.Seek(8);
+
+	TlvReader reader(source, TlvFormat::v2);
+	TlvRecordView record;
+	ASSERT_TRUE(reader.Next(record));
+	EXPECT_EQ(record.Type(), TlvType::rtMemberCount);
+	EXPECT_EQ(record.GetInt(), 3);
+	ASSERT_TRUE(reader.Next(record));
+	EXPECT_EQ(record.Type(), TlvType::rtInt);
+	EXPECT_EQ(record.GetInt(), 1);
+	ASSERT_TRUE(reader.Next(record));
+	EXPECT_EQ(record.Type(), TlvType::rtString);
+	EXPECT_EQ(record.GetString(), "value");
+	EXPECT_EQ(record.RecordSize(), 7u);
+	EXPECT_GE(record.Data(), begin);
+	EXPECT_LE(record.Data() + record.DataSize(), begin + tlv.size());
+
+	size_t records = 3;
+	while (reader.Next(record) && record.Type() != TlvType::rtDictionary)
+		++records;
+	EXPECT_EQ(records, 14u);
+	EXPECT_EQ(record.Type(), TlvType::rtDictionary);
+	EXPECT_EQ(reader.Position(), 0x56u);
+}
+
+TEST(TlvReaderTest, TruncatedRecord) {
+	const std::vector<char> tlv = {0x09, 0x05, 0x76, 0x61};
+	jsonpacker_stream::MemoryByteSource source(tlv.data(), tlv.size());
+	TlvReader reader(source, TlvFormat::v2);
+	TlvRecordView record;
+	EXPECT_THROW(reader.Next(record), TlvInvalidFormatError);
+}
+
+TEST(JsonParseArenaTest, NoAllocationsAfterWarmUp) {
+	JsonParseArena arena;
+	const std::string small_record = "{\"key1\":\"value\", \"key2\":42, \"key3\":true}";
+	std::string large_record = "{\"k0\":0";
+	for (int i = 1; i < 5000; ++i)
+		large_record += ", \"k" + std::to_string(i) + "\":\"" + std::string(static_cast<size_t>(i % 50), 'x') + "\"";
+	large_record += "}";
+
+	for (int i = 0; i < 3; ++i) {
+		ASSERT_FALSE(arena.Parse(small_record.data(), small_record.size()).HasParseError());
+		ASSERT_FALSE(arena.Parse(large_record.data(), large_record.size()).HasParseError());
+	}
+	const size_t allocations = arena.HeapAllocations();
+	for (int i = 0; i < 100; ++i) {
+		auto& document = arena.Parse(i % 2 ? small_record.data() : large_record.data(), i % 2 ? small_record.size() : large_record.size());
+		ASSERT_FALSE(document.HasParseError());
+		EXPECT_EQ(document.MemberCount(), i % 2 ? 3u : 5000u);
+	}
+	EXPECT_EQ(arena.HeapAllocations(), allocations);
+}
+
+TEST_F(JsonToTlvTest, NoAllocationsPerRecord) {
+	//all heap allocations of encoder (parser arenas and global operator new) are made while buffers and dictionaries warm up,
+	//so encoding 8 times more records of the same keys makes only the allocations growing output
+	auto input = [](size_t count) {
+		std::string records;
+		for (size_t i = 0; i < count; ++i)
+			records += "{\"id\":" + std::to_string(i) + ",\"status\":\"" + (i % 3 ? "ok" : "error") + "\",\"latency\":" + std::to_string(i % 1000 * 0.5) + ",\"flag\":true}\n";
+		return records;
+	};
+	const std::string small_input = input(2000);
+	const std::string large_input = input(16000);
+	for (int layout = 0; layout < 5; ++layout) {
+		auto allocations = [&](const std::string& records) {
+			JsonToTlv encoder;
+			//chunks are encoded by threads into their buffers and dictionaries
+			encoder.Options().threads = layout == 4 ? 2 : 1;
+			if (layout && layout < 4) {
+				encoder.Options().format = TlvFormat::v2;
+				encoder.Options().inline_keys = layout == 1;
+				encoder.Options().shapes = layout == 2;
+				encoder.Options().string_dictionary = layout == 3 ? 4 : 0;
+			}
+			std::stringstream input_stream(records);
+			std::stringstream output_stream;
+			jsonpacker_stream::JsonPackerStringStream stream(input_stream, output_stream);
+			const uint64_t before = global_allocations;
+			encoder.Run(stream);
+			return global_allocations - before + encoder.Stats().parser_heap_allocations;
+		};
+		const uint64_t small_allocations = allocations(small_input);
+		const uint64_t large_allocations = allocations(large_input);
+		EXPECT_LT(large_allocations - small_allocations, 20u) << layout << " " << small_allocations << " " << large_allocations;
+	}
+}
+
 TEST_F(JsonToTlvTest, ValidJsonRun) {
 	JsonToTlv coder;
 	FillInputStream(m_json_records_valid);
@@ -138,6 +369,21 @@ TEST_F(JsonToTlvTest, ValidJsonRunCheckOutput) {
 	EXPECT_TRUE(std::equal(result_data.begin(),result_data.end(), m_tlv_data_valid.begin()));
 }
 
+TEST_F(JsonToTlvTest, ValidJsonRunCheckOutputV2) {
+	std::string input;
+	for (auto& rec : m_json_records_valid)
+		input += rec + "\n";
+	const std::string expected(m_tlv_data_v2_valid.begin(), m_tlv_data_v2_valid.end());
+
+	JsonToTlv coder;
+	coder.Options().format = TlvFormat::v2;
+	EXPECT_EQ(RunCoder(coder, input), expected);
+
+	JsonToTlvSax sax_coder;
+	sax_coder.Options().format = TlvFormat::v2;
+	EXPECT_EQ(RunCoder(sax_coder, input), expected);
+}
+
 TEST_F(JsonToTlvTest, InvalidKeyNameJsonRun) {
 	FillInputStream(m_json_records_invalid_keyname);
 	JsonToTlv coder;
@@ -156,6 +402,114 @@ TEST_F(JsonToTlvTest, InvalidValueJsonRun) {
 	EXPECT_THROW(coder.Run(m_stream), jsonpacker_coder::JsonParseError);
 }
 
+TEST_F(JsonToTlvTest, ParallelRunCheckOutput) {
+	std::string input;
+	for (auto& rec : GenerateJsonRecords(1000))
+		input += rec + "\n";
+	input += "{\"last\":1}"; //the last line without new line symbol
+
+	JsonToTlv sequential_coder;
+	const std::string expected = RunCoder(sequential_coder, input);
+	EXPECT_EQ(sequential_coder.Stats().records, 1001u);
+	for (unsigned int threads : {2, 3, 8}) {
+		JsonToTlv coder;
+		coder.Options().threads = threads;
+		coder.Options().chunk_size = 100;
+		EXPECT_EQ(RunCoder(coder, input), expected);
+		EXPECT_TRUE(coder.GetDictionary()->Keys() == sequential_coder.GetDictionary()->Keys());
+	}
+}
+
+TEST_F(JsonToTlvTest, ParallelInvalidJsonLineNumber) {
+	StringVector records = GenerateJsonRecords(500);
+	records[356] = m_json_records_invalid_value.front();
+	std::string input;
+	for (auto& rec : records)
+		input += rec + "\n";
+
+	for (unsigned int threads : {1, 4}) {
+		JsonToTlv coder;
+		coder.Options().threads = threads;
+		coder.Options().chunk_size = 64;
+		try {
+			RunCoder(coder, input);
+			ADD_FAILURE() << "JsonParseError expected";
+		} catch (const JsonParseError& e) {
+			EXPECT_NE(std::string(e.what()).find("at line 357:"), std::string::npos) << e.what();
+		}
+	}
+}
+
+TEST_F(JsonToTlvTest, MappedFileRunCheckOutput) {
+	const std::string filename = "jsoncoder_tests_mapped_input.json";
+	std::string input;
+	for (auto& rec : GenerateJsonRecords(300))
+		input += rec + "\n";
+	std::ofstream(filename, std::ios_base::binary) << input;
+
+	JsonToTlv stream_coder;
+	const std::string expected = RunCoder(stream_coder, input);
+	for (unsigned int threads : {1, 4}) {
+		std::ofstream output;
+		jsonpacker_stream::JsonPackerMappedFileStream stream(filename, output);
+		{
+			auto source = stream.CreateInput();
+			const char* data;
+			EXPECT_EQ(source->Peek(data), input.size());
+			EXPECT_EQ(std::string(data, input.size()), input);
+		}
+
+		std::stringstream result;
+		jsonpacker_stream::JsonPackerStringStream string_stream(m_input_stream, result);
+		JsonToTlv coder;
+		coder.Options().threads = threads;
+		coder.Options().chunk_size = 128;
+		//read data from mapped file, but write it into string stream
+		struct MappedInputStringOutput : public jsonpacker_stream::JsonPackerStream {
+			jsonpacker_stream::JsonPackerStream& input;
+			jsonpacker_stream::JsonPackerStream& output;
+			MappedInputStringOutput(jsonpacker_stream::JsonPackerStream& i, jsonpacker_stream::JsonPackerStream& o) : input(i), output(o) {}
+			std::istream& InputStream() override {return input.InputStream();}
+			std::ostream& OutputStream() override {return output.OutputStream();}
+			std::unique_ptr<jsonpacker_stream::ByteSource> CreateInput() override {return input.CreateInput();}
+		} mixed_stream(stream, string_stream);
+		coder.Run(mixed_stream);
+		EXPECT_EQ(result.str(), expected);
+	}
+	std::remove(filename.c_str());
+}
+
+TEST_F(JsonToTlvTest, SaxOutputEqualsDomOutput) {
+	std::string input;
+	for (auto& rec : m_json_records_valid_all_datatypes)
+		input += rec + "\n";
+	for (auto& rec : GenerateJsonRecords(500))
+		input += rec + "\n";
+	input += "{\"i\":-5, \"u\":3000000000, \"i64\":-3000000000, \"u64\":18446744073709551615, \"e\":\"\", \"esc\":\"a\\\"b\\nc\"}\n";
+
+	JsonToTlv dom_coder;
+	const std::string expected = RunCoder(dom_coder, input);
+	for (unsigned int threads : {1, 3}) {
+		auto sax_coder = GetPacker("json2tlv-sax");
+		sax_coder->Options().threads = threads;
+		sax_coder->Options().chunk_size = 256;
+		EXPECT_EQ(RunCoder(*sax_coder, input), expected);
+		EXPECT_TRUE(sax_coder->GetDictionary()->Keys() == dom_coder.GetDictionary()->Keys());
+	}
+}
+
+TEST_F(JsonToTlvTest, SaxInvalidJsonRun) {
+	JsonToTlvSax coder;
+	for (auto records : {m_json_records_invalid_keyname, m_json_records_invalid_value, m_json_records_invalid_novalue}) {
+		std::string input;
+		for (auto& rec : records)
+			input += rec + "\n";
+		EXPECT_THROW(RunCoder(coder, input), jsonpacker_coder::JsonParseError);
+	}
+	for (auto record : {"{\"key1\":{\"nested\":1}}", "{\"key1\":[1, 2]}", "42"})
+		EXPECT_THROW(RunCoder(coder, record), jsonpacker_coder::JsonParseError);
+}
+
 TEST_F(TlvToJsonTest, ValidTlvRun) {
 	FillInputStream(m_tlv_data_valid);
 	TlvToJson coder;
@@ -211,6 +565,1287 @@ TEST_F(TlvToJsonTest, TlvToJsonToTlv) {
 	EXPECT_TRUE(std::equal(result_data.begin(),result_data.end(), m_tlv_data_valid.begin()));
 }
 
+TEST_F(TlvToJsonTest, TlvV1AndV2RunCheckOutput) {
+	std::string input;
+	for (auto& rec : m_json_records_valid_all_datatypes)
+		input += rec + "\n";
+	for (auto& rec : GenerateJsonRecords(200))
+		input += rec + "\n";
+
+	std::string expected;
+	for (TlvFormat format : {TlvFormat::v1, TlvFormat::v2}) {
+		JsonToTlv encoder;
+		encoder.Options().format = format;
+		const std::string tlv_data = RunCoder(encoder, input);
+		TlvToJson decoder;
+		const std::string json_data = RunCoder(decoder, tlv_data);
+		if (format == TlvFormat::v1)
+			expected = json_data;
+		else
+			EXPECT_EQ(json_data, expected);
+	}
+	EXPECT_EQ(std::count(expected.begin(), expected.end(), '\n'), 203);
+
+	TlvToJson decoder;
+	EXPECT_EQ(RunCoder(decoder, std::string(m_tlv_data_v2_valid.begin(), m_tlv_data_v2_valid.end())),
+			  RunCoder(decoder, std::string(m_tlv_data_valid.begin(), m_tlv_data_valid.end())));
+}
+
+TEST_F(TlvToJsonTest, SmallIoBlocksRunCheckOutput) {
+	std::string input;
+	for (auto& rec : GenerateJsonRecords(300))
+		input += rec + "\n";
+
+	for (TlvFormat format : {TlvFormat::v1, TlvFormat::v2}) {
+		JsonToTlv encoder;
+		encoder.Options().format = format;
+		const std::string tlv_data = RunCoder(encoder, input);
+		TlvToJson default_decoder;
+		const std::string json_data = RunCoder(default_decoder, tlv_data);
+
+		std::stringstream tlv_stream(tlv_data);
+		std::stringstream json_stream;
+		jsonpacker_stream::JsonPackerStringStream stream(tlv_stream, json_stream);
+		stream.SetBlockSize(7);
+		TlvToJson decoder;
+		decoder.Run(stream);
+		EXPECT_TRUE(json_stream.str() == json_data);
+
+		std::stringstream json_input(input);
+		std::stringstream tlv_output;
+		jsonpacker_stream::JsonPackerStringStream encoder_stream(json_input, tlv_output);
+		encoder_stream.SetBlockSize(7);
+		encoder.Options().chunk_size = 16;
+		encoder.Run(encoder_stream);
+		EXPECT_TRUE(tlv_output.str() == tlv_data);
+	}
+}
+
+TEST_F(TlvToJsonTest, DirectOutputEqualsDomOutput) {
+	std::string input;
+	for (auto& rec : m_json_records_valid_all_datatypes)
+		input += rec + "\n";
+	for (auto& rec : GenerateJsonRecords(500))
+		input += rec + "\n";
+	input += "{\"i\":-5, \"u\":3000000000, \"i64\":-3000000000, \"u64\":18446744073709551615, \"d\":-1.5e-300, \"e\":\"\"}\n";
+	input += "{\"esc\\t\\u0001\":\"a\\\"b\\\\c\\n\\r\\b\\f\\u001f/\\u00e9\\u0000z\"}\n";
+	input += "{}\n";
+
+	for (TlvFormat format : {TlvFormat::v1, TlvFormat::v2}) {
+		JsonToTlv encoder;
+		encoder.Options().format = format;
+		const std::string tlv_data = RunCoder(encoder, input);
+		TlvToJson dom_decoder;
+		const std::string expected = RunCoder(dom_decoder, tlv_data);
+		auto direct_decoder = GetPacker("tlv2json-direct");
+		EXPECT_TRUE(RunCoder(*direct_decoder, tlv_data) == expected);
+		EXPECT_EQ(direct_decoder->Stats().records, dom_decoder.Stats().records);
+	}
+	TlvToJsonDirect decoder;
+	EXPECT_EQ(RunCoder(decoder, std::string(m_tlv_data_valid.begin(), m_tlv_data_valid.end())),
+			  RunCoder(decoder, std::string(m_tlv_data_v2_valid.begin(), m_tlv_data_v2_valid.end())));
+}
+
+TEST_F(TlvToJsonTest, DirectInvalidTlv) {
+	TlvToJsonDirect coder;
+	EXPECT_THROW(RunCoder(coder, std::string(m_tlv_data_v2_truncated_length.begin(), m_tlv_data_v2_truncated_length.end())),
+				 jsonpacker_coder::TlvInvalidFormatError);
+	EXPECT_THROW(RunCoder(coder, std::string(m_tlv_data_dictionary_invalid_data.begin(), m_tlv_data_dictionary_invalid_data.end())),
+				 jsonpacker_coder::TlvInvalidFormatError);
+	EXPECT_THROW(RunCoder(coder, std::string(m_tlv_data_valid_dictionary_without_valid_key.begin(), m_tlv_data_valid_dictionary_without_valid_key.end())),
+				 app_err::JsonPackerMissed);
+}
+
+TEST_F(TlvToJsonTest, InlineKeysSinglePassFromPipe) {
+	std::string input;
+	for (auto& rec : m_json_records_valid_all_datatypes)
+		input += rec + "\n";
+	for (auto& rec : GenerateJsonRecords(500))
+		input += rec + "\n";
+
+	JsonToTlv encoder;
+	encoder.Options().format = TlvFormat::v2;
+	TlvToJson dom_decoder;
+	const std::string expected = RunCoder(dom_decoder, RunCoder(encoder, input));
+
+	//the output does not depend on parser and count of threads
+	encoder.Options().inline_keys = true;
+	const std::string tlv_data = RunCoder(encoder, input);
+	EXPECT_EQ(tlv_data[5], TLV_FLAG_INLINE_KEYS);
+	for (unsigned int threads : {1, 3}) {
+		JsonToTlvSax sax_encoder;
+		sax_encoder.Options().format = TlvFormat::v2;
+		sax_encoder.Options().inline_keys = true;
+		sax_encoder.Options().threads = threads;
+		sax_encoder.Options().chunk_size = 256;
+		EXPECT_TRUE(RunCoder(sax_encoder, input) == tlv_data);
+	}
+
+	//input can not be seeked, so it is decoded in a single pass
+	struct PipeBuffer : public std::stringbuf {
+		explicit PipeBuffer(const std::string& data) : std::stringbuf(data) {}
+		pos_type seekoff(off_type, std::ios_base::seekdir, std::ios_base::openmode) override {return pos_type(off_type(-1));}
+		pos_type seekpos(pos_type, std::ios_base::openmode) override {return pos_type(off_type(-1));}
+	};
+	struct PipeInputStringOutput : public jsonpacker_stream::JsonPackerStream {
+		std::istream& input;
+		std::ostream& output;
+		PipeInputStringOutput(std::istream& i, std::ostream& o) : input(i), output(o) {}
+		std::istream& InputStream() override {return input;}
+		std::ostream& OutputStream() override {return output;}
+	};
+	for (const char* method : {"tlv2json", "tlv2json-direct"}) {
+		PipeBuffer buffer(tlv_data);
+		std::istream pipe(&buffer);
+		std::stringstream result;
+		PipeInputStringOutput stream(pipe, result);
+		stream.SetBlockSize(7);
+		GetPacker(method)->Run(stream);
+		EXPECT_TRUE(result.str() == expected) << method;
+	}
+
+	encoder.Options().format = TlvFormat::v1;
+	EXPECT_THROW(RunCoder(encoder, input), app_err::JsonPackerError);
+}
+
+TEST_F(TlvToJsonTest, RecordRangeAndSample) {
+	std::string input;
+	for (auto& rec : GenerateJsonRecords(300))
+		input += rec + "\n";
+
+	JsonToTlv v1_encoder;
+	JsonToTlv v2_encoder;
+	v2_encoder.Options().format = TlvFormat::v2;
+	v2_encoder.Options().block_size = 500;
+	v2_encoder.Options().block_records = 7;
+	const std::string v2_data = RunCoder(v2_encoder, input);
+	TlvTrailer trailer;
+	jsonpacker_stream::MemoryByteSource source(v2_data.data(), v2_data.size());
+	ASSERT_TRUE(ReadTlvTrailer(source, 0, trailer));
+	std::vector<TlvBlock> blocks;
+	ReadTlvBlockIndex(source, 0, trailer, blocks);
+	EXPECT_GT(blocks.size(), 300u / 7);
+	EXPECT_EQ(blocks.back().first_record + blocks.back().record_count, 300u);
+	v2_encoder.Options().threads = 3;
+	v2_encoder.Options().chunk_size = 1000;
+	EXPECT_TRUE(RunCoder(v2_encoder, input) == v2_data);
+
+	TlvToJson decoder;
+	StringVector lines;
+	std::stringstream all_lines(RunCoder(decoder, v2_data));
+	for (std::string line; std::getline(all_lines, line);)
+		lines.push_back(line + "\n");
+	ASSERT_EQ(lines.size(), 300u);
+
+	for (const std::string& tlv_data : {RunCoder(v1_encoder, input), v2_data}) {
+		for (const char* method : {"tlv2json", "tlv2json-direct"}) {
+			auto coder = GetPacker(method);
+			coder->Options().from = 123;
+			coder->Options().count = 45;
+			EXPECT_EQ(RunCoder(*coder, tlv_data), std::accumulate(lines.begin() + 123, lines.begin() + 168, std::string())) << method;
+			EXPECT_EQ(coder->Stats().records, 45u);
+			coder->Options().from = 299;
+			EXPECT_EQ(RunCoder(*coder, tlv_data), lines.back());
+			coder->Options().from = 300;
+			EXPECT_EQ(RunCoder(*coder, tlv_data), "");
+
+			//sampled records are unique and keep the order of input
+			coder->Options().from = 100;
+			coder->Options().count = 150;
+			coder->Options().sample = 20;
+			coder->Options().seed = 42;
+			std::stringstream sample(RunCoder(*coder, tlv_data));
+			auto last = lines.begin() + 99;
+			size_t sample_size = 0;
+			for (std::string line; std::getline(sample, line); ++sample_size) {
+				auto found = std::find(last + 1, lines.begin() + 250, line + "\n");
+				ASSERT_NE(found, lines.begin() + 250) << line;
+				last = found;
+			}
+			EXPECT_EQ(sample_size, 20u);
+			coder->Options().sample = 1000;
+			EXPECT_EQ(RunCoder(*coder, tlv_data), std::accumulate(lines.begin() + 100, lines.begin() + 250, std::string()));
+		}
+	}
+
+	//streamable data is read in a single pass: the range of records is skipped to, but records can't be sampled
+	JsonToTlv stream_encoder;
+	stream_encoder.Options().format = TlvFormat::v2;
+	stream_encoder.Options().inline_keys = true;
+	const std::string stream_data = RunCoder(stream_encoder, input);
+	for (const char* method : {"tlv2json", "tlv2json-direct"}) {
+		auto coder = GetPacker(method);
+		coder->Options().from = 123;
+		coder->Options().count = 45;
+		EXPECT_EQ(RunCoder(*coder, stream_data), std::accumulate(lines.begin() + 123, lines.begin() + 168, std::string())) << method;
+		coder->Options().sample = 3;
+		EXPECT_THROW(RunCoder(*coder, stream_data), app_err::JsonPackerError) << method;
+	}
+}
+
+TEST_F(TlvToJsonTest, ParallelOutputEqualsSequentialOutput) {
+	std::string input;
+	for (auto& rec : m_json_records_valid_all_datatypes)
+		input += rec + "\n";
+	for (auto& rec : GenerateJsonRecords(1000))
+		input += rec + "\n";
+
+	for (TlvFormat format : {TlvFormat::v1, TlvFormat::v2}) {
+		//v1 data is split by scanning records, v2 data - by block index
+		JsonToTlv encoder;
+		encoder.Options().format = format;
+		encoder.Options().block_size = 300;
+		const std::string tlv_data = RunCoder(encoder, input);
+		for (const char* method : {"tlv2json", "tlv2json-direct"}) {
+			auto sequential_decoder = GetPacker(method);
+			const std::string expected = RunCoder(*sequential_decoder, tlv_data);
+			for (unsigned int threads : {2, 3, 8}) {
+				auto decoder = GetPacker(method);
+				decoder->Options().threads = threads;
+				decoder->Options().chunk_size = 200;
+				decoder->Options().block_size = 100;
+				EXPECT_TRUE(RunCoder(*decoder, tlv_data) == expected) << method << " " << threads;
+				EXPECT_EQ(decoder->Stats().records, sequential_decoder->Stats().records);
+			}
+		}
+	}
+
+	//the record is truncated by dictionary
+	std::string tlv_data(m_tlv_data_valid.begin(), m_tlv_data_valid.end());
+	tlv_data.erase(tlv_data.find("dsfewew"), 7);
+	TlvToJson decoder;
+	decoder.Options().threads = 2;
+	EXPECT_THROW(RunCoder(decoder, tlv_data), jsonpacker_coder::TlvInvalidFormatError);
+}
+
+TEST_F(TlvToJsonTest, CompressedBlocks) {
+	std::string input;
+	for (auto& rec : m_json_records_valid_all_datatypes)
+		input += rec + "\n";
+	for (auto& rec : GenerateJsonRecords(2000))
+		input += rec + "\n";
+	JsonToTlv plain_encoder;
+	plain_encoder.Options().format = TlvFormat::v2;
+	TlvToJson plain_decoder;
+	const std::string expected = RunCoder(plain_decoder, RunCoder(plain_encoder, input));
+	StringVector lines;
+	std::stringstream all_lines(expected);
+	for (std::string line; std::getline(all_lines, line);)
+		lines.push_back(line + "\n");
+	ASSERT_GT(lines.size(), 1503u);
+
+	for (auto& codec : jsonpacker_compression::CodecNames()) {
+		JsonToTlv encoder;
+		encoder.Options().format = TlvFormat::v2;
+		encoder.Options().compression = codec;
+		encoder.Options().block_size = 3000;
+		const std::string tlv_data = RunCoder(encoder, input);
+		EXPECT_EQ(tlv_data[5], TLV_FLAG_TRAILER | TLV_FLAG_BLOCK_INDEX | TLV_FLAG_COMPRESSED);
+		if (codec != "stored") {
+			EXPECT_LT(tlv_data.size(), RunCoder(plain_encoder, input).size() / 2) << codec;
+		}
+		//blocks are compressed in parallel with the same result
+		encoder.Options().threads = 3;
+		encoder.Options().chunk_size = 5000;
+		EXPECT_TRUE(RunCoder(encoder, input) == tlv_data) << codec;
+
+		for (const char* method : {"tlv2json", "tlv2json-direct"}) {
+			for (unsigned int threads : {1, 2, 4}) {
+				auto decoder = GetPacker(method);
+				decoder->Options().threads = threads;
+				decoder->Options().chunk_size = 4000;
+				EXPECT_TRUE(RunCoder(*decoder, tlv_data) == expected) << codec << " " << method << " " << threads;
+			}
+			//records are found by block index in uncompressed data
+			auto decoder = GetPacker(method);
+			decoder->Options().from = 1500;
+			decoder->Options().count = 3;
+			EXPECT_EQ(RunCoder(*decoder, tlv_data), std::accumulate(lines.begin() + 1500, lines.begin() + 1503, std::string())) << codec << " " << method;
+		}
+	}
+}
+
+TEST_F(TlvToJsonTest, SmallCompressedBlocksAreStored) {
+	std::string input;
+	for (auto& rec : m_json_records_valid_all_datatypes)
+		input += rec + "\n";
+	JsonToTlv encoder;
+	encoder.Options().format = TlvFormat::v2;
+	encoder.Options().compression = "lz";
+	const std::string tlv_data = RunCoder(encoder, input);
+	ASSERT_LT(tlv_data.size(), static_cast<size_t>(TLV_MIN_COMPRESSED_BLOCK_SIZE));
+	EXPECT_EQ(tlv_data[TLV_HEADER_SIZE], static_cast<char>(jsonpacker_compression::BlockCodecId::stored));
+	TlvToJson decoder;
+	JsonToTlv plain_encoder;
+	const std::string expected = RunCoder(decoder, RunCoder(plain_encoder, input));
+	EXPECT_EQ(RunCoder(decoder, tlv_data), expected);
+
+	//the size of block does not match block index
+	std::string invalid_data = tlv_data;
+	++invalid_data[TLV_HEADER_SIZE + 1];
+	EXPECT_THROW(RunCoder(decoder, invalid_data), jsonpacker_coder::TlvInvalidFormatError);
+	//unknown codec
+	invalid_data = tlv_data;
+	invalid_data[TLV_HEADER_SIZE] = 100;
+	EXPECT_THROW(RunCoder(decoder, invalid_data), app_err::JsonPackerMissed);
+
+	//compressed blocks require block index
+	encoder.Options().format = TlvFormat::v1;
+	EXPECT_THROW(RunCoder(encoder, input), app_err::JsonPackerError);
+	encoder.Options().format = TlvFormat::v2;
+	encoder.Options().inline_keys = true;
+	EXPECT_THROW(RunCoder(encoder, input), app_err::JsonPackerError);
+	encoder.Options().inline_keys = false;
+	encoder.Options().compression = "unknown";
+	EXPECT_THROW(RunCoder(encoder, input), app_err::JsonPackerMissed);
+}
+
+TEST_F(TlvToJsonTest, ColumnarBlocks) {
+	std::string input;
+	for (auto& rec : m_json_records_valid_all_datatypes)
+		input += rec + "\n";
+	const size_t first_generated = m_json_records_valid_all_datatypes.size();
+	for (auto& rec : GenerateJsonRecords(2000))
+		input += rec + "\n";
+	JsonToTlv row_encoder;
+	row_encoder.Options().format = TlvFormat::v2;
+	TlvToJson row_decoder;
+	const std::string expected = RunCoder(row_decoder, RunCoder(row_encoder, input));
+	StringVector lines;
+	std::stringstream all_lines(expected);
+	for (std::string line; std::getline(all_lines, line);)
+		lines.push_back(line + "\n");
+	ASSERT_EQ(lines.size(), first_generated + 2000);
+
+	for (const std::string codec : {"", "lz"}) {
+		JsonToTlvColumnar encoder;
+		encoder.Options().compression = codec;
+		encoder.Options().block_size = 3000;
+		const std::string tlv_data = RunCoder(encoder, input);
+		EXPECT_EQ(tlv_data[5], TLV_FLAG_TRAILER | TLV_FLAG_BLOCK_INDEX | TLV_FLAG_COLUMNAR | (codec.empty() ? 0 : TLV_FLAG_COMPRESSED));
+		//blocks are converted in parallel with the same result
+		encoder.Options().threads = 3;
+		encoder.Options().chunk_size = 5000;
+		EXPECT_TRUE(RunCoder(encoder, input) == tlv_data) << codec;
+
+		for (const char* method : {"tlv2json", "tlv2json-direct"}) {
+			for (unsigned int threads : {1, 2, 4}) {
+				auto decoder = GetPacker(method);
+				decoder->Options().threads = threads;
+				EXPECT_TRUE(RunCoder(*decoder, tlv_data) == expected) << codec << " " << method << " " << threads;
+				EXPECT_EQ(decoder->Stats().records, lines.size());
+			}
+			auto decoder = GetPacker(method);
+			decoder->Options().from = 1500;
+			decoder->Options().count = 3;
+			EXPECT_EQ(RunCoder(*decoder, tlv_data), std::accumulate(lines.begin() + 1500, lines.begin() + 1503, std::string())) << codec << " " << method;
+			decoder->Options().from = 100;
+			decoder->Options().count = 1000;
+			decoder->Options().sample = 1000;
+			EXPECT_EQ(RunCoder(*decoder, tlv_data), std::accumulate(lines.begin() + 100, lines.begin() + 1100, std::string())) << codec << " " << method;
+			decoder->Options().sample = 10;
+			std::stringstream sample(RunCoder(*decoder, tlv_data));
+			size_t sample_size = 0;
+			for (std::string line; std::getline(sample, line); ++sample_size)
+				EXPECT_NE(std::find(lines.begin() + 100, lines.begin() + 1100, line + "\n"), lines.begin() + 1100) << line;
+			EXPECT_EQ(sample_size, 10u);
+
+			//only the members of selected keys are converted in order of original records
+			decoder = GetPacker(method);
+			decoder->Options().keys = {"flag", "id", "unknown"};
+			decoder->Options().from = first_generated;
+			std::string projected;
+			for (size_t i = 0; i < 2000; ++i)
+				projected += "{\"id\":" + std::to_string(i) + (i % 3 ? std::string() : std::string(",\"flag\":") + (i % 2 ? "true" : "false")) + "}\n";
+			EXPECT_EQ(RunCoder(*decoder, tlv_data), projected) << codec << " " << method;
+		}
+	}
+
+	//columnar layout requires block index
+	JsonToTlvColumnar encoder;
+	encoder.Options().format = TlvFormat::v1;
+	EXPECT_THROW(RunCoder(encoder, input), app_err::JsonPackerError);
+	encoder.Options().format = TlvFormat::v2;
+	encoder.Options().inline_keys = true;
+	EXPECT_THROW(RunCoder(encoder, input), app_err::JsonPackerError);
+}
+
+TEST_F(TlvToJsonTest, IntegerCodecs) {
+	//every sequence is encoded by the expected codec and restored
+	std::vector<std::pair<std::vector<uint64_t>, ColumnCodecId>> sequences(6);
+	for (uint64_t i = 0; i < 1000; ++i) {
+		sequences[0].first.push_back(1600000000000ULL + i * 1000);
+		sequences[1].first.push_back(static_cast<uint64_t>(-5000000000LL + static_cast<long long>(i * i * 3)));
+		sequences[2].first.push_back(static_cast<uint64_t>(static_cast<int64_t>(i % 7) - 3));
+		sequences[3].first.push_back(i / 250);
+		sequences[4].first.push_back((i * 0x9e3779b97f4a7c15ULL) ^ (i << 61));
+	}
+	sequences[5].first.push_back(42);
+	sequences[0].second = ColumnCodecId::delta;
+	sequences[1].second = ColumnCodecId::delta_of_delta;
+	sequences[2].second = ColumnCodecId::frame;
+	sequences[3].second = ColumnCodecId::rle;
+	sequences[4].second = ColumnCodecId::packed;
+	sequences[5].second = ColumnCodecId::frame;
+	for (auto& sequence : sequences) {
+		const size_t packed_size = sequence.first.size() * sizeof(uint64_t);
+		std::string data;
+		EXPECT_EQ(EncodeIntegers(sequence.first, packed_size, data), sequence.second) << sequence.first[0];
+		if (sequence.second == ColumnCodecId::packed)
+			continue;
+		EXPECT_LT(data.size(), packed_size);
+		std::vector<uint64_t> values;
+		DecodeIntegers(sequence.second, data.data(), data.size(), sequence.first.size(), values);
+		EXPECT_EQ(values, sequence.first);
+		EXPECT_THROW(DecodeIntegers(sequence.second, data.data(), data.size() - 1, sequence.first.size(), values), TlvInvalidFormatError);
+	}
+
+	//integer columns of columnar TLV data are encoded
+	std::string input;
+	for (auto& rec : m_json_records_valid_all_datatypes)
+		input += rec + "\n";
+	for (auto& rec : GenerateJsonRecords(2000))
+		input += rec + "\n";
+	JsonToTlvColumnar plain_encoder;
+	plain_encoder.Options().block_size = 3000;
+	const std::string plain_data = RunCoder(plain_encoder, input);
+	TlvToJson row_decoder;
+	const std::string expected = RunCoder(row_decoder, plain_data);
+	JsonToTlvColumnar encoder;
+	encoder.Options().integer_codecs = true;
+	encoder.Options().block_size = 3000;
+	const std::string tlv_data = RunCoder(encoder, input);
+	EXPECT_TRUE(tlv_data[5] & TLV_FLAG_COLUMN_CODECS);
+	EXPECT_LT(tlv_data.size(), plain_data.size());
+	for (const char* method : {"tlv2json", "tlv2json-direct"}) {
+		auto decoder = GetPacker(method);
+		decoder->Options().threads = 2;
+		EXPECT_TRUE(RunCoder(*decoder, tlv_data) == expected) << method;
+		decoder->Options().keys = {"id"};
+		decoder->Options().from = m_json_records_valid_all_datatypes.size() + 1990;
+		EXPECT_EQ(RunCoder(*decoder, tlv_data), "{\"id\":1990}\n{\"id\":1991}\n{\"id\":1992}\n{\"id\":1993}\n{\"id\":1994}\n"
+			"{\"id\":1995}\n{\"id\":1996}\n{\"id\":1997}\n{\"id\":1998}\n{\"id\":1999}\n") << method;
+	}
+
+	JsonToTlv row_encoder;
+	row_encoder.Options().format = TlvFormat::v2;
+	row_encoder.Options().integer_codecs = true;
+	EXPECT_THROW(RunCoder(row_encoder, input), app_err::JsonPackerError);
+}
+
+TEST_F(TlvToJsonTest, DoubleCodec) {
+	//slowly changing values, repeated values and special values are restored bit-exactly
+	std::vector<double> doubles;
+	for (int i = 0; i < 1000; ++i)
+		doubles.push_back(i % 10 ? 100.0 + i * 0.25 : 100.0 + (i - 1) * 0.25);
+	const double special[] = {0.0, -0.0, 1e-310, -1e308, std::numeric_limits<double>::infinity(), std::numeric_limits<double>::quiet_NaN(), 3.5, 3.5};
+	doubles.insert(doubles.end(), std::begin(special), std::end(special));
+	std::vector<uint64_t> values(doubles.size());
+	memcpy(values.data(), doubles.data(), doubles.size() * sizeof(double));
+	std::string data;
+	ASSERT_EQ(EncodeDoubles(values, values.size() * sizeof(double), data), ColumnCodecId::xor_float);
+	EXPECT_LT(data.size(), values.size() * sizeof(double) / 2);
+	std::vector<uint64_t> restored;
+	DecodeDoubles(data.data(), data.size(), values.size(), restored);
+	EXPECT_EQ(restored, values);
+	EXPECT_THROW(DecodeDoubles(data.data(), data.size() - 1, values.size(), restored), TlvInvalidFormatError);
+	EXPECT_THROW(DecodeDoubles(data.data(), data.size(), values.size() + 100, restored), TlvInvalidFormatError);
+	//random bits are left packed
+	for (size_t i = 0; i < values.size(); ++i)
+		values[i] = i * 0x9e3779b97f4a7c15ULL;
+	data.clear();
+	EXPECT_EQ(EncodeDoubles(values, values.size() * sizeof(double), data), ColumnCodecId::packed);
+	EXPECT_TRUE(data.empty());
+
+	std::string input;
+	for (auto& rec : m_json_records_valid_all_datatypes)
+		input += rec + "\n";
+	for (int i = 0; i < 2000; ++i)
+		input += "{\"price\":" + std::to_string(50 + i % 17) + "." + std::to_string(i % 100) + ",\"real\":" + std::to_string(i * 0.5) + "}\n";
+	JsonToTlvColumnar plain_encoder;
+	const std::string plain_data = RunCoder(plain_encoder, input);
+	TlvToJson row_decoder;
+	const std::string expected = RunCoder(row_decoder, plain_data);
+	JsonToTlvColumnar encoder;
+	encoder.Options().double_codecs = true;
+	const std::string tlv_data = RunCoder(encoder, input);
+	EXPECT_TRUE(tlv_data[5] & TLV_FLAG_COLUMN_CODECS);
+	EXPECT_LT(tlv_data.size(), plain_data.size());
+	for (const char* method : {"tlv2json", "tlv2json-direct"}) {
+		auto decoder = GetPacker(method);
+		EXPECT_TRUE(RunCoder(*decoder, tlv_data) == expected) << method;
+	}
+	encoder.Options().integer_codecs = true;
+	TlvToJsonDirect decoder;
+	EXPECT_TRUE(RunCoder(decoder, RunCoder(encoder, input)) == expected);
+}
+
+TEST_F(TlvToJsonTest, BlockChecksums) {
+	std::string input;
+	for (auto& rec : m_json_records_valid_all_datatypes)
+		input += rec + "\n";
+	for (auto& rec : GenerateJsonRecords(2000))
+		input += rec + "\n";
+	JsonToTlv plain_encoder;
+	plain_encoder.Options().format = TlvFormat::v2;
+	TlvToJson plain_decoder;
+	const std::string expected = RunCoder(plain_decoder, RunCoder(plain_encoder, input));
+	StringVector lines;
+	std::stringstream all_lines(expected);
+	for (std::string line; std::getline(all_lines, line);)
+		lines.push_back(line + "\n");
+	auto checksum_error = [this](JsonPackerBase& decoder, const std::string& data) {
+		try {
+			RunCoder(decoder, data);
+		} catch (const app_err::JsonPackerError& e) {
+			return std::string(e.what()).find("Checksum mismatch in block 0") != std::string::npos;
+		}
+		return false;
+	};
+
+	//row-oriented, compressed and columnar blocks are checksummed as they are stored
+	for (int layout = 0; layout < 3; ++layout) {
+		std::unique_ptr<JsonToTlv> encoder(layout == 2 ? new JsonToTlvColumnar() : new JsonToTlv());
+		encoder->Options().format = TlvFormat::v2;
+		encoder->Options().block_size = 3000;
+		if (layout == 1)
+			encoder->Options().compression = "lz";
+		const std::string unchecked_data = RunCoder(*encoder, input);
+		encoder->Options().checksums = true;
+		const std::string tlv_data = RunCoder(*encoder, input);
+		EXPECT_EQ(tlv_data[6], TLV_EXT_FLAG_CHECKSUMS) << layout;
+		EXPECT_EQ(tlv_data.substr(TLV_HEADER_SIZE, 1000), unchecked_data.substr(TLV_HEADER_SIZE, 1000)) << layout;
+		encoder->Options().threads = 3;
+		encoder->Options().chunk_size = 5000;
+		EXPECT_TRUE(RunCoder(*encoder, input) == tlv_data) << layout;
+		for (unsigned int threads : {1, 3}) {
+			TlvToJsonDirect decoder;
+			decoder.Options().threads = threads;
+			EXPECT_TRUE(RunCoder(decoder, tlv_data) == expected) << layout << " " << threads;
+			decoder.Options().verify_only = true;
+			EXPECT_TRUE(RunCoder(decoder, tlv_data).empty()) << layout;
+			EXPECT_EQ(decoder.Stats().records, lines.size()) << layout;
+		}
+
+		//damaged block is detected unless it is out of converted range
+		std::string damaged_data = tlv_data;
+		damaged_data[TLV_HEADER_SIZE + 100] = static_cast<char>(damaged_data[TLV_HEADER_SIZE + 100] ^ 0x10);
+		TlvToJson decoder;
+		EXPECT_TRUE(checksum_error(decoder, damaged_data)) << layout;
+		decoder.Options().threads = 3;
+		EXPECT_TRUE(checksum_error(decoder, damaged_data)) << layout;
+		decoder.Options().from = 1500;
+		decoder.Options().count = 3;
+		EXPECT_EQ(RunCoder(decoder, damaged_data), std::accumulate(lines.begin() + 1500, lines.begin() + 1503, std::string())) << layout;
+		decoder.Options().verify_only = true;
+		EXPECT_TRUE(checksum_error(decoder, damaged_data)) << layout;
+		EXPECT_THROW(RunCoder(decoder, unchecked_data), app_err::JsonPackerError) << layout;
+
+		//the blocks are verified when they are read, so damaged block is not detected unless records of it are converted
+		MemoryByteSource source(tlv_data.data(), tlv_data.size());
+		TlvTrailer trailer;
+		ASSERT_TRUE(ReadTlvTrailer(source, 0, trailer));
+		std::string damaged_end = tlv_data;
+		damaged_end[trailer.dictionary_offset - 1] = static_cast<char>(damaged_end[trailer.dictionary_offset - 1] ^ 0x10);
+		TlvToJson range_decoder;
+		range_decoder.Options().count = 3;
+		EXPECT_EQ(RunCoder(range_decoder, damaged_end), std::accumulate(lines.begin(), lines.begin() + 3, std::string())) << layout;
+		range_decoder.Options().from = lines.size() - 1;
+		EXPECT_THROW(RunCoder(range_decoder, damaged_end), app_err::JsonPackerError) << layout;
+		range_decoder.Options().from = 0;
+		range_decoder.Options().count = 10;
+		range_decoder.Options().sample = 3;
+		EXPECT_TRUE(checksum_error(range_decoder, damaged_data)) << layout;
+	}
+	JsonToTlv encoder;
+	encoder.Options().format = TlvFormat::v2;
+	encoder.Options().inline_keys = true;
+	encoder.Options().checksums = true;
+	EXPECT_THROW(RunCoder(encoder, input), app_err::JsonPackerError);
+}
+
+TEST_F(TlvToJsonTest, ZoneMaps) {
+	//latency grows with record number, so blocks hold disjoint ranges of values
+	std::string input;
+	std::string expected;
+	for (int i = 0; i < 3000; ++i) {
+		std::string record = "{\"id\":" + std::to_string(i);
+		if (i % 7 == 0)
+			record += ",\"latency\":null";
+		else if (i % 11 == 0)
+			record += ",\"latency\":\"slow\"";
+		else if (i % 13)
+			record += ",\"latency\":" + std::to_string(i);
+		record += ",\"status\":" + std::to_string(200 + i % 3) + "}\n";
+		input += record;
+		if (i % 7 && i % 11 && i % 13 && i >= 1500 && i <= 1600 && i % 3 == 1)
+			expected += record;
+	}
+	ASSERT_FALSE(expected.empty());
+	const std::string where = "latency >= 1500 && \"latency\" <= 1600.0 && status == 201";
+
+	for (int layout = 0; layout < 3; ++layout) {
+		std::unique_ptr<JsonToTlv> encoder(layout == 2 ? new JsonToTlvColumnar() : new JsonToTlv());
+		encoder->Options().format = TlvFormat::v2;
+		encoder->Options().block_records = 100;
+		if (layout == 1)
+			encoder->Options().compression = "lz";
+		const std::string plain_data = RunCoder(*encoder, input);
+		encoder->Options().zone_maps = true;
+		const std::string tlv_data = RunCoder(*encoder, input);
+		encoder->Options().threads = 3;
+		encoder->Options().chunk_size = 5000;
+		EXPECT_TRUE(RunCoder(*encoder, input) == tlv_data) << layout;
+
+		//the statistics of the first block
+		MemoryByteSource source(tlv_data.data(), tlv_data.size());
+		TlvTrailer trailer;
+		std::vector<TlvBlock> blocks;
+		std::vector<ZoneMap> zone_maps;
+		ASSERT_TRUE(ReadTlvTrailer(source, 0, trailer));
+		ASSERT_NE(trailer.zone_map_offset, 0u);
+		ReadTlvBlockIndex(source, 0, trailer, blocks, layout == 1);
+		ReadTlvZoneMaps(source, 0, trailer, blocks.size(), zone_maps);
+		ASSERT_EQ(zone_maps.size(), 30u);
+		ASSERT_EQ(zone_maps[0].size(), 3u);
+		EXPECT_EQ(zone_maps[0][1].null_count, 15u + 6u); //nulls and missing members
+		EXPECT_EQ(zone_maps[0][1].number_count, 100u - 15u - 6u - 8u);
+		EXPECT_EQ(zone_maps[0][1].min, 1.0);
+		EXPECT_EQ(zone_maps[0][1].max, 97.0);
+
+		for (const char* method : {"tlv2json", "tlv2json-direct"}) {
+			for (unsigned int threads : {1, 3}) {
+				auto decoder = GetPacker(method);
+				decoder->Options().threads = threads;
+				decoder->Options().where = where;
+				EXPECT_TRUE(RunCoder(*decoder, plain_data) == expected) << layout << " " << method << " " << threads;
+				EXPECT_TRUE(RunCoder(*decoder, tlv_data) == expected) << layout << " " << method << " " << threads;
+				EXPECT_EQ(decoder->Stats().records, 27u) << layout << " " << method;
+			}
+		}
+		//the blocks which can not match are not read
+		std::string damaged_data = tlv_data;
+		std::fill(damaged_data.begin() + TLV_HEADER_SIZE, damaged_data.begin() + static_cast<std::ptrdiff_t>(blocks[1].offset), '\xff');
+		TlvToJsonDirect decoder;
+		decoder.Options().where = where;
+		EXPECT_TRUE(RunCoder(decoder, damaged_data) == expected) << layout;
+		decoder.Options().where.clear();
+		EXPECT_THROW(RunCoder(decoder, damaged_data), app_err::JsonPackerError) << layout;
+		//nor verified
+		encoder->Options().checksums = true;
+		std::string checked_data = RunCoder(*encoder, input);
+		std::fill(checked_data.begin() + TLV_HEADER_SIZE, checked_data.begin() + static_cast<std::ptrdiff_t>(blocks[1].offset), '\xff');
+		for (unsigned int threads : {1, 3}) {
+			decoder.Options().threads = threads;
+			decoder.Options().where = where;
+			EXPECT_TRUE(RunCoder(decoder, checked_data) == expected) << layout << " " << threads;
+			decoder.Options().where = "latency < 50";
+			EXPECT_THROW(RunCoder(decoder, checked_data), app_err::JsonPackerError) << layout << " " << threads;
+		}
+	}
+
+	TlvToJson decoder;
+	for (const char* where : {"latency", "latency >", "latency > 1 &&", "latency = 1", "\"latency > 1", "latency > 1 ||", "(latency > 1", "latency > 1)", "latency > 1 | id < 5"}) {
+		decoder.Options().where = where;
+		EXPECT_THROW(RunCoder(decoder, input), app_err::JsonPackerError) << where;
+	}
+	JsonToTlv encoder;
+	encoder.Options().zone_maps = true;
+	EXPECT_THROW(RunCoder(encoder, input), app_err::JsonPackerError);
+}
+
+TEST_F(TlvToJsonTest, FilterExpression) {
+	//the batches of records contain matching and not matching records, string values of status are defined inside records
+	std::string input;
+	std::string expected;
+	std::string grouped;
+	const char* statuses[] = {"error", "ok", "timeout-expired", "error-retried"};
+	for (int i = 0; i < 5000; ++i) {
+		const std::string status = statuses[i % 4] + (i % 5 ? std::string() : "-" + std::to_string(i % 30));
+		const int latency = (i * 37) % 500;
+		const int retries = i % 17 == 0 ? 3 + i % 2 : i % 3;
+		std::string record = "{\"id\":" + std::to_string(i) + ",\"status\":\"" + status + "\"";
+		if (i % 9)
+			record += ",\"latency_ms\":" + std::to_string(latency);
+		record += ",\"retries\":" + std::to_string(retries) + "}\n";
+		input += record;
+		if ((status == "error" && i % 9 && latency > 250) || retries >= 3)
+			expected += record;
+		if (status == "error" && ((i % 9 && latency > 450) || retries >= 2))
+			grouped += record;
+	}
+	ASSERT_FALSE(expected.empty());
+	ASSERT_FALSE(grouped.empty());
+
+	for (int layout = 0; layout < 4; ++layout) {
+		JsonToTlv encoder;
+		if (layout) {
+			encoder.Options().format = TlvFormat::v2;
+			encoder.Options().inline_keys = layout == 2;
+			encoder.Options().shapes = layout == 3;
+			encoder.Options().string_dictionary = 8;
+		}
+		const std::string tlv_data = RunCoder(encoder, input);
+		for (const char* method : {"tlv2json", "tlv2json-direct"}) {
+			for (unsigned int threads : {1, 3}) {
+				auto decoder = GetPacker(method);
+				decoder->Options().threads = threads;
+				decoder->Options().chunk_size = 20000;
+				decoder->Options().where = "status == \"error\" && latency_ms > 250 || retries >= 3";
+				EXPECT_TRUE(RunCoder(*decoder, tlv_data) == expected) << layout << " " << method << " " << threads;
+				decoder->Options().where = "(latency_ms>450||retries>=2)&&status==\"error\"";
+				EXPECT_TRUE(RunCoder(*decoder, tlv_data) == grouped) << layout << " " << method << " " << threads;
+				decoder->Options().where = "missing == 1 || id < 3";
+				EXPECT_EQ(RunCoder(*decoder, tlv_data), input.substr(0, input.find("{\"id\":3,"))) << layout << " " << method << " " << threads;
+			}
+		}
+	}
+}
+
+TEST_F(TlvToJsonTest, FilterLargeAndStreamedRecords) {
+	//records larger than the buffered data and batches ended by the end of buffered data are filtered in the same way
+	StringVector records;
+	std::string input;
+	std::string expected;
+	for (int i = 0; i < 2500; ++i) {
+		const size_t payload = i % 700 == 20 ? static_cast<size_t>(100000 + i) : static_cast<size_t>(i % 50);
+		records.push_back("{\"id\":" + std::to_string(i) + ",\"payload\":\"" + std::string(payload, static_cast<char>('a' + i % 26))
+			+ "\",\"status\":\"" + (i % 3 ? "ok" : "error") + "\"}\n");
+		input += records.back();
+		if (i % 3 == 0 || i == 20 || i == 1420)
+			expected += records.back();
+	}
+	const char* where = "status == \"error\" || id == 20 || id == 1420";
+
+	for (int layout = 0; layout < 3; ++layout) {
+		JsonToTlv encoder;
+		if (layout) {
+			encoder.Options().format = TlvFormat::v2;
+			encoder.Options().inline_keys = layout == 1;
+			encoder.Options().shapes = layout == 2;
+			encoder.Options().string_dictionary = 4;
+		}
+		const std::string tlv_data = RunCoder(encoder, input);
+		for (const char* method : {"tlv2json", "tlv2json-direct"}) {
+			for (size_t block_size : {7, 1000, 1 << 16}) {
+				auto decoder = GetPacker(method);
+				decoder->Options().where = where;
+				std::stringstream tlv_stream(tlv_data);
+				std::stringstream result;
+				jsonpacker_stream::JsonPackerStringStream stream(tlv_stream, result);
+				stream.SetBlockSize(block_size);
+				decoder->Run(stream);
+				EXPECT_TRUE(result.str() == expected) << layout << " " << method << " " << block_size;
+				EXPECT_EQ(decoder->Stats().records, static_cast<uint64_t>(std::count(expected.begin(), expected.end(), '\n'))) << layout << " " << method << " " << block_size;
+			}
+		}
+	}
+
+	//the last record of streamed data is truncated inside of the large value or at its end
+	JsonToTlv inline_encoder;
+	inline_encoder.Options().format = TlvFormat::v2;
+	inline_encoder.Options().inline_keys = true;
+	const std::string inline_data = RunCoder(inline_encoder, std::accumulate(records.begin(), records.begin() + 21, std::string()));
+	const std::string inline_expected = expected.substr(0, expected.find("{\"id\":21,"));
+	for (const char* method : {"tlv2json", "tlv2json-direct"}) {
+		auto decoder = GetPacker(method);
+		decoder->Options().where = where;
+		EXPECT_TRUE(RunCoder(*decoder, inline_data) == inline_expected) << method;
+		EXPECT_THROW(RunCoder(*decoder, inline_data.substr(0, inline_data.size() - 50000)), TlvInvalidFormatError) << method;
+		EXPECT_THROW(RunCoder(*decoder, inline_data.substr(0, inline_data.size() - 1)), TlvInvalidFormatError) << method;
+	}
+
+	//records are received from pipe one by one: the next record is sent only after the matching records sent before it are output
+	struct RecordPipe : public std::streambuf {
+		std::string data;
+		std::vector<size_t> ends;
+		StringVector outputs;
+		std::stringstream result;
+		size_t sent {0};
+		size_t early_reads {0};
+		int_type underflow() override {
+			if (result.str() != outputs[sent])
+				++early_reads;
+			if (sent == ends.size())
+				return traits_type::eof();
+			char* begin = &data[0];
+			setg(begin, begin + (sent ? ends[sent - 1] : 0), begin + ends[sent]);
+			++sent;
+			return traits_type::to_int_type(*gptr());
+		}
+	};
+	struct PipeInputStringOutput : public jsonpacker_stream::JsonPackerStream {
+		std::istream& input;
+		std::ostream& output;
+		PipeInputStringOutput(std::istream& i, std::ostream& o) : input(i), output(o) {}
+		std::istream& InputStream() override {return input;}
+		std::ostream& OutputStream() override {return output;}
+	};
+	for (const char* method : {"tlv2json", "tlv2json-direct"}) {
+		RecordPipe pipe;
+		pipe.outputs.emplace_back();
+		for (size_t i = 0; i < 40; ++i) {
+			pipe.data = RunCoder(inline_encoder, std::accumulate(records.begin(), records.begin() + static_cast<long>(i) + 1, std::string()));
+			pipe.ends.push_back(pipe.data.size());
+			pipe.outputs.push_back(pipe.outputs.back() + (i % 3 == 0 || i == 20 ? records[i] : std::string()));
+		}
+		std::istream pipe_stream(&pipe);
+		PipeInputStringOutput stream(pipe_stream, pipe.result);
+		auto decoder = GetPacker(method);
+		decoder->Options().where = where;
+		decoder->Run(stream);
+		EXPECT_TRUE(pipe.result.str() == pipe.outputs.back()) << method;
+		EXPECT_EQ(pipe.early_reads, 0u) << method;
+	}
+}
+
+TEST_F(TlvToJsonTest, KeyProjection) {
+	//the members of selected keys are converted in order of records, filter may compare the keys which are not selected
+	std::string input;
+	std::string expected;
+	std::string filtered;
+	for (int i = 0; i < 3000; ++i) {
+		const std::string status = i % 4 ? "ok" : "error";
+		input += "{\"id\":" + std::to_string(i) + ",\"payload\":\"" + std::string(static_cast<size_t>(50 + i % 100), 'x') + "\",\"status\":\"" + status + "\"";
+		if (i % 5)
+			input += ",\"latency_ms\":" + std::to_string(i % 700);
+		input += "}\n";
+		const std::string record = "{\"id\":" + std::to_string(i) + (i % 5 ? ",\"latency_ms\":" + std::to_string(i % 700) : std::string()) + "}\n";
+		expected += record;
+		if (status == "error" && i % 5 && i % 700 > 300)
+			filtered += record;
+	}
+
+	for (int layout = 0; layout < 5; ++layout) {
+		std::unique_ptr<JsonToTlv> encoder(layout == 4 ? new JsonToTlvColumnar() : new JsonToTlv());
+		if (layout) {
+			encoder->Options().format = TlvFormat::v2;
+			encoder->Options().inline_keys = layout == 2;
+			encoder->Options().shapes = layout == 3;
+			encoder->Options().string_dictionary = layout == 4 ? 0 : 4;
+		}
+		const std::string tlv_data = RunCoder(*encoder, input);
+		for (const char* method : {"tlv2json", "tlv2json-direct"}) {
+			for (unsigned int threads : {1, 3}) {
+				auto decoder = GetPacker(method);
+				decoder->Options().threads = threads;
+				decoder->Options().keys = {"latency_ms", "id", "unknown"};
+				EXPECT_TRUE(RunCoder(*decoder, tlv_data) == expected) << layout << " " << method << " " << threads;
+				decoder->Options().where = "status == \"error\" && latency_ms > 300";
+				EXPECT_TRUE(RunCoder(*decoder, tlv_data) == filtered) << layout << " " << method << " " << threads;
+			}
+		}
+	}
+}
+
+TEST_F(TlvToJsonTest, BloomFilters) {
+	//users are spread over all blocks, the values of "late" key appear only in the last blocks
+	std::string input;
+	std::string expected_user;
+	std::string expected_region;
+	for (int i = 0; i < 3000; ++i) {
+		const std::string user = "u" + std::to_string(i * 7919 % 3001);
+		std::string record = "{\"id\":" + std::to_string(i) + ",\"user\":\"" + user + "\",\"region\":\"" + (i % 3 ? "eu" : "us") + "\"";
+		if (i >= 2500)
+			record += ",\"late\":" + std::to_string(i % 10);
+		record += "}\n";
+		input += record;
+		if (user == "u1234")
+			expected_user += record;
+		if (i % 3 == 0 && i >= 1500 && i < 1520)
+			expected_region += record;
+	}
+	ASSERT_FALSE(expected_user.empty());
+
+	for (int layout = 0; layout < 3; ++layout) {
+		std::unique_ptr<JsonToTlv> encoder(layout == 2 ? new JsonToTlvColumnar() : new JsonToTlv());
+		encoder->Options().format = TlvFormat::v2;
+		encoder->Options().block_records = 100;
+		encoder->Options().string_dictionary = 16;
+		if (layout == 1)
+			encoder->Options().compression = "lz";
+		encoder->Options().bloom_keys = {"user", "id", "region", "late", "missing"};
+		const std::string tlv_data = RunCoder(*encoder, input);
+		encoder->Options().threads = 3;
+		encoder->Options().chunk_size = 5000;
+		EXPECT_TRUE(RunCoder(*encoder, input) == tlv_data) << layout;
+
+		//every key in dictionary has the filter in every block, the filters of keys without values are empty
+		MemoryByteSource source(tlv_data.data(), tlv_data.size());
+		TlvTrailer trailer;
+		std::vector<TlvBlock> blocks;
+		std::vector<BlockBloomFilters> filters;
+		ASSERT_TRUE(ReadTlvTrailer(source, 0, trailer));
+		ASSERT_NE(trailer.bloom_filter_offset, 0u);
+		ReadTlvBlockIndex(source, 0, trailer, blocks, layout == 1);
+		ReadTlvBloomFilters(source, 0, trailer, blocks.size(), filters);
+		ASSERT_EQ(filters.size(), 30u);
+		ASSERT_EQ(filters[0].size(), 4u);
+		EXPECT_EQ(filters[0][0].bits.size(), 4u * 64);
+		EXPECT_EQ(filters[0][2].bits.size(), 64u);
+		EXPECT_TRUE(filters[0][3].bits.empty());
+		EXPECT_EQ(filters[29][3].bits.size(), 64u);
+
+		for (const char* method : {"tlv2json", "tlv2json-direct"}) {
+			for (unsigned int threads : {1, 3}) {
+				auto decoder = GetPacker(method);
+				decoder->Options().threads = threads;
+				decoder->Options().where = "user == \"u1234\"";
+				EXPECT_TRUE(RunCoder(*decoder, tlv_data) == expected_user) << layout << " " << method << " " << threads;
+				decoder->Options().where = "id >= 1500 && id < 1520 && \"region\" == \"us\"";
+				EXPECT_TRUE(RunCoder(*decoder, tlv_data) == expected_region) << layout << " " << method << " " << threads;
+				decoder->Options().where = "late == 11";
+				EXPECT_TRUE(RunCoder(*decoder, tlv_data).empty()) << layout << " " << method << " " << threads;
+			}
+		}
+		//the blocks which can not contain the values are not read
+		std::string damaged_data = tlv_data;
+		std::fill(damaged_data.begin() + TLV_HEADER_SIZE, damaged_data.begin() + static_cast<std::ptrdiff_t>(blocks[1].offset), '\xff');
+		TlvToJsonDirect decoder;
+		decoder.Options().where = "id == 2024.0";
+		EXPECT_EQ(RunCoder(decoder, damaged_data), input.substr(input.find("{\"id\":2024,"), input.find("{\"id\":2025,") - input.find("{\"id\":2024,"))) << layout;
+		EXPECT_EQ(decoder.Stats().records, 1u);
+		decoder.Options().where = "late == 5";
+		EXPECT_NO_THROW(RunCoder(decoder, damaged_data)) << layout;
+		EXPECT_EQ(decoder.Stats().records, 50u);
+	}
+
+	TlvToJson decoder;
+	for (const char* where : {"user < \"u1\"", "user == \"u1", "user == u1"}) {
+		decoder.Options().where = where;
+		EXPECT_THROW(RunCoder(decoder, input), app_err::JsonPackerError) << where;
+	}
+	JsonToTlv encoder;
+	encoder.Options().bloom_keys = {"user"};
+	EXPECT_THROW(RunCoder(encoder, input), app_err::JsonPackerError);
+}
+
+TEST_F(TlvToJsonTest, SecondaryIndex) {
+	const std::string filename = "jsoncoder_tests_index.idx";
+	std::string input;
+	std::string expected_user;
+	std::string expected_ids;
+	std::string expected_number;
+	for (int i = 0; i < 2000; ++i) {
+		std::string record = "{\"id\":" + std::to_string(i);
+		if (i % 10)
+			record += ",\"user\":\"u" + std::to_string(i % 97) + "\"";
+		record += ",\"n\":" + std::to_string(i % 13) + "}\n";
+		input += record;
+		if (i % 10 && i % 97 == 5 && i % 13 > 6) {
+			expected_user += record;
+			expected_ids += "{\"id\":" + std::to_string(i) + "}\n";
+		}
+		if (i % 13 == 3 && i >= 1500)
+			expected_number += record;
+	}
+	ASSERT_FALSE(expected_user.empty());
+
+	for (int layout = 0; layout < 3; ++layout) {
+		JsonToTlv encoder;
+		if (layout) {
+			encoder.Options().format = TlvFormat::v2;
+			encoder.Options().shapes = true;
+			encoder.Options().string_dictionary = 32;
+			encoder.Options().block_records = 100;
+		}
+		if (layout == 2)
+			encoder.Options().compression = "lz";
+		const std::string tlv_data = RunCoder(encoder, input);
+
+		//the index sorted in memory is the same as the one merged from runs
+		TlvToIndex indexer;
+		indexer.Options().index_key = "user";
+		indexer.Options().threads = 3;
+		const std::string index_data = RunCoder(indexer, tlv_data);
+		EXPECT_EQ(indexer.Stats().records, 2000u);
+		indexer.Options().index_memory = 100 * sizeof(TlvIndexEntry);
+		EXPECT_TRUE(RunCoder(indexer, tlv_data) == index_data) << layout;
+		std::ofstream(filename, std::ios_base::binary | std::ios_base::trunc) << index_data;
+		{
+			TlvIndex index(filename);
+			EXPECT_EQ(index.Key(), "user");
+			EXPECT_EQ(index.Size(), 1800u);
+			EXPECT_EQ(index.DataSize(), tlv_data.size());
+		}
+
+		for (const char* method : {"tlv2json", "tlv2json-direct"}) {
+			auto decoder = GetPacker(method);
+			decoder->Options().index_file = filename;
+			decoder->Options().where = "n > 6 && user == \"u5\"";
+			EXPECT_TRUE(RunCoder(*decoder, tlv_data) == expected_user) << layout << " " << method;
+			decoder->Options().where = "user == \"u97\"";
+			EXPECT_TRUE(RunCoder(*decoder, tlv_data).empty()) << layout << " " << method;
+			EXPECT_EQ(decoder->Stats().records, 0u);
+			decoder->Options().where = "n == 5";
+			EXPECT_THROW(RunCoder(*decoder, tlv_data), app_err::JsonPackerError) << layout << " " << method;
+			EXPECT_THROW(RunCoder(*decoder, tlv_data + "\n"), app_err::JsonPackerError) << layout << " " << method;
+			//found records are not numbered, so the range, sampling and projection of records are rejected
+			decoder->Options().where = "user == \"u5\"";
+			decoder->Options().from = 1;
+			EXPECT_THROW(RunCoder(*decoder, tlv_data), app_err::JsonPackerError) << layout << " " << method;
+			decoder->Options().from = 0;
+			decoder->Options().count = 10;
+			EXPECT_THROW(RunCoder(*decoder, tlv_data), app_err::JsonPackerError) << layout << " " << method;
+			decoder->Options().count = std::numeric_limits<uint64_t>::max();
+			decoder->Options().sample = 10;
+			EXPECT_THROW(RunCoder(*decoder, tlv_data), app_err::JsonPackerError) << layout << " " << method;
+			decoder->Options().sample = 0;
+			//the members of found records are projected, the filter compares the key which is not selected
+			decoder->Options().where = "n > 6 && user == \"u5\"";
+			decoder->Options().keys = {"id"};
+			EXPECT_TRUE(RunCoder(*decoder, tlv_data) == expected_ids) << layout << " " << method;
+		}
+
+		//numbers of all types are found by the same hash
+		indexer.Options().index_key = "n";
+		std::ofstream(filename, std::ios_base::binary | std::ios_base::trunc) << RunCoder(indexer, tlv_data);
+		TlvToJsonDirect decoder;
+		decoder.Options().index_file = filename;
+		decoder.Options().where = "n == 3.0 && id >= 1500";
+		EXPECT_TRUE(RunCoder(decoder, tlv_data) == expected_number) << layout;
+	}
+
+	//only the blocks holding found records are verified
+	JsonToTlv checked_encoder;
+	checked_encoder.Options().format = TlvFormat::v2;
+	checked_encoder.Options().block_records = 100;
+	checked_encoder.Options().checksums = true;
+	std::string checked_data = RunCoder(checked_encoder, input);
+	TlvToIndex checked_indexer;
+	checked_indexer.Options().index_key = "user";
+	std::ofstream(filename, std::ios_base::binary | std::ios_base::trunc) << RunCoder(checked_indexer, checked_data);
+	TlvToJsonDirect checked_decoder;
+	checked_decoder.Options().index_file = filename;
+	checked_decoder.Options().where = "n > 6 && user == \"u5\"";
+	EXPECT_TRUE(RunCoder(checked_decoder, checked_data) == expected_user);
+	//the first block holds the record of u5 rejected by filter
+	checked_data[TLV_HEADER_SIZE + 10] = static_cast<char>(checked_data[TLV_HEADER_SIZE + 10] ^ 0x10);
+	EXPECT_THROW(RunCoder(checked_decoder, checked_data), app_err::JsonPackerError);
+	checked_decoder.Options().where = "user == \"u97\"";
+	EXPECT_TRUE(RunCoder(checked_decoder, checked_data).empty());
+	std::remove(filename.c_str());
+
+	//records of columnar data have no positions, the key of index is required
+	JsonToTlvColumnar columnar_encoder;
+	columnar_encoder.Options().format = TlvFormat::v2;
+	TlvToIndex indexer;
+	indexer.Options().index_key = "user";
+	EXPECT_THROW(RunCoder(indexer, RunCoder(columnar_encoder, input)), app_err::JsonPackerError);
+	indexer.Options().index_key.clear();
+	EXPECT_THROW(RunCoder(indexer, RunCoder(columnar_encoder, input)), app_err::JsonPackerError);
+
+	//the key of member must be an integer record
+	JsonToTlv encoder;
+	std::string tlv_data = RunCoder(encoder, "{\"user\":\"u1\"}\n");
+	const std::string key_record("\x01\x04\0\0\0\0\0\0\0", 9);
+	const size_t key_pos = tlv_data.find(key_record);
+	ASSERT_NE(key_pos, std::string::npos);
+	tlv_data[key_pos] = static_cast<char>(TlvRecordView::TlvRecordType::rtString);
+	indexer.Options().index_key = "user";
+	EXPECT_THROW(RunCoder(indexer, tlv_data), TlvInvalidFormatError);
+}
+
+TEST_F(TlvToJsonTest, ShapeDictionary) {
+	std::string input;
+	for (auto& rec : m_json_records_valid_all_datatypes)
+		input += rec + "\n";
+	input += "{}\n";
+	for (auto& rec : GenerateJsonRecords(1000))
+		input += rec + "\n";
+	JsonToTlv plain_encoder;
+	plain_encoder.Options().format = TlvFormat::v2;
+	const std::string plain_data = RunCoder(plain_encoder, input);
+	TlvToJson plain_decoder;
+	const std::string expected = RunCoder(plain_decoder, plain_data);
+	StringVector lines;
+	std::stringstream all_lines(expected);
+	for (std::string line; std::getline(all_lines, line);)
+		lines.push_back(line + "\n");
+
+	for (bool inline_keys : {false, true}) {
+		std::string tlv_data;
+		for (const char* method : {"json2tlv", "json2tlv-sax"}) {
+			auto encoder = GetPacker(method);
+			encoder->Options().format = TlvFormat::v2;
+			encoder->Options().shapes = true;
+			encoder->Options().inline_keys = inline_keys;
+			if (tlv_data.empty())
+				tlv_data = RunCoder(*encoder, input);
+			else
+				EXPECT_TRUE(RunCoder(*encoder, input) == tlv_data) << method;
+			EXPECT_TRUE(tlv_data[5] & TLV_FLAG_SHAPES);
+			//shapes are the same in multi-threaded mode
+			encoder->Options().threads = 3;
+			encoder->Options().chunk_size = 2000;
+			EXPECT_TRUE(RunCoder(*encoder, input) == tlv_data) << method << " " << inline_keys;
+			EXPECT_LT(encoder->GetShapes()->Size(), lines.size());
+		}
+		EXPECT_LT(tlv_data.size(), plain_data.size());
+
+		for (const char* method : {"tlv2json", "tlv2json-direct"}) {
+			for (unsigned int threads : {1, 3}) {
+				auto decoder = GetPacker(method);
+				decoder->Options().threads = threads;
+				decoder->Options().block_size = 1000;
+				EXPECT_TRUE(RunCoder(*decoder, tlv_data) == expected) << method << " " << threads << " " << inline_keys;
+			}
+			//the shapes of skipped records are defined before converted records
+			auto decoder = GetPacker(method);
+			decoder->Options().from = 700;
+			decoder->Options().count = 5;
+			EXPECT_EQ(RunCoder(*decoder, tlv_data), std::accumulate(lines.begin() + 700, lines.begin() + 705, std::string())) << method << " " << inline_keys;
+		}
+	}
+
+	JsonToTlv encoder;
+	encoder.Options().shapes = true;
+	EXPECT_THROW(RunCoder(encoder, input), app_err::JsonPackerError);
+	JsonToTlvColumnar columnar_encoder;
+	columnar_encoder.Options().shapes = true;
+	EXPECT_THROW(RunCoder(columnar_encoder, input), app_err::JsonPackerError);
+
+	//the shape is not defined
+	encoder.Options().format = TlvFormat::v2;
+	encoder.Options().inline_keys = true;
+	std::string tlv_data = RunCoder(encoder, "{\"a\":1}\n");
+	const size_t definition = tlv_data.find(static_cast<char>(TlvRecord<std::streamsize>::TlvRecordType::rtShapeDefinition));
+	ASSERT_NE(definition, std::string::npos);
+	tlv_data.erase(definition, 1 + 1 + 8);
+	TlvToJsonDirect decoder;
+	EXPECT_THROW(RunCoder(decoder, tlv_data), app_err::JsonPackerMissed);
+	EXPECT_THROW(RunCoder(plain_decoder, tlv_data), app_err::JsonPackerMissed);
+}
+
+TEST_F(TlvToJsonTest, StringDictionary) {
+	std::string input;
+	for (auto& rec : m_json_records_valid_all_datatypes)
+		input += rec + "\n";
+	const char* statuses[] = {"ok", "failed", "x", "\\\"quoted\\\"\\n", "\\u00e9t\\u00e9"};
+	const StringVector generated = GenerateJsonRecords(1000);
+	for (size_t i = 0; i < generated.size(); ++i) {
+		//"status" has few values, "city" has more values than dictionary keeps
+		input += "{\"status\":\"" + std::string(statuses[i % 5]) + "\",\"city\":\"city" + std::to_string(i % 13) + "\"," + generated[i].substr(1) + "\n";
+	}
+	JsonToTlv plain_encoder;
+	plain_encoder.Options().format = TlvFormat::v2;
+	const std::string plain_data = RunCoder(plain_encoder, input);
+	TlvToJson plain_decoder;
+	const std::string expected = RunCoder(plain_decoder, plain_data);
+	StringVector lines;
+	std::stringstream all_lines(expected);
+	for (std::string line; std::getline(all_lines, line);)
+		lines.push_back(line + "\n");
+
+	for (bool shapes : {false, true}) {
+		for (bool inline_keys : {false, true}) {
+			std::string tlv_data;
+			for (const char* method : {"json2tlv", "json2tlv-sax"}) {
+				auto encoder = GetPacker(method);
+				encoder->Options().format = TlvFormat::v2;
+				encoder->Options().string_dictionary = 8;
+				encoder->Options().shapes = shapes;
+				encoder->Options().inline_keys = inline_keys;
+				if (tlv_data.empty())
+					tlv_data = RunCoder(*encoder, input);
+				else
+					EXPECT_TRUE(RunCoder(*encoder, input) == tlv_data) << method;
+				EXPECT_TRUE(tlv_data[5] & TLV_FLAG_STRING_DICTIONARY);
+				//values are coded in the same way in multi-threaded mode
+				encoder->Options().threads = 3;
+				encoder->Options().chunk_size = 2000;
+				EXPECT_TRUE(RunCoder(*encoder, input) == tlv_data) << method << " " << shapes << " " << inline_keys;
+			}
+			EXPECT_LT(tlv_data.size(), plain_data.size());
+
+			for (const char* method : {"tlv2json", "tlv2json-direct"}) {
+				for (unsigned int threads : {1, 3}) {
+					auto decoder = GetPacker(method);
+					decoder->Options().threads = threads;
+					decoder->Options().block_size = 1000;
+					EXPECT_TRUE(RunCoder(*decoder, tlv_data) == expected) << method << " " << threads << " " << shapes << " " << inline_keys;
+				}
+				//the values of skipped records are defined before converted records
+				auto decoder = GetPacker(method);
+				decoder->Options().from = 700;
+				decoder->Options().count = 5;
+				EXPECT_EQ(RunCoder(*decoder, tlv_data), std::accumulate(lines.begin() + 700, lines.begin() + 705, std::string())) << method << " " << shapes << " " << inline_keys;
+			}
+		}
+	}
+
+	//codes are kept in columns
+	JsonToTlvColumnar columnar_encoder;
+	columnar_encoder.Options().string_dictionary = 8;
+	columnar_encoder.Options().compression = "lz";
+	const std::string columnar_data = RunCoder(columnar_encoder, input);
+	TlvToJsonDirect direct_decoder;
+	EXPECT_TRUE(RunCoder(direct_decoder, columnar_data) == expected);
+
+	JsonToTlv encoder;
+	encoder.Options().string_dictionary = 8;
+	EXPECT_THROW(RunCoder(encoder, input), app_err::JsonPackerError);
+	encoder.Options().format = TlvFormat::v2;
+	encoder.Options().string_dictionary = TLV_MAX_STRING_DICTIONARY_SIZE + 1;
+	EXPECT_THROW(RunCoder(encoder, input), app_err::JsonPackerError);
+
+	//the value is not defined
+	encoder.Options().string_dictionary = 8;
+	encoder.Options().inline_keys = true;
+	std::string tlv_data = RunCoder(encoder, "{\"a\":\"ok\"}\n");
+	const size_t definition = tlv_data.find(static_cast<char>(TlvRecord<std::streamsize>::TlvRecordType::rtValueDefinition));
+	ASSERT_NE(definition, std::string::npos);
+	tlv_data.erase(definition, 1 + 1 + 8);
+	EXPECT_THROW(RunCoder(direct_decoder, tlv_data), app_err::JsonPackerMissed);
+	EXPECT_THROW(RunCoder(plain_decoder, tlv_data), app_err::JsonPackerMissed);
+}
+
+TEST_F(TlvToJsonTest, TlvUnsupportedVersion) {
+	FillInputStream(m_tlv_data_unsupported_version);
+	TlvToJson coder;
+	EXPECT_THROW(coder.Run(m_stream), jsonpacker_coder::TlvInvalidFormatError);
+}
+
+TEST_F(TlvToJsonTest, TlvV2WithoutTrailerRunCheckOutput) {
+	//dictionary is searched by scanning records when trailer flag is not set
+	const size_t block_index_size = TLV_BLOCK_INDEX_ENTRY_SIZE;
+	std::string tlv_data(m_tlv_data_v2_valid.begin(), m_tlv_data_v2_valid.end() - TLV_TRAILER_BLOCK_INDEX_SIZE - block_index_size);
+	tlv_data[5] = 0x00;
+	TlvToJson decoder;
+	const std::string expected = RunCoder(decoder, std::string(m_tlv_data_v2_valid.begin(), m_tlv_data_v2_valid.end()));
+	EXPECT_EQ(RunCoder(decoder, tlv_data), expected);
+
+	//trailer without block index
+	StringByteSink trailer;
+	TlvTrailer trailer_data;
+	trailer_data.dictionary_offset = 0x55;
+	WriteTlvTrailer(trailer, trailer_data);
+	EXPECT_EQ(trailer.Data().size(), static_cast<size_t>(TLV_TRAILER_SIZE));
+	tlv_data[5] = TLV_FLAG_TRAILER;
+	EXPECT_EQ(RunCoder(decoder, tlv_data + trailer.Data()), expected);
+}
+
+TEST_F(TlvToJsonTest, TlvV2InvalidTrailer) {
+	std::vector<unsigned char> tlv_data = m_tlv_data_v2_valid;
+	tlv_data[tlv_data.size() - TLV_TRAILER_BLOCK_INDEX_SIZE] = 0x54; //dictionary offset points into the 2nd record
+	TlvToJson coder;
+	EXPECT_THROW(RunCoder(coder, std::string(tlv_data.begin(), tlv_data.end())), jsonpacker_coder::TlvInvalidFormatError);
+
+	tlv_data = m_tlv_data_v2_valid;
+	tlv_data[tlv_data.size() - TLV_TRAILER_BLOCK_INDEX_SIZE - 12] = 0x60; //the block begins in dictionary
+	EXPECT_THROW(RunCoder(coder, std::string(tlv_data.begin(), tlv_data.end())), jsonpacker_coder::TlvInvalidFormatError);
+
+	tlv_data = m_tlv_data_v2_valid;
+	tlv_data.back() = 0x00; //broken magic
+	EXPECT_THROW(RunCoder(coder, std::string(tlv_data.begin(), tlv_data.end())), jsonpacker_coder::TlvInvalidFormatError);
+}
+
+TEST_F(TlvToJsonTest, TlvV2TruncatedLength) {
+	FillInputStream(m_tlv_data_v2_truncated_length);
+	TlvToJson coder;
+	EXPECT_THROW(coder.Run(m_stream), jsonpacker_coder::TlvInvalidFormatError);
+}
+
 TEST_F(TlvToJsonTest, TlvWithoutDictionary) {
 	FillInputStream(m_valid_tlv_data_without_dictionary);
 	TlvToJson coder;
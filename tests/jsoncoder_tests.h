@@ -32,6 +32,9 @@ protected:
 	std::map<std::string, int> m_dictionary_valid = DICTIONARY_VALID;
 
 	std::vector<unsigned char> m_tlv_data_valid = TLV_DATA_VALID;
+	std::vector<unsigned char> m_tlv_data_v2_valid = TLV_DATA_V2_VALID;
+	std::vector<unsigned char> m_tlv_data_unsupported_version = TLV_DATA_UNSUPPORTED_VERSION;
+	std::vector<unsigned char> m_tlv_data_v2_truncated_length = TLV_DATA_V2_TRUNCATED_LENGTH;
 	std::vector<unsigned char> m_valid_tlv_data_without_dictionary = TLV_DATA_WITHOUT_DICTIONARY;
 	std::vector<unsigned char> m_tlv_data_dictionary_invalid_data = TLV_DATA_WITH_DICTIONARY_INVALID_DATA;
 	std::vector<unsigned char> m_tlv_data_dictionary_invalid_datasize = TLV_DATA_WITH_DICTIONARY_INVALID_DATASIZE;
@@ -43,6 +46,8 @@ protected:
 	std::vector<unsigned char> m_tlv_data_valid_dictionary_without_valid_key = TLV_DATA_WITH_DICTIONARY_WITHOUT_VALID_KEY;
 	void FillInputStream(const std::vector<std::string>& data);
 	void FillInputStream(const std::vector<unsigned char>& data);
+	StringVector GenerateJsonRecords(size_t count);
+	std::string RunCoder(JsonPackerBase& coder, const std::string& input);
 };
 
 class JsonToTlvTest : public JsonTlvTestBase {
@@ -346,4 +346,91 @@
 	0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /*size*/\
 	0x05, 0x00, 0x00, 0x00 /*5 hex*/\
 }
+//valid TLV data in v2 format for JSON_RECORDS_VALID
+#define TLV_DATA_V2_VALID {\
+	0x4a, 0x50, 0x4b, 0x54, /*magic 'JPKT'*/\
+	0x02, /*format version*/\
+	0x05, /*flags (TLV_FLAG_TRAILER | TLV_FLAG_BLOCK_INDEX)*/\
+	0x00, 0x00, /*reserved*/\
+	\
+	/*1st record*/\
+	0x00, /*membercount, fixed size - no length*/\
+	0x03, 0x00, 0x00, 0x00, /*count of member in 1st rec*/\
+	0x01, /*int, type of key index*/\
+	0x01, 0x00, 0x00, 0x00, /*index of 'key1'*/\
+	0x09, /*string, type of value*/\
+	0x05, /*varint size (length of 'value')*/\
+	0x76, 0x61, 0x6c, 0x75, 0x65, /*'value' in ascii codes*/\
+	0x01, /*int, type of key index*/\
+	0x02, 0x00, 0x00, 0x00, /*index of 'key2'*/\
+	0x01, /*int, type of value (42)*/\
+	0x2a, 0x00, 0x00, 0x00, /*42 hex*/\
+	0x01, /*int, type of key index*/\
+	0x03, 0x00, 0x00, 0x00, /*index of 'key3'*/\
+	0x04, /*bool, type of value*/\
+	0x01, /*true*/\
+	\
+	/*2nd record*/\
+	0x00, /*membercount*/\
+	0x03, 0x00, 0x00, 0x00, /*count of member in 2nd rec*/\
+	0x01, /*int, type of key index*/\
+	0x04, 0x00, 0x00, 0x00, /*index of 'sadsf'*/\
+	0x09, /*string, type of value*/\
+	0x07, /*varint size (length of 'dsewtew')*/\
+	0x64, 0x73, 0x65, 0x77, 0x74, 0x65, 0x77, /*'dsewtew' in ascii codes*/\
+	0x01, /*int, type of key index*/\
+	0x05, 0x00, 0x00, 0x00, /*index of 'dsre'*/\
+	0x01, /*int, type of value (3221)*/\
+	0x95, 0x0c, 0x00, 0x00, /*3221 hex*/\
+	0x01, /*int, type of key index*/\
+	0x06, 0x00, 0x00, 0x00, /*index of 'sdfds'*/\
+	0x09, /*string, type of value*/\
+	0x07, /*varint size (length of 'dsfewew')*/\
+	0x64, 0x73, 0x66, 0x65, 0x77, 0x65, 0x77, /*'dsfewew' in ascii codes*/\
+	\
+	/*dictionary*/\
+	0x7f, /*dictionary, fixed size 0 - no length*/\
+	0x09, 0x04, 0x64, 0x73, 0x72, 0x65, /*'dsre'*/\
+	0x01, 0x05, 0x00, 0x00, 0x00, /*5*/\
+	0x09, 0x04, 0x6b, 0x65, 0x79, 0x31, /*'key1'*/\
+	0x01, 0x01, 0x00, 0x00, 0x00, /*1*/\
+	0x09, 0x04, 0x6b, 0x65, 0x79, 0x32, /*'key2'*/\
+	0x01, 0x02, 0x00, 0x00, 0x00, /*2*/\
+	0x09, 0x04, 0x6b, 0x65, 0x79, 0x33, /*'key3'*/\
+	0x01, 0x03, 0x00, 0x00, 0x00, /*3*/\
+	0x09, 0x05, 0x73, 0x61, 0x64, 0x73, 0x66, /*'sadsf'*/\
+	0x01, 0x04, 0x00, 0x00, 0x00, /*4*/\
+	0x09, 0x05, 0x73, 0x64, 0x66, 0x64, 0x73, /*'sdfds'*/\
+	0x01, 0x06, 0x00, 0x00, 0x00, /*6*/\
+	\
+	/*block index*/\
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /*number of the first record of the 1st block*/\
+	0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /*offset of the 1st block*/\
+	0x02, 0x00, 0x00, 0x00, /*count of records in the 1st block*/\
+	\
+	/*trailer*/\
+	0x55, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /*offset of dictionary*/\
+	0x02, /*format version*/\
+	0x00, 0x00, 0x00, /*reserved*/\
+	0x9a, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /*offset of block index*/\
+	0x1c, 0x00, 0x00, 0x00, /*trailer size*/\
+	0x4a, 0x50, 0x4b, 0x54 /*magic 'JPKT'*/\
+}
+
+//TLV data in unsupported format version
+#define TLV_DATA_UNSUPPORTED_VERSION {\
+	0x4a, 0x50, 0x4b, 0x54, /*magic 'JPKT'*/\
+	0x7e, /*format version				-- unknown version*/\
+	0x00, 0x00, 0x00,\
+	0x7f /*dictionary*/\
+}
+
+//TLV data in v2 format with truncated varint length
+#define TLV_DATA_V2_TRUNCATED_LENGTH {\
+	0x4a, 0x50, 0x4b, 0x54, 0x02, 0x00, 0x00, 0x00, /*header*/\
+	0x00, 0x01, 0x00, 0x00, 0x00, /*membercount*/\
+	0x01, 0x01, 0x00, 0x00, 0x00, /*index of 'key1'*/\
+	0x09, /*string, type of value*/\
+	0x85 /*varint size							-- continuation bit is set, but data ends*/\
+}
 #endif // JSONCODER_TESTS_DEFINES_H
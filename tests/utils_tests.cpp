@@ -1,8 +1,12 @@
 #include <string>
 #include <map>
+#include <random>
 #include <typeinfo>
+#include <utility>
+#include <vector>
 #include <gtest/gtest.h>
 #include "apperror.h"
+#include "simd.h"
 #include "utils_tests.h"
 
 using namespace std;
@@ -34,6 +38,161 @@ TEST(StrTest, StringReplaceMap) {
 	EXPECT_EQ(str::Replace(templ, replace_map), "Hello, World!");
 }
 
+TEST(SimdTest, FindByte) {
+	using FindByteFunction = const char* (*)(const char*, const char*, char);
+	std::vector<std::pair<string, FindByteFunction>> kernels = {{"dispatched", simd::FindByte}, {"scalar", simd::kernel::FindByteScalar}};
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse2"))
+		kernels.emplace_back("sse2", simd::kernel::FindByteSse2);
+	if (__builtin_cpu_supports("avx2"))
+		kernels.emplace_back("avx2", simd::kernel::FindByteAvx2);
+#endif
+	string data(300, 'a');
+	for (const auto& kernel : kernels) {
+		for (size_t begin = 0; begin < 40; ++begin) {
+			for (size_t pos = begin; pos < data.size(); pos += 7) {
+				data[pos] = '\n';
+				EXPECT_EQ(kernel.second(data.data() + begin, data.data() + data.size(), '\n'), data.data() + pos) << kernel.first;
+				data[pos] = 'a';
+			}
+			EXPECT_EQ(kernel.second(data.data() + begin, data.data() + data.size(), '\n'), data.data() + data.size()) << kernel.first;
+		}
+	}
+}
+
+TEST(SimdTest, UnpackBits) {
+	using UnpackBitsFunction = void (*)(const char*, size_t, size_t, unsigned int, uint64_t, uint64_t*);
+	std::vector<std::pair<string, UnpackBitsFunction>> kernels = {{"dispatched", simd::UnpackBits}, {"scalar", simd::kernel::UnpackBitsScalar}};
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		kernels.emplace_back("avx2", simd::kernel::UnpackBitsAvx2);
+#endif
+	std::mt19937_64 random(11);
+	for (unsigned int width = 0; width <= 64; ++width) {
+		const uint64_t mask = width < 64 ? (uint64_t(1) << width) - 1 : ~uint64_t(0);
+		//the counts are not multiples of the 4 values unpacked at once, packed data has no padding after the last value
+		for (size_t count : {1, 5, 37, 100}) {
+			string data((count * width + 7) / 8, '\0');
+			std::vector<uint64_t> expected(count);
+			for (size_t i = 0; i < count; ++i) {
+				expected[i] = random() & mask;
+				for (unsigned int bit = 0; bit < width; ++bit) {
+					if (expected[i] >> bit & 1)
+						data[(i * width + bit) / 8] = static_cast<char>(data[(i * width + bit) / 8] | (1 << ((i * width + bit) % 8)));
+				}
+				expected[i] += 1000;
+			}
+			for (const auto& kernel : kernels) {
+				std::vector<uint64_t> values(count);
+				kernel.second(data.data(), data.size(), count, width, 1000, values.data());
+				EXPECT_EQ(values, expected) << kernel.first << " " << width << " " << count;
+			}
+		}
+	}
+}
+
+TEST(SimdTest, Crc32c) {
+	using Crc32cFunction = uint32_t (*)(const char*, size_t, uint32_t);
+	std::vector<std::pair<string, Crc32cFunction>> kernels = {{"dispatched", simd::Crc32c}, {"scalar", simd::kernel::Crc32cScalar}};
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("pclmul"))
+		kernels.emplace_back("sse4.2", simd::kernel::Crc32cSse42);
+#endif
+	//checksums of long data (combined from stripes) are compared with bitwise calculation, chained checksums are equal to the whole one
+	string data(10000, '\0');
+	for (size_t i = 0; i < data.size(); ++i)
+		data[i] = static_cast<char>(i * 131 + (i >> 7));
+	for (const auto& kernel : kernels) {
+		EXPECT_EQ(kernel.second("123456789", 9, 0), 0xe3069283u) << kernel.first;
+		EXPECT_EQ(kernel.second("", 0, 0), 0u) << kernel.first;
+		EXPECT_EQ(kernel.second(string(32, '\0').data(), 32, 0), 0x8a9136aau) << kernel.first;
+		EXPECT_EQ(kernel.second(string(32, '\xff').data(), 32, 0), 0x62a8ab43u) << kernel.first;
+		for (size_t size : {7, 8, 3071, 3072, 3073, 6150, 10000}) {
+			uint32_t expected = ~0u;
+			for (size_t i = 0; i < size; ++i) {
+				expected ^= static_cast<unsigned char>(data[i]);
+				for (int bit = 0; bit < 8; ++bit)
+					expected = expected & 1 ? (expected >> 1) ^ 0x82f63b78 : expected >> 1;
+			}
+			expected = ~expected;
+			EXPECT_EQ(kernel.second(data.data(), size, 0), expected) << kernel.first << " " << size;
+			EXPECT_EQ(kernel.second(data.data() + size / 3, size - size / 3, kernel.second(data.data(), size / 3, 0)), expected) << kernel.first << " " << size;
+		}
+	}
+	//kernels agree on random buffers of random sizes and offsets
+	std::mt19937_64 random(42);
+	string buffer(20000, '\0');
+	for (auto& c : buffer)
+		c = static_cast<char>(random());
+	for (int i = 0; i < 200; ++i) {
+		const size_t offset = random() % 64;
+		const size_t size = random() % (buffer.size() - offset);
+		const uint32_t crc = static_cast<uint32_t>(random());
+		const uint32_t expected = simd::kernel::Crc32cScalar(buffer.data() + offset, size, crc);
+		for (const auto& kernel : kernels)
+			EXPECT_EQ(kernel.second(buffer.data() + offset, size, crc), expected) << kernel.first << " " << offset << " " << size;
+	}
+}
+
+TEST(SimdTest, BloomFilter) {
+	//every added hash is found, false positives are rare with 16 bits per value
+	const size_t block_count = 32;
+	string filter(block_count * 64, '\0');
+	auto hash = [](uint64_t value) {
+		value *= 0x9e3779b97f4a7c15ull;
+		return value ^ (value >> 29);
+	};
+	EXPECT_FALSE(simd::BloomContains(filter.data(), 0, hash(1)));
+	for (uint64_t value = 0; value < block_count * 32; ++value)
+		simd::BloomInsert(&filter[0], block_count, hash(value));
+	size_t false_positives = 0;
+	for (uint64_t value = 0; value < 100000; ++value) {
+		const bool found = simd::BloomContains(filter.data(), block_count, hash(value));
+		if (value < block_count * 32)
+			EXPECT_TRUE(found) << value;
+		else if (found)
+			++false_positives;
+	}
+	EXPECT_LT(false_positives, 100u);
+}
+
+TEST(SimdTest, BloomContainsKernels) {
+	//the AVX2 kernel gives the same answers as the scalar one for filters of random density and random hashes
+	using BloomContainsFunction = bool (*)(const char*, size_t, uint64_t);
+	std::vector<std::pair<string, BloomContainsFunction>> kernels = {{"dispatched", simd::BloomContains}};
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		kernels.emplace_back("avx2", simd::kernel::BloomContainsAvx2);
+#endif
+	std::mt19937_64 random(7);
+	for (size_t block_count : {0, 1, 3, 64}) {
+		for (size_t inserted : {0, 16, 1000}) {
+			//the filter is not aligned to check unaligned loads of blocks
+			string storage(block_count * 64 + 1, '\0');
+			char* filter = &storage[1];
+			if (block_count) {
+				for (size_t i = 0; i < inserted; ++i)
+					simd::BloomInsert(filter, block_count, random());
+			}
+			size_t found = 0;
+			for (int i = 0; i < 10000; ++i) {
+				const uint64_t hash = random();
+				const bool expected = simd::kernel::BloomContainsScalar(filter, block_count, hash);
+				found += expected;
+				for (const auto& kernel : kernels)
+					EXPECT_EQ(kernel.second(filter, block_count, hash), expected) << kernel.first << " " << block_count << " " << inserted;
+			}
+			if (!block_count || !inserted) {
+				EXPECT_EQ(found, 0u);
+			}
+		}
+	}
+}
+
 
 namespace utils_tests {
 